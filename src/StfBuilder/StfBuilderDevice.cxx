@@ -73,6 +73,52 @@ void StfBuilderDevice::InitTask()
     GetConfig()->GetValue<ReadoutDataUtils::SanityCheckMode>(OptionKeyRdhSanityCheck)
   );
   mRdh4FilterTrigger = GetConfig()->GetValue<bool>(OptionKeyFilterTriggerRdh4);
+  mSuperpagePacking = GetConfig()->GetValue<bool>(OptionKeyStfSuperpagePacking);
+
+  // number of threads building STFs in parallel
+  {
+    const auto lNumBuilders = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfBuilderThreads);
+    if (lNumBuilders == 0) {
+      DDLOG(fair::Severity::WARNING) << "Number of StfBuilder threads must be at least 1. Using 1 thread.";
+    }
+    mNumStfBuilderThreads = std::max(std::uint64_t(1), lNumBuilders);
+
+    const auto lQueueSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfBuilderQueueSize);
+    if (lQueueSize < 2) {
+      DDLOG(fair::Severity::ERROR) << "StfBuilder thread input queue size must be at least 2 (unlimited queues are "
+        "not supported). " << OptionKeyStfBuilderQueueSize << "=" << lQueueSize;
+      exit(-1);
+    }
+    mStfBuilderQueueSize = lQueueSize;
+    DDLOG(fair::Severity::INFO) << "StfBuilder thread input queue size: " << mStfBuilderQueueSize;
+  }
+
+  // STF completeness
+  {
+    mOrbitsPerTf = GetConfig()->GetValue<std::uint64_t>(OptionKeyStfOrbitsPerTf);
+    mLinkGraceTime = std::chrono::milliseconds(GetConfig()->GetValue<std::uint64_t>(OptionKeyStfLinkGraceTime));
+
+    if (mLinkGraceTime.count() > 0) {
+      DDLOG(fair::Severity::INFO) << "STFs are closed when all links delivered. Orbits per TF: "
+        << (mOrbitsPerTf > 0 ? std::to_string(mOrbitsPerTf) : std::string("learned from data"))
+        << ", grace time for missing links: " << mLinkGraceTime.count() << " ms";
+    }
+  }
+
+  // header memory regions (in MiB)
+  {
+    const bool lAdaptive = GetConfig()->GetValue<bool>(OptionKeyHeaderRegionAdaptive);
+    const auto lReadoutSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyReadoutHeaderRegionSize);
+    const auto lFileSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyFileHeaderRegionSize);
+    const auto lMaxSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyHeaderRegionMaxSize) << 20;
+
+    mReadoutHeaderRegionCfg = { std::max(std::uint64_t(1), lReadoutSize) << 20, lAdaptive, lMaxSize };
+    mFileHeaderRegionCfg = { std::max(std::uint64_t(1), lFileSize) << 20, lAdaptive, lMaxSize };
+
+    DDLOG(fair::Severity::INFO) << "Header memory regions: readout size: " << mReadoutHeaderRegionCfg.mSize
+      << " B, file source size: " << mFileHeaderRegionCfg.mSize << " B, adaptive: " << (lAdaptive ? "yes" : "no")
+      << ", max size: " << lMaxSize << " B";
+  }
 
   // Buffering limitation
   if (mMaxStfsInPipeline > 0) {
@@ -89,6 +135,12 @@ void StfBuilderDevice::InitTask()
                  "Possibility of creating back-pressure.";
   }
 
+  // Pipeline memory budget
+  if (!PipelineMemoryBudgetConfig::loadVerifyConfig(*(this->GetConfig()), mPipelineMemoryBudget)) {
+    exit(-1);
+  }
+  setPipelineMemoryBudget(mPipelineMemoryBudget);
+
   // File sink
   if (!mFileSink.loadVerifyConfig(*(this->GetConfig()))) {
     exit(-1);
@@ -113,6 +165,10 @@ void StfBuilderDevice::InitTask()
     if (mRdh4FilterTrigger) {
       DDLOG(fair::Severity::info) << "Filtering of empty HBFrames in triggered mode enabled for RDHv4.";
     }
+
+    if (mSuperpagePacking) {
+      DDLOG(fair::Severity::info) << "Superpage packing enabled. HBFrames of each readout update are sent under one header.";
+    }
   }
 
   // Using DPL?
@@ -186,12 +242,15 @@ void StfBuilderDevice::PreRun()
 
   // start file source
   // channel for FileSource: stf or dpl, or generic one in case of standalone
-  mFileSource.start(getOutputChannel(), mDplEnabled);
+  mFileSource.start(getOutputChannel(), mDplEnabled, mFileHeaderRegionCfg);
 
   // start a thread for readout process
   if (!mFileSource.enabled()) {
     mReadoutInterface.setRdh4FilterTrigger(mRdh4FilterTrigger);
-    mReadoutInterface.start(1, mDataOrigin);
+    mReadoutInterface.setSuperpagePacking(mSuperpagePacking);
+    mReadoutInterface.setLinkCompletenessConfig(mOrbitsPerTf, mLinkGraceTime);
+    mReadoutInterface.setHeaderRegionConfig(mReadoutHeaderRegionCfg);
+    mReadoutInterface.start(mNumStfBuilderThreads, mStfBuilderQueueSize, mDataOrigin);
   }
 
   // gui thread
@@ -431,7 +490,36 @@ bpo::options_description StfBuilderDevice::getStfBuildingProgramOptions() {
     "Enable extensive RDH verification. Permitted values: off, print, drop (caution, any data not meeting criteria will be dropped)")(
     OptionKeyFilterTriggerRdh4,
     bpo::bool_switch()->default_value(false),
-    "Filter out empty HBFrames with RDHv4 sent in triggered mode.");
+    "Filter out empty HBFrames with RDHv4 sent in triggered mode.")(
+    OptionKeyStfSuperpagePacking,
+    bpo::bool_switch()->default_value(false),
+    "Send all HBFrames of a readout update under one header carrying an HBFrame index. HBFrames are not copied.")(
+    OptionKeyStfBuilderThreads,
+    bpo::value<std::uint64_t>()->default_value(1),
+    "Number of threads building SubTimeFrames in parallel. SubTimeFrames are forwarded in the order of TF ids.")(
+    OptionKeyStfBuilderQueueSize,
+    bpo::value<std::uint64_t>()->default_value(2048),
+    "Maximum number of readout updates queued for each SubTimeFrame building thread (rounded up to a power of 2, "
+    "at least 2). When a queue is full, receiving from readout is paused (back-pressure).")(
+    OptionKeyStfOrbitsPerTf,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Number of HBFrames each link sends per TF. If 0, the number is learned from the data.")(
+    OptionKeyStfLinkGraceTime,
+    bpo::value<std::uint64_t>()->default_value(200),
+    "Close a SubTimeFrame when all known links delivered, or after this time (in ms) without data from readout. "
+    "Data received for an already closed SubTimeFrame is dropped. If 0, SubTimeFrames are closed only when data of the next TF is received.")(
+    OptionKeyReadoutHeaderRegionSize,
+    bpo::value<std::uint64_t>()->default_value(SubTimeFrameReadoutBuilder::sDefaultHeaderRegionSize >> 20),
+    "Size of the header memory region of each SubTimeFrame building thread (in MiB).")(
+    OptionKeyFileHeaderRegionSize,
+    bpo::value<std::uint64_t>()->default_value(SubTimeFrameFileBuilder::sDefaultHeaderRegionSize >> 20),
+    "Size of the header memory region used for SubTimeFrames read from files (in MiB).")(
+    OptionKeyHeaderRegionAdaptive,
+    bpo::bool_switch()->default_value(false),
+    "Add header memory regions when the header pool occupancy stays high.")(
+    OptionKeyHeaderRegionMaxSize,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Maximum size of each header memory pool in the adaptive mode (in MiB). If 0, 4 times the initial region size.");
 
   return lStfBuildingOptions;
 }
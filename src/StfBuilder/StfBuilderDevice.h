@@ -20,6 +20,7 @@
 #include <SubTimeFrameDataModel.h>
 #include <SubTimeFrameFileSink.h>
 #include <SubTimeFrameFileSource.h>
+#include <PipelineMemoryBudget.h>
 #include <ConcurrentQueue.h>
 #include <Utilities.h>
 #include <RootGui.h>
@@ -75,6 +76,15 @@ class StfBuilderDevice : public DataDistDevice,
   static constexpr const char* OptionKeyStfDetector = "detector";
   static constexpr const char* OptionKeyRdhSanityCheck = "rdh-data-check";
   static constexpr const char* OptionKeyFilterTriggerRdh4 = "rdh-filter-empty-trigger-v4";
+  static constexpr const char* OptionKeyStfSuperpagePacking = "stf-superpage-packing";
+  static constexpr const char* OptionKeyStfBuilderThreads = "stf-builder-threads";
+  static constexpr const char* OptionKeyStfBuilderQueueSize = "stf-builder-input-queue-size";
+  static constexpr const char* OptionKeyStfOrbitsPerTf = "stf-orbits-per-tf";
+  static constexpr const char* OptionKeyStfLinkGraceTime = "stf-link-grace-ms";
+  static constexpr const char* OptionKeyReadoutHeaderRegionSize = "readout-header-region-size";
+  static constexpr const char* OptionKeyFileHeaderRegionSize = "file-header-region-size";
+  static constexpr const char* OptionKeyHeaderRegionAdaptive = "header-region-adaptive";
+  static constexpr const char* OptionKeyHeaderRegionMaxSize = "header-region-max-size";
 
   static bpo::options_description getDetectorProgramOptions();
   static bpo::options_description getStfBuildingProgramOptions();
@@ -179,6 +189,19 @@ class StfBuilderDevice : public DataDistDevice,
     return lNextStage;
   }
 
+  std::uint64_t getPipelineElementSize(const std::unique_ptr<SubTimeFrame>& pStf) const final
+  {
+    return pStf ? pStf->getDataSize() : 0;
+  }
+
+  void onPipelineElementEvicted(unsigned pStage, const std::unique_ptr<SubTimeFrame>& /*pStf*/) final
+  {
+    // only STFs queued for sending are counted
+    if (pStage == eStfSendIn) {
+      mNumStfs--;
+    }
+  }
+
   void StfOutputThread();
 
   /// config
@@ -188,10 +211,18 @@ class StfBuilderDevice : public DataDistDevice,
   o2::header::DataOrigin mDataOrigin;
   bool mRdhSanityCheck = false;
   bool mRdh4FilterTrigger = false;
+  bool mSuperpagePacking = false;
+  std::size_t mNumStfBuilderThreads = 1;
+  std::size_t mStfBuilderQueueSize = 0;
+  std::uint64_t mOrbitsPerTf = 0;
+  std::chrono::milliseconds mLinkGraceTime{0};
+  HeaderRegionConfig mReadoutHeaderRegionCfg = { SubTimeFrameReadoutBuilder::sDefaultHeaderRegionSize };
+  HeaderRegionConfig mFileHeaderRegionCfg = { SubTimeFrameFileBuilder::sDefaultHeaderRegionSize };
   bool mStandalone;
   bool mDplEnabled;
   std::int64_t mMaxStfsInPipeline;
   bool mPipelineLimit;
+  PipelineMemoryBudget mPipelineMemoryBudget;
 
   /// Input Interface handler
   StfInputInterface mReadoutInterface;
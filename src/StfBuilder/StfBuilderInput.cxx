@@ -25,20 +25,24 @@
 #include <queue>
 #include <chrono>
 #include <sstream>
+#include <iterator>
 
 namespace o2
 {
 namespace DataDistribution
 {
 
-void StfInputInterface::start(const std::size_t pNumBuilders, const o2::header::DataOrigin &pDataOrig)
+void StfInputInterface::start(const std::size_t pNumBuilders, const std::size_t pBuilderQueueSize,
+  const o2::header::DataOrigin &pDataOrig)
 {
   mNumBuilders = pNumBuilders;
   mDataOrigin = pDataOrig;
   mRunning = true;
 
   mBuilderInputQueues.clear();
-  mBuilderInputQueues.resize(mNumBuilders);
+  for (std::size_t i = 0; i < mNumBuilders; i++) {
+    mBuilderInputQueues.emplace_back(pBuilderQueueSize);
+  }
 
   // Reference to the output or DPL channel
   // const auto &lOutChanName = mDevice.getOutputChannelName();
@@ -46,9 +50,17 @@ void StfInputInterface::start(const std::size_t pNumBuilders, const o2::header::
 
   // NOTE: create the mStfBuilders first to avid resizing the vector; then threads
   for (std::size_t i = 0; i < mNumBuilders; i++) {
-    mStfBuilders.emplace_back(lOutputChan, mDevice.dplEnabled());
+    mStfBuilders.emplace_back(lOutputChan, mDevice.dplEnabled(), mHeaderRegionConfig);
   }
 
+  {
+    std::scoped_lock lLock(mStfOrderingLock);
+    mStfOrderingIds.clear();
+    mStfOrderingBuilt.clear();
+    mStfOrderingForwarded.clear();
+  }
+  mStfOrderingThread = std::thread(&StfInputInterface::StfOrderingThread, this);
+
   for (std::size_t i = 0; i < mNumBuilders; i++) {
     mBuilderThreads.emplace_back(std::thread(&StfInputInterface::StfBuilderThread, this, i));
   }
@@ -73,11 +85,77 @@ void StfInputInterface::stop()
     }
   }
 
+  mStfOrderingCondition.notify_all();
+  if (mStfOrderingThread.joinable()) {
+    mStfOrderingThread.join();
+  }
+
+  {
+    std::scoped_lock lLock(mStfOrderingLock);
+    mStfOrderingIds.clear();
+    mStfOrderingBuilt.clear();
+    mStfOrderingForwarded.clear();
+  }
+
   mStfBuilders.clear();
   mBuilderThreads.clear();
   mBuilderInputQueues.clear();
 }
 
+void StfInputInterface::announceStf(const std::uint64_t pStfId)
+{
+  std::scoped_lock lLock(mStfOrderingLock);
+  mStfOrderingIds.push_back(pStfId);
+}
+
+void StfInputInterface::finishStf(const std::uint64_t pStfId, std::unique_ptr<SubTimeFrame> pStf)
+{
+  {
+    std::scoped_lock lLock(mStfOrderingLock);
+
+    auto lIter = mStfOrderingBuilt.find(pStfId);
+    if (lIter == mStfOrderingBuilt.end()) {
+      mStfOrderingBuilt.emplace(pStfId, std::move(pStf));
+    } else if (pStf) {
+      // STF with the same id is not forwarded yet (e.g. late data after the builder timeout): merge
+      if (lIter->second) {
+        DDLOG(fair::Severity::WARNING) << "StfBuilder: merging data of STF id=" << pStfId
+          << " finished more than once.";
+        lIter->second->mergeStf(std::move(pStf));
+      } else {
+        lIter->second = std::move(pStf);
+      }
+    }
+  }
+  mStfOrderingCondition.notify_one();
+}
+
+/// Queue readout updates to the builder thread of the STF. Blocks while the builder queue is full.
+bool StfInputInterface::queueBuilderInput(const std::uint64_t pStfId, std::vector<FairMQMessagePtr> &&pReadoutMsgs)
+{
+  using namespace std::chrono_literals;
+  const auto lIdx = pStfId % mNumBuilders;
+  auto &lQueue = mBuilderInputQueues[lIdx];
+
+  if (lQueue.try_push(std::move(pReadoutMsgs))) {
+    return true;
+  }
+
+  static std::uint64_t sNumQueueFull = 0;
+  if (sNumQueueFull++ % 100 == 0) {
+    DDLOG(fair::Severity::WARNING) << "StfBuilder thread[" << lIdx << "] is falling behind. Input queue is full ("
+      << lQueue.capacity() << " readout updates). Back-pressure will be applied to readout. Total occurrences: "
+      << sNumQueueFull;
+  }
+
+  while (mRunning) {
+    if (lQueue.push_wait_for(100ms, std::move(pReadoutMsgs))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /// Receiving thread
 void StfInputInterface::DataHandlerThread(const unsigned pInputChannelIdx)
 {
@@ -85,6 +163,14 @@ void StfInputInterface::DataHandlerThread(const unsigned pInputChannelIdx)
   lReadoutMsgs.reserve(1U << 20);
   // current TF Id
   std::uint64_t lCurrentStfId = 0;
+  bool lStfAnnounced = false;
+
+  // STF completeness: the end of STF marker is sent as soon as all known links delivered
+  const bool lTrackLinks = mLinkGraceTime.count() > 0;
+  StfLinkCompleteness lLinks;
+  lLinks.setOrbitsPerTf(mOrbitsPerTf);
+  bool lStfClosed = false;
+  bool lLearnLinks = false; // the first STF can be partial
 
   // Reference to the input channel
   auto& lInputChan = mDevice.GetChannel(mDevice.getInputChannelName(), pInputChannelIdx);
@@ -97,7 +183,29 @@ void StfInputInterface::DataHandlerThread(const unsigned pInputChannelIdx)
       lReadoutMsgs.clear();
 
       // receive readout messages
-      const auto lRet = lInputChan.Receive(lReadoutMsgs);
+      const bool lStfOpen = lTrackLinks && lStfAnnounced && !lStfClosed;
+      const auto lRet = lInputChan.Receive(lReadoutMsgs, lStfOpen ? int(mLinkGraceTime.count()) : -1);
+
+      if (lRet == -2 && lStfOpen) {
+        // grace timeout: do not wait for the missing links
+        const auto lNumMissing = lLinks.numLinks() - lLinks.numCompleteLinks();
+        const auto lNumDropped = lLinks.dropMissingLinks();
+
+        static std::uint64_t sNumGraceTimeouts = 0;
+        if (sNumGraceTimeouts++ % 100 == 0) {
+          DDLOG(fair::Severity::WARNING) << "READOUT INTERFACE: closing STF id=" << lCurrentStfId
+            << " after the grace timeout. Incomplete links: " << lNumMissing
+            << ", links without data: " << lNumDropped
+            << ". Total occurrences: " << sNumGraceTimeouts;
+        }
+
+        if (!queueBuilderInput(lCurrentStfId, std::vector<FairMQMessagePtr>())) {
+          break;
+        }
+        lStfClosed = true;
+        continue;
+      }
+
       if (lRet < 0 && mRunning) {
         //DDLOG(fair::Severity::WARNING) << "StfHeader receive failed (err = " + std::to_string(lRet) + ")";
         // std::this_thread::yield();
@@ -152,10 +260,65 @@ void StfInputInterface::DataHandlerThread(const unsigned pInputChannelIdx)
         }
       }
 
+      // new STF: signal the end of the previous one to its builder, and record the ordering
+      if (!lStfAnnounced || lReadoutHdr.mTimeFrameId > lCurrentStfId) {
+        if (lStfAnnounced && !lStfClosed) {
+          // empty update marks the end of STF data
+          if (!queueBuilderInput(lCurrentStfId, std::vector<FairMQMessagePtr>())) {
+            break;
+          }
+        }
+
+        announceStf(lReadoutHdr.mTimeFrameId);
+
+        lLinks.startStf(lLearnLinks);
+        lLearnLinks = lStfAnnounced;
+        lStfClosed = false;
+
+        lStfAnnounced = true;
+      }
+
       // make sure we never jump down
       lCurrentStfId = std::max(lCurrentStfId, std::uint64_t(lReadoutHdr.mTimeFrameId));
 
-      mBuilderInputQueues[lReadoutHdr.mTimeFrameId % mNumBuilders].push(std::move(lReadoutMsgs));
+      // account the update of the link
+      bool lStfComplete = false;
+      if (lTrackLinks && lReadoutMsgs.size() > 1) {
+        const auto lSubSpec = ReadoutDataUtils::getSubSpecification(
+          static_cast<const char*>(lReadoutMsgs[1]->GetData()),
+          lReadoutMsgs[1]->GetSize()
+        );
+        lStfComplete = lLinks.addUpdate(lSubSpec, lReadoutMsgs.size() - 1);
+      }
+
+      // Late data of a closed STF (TF ids are monotonic, only the current one can be closed).
+      // The link and its HBFrame count are learned above, so the following STFs wait for it.
+      if (lStfClosed) {
+        mNumLateUpdatesDropped++;
+
+        static std::uint64_t sNumLateUpdates = 0;
+        if (sNumLateUpdates++ % 100 == 0) {
+          DDLOG(fair::Severity::WARNING) << "READOUT INTERFACE: dropping late data of closed STF id="
+            << lCurrentStfId << ", link id: " << unsigned(lReadoutHdr.mLinkId)
+            << ", num HBFrames: " << (lReadoutMsgs.size() > 0 ? lReadoutMsgs.size() - 1 : 0)
+            << ". Total occurrences: " << mNumLateUpdatesDropped;
+        }
+
+        lReadoutMsgs.clear();
+        continue;
+      }
+
+      if (!queueBuilderInput(lReadoutHdr.mTimeFrameId, std::move(lReadoutMsgs))) {
+        break;
+      }
+
+      // all known links delivered: close the STF without waiting for the next TF id
+      if (lStfComplete && !lStfClosed) {
+        if (!queueBuilderInput(lCurrentStfId, std::vector<FairMQMessagePtr>())) {
+          break;
+        }
+        lStfClosed = true;
+      }
     }
   } catch (std::runtime_error& e) {
     DDLOG(fair::Severity::ERROR) << "Receive failed. Stopping input thread[" << pInputChannelIdx << "]...";
@@ -171,10 +334,17 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
 {
   using namespace std::chrono_literals;
   // current TF Id
-  std::int64_t lCurrentStfId = 0;
+  std::uint64_t lCurrentStfId = 0;
+  bool lStfActive = false;
   std::vector<FairMQMessagePtr> lReadoutMsgs;
   lReadoutMsgs.reserve(1U << 20);
 
+  // readout updates are taken from the input queue in batches
+  static constexpr unsigned long sMaxBatch = 64;
+  std::vector<std::vector<FairMQMessagePtr>> lReadoutBatch;
+  lReadoutBatch.reserve(sMaxBatch);
+  std::size_t lReadoutBatchIdx = 0;
+
   // Reference to the input channel
   assert (mBuilderInputQueues.size() == mNumBuilders);
   assert (pIdx < mBuilderInputQueues.size());
@@ -183,13 +353,19 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
   // Stf builder
   SubTimeFrameReadoutBuilder &lStfBuilder = mStfBuilders[pIdx];
   lStfBuilder.setRdh4FilterTrigger(mRdh4FilterTrigger);
+  lStfBuilder.setSuperpagePacking(mSuperpagePacking);
 
   const std::chrono::microseconds cMinWaitTime = 2s;
   const std::chrono::microseconds cDesiredWaitTime = 2s * mNumBuilders / 3;
   const auto cStfDataWaitFor = std::max(cMinWaitTime, cDesiredWaitTime);
 
-  using hres_clock = std::chrono::high_resolution_clock;
-  auto lStfStartTime = hres_clock::now();
+  // hand the current STF over to the ordering thread, even when no data was added
+  const auto lFinishStf = [&]() {
+    if (lStfActive) {
+      finishStf(lCurrentStfId, lStfBuilder.getStf());
+      lStfActive = false;
+    }
+  };
 
     while (mRunning) {
 
@@ -197,24 +373,29 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
       lReadoutMsgs.clear();
 
       // receive readout messages
-      const auto lRet = lInputQueue.pop_wait_for(lReadoutMsgs, cStfDataWaitFor);
-      if (!lRet && mRunning) {
+      if (lReadoutBatchIdx == lReadoutBatch.size()) {
+        lReadoutBatch.clear();
+        lReadoutBatchIdx = 0;
+        lInputQueue.pop_n_wait_for(sMaxBatch, std::back_inserter(lReadoutBatch), cStfDataWaitFor);
+      }
 
-        // timeout! should finish the Stf if have outstanding data
-        std::unique_ptr<SubTimeFrame> lStf = lStfBuilder.getStf();
+      const bool lRet = lReadoutBatchIdx < lReadoutBatch.size();
+      if (lRet) {
+        lReadoutMsgs = std::move(lReadoutBatch[lReadoutBatchIdx++]);
+      }
 
-        if (lStf) {
-         DDLOG(fair::Severity::WARNING) << "StfBuilderThread " << pIdx << ": finishing STF on timeout, id[" << lStf->header().mId<< "]::size= " << lStf->getDataSize();
+      if (!lRet && mRunning) {
 
-          mDevice.queue(eStfBuilderOut, std::move(lStf));
+        // timeout! should finish the Stf if have outstanding data
+        if (lStfActive) {
+          std::unique_ptr<SubTimeFrame> lStf = lStfBuilder.getStf();
 
-          { // MON: data of a new STF received, get the freq and new start time
-            if (mDevice.guiEnabled()) {
-              const auto lStfDur = std::chrono::duration<float>(hres_clock::now() - lStfStartTime);
-              mStfFreqSamples.Fill(1.0f / lStfDur.count() * mNumBuilders);
-              lStfStartTime = hres_clock::now();
-            }
+          if (lStf) {
+            DDLOG(fair::Severity::WARNING) << "StfBuilderThread " << pIdx << ": finishing STF on timeout, id[" << lStf->header().mId<< "]::size= " << lStf->getDataSize();
           }
+
+          finishStf(lCurrentStfId, std::move(lStf));
+          lStfActive = false;
         }
 
         lReadoutMsgs.clear();
@@ -225,12 +406,8 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
       }
 
       if (lReadoutMsgs.empty()) {
-        DDLOG(fair::Severity::ERROR) << "READOUT INTERFACE: empty readout multipart.";
-        continue;
-      }
-
-      if (lReadoutMsgs.size() < 2) {
-        DDLOG(fair::Severity::ERROR) << "READOUT INTERFACE [" << pIdx << "]: no data sent, only header.";
+        // end of STF marker from the input thread
+        lFinishStf();
         continue;
       }
 
@@ -239,6 +416,23 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
       assert(lReadoutMsgs[0]->GetSize() == sizeof(ReadoutSubTimeframeHeader));
       std::memcpy(&lReadoutHdr, lReadoutMsgs[0]->GetData(), sizeof(ReadoutSubTimeframeHeader));
 
+      // check for the new TF marker
+      if (!lStfActive || lReadoutHdr.mTimeFrameId != lCurrentStfId) {
+        // Finished: hand over the current STF and start a new one
+        lFinishStf();
+
+        ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
+
+        // start a new STF
+        lCurrentStfId = lReadoutHdr.mTimeFrameId;
+        lStfActive = true;
+      }
+
+      if (lReadoutMsgs.size() < 2) {
+        DDLOG(fair::Severity::ERROR) << "READOUT INTERFACE [" << pIdx << "]: no data sent, only header.";
+        continue;
+      }
+
 
       // log only
       if (lReadoutHdr.mTimeFrameId % (100 + pIdx) == 0) {
@@ -292,35 +486,6 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
       //           << "#HBF: " << lReadoutHdr.mNumberHbf << ", "
       //           << "EQ: " << lReadoutHdr.linkId;
 
-      // check for the new TF marker
-      if (lReadoutHdr.mTimeFrameId != lCurrentStfId) {
-
-        if (lReadoutMsgs.size() > 1) {
-          ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
-        }
-
-        if (lCurrentStfId >= 0) {
-          // Finished: queue the current STF and start a new one
-          std::unique_ptr<SubTimeFrame> lStf = lStfBuilder.getStf();
-
-          if (lStf) {
-            // DDLOG(fair::Severity::DEBUG) << "Received TF[" << lStf->header().mId<< "]::size= " << lStf->getDataSize();
-            mDevice.queue(eStfBuilderOut, std::move(lStf));
-
-            { // MON: data of a new STF received, get the freq and new start time
-              if (mDevice.guiEnabled()) {
-                const auto lStfDur = std::chrono::duration<float>(hres_clock::now() - lStfStartTime);
-                mStfFreqSamples.Fill(1.0f / lStfDur.count() * mNumBuilders);
-                lStfStartTime = hres_clock::now();
-              }
-            }
-          }
-        }
-
-        // start a new STF
-        lCurrentStfId = lReadoutHdr.mTimeFrameId;
-      }
-
       // check subspecifications of all messages
       auto lSubSpecification = ReadoutDataUtils::getSubSpecification(
         static_cast<const char*>(lReadoutMsgs[1]->GetData()),
@@ -373,5 +538,77 @@ void StfInputInterface::StfBuilderThread(const std::size_t pIdx)
   DDLOG(fair::Severity::INFO) << "Exiting StfBuilder thread[" << pIdx << "]...";
 }
 
+/// StfOrdering thread: forward built STFs in the order of TF ids received from readout
+void StfInputInterface::StfOrderingThread()
+{
+  using namespace std::chrono_literals;
+  using hres_clock = std::chrono::high_resolution_clock;
+  auto lStfStartTime = hres_clock::now();
+
+  const auto lNextStfBuilt = [this]() {
+    return !mStfOrderingIds.empty() && (mStfOrderingBuilt.count(mStfOrderingIds.front()) > 0);
+  };
+
+  std::vector<std::unique_ptr<SubTimeFrame>> lStfs;
+
+  while (mRunning) {
+
+    lStfs.clear();
+    {
+      std::unique_lock<std::mutex> lLock(mStfOrderingLock);
+      if (!mStfOrderingCondition.wait_for(lLock, 500ms, lNextStfBuilt)) {
+        continue;
+      }
+
+      const auto lStfIter = std::next(mStfOrderingBuilt.find(mStfOrderingIds.front()));
+
+      // Lower ids are already announced: these can be STFs without data (e.g. before the first
+      // readout update), or late data of STFs finished on timeout. Forward only the latter, and
+      // never forward an id twice.
+      for (auto lIter = mStfOrderingBuilt.begin(); lIter != lStfIter; ++lIter) {
+        if (!lIter->second) {
+          continue;
+        }
+
+        if (!mStfOrderingForwarded.emplace(lIter->first).second) {
+          static std::uint64_t sNumDuplicates = 0;
+          if (sNumDuplicates++ % 100 == 0) {
+            DDLOG(fair::Severity::ERROR) << "StfBuilder: dropping late data of already forwarded STF id="
+              << lIter->first << ", size=" << lIter->second->getDataSize()
+              << ". Total occurrences: " << sNumDuplicates;
+          }
+          continue;
+        }
+
+        lStfs.emplace_back(std::move(lIter->second));
+      }
+
+      // bounded history of forwarded ids
+      while (mStfOrderingForwarded.size() > sStfOrderingForwardedHistory) {
+        mStfOrderingForwarded.erase(mStfOrderingForwarded.begin());
+      }
+
+      mStfOrderingBuilt.erase(mStfOrderingBuilt.begin(), lStfIter);
+      mStfOrderingIds.pop_front();
+    }
+
+    for (auto &lStf : lStfs) {
+      // DDLOG(fair::Severity::DEBUG) << "Received TF[" << lStf->header().mId<< "]::size= " << lStf->getDataSize();
+      mDevice.queue(eStfBuilderOut, std::move(lStf));
+
+      { // MON: data of a new STF received, get the freq and new start time
+        if (mDevice.guiEnabled()) {
+          const auto lStfDur = std::chrono::duration<float>(hres_clock::now() - lStfStartTime);
+          mStfFreqSamples.Fill(1.0f / lStfDur.count());
+          lStfStartTime = hres_clock::now();
+        }
+      }
+    }
+  }
+
+  DDLOG(fair::Severity::INFO) << "Exiting StfOrdering thread...";
+}
+
+
 }
 }
@@ -18,10 +18,18 @@
 #include <ConcurrentQueue.h>
 #include <Utilities.h>
 
+#include "StfLinkCompleteness.h"
+
 #include <Headers/DataHeader.h>
 
 #include <thread>
 #include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace o2
 {
@@ -41,15 +49,23 @@ class StfInputInterface
   {
   }
 
-  void start(const std::size_t pNumBuilders, const o2::header::DataOrigin &);
+  void start(const std::size_t pNumBuilders, const std::size_t pBuilderQueueSize, const o2::header::DataOrigin &);
   void stop();
 
   void DataHandlerThread(const unsigned pInputChannelIdx);
   void StfBuilderThread(const std::size_t pIdx);
+  void StfOrderingThread();
 
   const RunningSamples<float>& StfFreqSamples() const { return mStfFreqSamples; }
 
   void setRdh4FilterTrigger(bool pVal) { mRdh4FilterTrigger = pVal; }
+  void setSuperpagePacking(bool pVal) { mSuperpagePacking = pVal; }
+  void setHeaderRegionConfig(const HeaderRegionConfig& pCfg) { mHeaderRegionConfig = pCfg; }
+  void setLinkCompletenessConfig(const std::uint64_t pOrbitsPerTf, const std::chrono::milliseconds pGraceTime)
+  {
+    mOrbitsPerTf = pOrbitsPerTf;
+    mLinkGraceTime = pGraceTime;
+  }
 
  private:
   /// Main SubTimeBuilder O2 device
@@ -63,6 +79,15 @@ class StfInputInterface
 
   /// Readout flags
   bool mRdh4FilterTrigger = false;  // filter out empty HBFs in triggered mode with RDHv4
+  bool mSuperpagePacking = false;   // send HBFs of a readout update under one header
+
+  /// STF completeness: close STFs when all links delivered, or after the grace time without data
+  std::uint64_t mOrbitsPerTf = 0;                      // 0: learn from data
+  std::chrono::milliseconds mLinkGraceTime{0};         // 0: close only on a new TF id (or builder timeout)
+  std::atomic_uint64_t mNumLateUpdatesDropped = 0;     // readout updates received after their STF was closed
+
+  /// Header memory regions of STF builders
+  HeaderRegionConfig mHeaderRegionConfig = { SubTimeFrameReadoutBuilder::sDefaultHeaderRegionSize };
 
   RunningSamples<float> mStfNumFilteredMessages;
 
@@ -71,9 +96,25 @@ class StfInputInterface
   /// StfBuilding threads
   /// Start a thread per building slot: updates are distributed with % numBuildingThreads
   std::size_t mNumBuilders = 1;
-  std::vector<ConcurrentFifo<std::vector<FairMQMessagePtr>>> mBuilderInputQueues;
+  /// Bounded SPSC rings: the input thread stops receiving from readout when a builder falls behind
+  std::vector<ConcurrentSpscRing<std::vector<FairMQMessagePtr>>> mBuilderInputQueues;
+  bool queueBuilderInput(const std::uint64_t pStfId, std::vector<FairMQMessagePtr> &&pReadoutMsgs);
   std::vector<SubTimeFrameReadoutBuilder> mStfBuilders;
   std::vector<std::thread> mBuilderThreads;
+
+  /// StfOrdering thread
+  /// Builder threads can finish STFs out of order. Ids of new STFs are recorded in the order received
+  /// from readout, and built STFs are forwarded to the pipeline in the same order.
+  void announceStf(const std::uint64_t pStfId);
+  void finishStf(const std::uint64_t pStfId, std::unique_ptr<SubTimeFrame> pStf);
+
+  std::mutex mStfOrderingLock;
+  std::condition_variable mStfOrderingCondition;
+  std::deque<std::uint64_t> mStfOrderingIds;
+  std::map<std::uint64_t, std::unique_ptr<SubTimeFrame>> mStfOrderingBuilt; // nullptr if no data
+  static constexpr std::size_t sStfOrderingForwardedHistory = 1024;
+  std::set<std::uint64_t> mStfOrderingForwarded; // recently forwarded ids, to reject duplicates
+  std::thread mStfOrderingThread;
 };
 
 }
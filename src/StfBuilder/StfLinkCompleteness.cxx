@@ -0,0 +1,67 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "StfLinkCompleteness.h"
+
+#include <algorithm>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+void StfLinkCompleteness::startStf(const bool pLearn)
+{
+  for (auto &lLinkIter : mLinks) {
+    auto &lLink = lLinkIter.second;
+    if (pLearn) {
+      lLink.mExpectedHbfs = std::max(lLink.mExpectedHbfs, lLink.mHbfs);
+    }
+    lLink.mHbfs = 0;
+  }
+  mNumComplete = 0;
+}
+
+bool StfLinkCompleteness::addUpdate(const o2::header::DataHeader::SubSpecificationType pSubSpec,
+  const std::uint64_t pNumHbf)
+{
+  auto &lLink = mLinks[pSubSpec];
+  const auto lExpectedHbfs = mOrbitsPerTf > 0 ? mOrbitsPerTf : lLink.mExpectedHbfs;
+
+  const bool lWasComplete = (lExpectedHbfs > 0) && (lLink.mHbfs >= lExpectedHbfs);
+  lLink.mHbfs += pNumHbf;
+  const bool lIsComplete = (lExpectedHbfs > 0) && (lLink.mHbfs >= lExpectedHbfs);
+
+  if (lIsComplete && !lWasComplete) {
+    mNumComplete++;
+  }
+
+  return mNumComplete == mLinks.size();
+}
+
+std::size_t StfLinkCompleteness::dropMissingLinks()
+{
+  std::size_t lDropped = 0;
+  for (auto lIter = mLinks.begin(); lIter != mLinks.end(); ) {
+    if (lIter->second.mHbfs == 0) {
+      lIter = mLinks.erase(lIter);
+      lDropped++;
+    } else {
+      ++lIter;
+    }
+  }
+  return lDropped;
+}
+
+}
+} /* namespace o2::DataDistribution */
@@ -0,0 +1,59 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_STFBUILDER_LINK_COMPLETENESS_H_
+#define ALICEO2_STFBUILDER_LINK_COMPLETENESS_H_
+
+#include <Headers/DataHeader.h>
+
+#include <map>
+#include <cstdint>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+/// Per-link completeness of the STF being received from readout
+/// Links (subspecifications) and the number of HBFrames per TF are learned from the data,
+/// unless the number of orbits per TF is configured.
+class StfLinkCompleteness
+{
+ public:
+  void setOrbitsPerTf(const std::uint64_t pOrbits) { mOrbitsPerTf = pOrbits; }
+
+  /// Start a new STF. Expected HBFrame counts are updated from the previous STF if pLearn is set.
+  void startStf(const bool pLearn);
+  /// Account an update of a link. Returns true when all known links have delivered the STF.
+  bool addUpdate(const o2::header::DataHeader::SubSpecificationType pSubSpec, const std::uint64_t pNumHbf);
+  /// Forget links that did not send any data for the current STF
+  std::size_t dropMissingLinks();
+
+  std::size_t numLinks() const { return mLinks.size(); }
+  std::size_t numCompleteLinks() const { return mNumComplete; }
+
+ private:
+  struct LinkState {
+    std::uint64_t mExpectedHbfs = 0; // 0 if not learned yet
+    std::uint64_t mHbfs = 0;
+  };
+
+  std::map<o2::header::DataHeader::SubSpecificationType, LinkState> mLinks;
+  std::uint64_t mOrbitsPerTf = 0;
+  std::size_t mNumComplete = 0;
+};
+
+}
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_STFBUILDER_LINK_COMPLETENESS_H_ */
@@ -15,6 +15,7 @@
 #include <options/FairMQProgOptions.h>
 
 #include <SubTimeFrameFileSink.h>
+#include <PipelineMemoryBudget.h>
 #include <SubTimeFrameFileSource.h>
 
 #include <Headers/DataHeader.h>
@@ -71,6 +72,8 @@ void addCustomOptions(bpo::options_description& options)
 
   // Add options for STF file sink
   options.add(o2::DataDistribution::SubTimeFrameFileSink::getProgramOptions());
+  // Add options for the pipeline memory budget
+  options.add(o2::DataDistribution::PipelineMemoryBudgetConfig::getProgramOptions());
   // Add options for STF file source
   options.add(o2::DataDistribution::SubTimeFrameFileSource::getProgramOptions());
 }
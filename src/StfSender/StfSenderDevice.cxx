@@ -50,6 +50,8 @@ void StfSenderDevice::InitTask()
   mInputChannelName = GetConfig()->GetValue<std::string>(OptionKeyInputChannelName);
   mStandalone = GetConfig()->GetValue<bool>(OptionKeyStandalone);
   mMaxStfsInPipeline = GetConfig()->GetValue<std::int64_t>(OptionKeyMaxBufferedStfs);
+  mEvictionCfg.mTimeout = std::chrono::milliseconds(GetConfig()->GetValue<std::uint64_t>(OptionKeyStfEvictionTimeout));
+  mEvictionCfg.mMaxBufferedBytes = GetConfig()->GetValue<std::uint64_t>(OptionKeyMaxBufferedStfSize) << 20;
   mBuildHistograms = GetConfig()->GetValue<bool>(OptionKeyGui);
 
   // Discovery
@@ -79,6 +81,11 @@ void StfSenderDevice::InitTask()
                  "Possibility of creating back-pressure";
   }
 
+  // Pipeline memory budget
+  if (!PipelineMemoryBudgetConfig::loadVerifyConfig(*GetConfig(), mPipelineMemoryBudget))
+    exit(-1);
+  setPipelineMemoryBudget(mPipelineMemoryBudget);
+
   // File sink
   if (!mFileSink.loadVerifyConfig(*GetConfig()))
     exit(-1);
@@ -111,7 +118,7 @@ void StfSenderDevice::PreRun()
 
   // Start output handler
   // NOTE: required even in standalone operation
-  mOutputHandler.start(mDiscoveryConfig);
+  mOutputHandler.start(mDiscoveryConfig, mEvictionCfg);
 
   // start the RPC server after output
   int lRpcRealPort = 0;
@@ -21,6 +21,7 @@
 #include <TfSchedulerRpcClient.h>
 
 #include <SubTimeFrameFileSink.h>
+#include <PipelineMemoryBudget.h>
 #include <Utilities.h>
 #include <RootGui.h>
 
@@ -56,6 +57,8 @@ class StfSenderDevice : public DataDistDevice,
   static constexpr const char* OptionKeyInputChannelName = "input-channel-name";
   static constexpr const char* OptionKeyStandalone = "stand-alone";
   static constexpr const char* OptionKeyMaxBufferedStfs = "max-buffered-stfs";
+  static constexpr const char* OptionKeyStfEvictionTimeout = "stf-eviction-timeout";
+  static constexpr const char* OptionKeyMaxBufferedStfSize = "max-buffered-stf-size";
   static constexpr const char* OptionKeyGui = "gui";
 
   /// Default constructor
@@ -146,12 +149,27 @@ class StfSenderDevice : public DataDistDevice,
     return lNextStage;
   }
 
+  std::uint64_t getPipelineElementSize(const std::unique_ptr<SubTimeFrame>& pStf) const final
+  {
+    return pStf ? pStf->getDataSize() : 0;
+  }
+
+  void onPipelineElementEvicted(unsigned pStage, const std::unique_ptr<SubTimeFrame>& /*pStf*/) final
+  {
+    // STFs in the sender queue are counted as buffered
+    if (pStage == eSenderIn) {
+      stfCountDecFetch();
+    }
+  }
+
   /// Configuration
   std::string mInputChannelName;
   bool mStandalone;
   std::int64_t mMaxStfsInPipeline;
+  StfEvictionConfig mEvictionCfg;
   std::uint32_t mMaxConcurrentSends;
   bool mPipelineLimit;
+  PipelineMemoryBudget mPipelineMemoryBudget;
 
   /// Discovery configuration
   std::shared_ptr<ConsulStfSender> mDiscoveryConfig;
@@ -29,19 +29,43 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
-void StfSenderOutput::start(std::shared_ptr<ConsulStfSender> pDiscoveryConfig)
+void StfSenderOutput::start(std::shared_ptr<ConsulStfSender> pDiscoveryConfig, const StfEvictionConfig &pEvictionCfg)
 {
   assert(pDiscoveryConfig);
   mDiscoveryConfig = pDiscoveryConfig;
+  mEvictionCfg = pEvictionCfg;
 
   std::scoped_lock lLock(mOutputMapLock);
 
+  {
+    std::scoped_lock lSlotLock(mSlotTableLock);
+    mSlotTableVersion = 0;
+    mSlotTables.clear();
+    mLastSlotStfId = 0;
+  }
+
   // create scheduler thread
   mSchedulerThread = std::thread(&StfSenderOutput::StfSchedulerThread, this);
 
   if (mDevice.standalone()) {
     return;
   }
+
+  // create the STF announce thread
+  mStfAnnounceQueue = std::make_unique<ConcurrentFifo<StfSenderStfInfo>>();
+  mStfAnnounceThread = std::thread(&StfSenderOutput::StfAnnounceThread, this);
+
+  // create the STF eviction thread
+  {
+    std::scoped_lock lStfLock(mScheduledStfMapLock);
+    mScheduledStfBytes = 0;
+    mAnyStfEvicted = false;
+    mLastEvictedStfId = 0;
+  }
+  if (mEvictionCfg.mTimeout.count() > 0 || mEvictionCfg.mMaxBufferedBytes > 0) {
+    mEvictionRunning = true;
+    mEvictionThread = std::thread(&StfSenderOutput::StfEvictionThread, this);
+  }
 }
 
 void StfSenderOutput::stop()
@@ -56,6 +80,21 @@ void StfSenderOutput::stop()
     return;
   }
 
+  // send remaining STF announcements and close the scheduler stream
+  if (mStfAnnounceQueue) {
+    mStfAnnounceQueue->stop();
+  }
+  if (mStfAnnounceThread.joinable()) {
+    mStfAnnounceThread.join();
+  }
+
+  // stop the eviction thread
+  mEvictionRunning = false;
+  mEvictionCondition.notify_all();
+  if (mEvictionThread.joinable()) {
+    mEvictionThread.join();
+  }
+
   // signal threads to stop
   for (auto& lIdOutputIt : mOutputMap) {
     lIdOutputIt.second.mRunning->store(false);
@@ -81,7 +120,8 @@ bool StfSenderOutput::running() const
 }
 
 StfSenderOutput::ConnectStatus StfSenderOutput::connectTfBuilder(const std::string &pTfBuilderId,
-                                                                const std::string &pEndpoint)
+                                                                const std::string &pEndpoint,
+                                                                const std::string &pTransport)
 {
   // Check if connection already exists
   {
@@ -93,8 +133,13 @@ StfSenderOutput::ConnectStatus StfSenderOutput::connectTfBuilder(const std::stri
     }
   }
 
-  // create a socket and connect
-  auto transportFactory = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  // create a socket and connect. The transport is selected by the TfBuilder.
+  // With the shmem transport the STF data is passed to co-located TfBuilders without a copy.
+  auto transportFactory = FairMQTransportFactory::CreateTransportFactory(pTransport, "", mDevice.GetConfig());
+  if (!transportFactory) {
+    DDLOG(fair::Severity::ERROR) << "Cannot create the " << pTransport << " transport for TfBuilder " << pTfBuilderId;
+    return eCONNERR;
+  }
 
   auto lNewChannel = std::make_unique<FairMQChannel>(
     "tf_builder_" + pTfBuilderId ,  // name
@@ -129,7 +174,8 @@ StfSenderOutput::ConnectStatus StfSenderOutput::connectTfBuilder(const std::stri
         std::make_unique<ConcurrentFifo<std::unique_ptr<SubTimeFrame>>>(),
         // Note: this thread will try to access this same map. The MapLock will prevent races
         std::thread(&StfSenderOutput::DataHandlerThread, this, pTfBuilderId),
-        std::make_unique<std::atomic_bool>(true) // running
+        std::make_unique<std::atomic_bool>(true), // running
+        std::make_unique<StfDataCreditState>()
       }
     );
   }
@@ -220,55 +266,158 @@ void StfSenderOutput::StfSchedulerThread()
       continue;
     }
 
+    // static assignment: send directly to the TfBuilder owning the TF
+    if (sendStfToSlotOwner(lStf)) {
+      continue;
+    }
+
     // move the stf into triage map (before notifying the scheduler to avoid races)
     {
       std::scoped_lock lLock(mScheduledStfMapLock);
-      auto [it, ins] = mScheduledStfMap.try_emplace(lStfId, std::move(lStf));
+      auto [it, ins] = mScheduledStfMap.try_emplace(lStfId,
+        ScheduledStf{ std::move(lStf), lStfSize, std::chrono::steady_clock::now() });
       if (!ins) {
         (void)it;
         DDLOG(fair::Severity::ERROR) << "Stf with id: " << lStfId << " already scheduled! Skipping the duplicate.";
         continue;
       }
+      mScheduledStfBytes += lStfSize;
+
+      // evict immediately when over the budget
+      if (mEvictionCfg.mMaxBufferedBytes > 0 && mScheduledStfBytes > mEvictionCfg.mMaxBufferedBytes) {
+        mEvictionCondition.notify_one();
+      }
     }
 
-    // Send STF info to scheduler
+    // Queue the STF info for the scheduler. Responses are handled asynchronously
     {
       const auto &lStatus = mDiscoveryConfig->status();
 
       StfSenderStfInfo lStfInfo;
-      SchedulerStfInfoResponse lSchedResponse;
 
       *lStfInfo.mutable_info() = lStatus.info();
       *lStfInfo.mutable_partition() = lStatus.partition();
+      mDevice.TfSchedRpcCli().updateTimeInformation(*lStfInfo.mutable_info());
 
       lStfInfo.set_stf_id(lStfId);
       lStfInfo.set_stf_size(lStfSize);
 
-      mDevice.TfSchedRpcCli().StfSenderStfUpdate(lStfInfo, lSchedResponse);
+      mStfAnnounceQueue->push(std::move(lStfInfo));
+    }
+  }
 
-      {
-        static std::uint64_t sNumStfSentUpdates = 0;
-        if (++sNumStfSentUpdates % 1000 == 0) {
-          DDLOG(fair::Severity::DEBUG) << "Sent STF announce, id: " << lStfId << ", size: " << lStfInfo.stf_size() << ", total: " << sNumStfSentUpdates;
-        }
+  DDLOG(fair::Severity::INFO) << "StfSchedulerThread: Exiting...";
+}
+
+void StfSenderOutput::StfAnnounceThread()
+{
+  DDLOG(fair::Severity::INFO) << "StfAnnounceThread: Starting...";
+
+  std::unique_ptr<ClientContext> lContext;
+  std::unique_ptr<TfSchedulerRpcClient::StfUpdateStream> lStream;
+  std::thread lResponseThread;
+
+  auto lCloseStream = [&](const bool pCancel) {
+    if (!lStream) {
+      return;
+    }
+    if (pCancel) {
+      lContext->TryCancel();
+    }
+    lStream->WritesDone();
+    if (lResponseThread.joinable()) {
+      lResponseThread.join();
+    }
+    const auto lStatus = lStream->Finish();
+    if (!lStatus.ok() && !pCancel) {
+      DDLOG(fair::Severity::WARNING) << "StfAnnounceThread: STF update stream error. Code: " << lStatus.error_code()
+                                     << ", message: " << lStatus.error_message();
+    }
+    lStream.reset();
+    lContext.reset();
+  };
+
+  std::vector<StfSenderStfInfo> lStfInfos(sStfAnnounceBatchSize);
+  StfSenderStfInfoBatch lBatch;
+
+  // batch all STF infos accumulated while the previous write was in progress
+  while (const auto lNumStfs = mStfAnnounceQueue->pop_n(sStfAnnounceBatchSize, lStfInfos.begin())) {
+
+    lBatch.Clear();
+    for (std::size_t i = 0; i < lNumStfs; i++) {
+      *lBatch.add_stf_info() = std::move(lStfInfos[i]);
+    }
+
+    if (!lStream) {
+      lContext = std::make_unique<ClientContext>();
+      lStream = mDevice.TfSchedRpcCli().StfSenderStfUpdateStream(*lContext);
+      if (lStream) {
+        lResponseThread = std::thread(&StfSenderOutput::StfAnnounceResponseThread, this, lStream.get());
       }
+    }
 
-      // check if the scheduler rejected the data
-      if (lSchedResponse.status() != SchedulerStfInfoResponse::OK) {
-        DDLOG(fair::Severity::INFO) << "TfScheduler rejected the Stf announce: " << lStfId
-                   << ", reason: " << SchedulerStfInfoResponse_StfInfoStatus_Name(lSchedResponse.status());
+    if (lStream && lStream->Write(lBatch)) {
+      static std::uint64_t sNumStfSentUpdates = 0;
+      static std::uint64_t sNumStfBatches = 0;
+      sNumStfBatches++;
+      if ((sNumStfSentUpdates += lNumStfs) % 1000 < lNumStfs) {
+        DDLOG(fair::Severity::DEBUG) << "Sent STF announce, id: " << lBatch.stf_info(lNumStfs - 1).stf_id()
+                                     << ", total: " << sNumStfSentUpdates << ", batches: " << sNumStfBatches;
+      }
+      continue;
+    }
 
-        // remove from the scheduling map
-        std::scoped_lock lLock(mScheduledStfMapLock);
-        if (mScheduledStfMap.erase(lStfId) == 1) {
-          // Decrement buffered STF count
-          mDevice.stfCountDecFetch();
-        }
+    // the stream is broken: announce this batch with unary requests and reopen the stream for the next one
+    {
+      static std::uint64_t sNumStreamErrors = 0;
+      if (++sNumStreamErrors % 100 == 1) {
+        DDLOG(fair::Severity::WARNING) << "StfAnnounceThread: STF update stream is not available. "
+                                          "Using unary requests. Total errors: " << sNumStreamErrors;
+      }
+    }
+    lCloseStream(true);
+
+    for (auto &lStfInfo : *lBatch.mutable_stf_info()) {
+      SchedulerStfInfoResponse lSchedResponse;
+      if (mDevice.TfSchedRpcCli().StfSenderStfUpdate(lStfInfo, lSchedResponse)) {
+        lSchedResponse.set_stf_id(lStfInfo.stf_id());
+        handleSchedulerResponse(lSchedResponse);
       }
     }
   }
 
-  DDLOG(fair::Severity::INFO) << "StfSchedulerThread: Exiting...";
+  lCloseStream(false);
+
+  DDLOG(fair::Severity::INFO) << "StfAnnounceThread: Exiting...";
+}
+
+void StfSenderOutput::StfAnnounceResponseThread(TfSchedulerRpcClient::StfUpdateStream *pStream)
+{
+  SchedulerStfInfoResponseBatch lResponseBatch;
+
+  while (pStream->Read(&lResponseBatch)) {
+    for (const auto &lSchedResponse : lResponseBatch.responses()) {
+      handleSchedulerResponse(lSchedResponse);
+    }
+  }
+}
+
+void StfSenderOutput::handleSchedulerResponse(const SchedulerStfInfoResponse &pResponse)
+{
+  // check if the scheduler rejected the data
+  if (pResponse.status() != SchedulerStfInfoResponse::OK) {
+    const auto lStfId = pResponse.stf_id();
+
+    DDLOG(fair::Severity::INFO) << "TfScheduler rejected the Stf announce: " << lStfId
+               << ", reason: " << SchedulerStfInfoResponse_StfInfoStatus_Name(pResponse.status());
+
+    // remove from the scheduling map
+    std::scoped_lock lLock(mScheduledStfMapLock);
+    if (eraseScheduledStf(lStfId)) {
+      // Decrement buffered STF count
+      mDevice.stfCountDecFetch();
+    }
+  }
 }
 
 void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::string &pTfBuilderId, StfDataResponse &pRes)
@@ -286,7 +435,7 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
       }
     }
     pRes.set_status(StfDataResponse::DATA_DROPPED_SCHEDULER);
-    if (mScheduledStfMap.erase(pStfId) == 1) {
+    if (eraseScheduledStf(pStfId)) {
       // Decrement buffered STF count
       mDevice.stfCountDecFetch();
     }
@@ -294,7 +443,12 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
   } else {
     auto lStfIter = mScheduledStfMap.find(pStfId);
     if (lStfIter == mScheduledStfMap.end()) {
-      pRes.set_status(StfDataResponse::DATA_DROPPED_UNKNOWN);
+      // STFs are evicted oldest first
+      if (mAnyStfEvicted && pStfId <= mLastEvictedStfId) {
+        pRes.set_status(StfDataResponse::DATA_DROPPED_TIMEOUT);
+      } else {
+        pRes.set_status(StfDataResponse::DATA_DROPPED_UNKNOWN);
+      }
       return;
     }
 
@@ -305,13 +459,243 @@ void StfSenderOutput::sendStfToTfBuilder(const std::uint64_t pStfId, const std::
     }
 
     // all is well, schedule the stf and cleanup
-    lTfBuilderIter->second.mStfQueue->push(std::move(lStfIter->second));
-    mScheduledStfMap.erase(lStfIter);
+    lTfBuilderIter->second.mStfQueue->push(std::move(lStfIter->second.mStf));
+    eraseScheduledStf(pStfId);
 
     pRes.set_status(StfDataResponse::OK);
   }
 }
 
+bool StfSenderOutput::eraseScheduledStf(const std::uint64_t pStfId)
+{
+  auto lStfIter = mScheduledStfMap.find(pStfId);
+  if (lStfIter == mScheduledStfMap.end()) {
+    return false;
+  }
+
+  mScheduledStfBytes -= std::min(mScheduledStfBytes, lStfIter->second.mSize);
+  mScheduledStfMap.erase(lStfIter);
+  return true;
+}
+
+void StfSenderOutput::StfEvictionThread()
+{
+  DDLOG(fair::Severity::INFO) << "StfEvictionThread: Starting...";
+
+  std::vector<std::unique_ptr<SubTimeFrame>> lEvictedStfs;
+  StfSenderStfDropInfo lDropInfo;
+
+  while (mEvictionRunning) {
+    lDropInfo.Clear();
+    {
+      std::unique_lock lLock(mScheduledStfMapLock);
+      mEvictionCondition.wait_for(lLock, sStfEvictionCheckInterval);
+
+      const auto lDeadline = std::chrono::steady_clock::now() - mEvictionCfg.mTimeout;
+
+      // the map is ordered by STF id: the oldest STFs are first
+      while (!mScheduledStfMap.empty()) {
+        auto lStfIter = mScheduledStfMap.begin();
+
+        const bool lExpired = (mEvictionCfg.mTimeout.count() > 0) && (lStfIter->second.mArrivalTime < lDeadline);
+        const bool lOverBudget = (mEvictionCfg.mMaxBufferedBytes > 0) &&
+          (mScheduledStfBytes > mEvictionCfg.mMaxBufferedBytes);
+        if (!lExpired && !lOverBudget) {
+          break;
+        }
+
+        const auto lStfId = lStfIter->first;
+        lDropInfo.add_stf_ids(lStfId);
+        lEvictedStfs.push_back(std::move(lStfIter->second.mStf));
+        eraseScheduledStf(lStfId);
+
+        mLastEvictedStfId = mAnyStfEvicted ? std::max(mLastEvictedStfId, lStfId) : lStfId;
+        mAnyStfEvicted = true;
+      }
+    }
+
+    if (lEvictedStfs.empty()) {
+      continue;
+    }
+
+    // release the data outside of the lock
+    for (std::size_t i = 0; i < lEvictedStfs.size(); i++) {
+      mDevice.stfCountDecFetch();
+    }
+    lEvictedStfs.clear();
+
+    {
+      static std::uint64_t sNumEvictedStfs = 0;
+      static std::uint64_t sNumEvictions = 0;
+      sNumEvictedStfs += lDropInfo.stf_ids_size();
+      if (++sNumEvictions % 20 == 1) {
+        DDLOG(fair::Severity::WARNING) << "Evicted SubTimeFrames not requested in time. Last: "
+                                       << lDropInfo.stf_ids(lDropInfo.stf_ids_size() - 1)
+                                       << ", batch size: " << lDropInfo.stf_ids_size() << ", total: " << sNumEvictedStfs;
+      }
+    }
+
+    // report the batch to the scheduler
+    const auto &lStatus = mDiscoveryConfig->status();
+    *lDropInfo.mutable_info() = lStatus.info();
+    *lDropInfo.mutable_partition() = lStatus.partition();
+
+    if (!mDevice.TfSchedRpcCli().StfSenderStfDropped(lDropInfo)) {
+      DDLOG(fair::Severity::WARNING) << "Cannot report evicted SubTimeFrames to the TfScheduler.";
+    }
+  }
+
+  DDLOG(fair::Severity::INFO) << "StfEvictionThread: Exiting...";
+}
+
+bool StfSenderOutput::updateTfBuilderSlotTable(const TfBuilderSlotTable &pSlotTable)
+{
+  std::scoped_lock lLock(mSlotTableLock);
+
+  // the table is republished periodically: ignore stale versions
+  if (pSlotTable.version() < mSlotTableVersion) {
+    return false;
+  }
+
+  if (pSlotTable.version() == mSlotTableVersion) {
+    return true; // periodic republish
+  }
+
+  const auto lEffectiveTfId = pSlotTable.effective_tf_id();
+
+  DDLOG(fair::Severity::INFO) << "TfBuilder slot table updated. Version: " << pSlotTable.version()
+                              << ", number of TfBuilders: " << pSlotTable.tf_builder_ids_size()
+                              << ", effective from TF id: " << lEffectiveTfId;
+
+  if (mSlotTableVersion > 0 && lEffectiveTfId <= mLastSlotStfId) {
+    DDLOG(fair::Severity::WARNING) << "TfBuilder slot table received late. Effective from TF id: " << lEffectiveTfId
+                                   << ", last sent STF id: " << mLastSlotStfId;
+  }
+
+  // the new table replaces pending tables that are not in effect yet
+  mSlotTables.erase(mSlotTables.lower_bound(lEffectiveTfId), mSlotTables.end());
+  mSlotTables[lEffectiveTfId].assign(pSlotTable.tf_builder_ids().begin(), pSlotTable.tf_builder_ids().end());
+
+  mSlotTableVersion = pSlotTable.version();
+  return true;
+}
+
+bool StfSenderOutput::updateTfBuilderCredit(const StfDataCredit &pCredit)
+{
+  std::scoped_lock lLock(mOutputMapLock);
+
+  auto lTfBuilderIter = mOutputMap.find(pCredit.tf_builder_id());
+  if (lTfBuilderIter == mOutputMap.end()) {
+    return false;
+  }
+
+  auto &lCredit = *lTfBuilderIter->second.mCredit;
+  {
+    std::scoped_lock lCreditLock(lCredit.mLock);
+    // updates can be reordered: the returned byte count only grows
+    lCredit.mWindow = pCredit.window();
+    lCredit.mReturnedBytes = std::max(lCredit.mReturnedBytes, pCredit.returned_bytes());
+  }
+  lCredit.mCondition.notify_one();
+  return true;
+}
+
+/// Wait until the STF fits into the credit window of the TfBuilder. A STF is always sent when no
+/// data is outstanding, even if it is larger than the window.
+bool StfSenderOutput::waitForStfCredit(StfDataCreditState &pCredit, const std::uint64_t pStfSize, std::atomic_bool &pRunning)
+{
+  std::unique_lock lLock(pCredit.mLock);
+
+  const auto lHasCredit = [&]() {
+    const auto lOutstanding = pCredit.mSentBytes - std::min(pCredit.mSentBytes, pCredit.mReturnedBytes);
+    return (pCredit.mWindow == 0) || (lOutstanding == 0) || (lOutstanding + pStfSize <= pCredit.mWindow);
+  };
+
+  while (!lHasCredit()) {
+    if (!pRunning.load()) {
+      return false;
+    }
+    pCredit.mCondition.wait_for(lLock, sStfCreditWaitTime);
+  }
+
+  pCredit.mSentBytes += pStfSize;
+  return true;
+}
+
+bool StfSenderOutput::sendStfToSlotOwner(std::unique_ptr<SubTimeFrame> &pStf)
+{
+  const auto lStfId = pStf->header().mId;
+  std::string lTfBuilderId;
+  {
+    std::scoped_lock lLock(mSlotTableLock);
+    if (mSlotTableVersion == 0) {
+      return false; // not in static assignment mode
+    }
+
+    // table in effect for the TF: the last one with effective id <= stf id
+    auto lTableIt = mSlotTables.upper_bound(lStfId);
+    if (lTableIt != mSlotTables.begin()) {
+      --lTableIt;
+      // STFs are sent in order: older tables are not needed any more
+      mSlotTables.erase(mSlotTables.begin(), lTableIt);
+    }
+
+    if (lTableIt != mSlotTables.end() && !lTableIt->second.empty()) {
+      lTfBuilderId = lTableIt->second[lStfId % lTableIt->second.size()];
+    }
+    mLastSlotStfId = std::max(mLastSlotStfId, lStfId);
+  }
+
+  {
+    std::scoped_lock lLock(mOutputMapLock);
+    auto lTfBuilderIter = mOutputMap.find(lTfBuilderId);
+    if (lTfBuilderIter != mOutputMap.end()) {
+      lTfBuilderIter->second.mStfQueue->push(std::move(pStf));
+      return true;
+    }
+  }
+
+  // no TfBuilder available for the TF
+  {
+    static std::uint64_t sNumNoSlotOwner = 0;
+    if (++sNumNoSlotOwner % 100 == 1) {
+      DDLOG(fair::Severity::WARNING) << "Dropping STF: no TfBuilder is available for the slot. Stf id: " << lStfId
+                                     << ", TfBuilder: " << (lTfBuilderId.empty() ? "none" : lTfBuilderId)
+                                     << ", total: " << sNumNoSlotOwner;
+    }
+  }
+  pStf.reset();
+  mDevice.stfCountDecFetch();
+  return true;
+}
+
+void StfSenderOutput::dropStfs(const StfDataDropMessage &pReq, StfDataDropResponse &pRes)
+{
+  std::uint64_t lNumDropped = 0;
+  {
+    std::scoped_lock lLock(mScheduledStfMapLock);
+
+    for (const auto lStfId : pReq.stf_ids()) {
+      if (eraseScheduledStf(lStfId)) {
+        // Decrement buffered STF count
+        mDevice.stfCountDecFetch();
+        lNumDropped++;
+      } else {
+        pRes.add_unknown_stf_ids(lStfId);
+      }
+    }
+  }
+  pRes.set_num_dropped(lNumDropped);
+
+  static std::atomic_uint64_t sNumDropRequests = 0;
+  static std::atomic_uint64_t sNumDroppedStfs = 0;
+  sNumDroppedStfs += lNumDropped;
+  if (++sNumDropRequests % 50 == 0) {
+    DDLOG(fair::Severity::DEBUG) << "Scheduler requested drop of " << pReq.stf_ids_size() << " STFs, total requests: "
+                                 << sNumDropRequests << ", total dropped: " << sNumDroppedStfs;
+  }
+}
+
 /// Sending thread
 void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
 {
@@ -320,6 +704,7 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
   FairMQChannel *lOutputChan = nullptr;
   ConcurrentFifo<std::unique_ptr<SubTimeFrame>> *lInputStfQueue = nullptr;
   std::atomic_bool *lRunning = nullptr;
+  StfDataCreditState *lCredit = nullptr;
   {
     // get the thread data. MapLock prevents races on the map operation
     std::scoped_lock lLock(mOutputMapLock);
@@ -328,10 +713,12 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
     lOutputChan = lOutData.mChannel.get();
     lInputStfQueue = lOutData.mStfQueue.get();
     lRunning = lOutData.mRunning.get();
+    lCredit = lOutData.mCredit.get();
   }
   assert(lOutputChan != nullptr && lOutputChan->IsValid());
   assert(lInputStfQueue != nullptr && lInputStfQueue->is_running());
   assert(lRunning != nullptr && (lRunning->load() == true));
+  assert(lCredit != nullptr);
 
   InterleavedHdrDataSerializer lStfSerializer(*lOutputChan);
 
@@ -343,6 +730,12 @@ void StfSenderOutput::DataHandlerThread(const std::string pTfBuilderId)
       break;
     }
 
+    // keep the STF until the TfBuilder has room for it
+    if (!waitForStfCredit(*lCredit, lStf->getDataSize(), *lRunning)) {
+      DDLOG(fair::Severity::INFO) << "StfSenderOutput[" << pTfBuilderId << "]: stopped while waiting for credit. Exiting.";
+      break;
+    }
+
     {
       static std::atomic_uint64_t sNumSentStfs = 0;
       if (++sNumSentStfs % 100 == 0) {
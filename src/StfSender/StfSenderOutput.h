@@ -15,6 +15,7 @@
 #define ALICEO2_STF_SENDER_OUTPUT_H_
 
 #include <ConfigConsul.h>
+#include <TfSchedulerRpcClient.h>
 
 #include <SubTimeFrameDataModel.h>
 #include <ConcurrentQueue.h>
@@ -22,6 +23,9 @@
 #include <vector>
 #include <map>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace o2
 {
@@ -30,6 +34,14 @@ namespace DataDistribution
 
 class StfSenderDevice;
 
+/// Eviction of STFs waiting for the scheduler decision
+struct StfEvictionConfig {
+  /// Evict STFs older than the timeout (0: disabled)
+  std::chrono::milliseconds mTimeout = std::chrono::milliseconds(0);
+  /// Evict the oldest STFs when more bytes are waiting (0: unlimited)
+  std::uint64_t mMaxBufferedBytes = 0;
+};
+
 class StfSenderOutput
 {
  public:
@@ -39,20 +51,27 @@ class StfSenderOutput
   {
   }
 
-  void start(std::shared_ptr<ConsulStfSender> pDiscoveryConfig);
+  void start(std::shared_ptr<ConsulStfSender> pDiscoveryConfig, const StfEvictionConfig &pEvictionCfg = StfEvictionConfig());
   void stop();
 
   bool running() const;
 
   void StfSchedulerThread();
+  void StfEvictionThread();
+  void StfAnnounceThread();
+  void StfAnnounceResponseThread(TfSchedulerRpcClient::StfUpdateStream *pStream);
   void DataHandlerThread(const std::string pTfBuilderId);
 
   /// RPC requests
   enum ConnectStatus { eOK, eEXISTS, eCONNERR };
-  ConnectStatus connectTfBuilder(const std::string &pTfBuilderId, const std::string &lEndpoint);
+  ConnectStatus connectTfBuilder(const std::string &pTfBuilderId, const std::string &lEndpoint,
+                                 const std::string &pTransport);
   bool disconnectTfBuilder(const std::string &pTfBuilderId, const std::string &lEndpoint);
 
   void sendStfToTfBuilder(const std::uint64_t pStfId, const std::string &pTfBuilderId, StfDataResponse &pRes);
+  void dropStfs(const StfDataDropMessage &pReq, StfDataDropResponse &pRes);
+  bool updateTfBuilderSlotTable(const TfBuilderSlotTable &pSlotTable);
+  bool updateTfBuilderCredit(const StfDataCredit &pCredit);
 
  private:
   /// Ref to the main SubTimeBuilder O2 device
@@ -63,8 +82,49 @@ class StfSenderOutput
 
   /// Scheduler threads
   std::thread mSchedulerThread;
+  struct ScheduledStf {
+    std::unique_ptr<SubTimeFrame> mStf;
+    std::uint64_t mSize = 0;
+    std::chrono::steady_clock::time_point mArrivalTime;
+  };
   std::mutex mScheduledStfMapLock;
-  std::map<std::uint64_t, std::unique_ptr<SubTimeFrame>> mScheduledStfMap;
+  std::map<std::uint64_t, ScheduledStf> mScheduledStfMap;
+  std::uint64_t mScheduledStfBytes = 0;
+  bool eraseScheduledStf(const std::uint64_t pStfId); // mScheduledStfMapLock must be held
+
+  /// STF eviction: oldest STFs are dropped on timeout or when over the byte budget
+  static constexpr auto sStfEvictionCheckInterval = std::chrono::milliseconds(100);
+  StfEvictionConfig mEvictionCfg;
+  std::thread mEvictionThread;
+  std::atomic_bool mEvictionRunning = false;
+  std::condition_variable mEvictionCondition;
+  bool mAnyStfEvicted = false;
+  std::uint64_t mLastEvictedStfId = 0;
+
+  /// STF announcements to the scheduler, sent in batches over a gRPC stream
+  static constexpr std::size_t sStfAnnounceBatchSize = 64;
+  std::thread mStfAnnounceThread;
+  std::unique_ptr<ConcurrentFifo<StfSenderStfInfo>> mStfAnnounceQueue;
+  void handleSchedulerResponse(const SchedulerStfInfoResponse &pResponse);
+
+  /// Static TF assignment published by the scheduler. When set, STFs are sent without announcing
+  std::mutex mSlotTableLock;
+  std::uint64_t mSlotTableVersion = 0;
+  /// slot tables by the first TF id they are used for (all StfSenders switch at the same TF)
+  std::map<std::uint64_t, std::vector<std::string>> mSlotTables;
+  std::uint64_t mLastSlotStfId = 0;
+  bool sendStfToSlotOwner(std::unique_ptr<SubTimeFrame> &pStf);
+
+  /// Credit-based flow control of an output channel. Counters are cumulative over the connection
+  struct StfDataCreditState {
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::uint64_t mWindow = 0;          // no flow control until the TfBuilder advertises the window
+    std::uint64_t mReturnedBytes = 0;
+    std::uint64_t mSentBytes = 0;
+  };
+  static constexpr auto sStfCreditWaitTime = std::chrono::milliseconds(500);
+  bool waitForStfCredit(StfDataCreditState &pCredit, const std::uint64_t pStfSize, std::atomic_bool &pRunning);
 
   /// Threads for output channels (to EPNs)
   struct OutputChannelObjects {
@@ -74,6 +134,7 @@ class StfSenderOutput
     std::thread mThread;
 
     std::unique_ptr<std::atomic_bool> mRunning;
+    std::unique_ptr<StfDataCreditState> mCredit;
   };
   mutable std::mutex mOutputMapLock;
   std::map<std::string, OutputChannelObjects> mOutputMap;
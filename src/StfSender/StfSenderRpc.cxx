@@ -53,12 +53,14 @@ void StfSenderRpcImpl::stop()
 {
   const std::string lTfSenderId = request->tf_builder_id();
   const std::string lTfSenderEndpoint = request->endpoint();
+  const std::string lTransport = request->transport().empty() ? "zeromq" : request->transport();
 
   // handle the request
-  DDLOG(fair::Severity::INFO) << "Requested to connect to TfBuilder " << lTfSenderId << " at endpoint: " << lTfSenderEndpoint;
+  DDLOG(fair::Severity::INFO) << "Requested to connect to TfBuilder " << lTfSenderId << " at endpoint: " << lTfSenderEndpoint
+                              << ", transport: " << lTransport;
   response->set_status(OK);
 
-  const auto lStatus = mOutput.connectTfBuilder(lTfSenderId, lTfSenderEndpoint);
+  const auto lStatus = mOutput.connectTfBuilder(lTfSenderId, lTfSenderEndpoint, lTransport);
   switch (lStatus) {
     case StfSenderOutput::ConnectStatus::eOK:
       response->set_status(OK);
@@ -97,12 +99,51 @@ void StfSenderRpcImpl::stop()
                                 const StfDataRequestMessage* request,
                                 StfDataResponse* response)
 {
+  // the request carries the current credit of the TfBuilder
+  if (request->has_credit()) {
+    mOutput.updateTfBuilderCredit(request->credit());
+  }
 
   mOutput.sendStfToTfBuilder(request->stf_id(), request->tf_builder_id(), *response/*out*/);
 
   return Status::OK;
 }
 
+::grpc::Status StfSenderRpcImpl::StfDataDropRequest(::grpc::ServerContext* /*context*/,
+                                const StfDataDropMessage* request,
+                                StfDataDropResponse* response)
+{
+  mOutput.dropStfs(*request, *response/*out*/);
+
+  return Status::OK;
+}
+
+::grpc::Status StfSenderRpcImpl::TfBuilderSlotTableUpdate(::grpc::ServerContext* /*context*/,
+                                const TfBuilderSlotTable* request,
+                                StatusResponse* response)
+{
+  response->set_status(0);
+
+  if (!mOutput.updateTfBuilderSlotTable(*request)) {
+    response->set_status(-1);
+  }
+
+  return Status::OK;
+}
+
+::grpc::Status StfSenderRpcImpl::StfDataCreditUpdate(::grpc::ServerContext* /*context*/,
+                                const StfDataCredit* request,
+                                StatusResponse* response)
+{
+  response->set_status(0);
+
+  if (!mOutput.updateTfBuilderCredit(*request)) {
+    response->set_status(-1);
+  }
+
+  return Status::OK;
+}
+
 
 }
 } /* o2::DataDistribution */
@@ -63,6 +63,21 @@ class StfSenderRpcImpl final : public StfSenderRpc::Service
                                 const StfDataRequestMessage* request,
                                 StfDataResponse* response) override;
 
+  // rpc StfDataDropRequest(StfDataDropMessage) returns (StfDataDropResponse) { }
+  ::grpc::Status StfDataDropRequest(::grpc::ServerContext* context,
+                                    const StfDataDropMessage* request,
+                                    StfDataDropResponse* response) override;
+
+  // rpc TfBuilderSlotTableUpdate(TfBuilderSlotTable) returns (StatusResponse) { }
+  ::grpc::Status TfBuilderSlotTableUpdate(::grpc::ServerContext* context,
+                                          const TfBuilderSlotTable* request,
+                                          StatusResponse* response) override;
+
+  // rpc StfDataCreditUpdate(StfDataCredit) returns (StatusResponse) { }
+  ::grpc::Status StfDataCreditUpdate(::grpc::ServerContext* context,
+                                     const StfDataCredit* request,
+                                     StatusResponse* response) override;
+
   void start(const std::string pRpcSrvBindIp, int &lRealPort /*[out]*/);
   void stop();
 
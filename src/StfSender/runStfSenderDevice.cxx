@@ -10,6 +10,7 @@
 
 #include "StfSenderDevice.h"
 #include <SubTimeFrameFileSink.h>
+#include <PipelineMemoryBudget.h>
 #include <Config.h>
 
 #include <options/FairMQProgOptions.h>
@@ -31,12 +32,20 @@ void addCustomOptions(bpo::options_description& options)
     bpo::value<std::int64_t>()->default_value(-1),
     "Maximum number of buffered SubTimeFrames before starting to drop data. "
     "Unlimited: -1.")(
+    o2::DataDistribution::StfSenderDevice::OptionKeyStfEvictionTimeout,
+    bpo::value<std::uint64_t>()->default_value(20000),
+    "Drop SubTimeFrames not requested by a TfBuilder within the timeout, in milliseconds (0 = disabled).")(
+    o2::DataDistribution::StfSenderDevice::OptionKeyMaxBufferedStfSize,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Maximum size of SubTimeFrames waiting for scheduling, in MiB. The oldest are dropped first (0 = unlimited).")(
     o2::DataDistribution::StfSenderDevice::OptionKeyGui,
     bpo::bool_switch()->default_value(false),
     "Enable GUI.");
 
   // Add options for STF file sink
   options.add(o2::DataDistribution::SubTimeFrameFileSink::getProgramOptions());
+  // Add options for the pipeline memory budget
+  options.add(o2::DataDistribution::PipelineMemoryBudgetConfig::getProgramOptions());
   // Add options for Data Distribution discovery
   options.add(o2::DataDistribution::Config::getProgramOptions(o2::DataDistribution::ProcessType::StfSender));
 }
@@ -0,0 +1,154 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "StfTransferSlots.h"
+
+#include <algorithm>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+void StfTransferSlots::start(const std::uint32_t pMaxSlots, const std::chrono::milliseconds pSlotTimeout)
+{
+  std::scoped_lock lLock(mLock);
+  mMaxSlots = pMaxSlots;
+  mSlotTimeout = pSlotTimeout;
+  mSlots.clear();
+  mNumExpired = 0;
+  mRunning = true;
+}
+
+void StfTransferSlots::stop()
+{
+  {
+    std::scoped_lock lLock(mLock);
+    mRunning = false;
+    mSlots.clear();
+  }
+  mCondition.notify_all();
+}
+
+bool StfTransferSlots::acquire(const std::uint64_t pTfId, const std::string &pStfSenderId,
+  const std::chrono::milliseconds pWait)
+{
+  if (mMaxSlots == 0) {
+    return true;
+  }
+
+  const auto lWaitUntil = Clock::now() + pWait;
+  std::unique_lock lLock(mLock);
+
+  while (mRunning) {
+    const auto lNow = Clock::now();
+
+    // the STF is requested again: keep its slot
+    auto lSlotIter = mSlots.find({ pTfId, pStfSenderId });
+    if (lSlotIter != mSlots.end()) {
+      lSlotIter->second = lNow + mSlotTimeout;
+      return true;
+    }
+
+    auto lNextDeadline = Clock::time_point::max();
+    if (mSlots.size() >= mMaxSlots) {
+      lNextDeadline = expireSlots(lNow);
+    }
+
+    if (mSlots.size() < mMaxSlots) {
+      mSlots.emplace(SlotKey{ pTfId, pStfSenderId }, lNow + mSlotTimeout);
+      return true;
+    }
+
+    if (lNow >= lWaitUntil) {
+      return false;
+    }
+
+    // wake up on release, or when the oldest slot expires
+    mCondition.wait_until(lLock, std::min(lWaitUntil, lNextDeadline));
+  }
+
+  return false;
+}
+
+bool StfTransferSlots::release(const std::uint64_t pTfId, const std::string &pStfSenderId)
+{
+  if (mMaxSlots == 0) {
+    return false;
+  }
+
+  {
+    std::scoped_lock lLock(mLock);
+    if (mSlots.erase({ pTfId, pStfSenderId }) == 0) {
+      return false;
+    }
+  }
+  mCondition.notify_one();
+  return true;
+}
+
+std::size_t StfTransferSlots::releaseTf(const std::uint64_t pTfId)
+{
+  if (mMaxSlots == 0) {
+    return 0;
+  }
+
+  std::size_t lNumReleased = 0;
+  {
+    std::scoped_lock lLock(mLock);
+
+    // slots are ordered by TF id
+    auto lSlotIter = mSlots.lower_bound({ pTfId, std::string() });
+    while (lSlotIter != mSlots.end() && lSlotIter->first.first == pTfId) {
+      lSlotIter = mSlots.erase(lSlotIter);
+      lNumReleased++;
+    }
+  }
+
+  if (lNumReleased > 0) {
+    mCondition.notify_all();
+  }
+  return lNumReleased;
+}
+
+std::size_t StfTransferSlots::inTransfer() const
+{
+  std::scoped_lock lLock(mLock);
+  return mSlots.size();
+}
+
+std::uint64_t StfTransferSlots::numExpired() const
+{
+  std::scoped_lock lLock(mLock);
+  return mNumExpired;
+}
+
+StfTransferSlots::Clock::time_point StfTransferSlots::expireSlots(const Clock::time_point pNow)
+{
+  auto lNextDeadline = Clock::time_point::max();
+
+  for (auto lSlotIter = mSlots.begin(); lSlotIter != mSlots.end(); ) {
+    if (lSlotIter->second <= pNow) {
+      lSlotIter = mSlots.erase(lSlotIter);
+      mNumExpired++;
+    } else {
+      lNextDeadline = std::min(lNextDeadline, lSlotIter->second);
+      ++lSlotIter;
+    }
+  }
+
+  return lNextDeadline;
+}
+
+}
+} /* namespace o2::DataDistribution */
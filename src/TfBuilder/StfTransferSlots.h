@@ -0,0 +1,74 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_TF_BUILDER_STF_TRANSFER_SLOTS_H_
+#define ALICEO2_TF_BUILDER_STF_TRANSFER_SLOTS_H_
+
+#include <map>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+/// Incast avoidance: limits the number of StfSenders sending to the TfBuilder concurrently
+/// A slot is held by one requested STF, identified by (TF id, StfSender id). It is freed when the
+/// STF arrives, when the request fails, when the TF is built or dropped, or when the STF does not
+/// arrive within the slot timeout. The limit is never exceeded.
+class StfTransferSlots
+{
+ public:
+  /// pMaxSlots 0: unlimited
+  void start(const std::uint32_t pMaxSlots, const std::chrono::milliseconds pSlotTimeout);
+  /// Wake up and fail all waiting acquire() calls
+  void stop();
+
+  bool enabled() const { return mMaxSlots > 0; }
+
+  /// Wait up to pWait for a free slot and take it for the STF. Returns false on timeout or stop.
+  bool acquire(const std::uint64_t pTfId, const std::string &pStfSenderId, const std::chrono::milliseconds pWait);
+  /// Free the slot of the STF. Returns false if the STF did not hold a slot (e.g. it was not requested).
+  bool release(const std::uint64_t pTfId, const std::string &pStfSenderId);
+  /// Free all slots of the TF. Returns the number of freed slots.
+  std::size_t releaseTf(const std::uint64_t pTfId);
+
+  std::size_t inTransfer() const;
+  /// Number of slots freed on the slot timeout
+  std::uint64_t numExpired() const;
+
+ private:
+  using SlotKey = std::pair<std::uint64_t, std::string>;
+  using Clock = std::chrono::steady_clock;
+
+  /// Free slots past their deadline. Returns the earliest remaining deadline. Call with mLock held.
+  Clock::time_point expireSlots(const Clock::time_point pNow);
+
+  std::uint32_t mMaxSlots = 0;
+  std::chrono::milliseconds mSlotTimeout = std::chrono::milliseconds(5000);
+  bool mRunning = false;
+
+  mutable std::mutex mLock;
+  std::condition_variable mCondition;
+  std::map<SlotKey, Clock::time_point> mSlots; // deadline of each slot
+  std::uint64_t mNumExpired = 0;
+};
+
+}
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_TF_BUILDER_STF_TRANSFER_SLOTS_H_ */
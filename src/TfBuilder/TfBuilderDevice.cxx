@@ -57,6 +57,22 @@ void TfBuilderDevice::InitTask()
     mStandalone = GetConfig()->GetValue<bool>(OptionKeyStandalone);
     mTfBufferSize = GetConfig()->GetValue<std::uint64_t>(OptionKeyTfMemorySize);
     mBuildHistograms = GetConfig()->GetValue<bool>(OptionKeyGui);
+    mTfHeaderRegionCfg = {
+      std::max(std::uint64_t(1), GetConfig()->GetValue<std::uint64_t>(OptionKeyTfHeaderRegionSize)) << 20,
+      GetConfig()->GetValue<bool>(OptionKeyHeaderRegionAdaptive),
+      GetConfig()->GetValue<std::uint64_t>(OptionKeyHeaderRegionMaxSize) << 20
+    };
+    mTfAssemblyCfg.mTimeout = std::chrono::milliseconds(
+      std::max(std::uint64_t(1), GetConfig()->GetValue<std::uint64_t>(OptionKeyTfAssemblyTimeout)));
+    mTfAssemblyCfg.mDropIncomplete = GetConfig()->GetValue<bool>(OptionKeyDropIncompleteTfs);
+    mMaxConcurrentStfSenders = GetConfig()->GetValue<std::uint32_t>(OptionKeyMaxConcurrentStfSenders);
+    mStfCreditFlowControl = GetConfig()->GetValue<bool>(OptionKeyStfCreditFlowControl);
+    mTfAssemblyCfg.mTransport = GetConfig()->GetValue<std::string>(OptionKeyStfTransport);
+
+    if (mTfAssemblyCfg.mTransport != "zeromq" && mTfAssemblyCfg.mTransport != "shmem" && mTfAssemblyCfg.mTransport != "ofi") {
+      DDLOG(fair::Severity::ERROR) << "Unknown STF transport: " << mTfAssemblyCfg.mTransport << ". Use zeromq, shmem, or ofi.";
+      throw "STF transport option";
+    }
 
     mDiscoveryConfig = std::make_shared<ConsulTfBuilder>(ProcessType::TfBuilder,
       Config::getEndpointOption(*GetConfig()));
@@ -69,6 +85,13 @@ void TfBuilderDevice::InitTask()
     mPartitionId = Config::getPartitionOption(*GetConfig());
     lStatus.mutable_partition()->set_partition_id(mPartitionId);
 
+    // Pipeline memory budget
+    if (!PipelineMemoryBudgetConfig::loadVerifyConfig(*(this->GetConfig()), mPipelineMemoryBudget)) {
+      throw "Pipeline memory budget options";
+      return;
+    }
+    setPipelineMemoryBudget(mPipelineMemoryBudget);
+
     // File sink
     if (!mFileSink.loadVerifyConfig(*(this->GetConfig()))) {
       throw "File Sink options";
@@ -76,7 +99,7 @@ void TfBuilderDevice::InitTask()
     }
 
     mRpc = std::make_shared<TfBuilderRpcImpl>(mDiscoveryConfig);
-    mFlpInputHandler = std::make_unique<TfBuilderInput>(*this, mRpc, eTfBuilderOut);
+    mFlpInputHandler = std::make_unique<TfBuilderInput>(*this, mRpc, eTfBuilderOut, mTfAssemblyCfg);
   }
 
   {
@@ -128,8 +151,8 @@ void TfBuilderDevice::InitTask()
 
     // start the gui thread
     if (mBuildHistograms) {
-      mGui = std::make_unique<RootGui>("TFBuilder", "TF Builder", 1200, 400);
-      mGui->Canvas().Divide(3, 1);
+      mGui = std::make_unique<RootGui>("TFBuilder", "TF Builder", 1200, 800);
+      mGui->Canvas().Divide(3, 2);
       mGuiThread = std::thread(&TfBuilderDevice::GuiThread, this);
     }
   }
@@ -143,7 +166,8 @@ void TfBuilderDevice::PreRun()
 bool TfBuilderDevice::start()
 {
   // start all gRPC clients
-  while (!mRpc->start(mTfBufferSize << 20 /* MiB */)) {
+  while (!mRpc->start(mTfBufferSize << 20 /* MiB */, mMaxConcurrentStfSenders, mStfCreditFlowControl,
+                      mTfAssemblyCfg.mTimeout)) {
     // try to reach the scheduler unless we should exit
     if (IsRunningState() && NewStatePending()) {
       mShouldExit = true;
@@ -239,7 +263,7 @@ void TfBuilderDevice::TfForwardThread()
   if (!mStandalone) {
     if (dplEnabled()) {
       auto& lOutputChan = GetChannel(getDplChannelName(), 0);
-      lTfBuilder = std::make_unique<TimeFrameBuilder>(lOutputChan, dplEnabled());
+      lTfBuilder = std::make_unique<TimeFrameBuilder>(lOutputChan, dplEnabled(), mTfHeaderRegionCfg);
       lTfDplAdapter = std::make_unique<StfDplAdapter>(lOutputChan);
     }
   }
@@ -309,6 +333,20 @@ void TfBuilderDevice::TfForwardThread()
   DDLOG(fair::Severity::INFO) << "Exiting TF forwarding thread... ";
 }
 
+void TfBuilderDevice::onPipelineElementEvicted(unsigned /*pStage*/, const std::unique_ptr<SubTimeFrame>& pTf)
+{
+  // the evicted TF frees its buffer space and credits as if it was forwarded
+  if (pTf && mRpc) {
+    mRpc->recordTfForwarded(pTf->header().mId);
+  }
+
+  static std::uint64_t sNumEvictedTfs = 0;
+  if (++sNumEvictedTfs % 100 == 1) {
+    DDLOGF(fair::Severity::WARNING, "Dropped TimeFrames due to the pipeline memory budget. total_dropped={}",
+      getPipelineBudgetDrops());
+  }
+}
+
 void TfBuilderDevice::GuiThread()
 {
   std::unique_ptr<TH1F> lTfSizeHist = std::make_unique<TH1F>("TfSizeH", "Size of TF", 100, 0.0, float(1UL << 30));
@@ -320,6 +358,12 @@ void TfBuilderDevice::GuiThread()
   std::unique_ptr<TH1S> lStfPipelinedCntHist = std::make_unique<TH1S>("StfQueuedH", "Queued STFs", 150, -0.5, 150.0 - 0.5);
   lStfPipelinedCntHist->GetXaxis()->SetTitle("Number of queued Stf");
 
+  std::unique_ptr<TH1F> lStfRequestLatencyHist = std::make_unique<TH1F>("StfReqLatH", "StfDataRequest latency", 200, 0.0, 100.0);
+  lStfRequestLatencyHist->GetXaxis()->SetTitle("Latency [ms]");
+
+  std::unique_ptr<TH1F> lTfRequestDurationHist = std::make_unique<TH1F>("TfReqDurH", "TF request duration", 200, 0.0, 1000.0);
+  lTfRequestDurationHist->GetXaxis()->SetTitle("Duration [ms]");
+
   // wait for the device to go into RUNNING state
   WaitForRunningState();
 
@@ -335,12 +379,20 @@ void TfBuilderDevice::GuiThread()
     mGui->Canvas().cd(3);
     mGui->DrawHist(lStfPipelinedCntHist.get(), this->getPipelinedSizeSamples());
 
+    mGui->Canvas().cd(4);
+    mGui->DrawHist(lStfRequestLatencyHist.get(), mRpc->StfRequestLatencySamples());
+
+    mGui->Canvas().cd(5);
+    mGui->DrawHist(lTfRequestDurationHist.get(), mRpc->TfRequestDurationSamples());
+
     mGui->Canvas().Modified();
     mGui->Canvas().Update();
 
     DDLOG(fair::Severity::INFO) << "Mean size of TimeFrames : " << mTfSizeSamples.Mean();
     DDLOG(fair::Severity::INFO) << "Mean TimeFrame frequency: " << mTfFreqSamples.Mean();
     DDLOG(fair::Severity::INFO) << "Number of queued TFs    : " << getPipelineSize(); // current value
+    DDLOG(fair::Severity::INFO) << "Mean StfDataRequest latency [ms]: " << mRpc->StfRequestLatencySamples().Mean();
+    DDLOG(fair::Severity::INFO) << "Mean TF request duration [ms]   : " << mRpc->TfRequestDurationSamples().Mean();
 
     std::this_thread::sleep_for(5s);
   }
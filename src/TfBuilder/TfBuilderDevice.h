@@ -22,6 +22,7 @@
 #include <SubTimeFrameDataModel.h>
 #include <SubTimeFrameFileSink.h>
 #include <SubTimeFrameFileSource.h>
+#include <PipelineMemoryBudget.h>
 #include <ConcurrentQueue.h>
 #include <Utilities.h>
 #include <RootGui.h>
@@ -63,6 +64,14 @@ class TfBuilderDevice : public DataDistDevice,
   static constexpr const char* OptionKeyStandalone = "stand-alone";
   static constexpr const char* OptionKeyTfMemorySize = "tf-memory-size";
   static constexpr const char* OptionKeyGui = "gui";
+  static constexpr const char* OptionKeyTfHeaderRegionSize = "tf-header-region-size";
+  static constexpr const char* OptionKeyHeaderRegionAdaptive = "header-region-adaptive";
+  static constexpr const char* OptionKeyHeaderRegionMaxSize = "header-region-max-size";
+  static constexpr const char* OptionKeyTfAssemblyTimeout = "tf-assembly-timeout";
+  static constexpr const char* OptionKeyDropIncompleteTfs = "drop-incomplete-tfs";
+  static constexpr const char* OptionKeyMaxConcurrentStfSenders = "max-concurrent-stf-senders";
+  static constexpr const char* OptionKeyStfCreditFlowControl = "stf-credit-flow-control";
+  static constexpr const char* OptionKeyStfTransport = "stf-transport";
 
   static constexpr const char* OptionKeyDplChannelName = "dpl-channel-name";
 
@@ -111,6 +120,13 @@ class TfBuilderDevice : public DataDistDevice,
     return lNextStage;
   }
 
+  std::uint64_t getPipelineElementSize(const std::unique_ptr<SubTimeFrame>& pTf) const final
+  {
+    return pTf ? pTf->getDataSize() : 0;
+  }
+
+  void onPipelineElementEvicted(unsigned pStage, const std::unique_ptr<SubTimeFrame>& pTf) final;
+
   void TfForwardThread();
 
 
@@ -122,6 +138,11 @@ class TfBuilderDevice : public DataDistDevice,
   std::string mDplChannelName;
   bool mStandalone;
   std::uint64_t mTfBufferSize;
+  PipelineMemoryBudget mPipelineMemoryBudget;
+  HeaderRegionConfig mTfHeaderRegionCfg = { TimeFrameBuilder::sDefaultHeaderRegionSize };
+  TfAssemblyConfig mTfAssemblyCfg;
+  std::uint32_t mMaxConcurrentStfSenders = 0;
+  bool mStfCreditFlowControl = false;
   std::string mPartitionId;
   bool mDplEnabled = false;
 
@@ -24,6 +24,7 @@
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 namespace o2
 {
@@ -35,7 +36,11 @@ using namespace std::chrono_literals;
 bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
 {
   // make max number of listening channels for the partition
-  auto transportFactory = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  auto transportFactory = FairMQTransportFactory::CreateTransportFactory(mAssemblyCfg.mTransport, "", mDevice.GetConfig());
+  if (!transportFactory) {
+    DDLOG(fair::Severity::ERROR) << "Creating the " << mAssemblyCfg.mTransport << " transport factory failed!";
+    return false;
+  }
 
   auto &lStatus = pConfig->status();
 
@@ -90,6 +95,7 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
     auto &lSocket = lSocketMap[lSocketIdx];
     lSocket.set_idx(lSocketIdx);
     lSocket.set_endpoint(lAddress);
+    lSocket.set_transport(mAssemblyCfg.mTransport);
 
     mStfSenderChannels.emplace_back(std::move(lNewChannel));
   }
@@ -138,8 +144,13 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
 
   // Start the merger
   {
-    std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
-    mStfMergeQueue.clear();
+    for (auto &lShard : mAssemblyTable) {
+      std::scoped_lock lLock(lShard.mLock);
+      lShard.mSlots.clear();
+      lShard.mAnyExpired = false;
+      lShard.mCompletedTfIds.clear();
+    }
+    mCompletedTfs.flush();
 
     // start the merger thread
     mStfMergerThread = std::thread(&TfBuilderInput::StfMergerThread, this);
@@ -149,7 +160,7 @@ bool TfBuilderInput::start(std::shared_ptr<ConsulTfBuilder> pConfig)
   assert(mInputThreads.size() == 0);
 
   for (auto &[lSocketIdx, lStfSenderId] : lConnResult.connection_map()) {
-    mInputThreads.try_emplace(lStfSenderId, std::thread(&TfBuilderInput::DataHandlerThread, this, lSocketIdx));
+    mInputThreads.try_emplace(lStfSenderId, std::thread(&TfBuilderInput::DataHandlerThread, this, lSocketIdx, lStfSenderId));
   }
 
   // finally start accepting TimeFrames
@@ -202,17 +213,20 @@ void TfBuilderInput::stop(std::shared_ptr<ConsulTfBuilder> pConfig)
   // Make sure the merger stopped
   {
     DDLOG(fair::Severity::INFO) << "TfBuilderInput::stop: Stopping the Stf merger thread.";
-    {
-      std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
-      mStfMergeQueue.clear();
-      DDLOG(fair::Severity::INFO) << "TfBuilderInput::stop: Merger queue emptied.";
-      mStfMergerCondition.notify_all();
-    }
-
     if (mStfMergerThread.joinable()) {
       mStfMergerThread.join();
       mStfMergerThread = {};
     }
+
+    // release STFs of TFs that were not built
+    std::size_t lNumUnfinished = mCompletedTfs.size();
+    mCompletedTfs.flush();
+    for (auto &lShard : mAssemblyTable) {
+      std::scoped_lock lLock(lShard.mLock);
+      lNumUnfinished += lShard.mSlots.size();
+      lShard.mSlots.clear();
+    }
+    DDLOG(fair::Severity::INFO) << "TfBuilderInput::stop: Assembly table emptied. Unfinished TFs: " << lNumUnfinished;
   }
   DDLOG(fair::Severity::DEBUG) << "TfBuilderInput::stop: Merger thread stopped.";
 
@@ -226,7 +240,7 @@ void TfBuilderInput::stop(std::shared_ptr<ConsulTfBuilder> pConfig)
 
 
 /// Receiving thread
-void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex)
+void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex, const std::string pStfSenderId)
 {
   DDLOG(fair::Severity::INFO) << "Starting input thread for StfSender[" << pFlpIndex << "]...";
 
@@ -252,89 +266,176 @@ void TfBuilderInput::DataHandlerThread(const std::uint32_t pFlpIndex)
       DDLOG(fair::Severity::DEBUG) << "Received Stf from flp " << pFlpIndex << " with id " << lTfId << ", total: " << sNumStfs;
     }
 
-    {
-      // Push the STF into the merger queue
-      std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
-      mStfMergeQueue.emplace(std::make_pair(lTfId, std::move(lStf)));
-
-      // Notify the Merger if enough inputs are collected
-      // NOW:  Merge STFs if exactly |FLP| chunks have been received
-      //       or a next TF started arriving (STFs from previous delayed or not
-      //       available)
-      // TODO: Find out exactly how many STFs is arriving.
-      if (mStfMergeQueue.size() >= mNumStfSenders){
-        lQueueLock.unlock();
-        mStfMergerCondition.notify_one();
-      }
+    const auto lStfSize = lStf->getDataSize();
+    mRpc->recordStfReceived(pStfSenderId, lTfId, lStfSize);
+    if (!addStf(pFlpIndex, std::move(lStf))) {
+      mRpc->recordStfDropped(pStfSenderId, lTfId, lStfSize);
     }
   }
 
   DDLOG(fair::Severity::INFO) << "Exiting input thread[" << pFlpIndex << "]...";
 }
 
-/// STF->TF Merger thread
-void TfBuilderInput::StfMergerThread()
+/// Insert the STF into the assembly table. Complete TFs are handed to the merger thread
+/// Returns false if the STF was dropped
+bool TfBuilderInput::addStf(const std::uint32_t pFlpIndex, std::unique_ptr<SubTimeFrame> &&pStf)
 {
-  using namespace std::chrono_literals;
-
-  while (mState == RUNNING) {
-
-    std::unique_lock<std::mutex> lQueueLock(mStfMergerQueueLock);
-
-    if (mStfMergeQueue.empty()) {
-      // wait for the signal
-      if (std::cv_status::timeout == mStfMergerCondition.wait_for(lQueueLock, 500ms)) {
-        continue; // should exit?
+  const TimeFrameIdType lTfId = pStf->header().mId;
+  auto &lShard = mAssemblyTable[lTfId % sNumAssemblyShards];
+
+  std::unique_lock<std::mutex> lLock(lShard.mLock);
+
+  auto lSlotIter = lShard.mSlots.find(lTfId);
+  if (lSlotIter == lShard.mSlots.end()) {
+    // STF of a TF that was already forwarded or dropped
+    if (lShard.mAnyExpired && lTfId <= lShard.mLastExpiredTfId) {
+      lLock.unlock();
+      static std::atomic_uint64_t sNumLateStfs = 0;
+      if (++sNumLateStfs % 100 == 1) {
+        DDLOG(fair::Severity::WARN) << "Dropping late STF from StfSender[" << pFlpIndex << "] for expired TF " << lTfId
+                                    << ". Total late STFs: " << sNumLateStfs;
       }
+      return false;
     }
 
-    // check for spurious signaling
-    if (mStfMergeQueue.empty()) {
-      continue;
+    // STF of a TF that was already completed (late or duplicate)
+    if (lShard.isCompleted(lTfId)) {
+      lLock.unlock();
+      static std::atomic_uint64_t sNumLateCompleteStfs = 0;
+      if (++sNumLateCompleteStfs % 100 == 1) {
+        DDLOG(fair::Severity::WARN) << "Dropping late STF from StfSender[" << pFlpIndex << "] for completed TF " << lTfId
+                                    << ". Total late STFs: " << sNumLateCompleteStfs;
+      }
+      return false;
     }
 
-    // check the merge queue for partial TFs first
-    const SubTimeFrameIdType lTfId = mStfMergeQueue.begin()->first;
+    lSlotIter = lShard.mSlots.emplace(lTfId, TfAssemblySlot()).first;
 
-    // Case 1: a full TF can be merged
-    if (mStfMergeQueue.count(lTfId) == mNumStfSenders) {
+    auto &lNewSlot = lSlotIter->second;
+    lNewSlot.mTfId = lTfId;
+    lNewSlot.mStfs.resize(mNumStfSenders);
+    lNewSlot.mReceived.resize(mNumStfSenders, false);
+    lNewSlot.mFirstArrival = std::chrono::steady_clock::now();
+  }
 
-      auto lStfRange = mStfMergeQueue.equal_range(lTfId);
-      assert(std::distance(lStfRange.first, lStfRange.second) == mNumStfSenders);
+  auto &lSlot = lSlotIter->second;
 
-      auto lStfCount = 1UL; // start from the first element
-      std::unique_ptr<SubTimeFrame> lTf = std::move(lStfRange.first->second);
+  if (lSlot.mReceived[pFlpIndex]) {
+    DDLOG(fair::Severity::ERROR) << "Duplicate STF from StfSender[" << pFlpIndex << "] for TF " << lTfId << ". Dropping.";
+    return false;
+  }
 
-      for (auto lStfIter = std::next(lStfRange.first); lStfIter != lStfRange.second; ++lStfIter) {
-        // Add them all up
-        lTf->mergeStf(std::move(lStfIter->second));
-        lStfCount++;
-      }
+  lSlot.mStfs[pFlpIndex] = std::move(pStf);
+  lSlot.mReceived[pFlpIndex] = true;
+  lSlot.mNumReceived++;
+
+  if (lSlot.mNumReceived == mNumStfSenders) {
+    TfAssemblySlot lCompleteSlot = std::move(lSlot);
+    lShard.mSlots.erase(lSlotIter);
+    lShard.addCompleted(lTfId);
+    lLock.unlock();
+
+    mCompletedTfs.push(std::move(lCompleteSlot));
+  }
+
+  return true;
+}
+
+/// Remove TFs that did not complete within the assembly timeout
+void TfBuilderInput::expireIncompleteTfs()
+{
+  const auto lDeadline = std::chrono::steady_clock::now() - mAssemblyCfg.mTimeout;
+  std::vector<TfAssemblySlot> lExpired;
 
-      if (lStfCount < mNumStfSenders) {
-        DDLOG(fair::Severity::WARN) << "STF MergerThread: merging incomplete TF[" << lTf->header().mId << "]: contains "
-                  << lStfCount << " instead of " << mNumStfSenders << " SubTimeFrames";
+  for (auto &lShard : mAssemblyTable) {
+    std::scoped_lock lLock(lShard.mLock);
+
+    for (auto lIter = lShard.mSlots.begin(); lIter != lShard.mSlots.end(); ) {
+      if (lIter->second.mFirstArrival > lDeadline) {
+        ++lIter;
+        continue;
       }
 
-      // remove consumed STFs from the merge queue
-      mStfMergeQueue.erase(lStfRange.first, lStfRange.second);
+      lShard.mLastExpiredTfId = lShard.mAnyExpired ?
+        std::max(lShard.mLastExpiredTfId, lIter->first) : lIter->first;
+      lShard.mAnyExpired = true;
+
+      lExpired.emplace_back(std::move(lIter->second));
+      lIter = lShard.mSlots.erase(lIter);
+    }
+  }
+
+  for (auto &lSlot : lExpired) {
+    static std::uint64_t sNumIncompleteTfs = 0;
+    sNumIncompleteTfs++;
 
-      // account the size of received TF
-      mRpc->recordTfBuilt(*lTf);
+    DDLOG(fair::Severity::WARN) << "TF[" << lSlot.mTfId << "] incomplete after " << mAssemblyCfg.mTimeout.count()
+                                << " ms: received " << lSlot.mNumReceived << " of " << mNumStfSenders
+                                << " SubTimeFrames. " << (mAssemblyCfg.mDropIncomplete ? "Dropping." : "Forwarding.")
+                                << " Total incomplete TFs: " << sNumIncompleteTfs;
 
-      // Queue out the TF for consumption
-      mDevice.queue(mOutStage, std::move(lTf));
+    if (!mAssemblyCfg.mDropIncomplete) {
+      mergeAndQueueTf(std::move(lSlot));
+    } else {
+      mRpc->recordTfDropped(lSlot.mTfId);
     }
-    // else if (mStfMergeQueue.size() > (50 * mNumStfSenders)) {
-    //   // FIXME: for now, discard incomplete TFs
-    //   DDLOG(fair::Severity::WARN) << "Unbounded merge queue size: " << mStfMergeQueue.size();
+  }
+}
 
-    //   const auto lDroppedStfs = mStfMergeQueue.count(lTfId);
+void TfBuilderInput::mergeAndQueueTf(TfAssemblySlot &&pSlot)
+{
+  std::unique_ptr<SubTimeFrame> lTf;
 
-    //   mStfMergeQueue.erase(lTfId);
+  for (auto &lStf : pSlot.mStfs) {
+    if (!lStf) {
+      continue;
+    }
+
+    if (!lTf) {
+      lTf = std::move(lStf);
+    } else {
+      lTf->mergeStf(std::move(lStf));
+    }
+  }
 
-    //   DDLOG(fair::Severity::WARN) << "Dropping oldest incomplete TF... (" << lDroppedStfs << " STFs)";
-    // }
+  if (!lTf) {
+    return;
+  }
+
+  // account the size of received TF
+  mRpc->recordTfBuilt(*lTf);
+
+  // Queue out the TF for consumption
+  const auto lTfId = lTf->header().mId;
+  if (!mDevice.queue(mOutStage, std::move(lTf))) {
+    // rejected by the pipeline memory budget: release the buffer space
+    mRpc->recordTfForwarded(lTfId);
+  }
+}
+
+/// STF->TF Merger thread
+void TfBuilderInput::StfMergerThread()
+{
+  using namespace std::chrono_literals;
+
+  // check for expired TFs a few times per timeout period
+  const auto lExpireCheckInterval = std::clamp(
+    std::chrono::duration_cast<std::chrono::milliseconds>(mAssemblyCfg.mTimeout / 4),
+    std::chrono::milliseconds(10), std::chrono::milliseconds(500));
+  auto lLastExpireCheck = std::chrono::steady_clock::now();
+
+  while (mState == RUNNING) {
+    TfAssemblySlot lSlot;
+
+    if (mCompletedTfs.pop_wait_for(lSlot, 100ms)) {
+      mergeAndQueueTf(std::move(lSlot));
+    }
+
+    const auto lNow = std::chrono::steady_clock::now();
+    if (lNow - lLastExpireCheck >= lExpireCheckInterval) {
+      expireIncompleteTfs();
+      lLastExpireCheck = lNow;
+    }
   }
 
   DDLOG(fair::Severity::INFO) << "Exiting STF merger thread...";
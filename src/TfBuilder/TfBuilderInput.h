@@ -22,6 +22,10 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#include <array>
+#include <unordered_map>
+#include <chrono>
 
 #include <condition_variable>
 #include <mutex>
@@ -35,13 +39,25 @@ namespace DataDistribution
 class TfBuilderDevice;
 class TfBuilderRpcImpl;
 
+/// TimeFrame assembly parameters
+struct TfAssemblyConfig {
+  /// Time to wait for all STFs of a TF, measured from the arrival of the first one
+  std::chrono::milliseconds mTimeout = std::chrono::milliseconds(5000);
+  /// Drop incomplete TFs instead of forwarding them
+  bool mDropIncomplete = false;
+  /// FairMQ transport of the StfSender input channels (zeromq, shmem, ofi)
+  std::string mTransport = "zeromq";
+};
+
 class TfBuilderInput
 {
  public:
   TfBuilderInput() = delete;
-  TfBuilderInput(TfBuilderDevice& pStfBuilderDev, std::shared_ptr<TfBuilderRpcImpl> pRpc, unsigned pOutStage)
+  TfBuilderInput(TfBuilderDevice& pStfBuilderDev, std::shared_ptr<TfBuilderRpcImpl> pRpc, unsigned pOutStage,
+                 const TfAssemblyConfig &pAssemblyCfg = TfAssemblyConfig())
     : mDevice(pStfBuilderDev),
       mRpc(pRpc),
+      mAssemblyCfg(pAssemblyCfg),
       mOutStage(pOutStage)
   {
   }
@@ -49,13 +65,56 @@ class TfBuilderInput
   bool start(std::shared_ptr<ConsulTfBuilder> pConfig);
   void stop(std::shared_ptr<ConsulTfBuilder> pConfig);
 
-  void DataHandlerThread(const std::uint32_t pFlpIndex);
+  void DataHandlerThread(const std::uint32_t pFlpIndex, const std::string pStfSenderId);
   void StfMergerThread();
 
  private:
   enum RunState { CONFIGURING, RUNNING, TERMINATED };
   volatile RunState mState = CONFIGURING;
 
+  /// STFs of one TimeFrame, indexed by the input (StfSender) index
+  struct TfAssemblySlot {
+    TimeFrameIdType mTfId = 0;
+    std::vector<std::unique_ptr<SubTimeFrame>> mStfs;
+    std::vector<bool> mReceived;  // completeness bitmap
+    std::uint32_t mNumReceived = 0;
+    std::chrono::steady_clock::time_point mFirstArrival;
+  };
+
+  static constexpr std::size_t sCompletedTfHistory = 256; // per shard
+
+  /// Part of the assembly table. TFs are distributed over shards by id to reduce contention
+  struct TfAssemblyShard {
+    std::mutex mLock;
+    std::unordered_map<TimeFrameIdType, TfAssemblySlot> mSlots;
+    bool mAnyExpired = false;
+    TimeFrameIdType mLastExpiredTfId = 0;
+    /// Recently completed TFs (bounded). Older ids are considered completed when the history is full.
+    std::set<TimeFrameIdType> mCompletedTfIds;
+
+    bool isCompleted(const TimeFrameIdType pTfId) const
+    {
+      if (mCompletedTfIds.size() < sCompletedTfHistory) {
+        return mCompletedTfIds.count(pTfId) > 0;
+      }
+      return pTfId < *mCompletedTfIds.begin() || mCompletedTfIds.count(pTfId) > 0;
+    }
+
+    void addCompleted(const TimeFrameIdType pTfId)
+    {
+      mCompletedTfIds.insert(pTfId);
+      if (mCompletedTfIds.size() > sCompletedTfHistory) {
+        mCompletedTfIds.erase(mCompletedTfIds.begin());
+      }
+    }
+  };
+
+  static constexpr std::size_t sNumAssemblyShards = 16;
+
+  bool addStf(const std::uint32_t pFlpIndex, std::unique_ptr<SubTimeFrame> &&pStf);
+  void expireIncompleteTfs();
+  void mergeAndQueueTf(TfAssemblySlot &&pSlot);
+
   /// Main TimeFrameBuilder O2 device
   TfBuilderDevice& mDevice;
 
@@ -71,11 +130,13 @@ class TfBuilderInput
   /// Threads for input channels (per FLP)
   std::map<std::string, std::thread> mInputThreads;
 
+  /// TF assembly table
+  TfAssemblyConfig mAssemblyCfg;
+  std::array<TfAssemblyShard, sNumAssemblyShards> mAssemblyTable;
+
   /// STF Merger
   std::thread mStfMergerThread;
-  std::mutex mStfMergerQueueLock;
-  std::condition_variable mStfMergerCondition;
-  std::multimap<TimeFrameIdType, std::unique_ptr<SubTimeFrame>> mStfMergeQueue;
+  ConcurrentFifo<TfAssemblySlot> mCompletedTfs;
 
   /// Output pipeline stage
   unsigned mOutStage;
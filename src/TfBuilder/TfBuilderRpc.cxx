@@ -18,6 +18,7 @@
 
 #include <condition_variable>
 #include <stdexcept>
+#include <algorithm>
 
 namespace o2
 {
@@ -38,9 +39,12 @@ void TfBuilderRpcImpl::initDiscovery(const std::string pRpcSrvBindIp, int &lReal
 }
 
 
-bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize)
+bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize, const std::uint32_t pMaxConcurrentStfSenders,
+                             const bool pStfCreditFlowControl, const std::chrono::milliseconds pStfTransferTimeout)
 {
   mCurrentTfBufferSize = pBufferSize;
+  // a requested STF that does not arrive before its TF times out frees the slot
+  mStfTransferSlots.start(pMaxConcurrentStfSenders, pStfTransferTimeout);
 
   // Interact with the scheduler
   if (!mTfSchedulerRpcClient.start(mDiscoveryConfig)) {
@@ -52,6 +56,23 @@ bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize)
     return false;
   }
 
+  // the buffer is shared equally by all StfSenders
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+    mStfSenderCredits.clear();
+    mTfStfCredits.clear();
+    mStfCreditWindow = 0;
+
+    if (pStfCreditFlowControl && mStfSenderRpcClients.size() > 0) {
+      mStfCreditWindow = pBufferSize / mStfSenderRpcClients.size();
+      for (const auto &lClient : mStfSenderRpcClients) {
+        mStfSenderCredits[lClient.first] = StfSenderCredit();
+      }
+      DDLOG(fair::Severity::INFO) << "STF credit flow control enabled. Credit window per StfSender: "
+                                  << (mStfCreditWindow >> 20) << " MiB";
+    }
+  }
+
   mTfBuildRequests = std::make_unique<ConcurrentFifo<TfBuildingInformation>>();
 
   // start the update sending thread
@@ -61,6 +82,11 @@ bool TfBuilderRpcImpl::start(const std::uint64_t pBufferSize)
   // start the stf requester thread
   mStfRequestThread = std::thread(&TfBuilderRpcImpl::StfRequestThread, this);
 
+  // start the credit update thread
+  if (mStfCreditWindow > 0) {
+    mStfCreditThread = std::thread(&TfBuilderRpcImpl::StfCreditThread, this);
+  }
+
   return true;
 }
 
@@ -68,11 +94,17 @@ void TfBuilderRpcImpl::stop()
 {
   stopAcceptingTfs();
   mRunning = false;
+  mStfTransferSlots.stop();
+  mStfCreditCondition.notify_all();
 
   if (mUpdateThread.joinable()) {
     mUpdateThread.join();
   }
 
+  if (mStfCreditThread.joinable()) {
+    mStfCreditThread.join();
+  }
+
   {
     if (mTfBuildRequests) {
       mTfBuildRequests->stop();
@@ -93,6 +125,15 @@ void TfBuilderRpcImpl::stop()
   mCurrentTfBufferSize = 0;
   mNumBufferedTfs = 0;
   mLastBuiltTfId = 0;
+  mLastBuiltTfSize = 0;
+  mBuiltTfIds.clear();
+
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+    mStfSenderCredits.clear();
+    mTfStfCredits.clear();
+    mStfCreditWindow = 0;
+  }
 }
 
 // make sure these are sent immediately
@@ -137,9 +178,13 @@ void TfBuilderRpcImpl::StfRequestThread()
   TfBuildingInformation mTfInfo;
 
   StfDataRequestMessage lStfRequest;
-  StfDataResponse lStfResponse;
   lStfRequest.set_tf_builder_id(lTfBuilderId);
 
+  // all requests for a TF are issued at once (or paced), responses are collected as they arrive
+  grpc::CompletionQueue lCompletionQueue;
+  std::vector<std::unique_ptr<StfRequestCall>> lStfRequests;
+  std::vector<std::string> lStfSenderIds;
+
   while (mRunning) {
     if (!mTfBuildRequests->pop(mTfInfo)) {
       continue; // mRunning will change to false
@@ -148,38 +193,297 @@ void TfBuilderRpcImpl::StfRequestThread()
     {
       static std::uint64_t sNumTfRequests = 0;
       if (++sNumTfRequests % 50 == 0) {
+        const auto [lLatMin, lLatMax] = mStfRequestLatencySamples.MinMax();
         DDLOG(fair::Severity::INFO) << "Requesting SubTimeFrames with id: " << mTfInfo.tf_id()
-                   << ", total size: " << mTfInfo.tf_size() << ". Total requests: " << sNumTfRequests;
+                   << ", total size: " << mTfInfo.tf_size() << ". Total requests: " << sNumTfRequests
+                   << ". StfDataRequest latency [ms] mean: " << mStfRequestLatencySamples.Mean()
+                   << ", min: " << lLatMin << ", max: " << lLatMax
+                   << ". TF request duration [ms] mean: " << mTfRequestDurationSamples.Mean();
       }
     }
 
-    for (auto &lStfDataIter : mTfInfo.stf_size_map()) {
-      const auto &lStfSenderId = lStfDataIter.first;
-      // const auto &lStfSize = lStfDataIter.second;
-      lStfRequest.set_stf_id(mTfInfo.tf_id());
+    const auto lTfRequestStart = std::chrono::steady_clock::now();
+    lStfRequest.set_stf_id(mTfInfo.tf_id());
+    lStfRequests.clear();
+    std::size_t lNumResponses = 0;
 
-      grpc::Status lStatus = StfSenderRpcClients()[lStfSenderId]->StfDataRequest(lStfRequest, lStfResponse);
-      if (!lStatus.ok()) {
+    // completed request: failed requests free their STF transfer slot
+    const auto lHandleResponse = [&](void *pTag, const bool pOk) {
+      lNumResponses++;
+
+      const auto &lCall = *static_cast<StfRequestCall*>(pTag);
+      mStfRequestLatencySamples.Fill(
+        std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - lCall.mStartTime).count());
+
+      if (!pOk || !lCall.mStatus.ok()) {
         // gRPC problem... continue asking for other STFs
-        DDLOG(fair::Severity::WARNING) << "StfSender gRPC connection problem. Code: " <<lStatus.error_code()
-                      << ", message: " << lStatus.error_message();
-        continue;
+        DDLOG(fair::Severity::WARNING) << "StfSender " << lCall.mStfSenderId
+                      << " gRPC connection problem. Code: " << lCall.mStatus.error_code()
+                      << ", message: " << lCall.mStatus.error_message();
+        mStfTransferSlots.release(lCall.mTfId, lCall.mStfSenderId);
+        return;
+      }
+
+      if (lCall.mResponse.status() != StfDataResponse::OK) {
+        DDLOG(fair::Severity::WARNING) << "StfSender " << lCall.mStfSenderId
+                      << " cannot send data. Reason: " << StfDataResponse_StfDataStatus_Name(lCall.mResponse.status());
+        mStfTransferSlots.release(lCall.mTfId, lCall.mStfSenderId);
+      }
+    };
+
+    // collect already completed requests without blocking
+    const auto lPollResponses = [&]() {
+      void *lTag = nullptr;
+      bool lOk = false;
+
+      while (lNumResponses < lStfRequests.size() &&
+        lCompletionQueue.AsyncNext(&lTag, &lOk, std::chrono::system_clock::now()) == grpc::CompletionQueue::GOT_EVENT) {
+        lHandleResponse(lTag, lOk);
       }
+    };
 
-      if (lStfResponse.status() != StfDataResponse::OK) {
-        DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId
-                      << " cannot send data. Reason: " << StfDataResponse_StfDataStatus_Name(lStfResponse.status());
+    // stagger the request order: TfBuilders building consecutive TFs start with different StfSenders
+    lStfSenderIds.clear();
+    for (auto &lStfDataIter : mTfInfo.stf_size_map()) {
+      lStfSenderIds.push_back(lStfDataIter.first);
+    }
+    std::sort(lStfSenderIds.begin(), lStfSenderIds.end());
+    if (!lStfSenderIds.empty()) {
+      std::rotate(lStfSenderIds.begin(), lStfSenderIds.begin() + (mTfInfo.tf_id() % lStfSenderIds.size()),
+        lStfSenderIds.end());
+    }
+
+    for (const auto &lStfSenderId : lStfSenderIds) {
+      if (StfSenderRpcClients().count(lStfSenderId) == 0) {
+        DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId << " gRPC client is not connected.";
         continue;
       }
+
+      // limit the number of StfSenders sending concurrently. Completed requests are collected while
+      // waiting, so a failed request frees its slot immediately. Slots of STFs that never arrive
+      // are freed on their deadline: the limit is never exceeded.
+      const auto lSlotWaitStart = std::chrono::steady_clock::now();
+      bool lSlotWarned = false;
+      while (!mStfTransferSlots.acquire(mTfInfo.tf_id(), lStfSenderId, sStfTransferSlotPoll)) {
+        if (!mRunning) {
+          break;
+        }
+        lPollResponses();
+
+        if (!lSlotWarned && (std::chrono::steady_clock::now() - lSlotWaitStart) >= sStfTransferSlotWarnTime) {
+          lSlotWarned = true;
+          static std::uint64_t sNumSlotWaits = 0;
+          if (++sNumSlotWaits % 100 == 1) {
+            DDLOG(fair::Severity::WARNING) << "Waiting for a STF transfer slot longer than "
+                                           << sStfTransferSlotWarnTime.count() << " ms. In transfer: "
+                                           << mStfTransferSlots.inTransfer() << ", expired slots: "
+                                           << mStfTransferSlots.numExpired() << ", total waits: " << sNumSlotWaits;
+          }
+        }
+      }
+
+      if (!mRunning) {
+        break;
+      }
+
+      // pass the current credit with the request
+      if (!getStfCredit(lStfSenderId, *lStfRequest.mutable_credit())) {
+        lStfRequest.clear_credit();
+      }
+
+      auto &lCall = lStfRequests.emplace_back(std::make_unique<StfRequestCall>());
+      lCall->mTfId = mTfInfo.tf_id();
+      lCall->mStfSenderId = lStfSenderId;
+      lCall->mContext.set_deadline(std::chrono::system_clock::now() + sStfRequestTimeout);
+      lCall->mStartTime = std::chrono::steady_clock::now();
+
+      lCall->mReader = StfSenderRpcClients()[lStfSenderId]->AsyncStfDataRequest(lCall->mContext, lStfRequest, lCompletionQueue);
+      lCall->mReader->Finish(&lCall->mResponse, &lCall->mStatus, lCall.get());
     }
+
+    // gather the remaining responses
+    while (lNumResponses < lStfRequests.size()) {
+      void *lTag = nullptr;
+      bool lOk = false;
+
+      if (!lCompletionQueue.Next(&lTag, &lOk)) {
+        break; // queue is shutting down
+      }
+
+      lHandleResponse(lTag, lOk);
+    }
+
+    mTfRequestDurationSamples.Fill(
+      std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - lTfRequestStart).count());
   }
 
+  // drain the completion queue
+  lCompletionQueue.Shutdown();
+  {
+    void *lTag = nullptr;
+    bool lOk = false;
+    while (lCompletionQueue.Next(&lTag, &lOk)) { }
+  }
+  lStfRequests.clear();
+
   // send disconnect update
   assert (!mRunning);
 
   DDLOG(fair::Severity::DEBUG) << "Exiting Stf requesting thread...";
 }
 
+void TfBuilderRpcImpl::recordStfReceived(const std::string &pStfSenderId, const std::uint64_t pTfId,
+                                         const std::uint64_t pStfSize)
+{
+  // STFs pushed without a request (static TF assignment) do not hold a slot
+  mStfTransferSlots.release(pTfId, pStfSenderId);
+
+  std::scoped_lock lLock(mStfCreditLock);
+  if (mStfCreditWindow > 0) {
+    mTfStfCredits[pTfId].emplace_back(pStfSenderId, pStfSize);
+  }
+}
+
+void TfBuilderRpcImpl::recordStfDropped(const std::string &pStfSenderId, const std::uint64_t pTfId,
+                                        const std::uint64_t pStfSize)
+{
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+    if (mStfCreditWindow == 0) {
+      return;
+    }
+
+    auto lTfIter = mTfStfCredits.find(pTfId);
+    if (lTfIter != mTfStfCredits.end()) {
+      auto &lStfCredits = lTfIter->second;
+      auto lStfIter = std::find(lStfCredits.begin(), lStfCredits.end(), std::make_pair(pStfSenderId, pStfSize));
+      if (lStfIter != lStfCredits.end()) {
+        lStfCredits.erase(lStfIter);
+      }
+      if (lStfCredits.empty()) {
+        mTfStfCredits.erase(lTfIter);
+      }
+    }
+
+    auto lCreditIter = mStfSenderCredits.find(pStfSenderId);
+    if (lCreditIter != mStfSenderCredits.end()) {
+      lCreditIter->second.mReturnedBytes += pStfSize;
+    }
+  }
+  mStfCreditCondition.notify_one();
+}
+
+void TfBuilderRpcImpl::recordTfDropped(const std::uint64_t pTfId)
+{
+  mStfTransferSlots.releaseTf(pTfId);
+  returnTfCredits(pTfId);
+
+  {
+    // the TF will not be built: report it to release the reservation
+    std::scoped_lock lLock(mTfIdSizesLock);
+    addReportedTfId(pTfId);
+  }
+  mUpdateCondition.notify_one();
+}
+
+void TfBuilderRpcImpl::addReportedTfId(const std::uint64_t pTfId)
+{
+  mBuiltTfIds.push_back(pTfId);
+  if (mBuiltTfIds.size() > sMaxReportedTfIds) {
+    mBuiltTfIds.pop_front();
+  }
+}
+
+void TfBuilderRpcImpl::returnTfCredits(const std::uint64_t pTfId)
+{
+  {
+    std::scoped_lock lLock(mStfCreditLock);
+
+    auto lTfIter = mTfStfCredits.find(pTfId);
+    if (lTfIter == mTfStfCredits.end()) {
+      return;
+    }
+
+    for (const auto &[lStfSenderId, lStfSize] : lTfIter->second) {
+      auto lCreditIter = mStfSenderCredits.find(lStfSenderId);
+      if (lCreditIter != mStfSenderCredits.end()) {
+        lCreditIter->second.mReturnedBytes += lStfSize;
+      }
+    }
+    mTfStfCredits.erase(lTfIter);
+  }
+  mStfCreditCondition.notify_one();
+}
+
+bool TfBuilderRpcImpl::getStfCredit(const std::string &pStfSenderId, StfDataCredit &pCredit /*out*/)
+{
+  std::scoped_lock lLock(mStfCreditLock);
+
+  auto lCreditIter = mStfSenderCredits.find(pStfSenderId);
+  if (mStfCreditWindow == 0 || lCreditIter == mStfSenderCredits.end()) {
+    return false;
+  }
+
+  pCredit.set_tf_builder_id(mDiscoveryConfig->status().info().process_id());
+  pCredit.set_window(mStfCreditWindow);
+  pCredit.set_returned_bytes(lCreditIter->second.mReturnedBytes);
+  return true;
+}
+
+void TfBuilderRpcImpl::StfCreditThread()
+{
+  DDLOG(fair::Severity::DEBUG) << "Starting STF credit update thread...";
+
+  StfDataCredit lCredit;
+  lCredit.set_tf_builder_id(mDiscoveryConfig->status().info().process_id());
+  StfCreditList lUpdates;
+  auto lLastRepublish = std::chrono::steady_clock::now();
+
+  while (mRunning) {
+    lUpdates.clear();
+    {
+      std::unique_lock lLock(mStfCreditLock);
+      mStfCreditCondition.wait_for(lLock, sStfCreditRepublishInterval);
+
+      // republish all credits periodically: updates are lost while StfSenders are connecting
+      const auto lNow = std::chrono::steady_clock::now();
+      const bool lRepublish = (lNow - lLastRepublish) >= sStfCreditRepublishInterval;
+      if (lRepublish) {
+        lLastRepublish = lNow;
+      }
+
+      lCredit.set_window(mStfCreditWindow);
+      for (auto &[lStfSenderId, lSenderCredit] : mStfSenderCredits) {
+        if (lRepublish || lSenderCredit.mReturnedBytes != lSenderCredit.mPublishedBytes) {
+          lUpdates.emplace_back(lStfSenderId, lSenderCredit.mReturnedBytes);
+          lSenderCredit.mPublishedBytes = lSenderCredit.mReturnedBytes;
+        }
+      }
+    }
+
+    for (const auto &[lStfSenderId, lReturnedBytes] : lUpdates) {
+      if (!mRunning) {
+        break;
+      }
+
+      lCredit.set_returned_bytes(lReturnedBytes);
+      StatusResponse lResponse;
+      const auto lStatus = StfSenderRpcClients()[lStfSenderId]->StfDataCreditUpdate(lCredit, lResponse);
+
+      if (!lStatus.ok()) {
+        static std::uint64_t sNumCreditErrors = 0;
+        if (++sNumCreditErrors % 100 == 1) {
+          DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId << " credit update failed. Code: "
+                                         << lStatus.error_code() << ", message: " << lStatus.error_message()
+                                         << ", total errors: " << sNumCreditErrors;
+        }
+      }
+    }
+  }
+
+  DDLOG(fair::Severity::DEBUG) << "Exiting STF credit update thread...";
+}
+
 bool TfBuilderRpcImpl::sendTfBuilderUpdate()
 {
   TfBuilderUpdateMessage lUpdate;
@@ -188,14 +492,22 @@ bool TfBuilderRpcImpl::sendTfBuilderUpdate()
   *lUpdate.mutable_info() = lStatus.info();
   *lUpdate.mutable_partition() = lStatus.partition();
 
+  std::size_t lNumReportedTfIds = 0;
+
   if (mAcceptingTfs) {
     lUpdate.set_state(TfBuilderUpdateMessage::RUNNING);
 
     std::scoped_lock lLock(mTfIdSizesLock);
 
     lUpdate.set_last_built_tf_id(mLastBuiltTfId);
+    lUpdate.set_last_built_tf_size(mLastBuiltTfSize);
     lUpdate.set_free_memory(mCurrentTfBufferSize);
     lUpdate.set_num_buffered_tfs(mNumBufferedTfs);
+
+    for (const auto lTfId : mBuiltTfIds) {
+      lUpdate.add_built_tf_ids(lTfId);
+    }
+    lNumReportedTfIds = mBuiltTfIds.size();
   } else {
     lUpdate.set_state(TfBuilderUpdateMessage::NOT_RUNNING);
 
@@ -213,12 +525,20 @@ bool TfBuilderRpcImpl::sendTfBuilderUpdate()
   auto lRet = mTfSchedulerRpcClient.TfBuilderUpdate(lUpdate);
   if (!lRet) {
     DDLOG(fair::Severity::WARN) << "Sending TfBuilder status update failed.";
+  } else if (lNumReportedTfIds > 0) {
+    // reported ids are removed only after a successful update (new ids are appended at the back)
+    std::scoped_lock lLock(mTfIdSizesLock);
+    mBuiltTfIds.erase(mBuiltTfIds.begin(),
+      mBuiltTfIds.begin() + std::min(lNumReportedTfIds, mBuiltTfIds.size()));
   }
   return lRet;
 }
 
 bool TfBuilderRpcImpl::recordTfBuilt(const SubTimeFrame &pTf)
 {
+  // incomplete TFs are built on timeout: free the slots of the missing STFs
+  mStfTransferSlots.releaseTf(pTf.header().mId);
+
   if (!mRunning) {
     return false;
   }
@@ -240,8 +560,12 @@ bool TfBuilderRpcImpl::recordTfBuilt(const SubTimeFrame &pTf)
     mTfIdSizes[pTf.header().mId] = lTfSize;
 
     mNumBufferedTfs++;
+    addReportedTfId(pTf.header().mId);
 
-    mLastBuiltTfId = std::max(mLastBuiltTfId, pTf.header().mId);
+    if (pTf.header().mId >= mLastBuiltTfId) {
+      mLastBuiltTfId = pTf.header().mId;
+      mLastBuiltTfSize = lTfSize;
+    }
   }
   mUpdateCondition.notify_one();
 
@@ -254,6 +578,9 @@ bool TfBuilderRpcImpl::recordTfForwarded(const std::uint64_t &pTfId)
     return false;
   }
 
+  // the TF left our buffer: StfSenders can send more data
+  returnTfCredits(pTfId);
+
   {
     std::scoped_lock lLock(mTfIdSizesLock);
 
@@ -24,11 +24,15 @@
 #include <TfSchedulerRpcClient.h>
 #include <StfSenderRpcClient.h>
 
+#include "StfTransferSlots.h"
+
 #include <SubTimeFrameDataModel.h>
 
 #include <ConcurrentQueue.h>
+#include <Utilities.h>
 
 #include <vector>
+#include <deque>
 #include <map>
 #include <thread>
 #include <mutex>
@@ -56,7 +60,9 @@ public:
   TfSchedulerRpcClient& TfSchedRpcCli() { return mTfSchedulerRpcClient; }
 
   void initDiscovery(const std::string pRpcSrvBindIp, int &lRealPort /*[out]*/);
-  bool start(const std::uint64_t pBufferSize);
+  bool start(const std::uint64_t pBufferSize, const std::uint32_t pMaxConcurrentStfSenders = 0,
+             const bool pStfCreditFlowControl = false,
+             const std::chrono::milliseconds pStfTransferTimeout = std::chrono::milliseconds(5000));
   void stop();
 
   void startAcceptingTfs();
@@ -64,9 +70,14 @@ public:
 
   void UpdateSendingThread();
   void StfRequestThread();
+  void StfCreditThread();
 
+  /// STF arrived: the StfSender no longer sends to us. The credit is held until the TF is released
+  void recordStfReceived(const std::string &pStfSenderId, const std::uint64_t pTfId, const std::uint64_t pStfSize);
+  void recordStfDropped(const std::string &pStfSenderId, const std::uint64_t pTfId, const std::uint64_t pStfSize);
   bool recordTfBuilt(const SubTimeFrame &pTf);
   bool recordTfForwarded(const std::uint64_t &pTfId);
+  void recordTfDropped(const std::uint64_t pTfId);
   bool sendTfBuilderUpdate();
 
   bool getNewTfBuildingRequest(TfBuildingInformation &pNewTfRequest)
@@ -78,11 +89,27 @@ public:
 
   StfSenderRpcClientCollection<ConsulTfBuilder>& StfSenderRpcClients() { return mStfSenderRpcClients; }
 
+  /// StfDataRequest statistics (in milliseconds)
+  const RunningSamples<float>& StfRequestLatencySamples() const { return mStfRequestLatencySamples; }
+  const RunningSamples<float>& TfRequestDurationSamples() const { return mTfRequestDurationSamples; }
+
   // rpc BuildTfRequest(TfBuildingInformation) returns (BuildTfResponse) { }
   ::grpc::Status BuildTfRequest(::grpc::ServerContext* context, const TfBuildingInformation* request, BuildTfResponse* response) override;
 
 private:
   static constexpr const std::int64_t sMaxStfRequestsInFlight = 10;
+  static constexpr auto sStfRequestTimeout = std::chrono::seconds(5);
+
+  /// Asynchronous StfDataRequest in flight
+  struct StfRequestCall {
+    std::uint64_t mTfId = 0;
+    std::string mStfSenderId;
+    grpc::ClientContext mContext;
+    StfDataResponse mResponse;
+    grpc::Status mStatus;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<StfDataResponse>> mReader;
+    std::chrono::steady_clock::time_point mStartTime;
+  };
 
   std::atomic_bool mRunning = false;
 
@@ -96,6 +123,31 @@ private:
   // Stf request thread
   // std::condition_variable mNewRequestCondition;
   std::thread mStfRequestThread;
+  RunningSamples<float> mStfRequestLatencySamples;
+  RunningSamples<float> mTfRequestDurationSamples;
+
+  /// Incast avoidance: StfSenders sending to us concurrently, tracked per requested STF
+  static constexpr auto sStfTransferSlotWarnTime = std::chrono::milliseconds(500);
+  static constexpr auto sStfTransferSlotPoll = std::chrono::milliseconds(10);
+  StfTransferSlots mStfTransferSlots;
+
+  /// Credit-based flow control of the StfSender data channels (window 0: disabled)
+  /// Each StfSender may have mStfCreditWindow bytes in our buffer. The credit of a STF is
+  /// returned when its TF is forwarded or dropped.
+  static constexpr auto sStfCreditRepublishInterval = std::chrono::seconds(1);
+  struct StfSenderCredit {
+    std::uint64_t mReturnedBytes = 0;
+    std::uint64_t mPublishedBytes = 0;
+  };
+  using StfCreditList = std::vector<std::pair<std::string, std::uint64_t>>;
+  std::uint64_t mStfCreditWindow = 0;
+  std::mutex mStfCreditLock;
+  std::condition_variable mStfCreditCondition;
+  std::map<std::string, StfSenderCredit> mStfSenderCredits;
+  std::unordered_map<std::uint64_t, StfCreditList> mTfStfCredits;
+  std::thread mStfCreditThread;
+  void returnTfCredits(const std::uint64_t pTfId);
+  bool getStfCredit(const std::string &pStfSenderId, StfDataCredit &pCredit /*out*/);
 
   /// Discovery configuration
   std::shared_ptr<ConsulTfBuilder> mDiscoveryConfig;
@@ -115,7 +167,12 @@ private:
   // Update information for the TfScheduler
   std::atomic_uint64_t mCurrentTfBufferSize = 0;
   std::uint64_t mLastBuiltTfId = 0;
+  std::uint64_t mLastBuiltTfSize = 0;
   std::uint32_t mNumBufferedTfs = 0;
+  /// TFs built or dropped since the last update: the TfScheduler releases their reservations
+  static constexpr std::size_t sMaxReportedTfIds = 4096;
+  std::deque<std::uint64_t> mBuiltTfIds;
+  void addReportedTfId(const std::uint64_t pTfId); // call with mTfIdSizesLock held
 
   /// Queue of TF building requests
   std::unique_ptr<ConcurrentFifo<TfBuildingInformation>> mTfBuildRequests;
@@ -12,6 +12,7 @@
 
 #include <Config.h>
 #include <SubTimeFrameFileSink.h>
+#include <PipelineMemoryBudget.h>
 
 #include <options/FairMQProgOptions.h>
 #include <runFairMQDevice.h>
@@ -32,7 +33,32 @@ void addCustomOptions(bpo::options_description& options)
     "Memory buffer reserved for building and buffering TimeFrames (in MiB).")(
     o2::DataDistribution::TfBuilderDevice::OptionKeyGui,
     bpo::bool_switch()->default_value(false),
-    "Enable GUI.");
+    "Enable GUI.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyTfHeaderRegionSize,
+    bpo::value<std::uint64_t>()->default_value(o2::DataDistribution::TimeFrameBuilder::sDefaultHeaderRegionSize >> 20),
+    "Size of the header memory region used for building TimeFrames (in MiB).")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyHeaderRegionAdaptive,
+    bpo::bool_switch()->default_value(false),
+    "Add header memory regions when the header pool occupancy stays high.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyHeaderRegionMaxSize,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Maximum size of the header memory pool in the adaptive mode (in MiB). If 0, 4 times the initial region size.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyTfAssemblyTimeout,
+    bpo::value<std::uint64_t>()->default_value(5000),
+    "Time to wait for all SubTimeFrames of a TimeFrame, counted from the first received one (in ms).")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyDropIncompleteTfs,
+    bpo::bool_switch()->default_value(false),
+    "Drop TimeFrames that are incomplete after the assembly timeout instead of forwarding them.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyMaxConcurrentStfSenders,
+    bpo::value<std::uint32_t>()->default_value(0),
+    "Maximum number of StfSenders sending SubTimeFrames concurrently, to avoid incast congestion (0 = unlimited). "
+    "The slot of a SubTimeFrame not received within the TF assembly timeout is freed.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyStfCreditFlowControl,
+    bpo::bool_switch()->default_value(false),
+    "Credit-based flow control: StfSenders send within a byte window of the TimeFrame buffer.")(
+    o2::DataDistribution::TfBuilderDevice::OptionKeyStfTransport,
+    bpo::value<std::string>()->default_value("zeromq"),
+    "FairMQ transport of the StfSender channels: zeromq, shmem (co-located, no copy), or ofi (libfabric).");
 
 
   bpo::options_description lTfBuilderDplOptions("TfBuilder DPL options", 120);
@@ -48,6 +74,8 @@ void addCustomOptions(bpo::options_description& options)
 
   // Add options for TF file sink
   options.add(o2::DataDistribution::SubTimeFrameFileSink::getProgramOptions());
+  // Add options for the pipeline memory budget
+  options.add(o2::DataDistribution::PipelineMemoryBudgetConfig::getProgramOptions());
   // Add options for Data Distribution discovery
   options.add(o2::DataDistribution::Config::getProgramOptions(o2::DataDistribution::ProcessType::TfBuilder));
 }
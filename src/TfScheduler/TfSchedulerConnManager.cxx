@@ -19,7 +19,6 @@
 #include <set>
 #include <tuple>
 #include <algorithm>
-#include <future>
 
 namespace o2
 {
@@ -72,6 +71,7 @@ void TfSchedulerConnManager::connectTfBuilder(const TfBuilderConfigStatus &pTfBu
   for (auto &[lStfSenderId, lRpcClient] : mStfSenderRpcClients) {
 
     lParam.set_endpoint(pTfBuilderStatus.sockets().map().at(lEndpointIdx).endpoint());
+    lParam.set_transport(pTfBuilderStatus.sockets().map().at(lEndpointIdx).transport());
 
     ConnectTfBuilderResponse lResponse;
     if(!lRpcClient->ConnectTfBuilderRequest(lParam, lResponse).ok()) {
@@ -188,47 +188,162 @@ void TfSchedulerConnManager::removeTfBuilder(const std::string &pTfBuilderId)
 
 void TfSchedulerConnManager::dropAllStfsAsync(const std::uint64_t pStfId)
 {
+  {
+    std::scoped_lock lLock(mStfDropLock);
+    for (auto &lPending : mStfDropPending) {
+      lPending.push_back(pStfId);
+    }
+  }
+  mStfDropCondition.notify_all();
+}
+
+void TfSchedulerConnManager::StfDropThread(const unsigned pThreadIdx)
+{
+  DDLOG(fair::Severity::DEBUG) << "Starting STF drop thread " << pThreadIdx << "...";
+
+  std::vector<std::uint64_t> lStfIds;
+  StfDataDropMessage lDropRequest;
+  StfDataDropMessage lRetryDropRequest;
+  StfDataDropResponse lDropResponse;
+  // drops not delivered to a StfSender: coalesced with its next batch
+  std::map<std::string, std::vector<std::uint64_t>> lRetryStfIds;
+
+  while (true) {
+    lStfIds.clear();
+    {
+      std::unique_lock lLock(mStfDropLock);
+      const auto lHasWork = [&]() { return !mRunning || !mStfDropPending[pThreadIdx].empty(); };
+      if (lRetryStfIds.empty()) {
+        mStfDropCondition.wait(lLock, lHasWork);
+      } else {
+        mStfDropCondition.wait_for(lLock, sStfDropRetryInterval, lHasWork);
+      }
+
+      if (!mRunning && mStfDropPending[pThreadIdx].empty()) {
+        break; // stopped and nothing left to drop
+      }
+      // take all drops accumulated since the last batch
+      lStfIds.swap(mStfDropPending[pThreadIdx]);
+    }
+
+    std::sort(lStfIds.begin(), lStfIds.end());
+    lStfIds.erase(std::unique(lStfIds.begin(), lStfIds.end()), lStfIds.end());
 
-  auto lDropLambda = [&](const std::uint64_t pLamStfId) -> std::uint64_t {
-    StfDataRequestMessage lStfRequest;
-    StfDataResponse lStfResponse;
-    lStfRequest.set_tf_builder_id("-1");
-    lStfRequest.set_stf_id(pLamStfId);
+    lDropRequest.Clear();
+    lDropRequest.mutable_stf_ids()->Add(lStfIds.begin(), lStfIds.end());
 
+    // one request per StfSender handled by this thread
+    std::size_t lStfSenderIdx = 0;
     for (auto &lStfSenderIdCli : mStfSenderRpcClients) {
+      if (lStfSenderIdx++ % sNumStfDropThreads != pThreadIdx) {
+        continue;
+      }
+
       const auto &lStfSenderId = lStfSenderIdCli.first;
       auto &lStfSenderRpcCli = lStfSenderIdCli.second;
 
-      auto lStatus = lStfSenderRpcCli->StfDataRequest(lStfRequest, lStfResponse);
+      auto lRetryIter = lRetryStfIds.find(lStfSenderId);
+      if (lRetryIter == lRetryStfIds.end() && lStfIds.empty()) {
+        continue;
+      }
+
+      const StfDataDropMessage *lRequest = &lDropRequest;
+      if (lRetryIter != lRetryStfIds.end()) {
+        auto &lRetryIds = lRetryIter->second;
+        lRetryIds.insert(lRetryIds.end(), lStfIds.begin(), lStfIds.end());
+        std::sort(lRetryIds.begin(), lRetryIds.end());
+        lRetryIds.erase(std::unique(lRetryIds.begin(), lRetryIds.end()), lRetryIds.end());
+        // the oldest STFs are dropped by the StfSender buffer eviction
+        if (lRetryIds.size() > sMaxStfDropRetryIds) {
+          lRetryIds.erase(lRetryIds.begin(), lRetryIds.end() - sMaxStfDropRetryIds);
+        }
+
+        lRetryDropRequest.Clear();
+        lRetryDropRequest.mutable_stf_ids()->Add(lRetryIds.begin(), lRetryIds.end());
+        lRequest = &lRetryDropRequest;
+      }
+
+      lDropResponse.Clear();
+      auto lStatus = lStfSenderRpcCli->StfDataDropRequest(*lRequest, lDropResponse, sStfDropRequestTimeout);
       if (!lStatus.ok()) {
-        // gRPC problem... continue asking for other STFs
-        DDLOG(fair::Severity::WARNING) << "StfSender (" << lStfSenderId << ") gRPC connection problem. Code: "
-                      <<lStatus.error_code() << ", message: " << lStatus.error_message();
+        // gRPC problem or timeout... keep the drops and continue with other StfSenders
+        if (lRetryIter == lRetryStfIds.end()) {
+          lRetryStfIds.emplace(lStfSenderId, lStfIds);
+        }
+
+        static thread_local std::uint64_t sNumDropErrors = 0;
+        if (sNumDropErrors++ % 100 == 0) {
+          DDLOG(fair::Severity::WARNING) << "StfSender (" << lStfSenderId << ") gRPC connection problem. Code: "
+                        << lStatus.error_code() << ", message: " << lStatus.error_message()
+                        << ". Pending drops: " << lRetryStfIds[lStfSenderId].size()
+                        << ", total errors: " << sNumDropErrors;
+        }
+        continue;
+      }
+
+      if (lRetryIter != lRetryStfIds.end()) {
+        lRetryStfIds.erase(lRetryIter);
       }
 
-      if (lStfResponse.status() == StfDataResponse::DATA_DROPPED_TIMEOUT) {
-        DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId << " dropped STF " << pLamStfId <<
-                         " before notification from TfScheduler. Check StfSender buffer state.";
-      } else if (lStfResponse.status() == StfDataResponse::DATA_DROPPED_UNKNOWN) {
-        DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId << " dropped STF " << pLamStfId << " for unknown reason"
-                         " before notification from TfScheduler. Check StfSender buffer state.";
+      if (lDropResponse.unknown_stf_ids_size() > 0) {
+        DDLOG(fair::Severity::WARNING) << "StfSender " << lStfSenderId << " dropped " << lDropResponse.unknown_stf_ids_size()
+                         << " STFs (first: " << lDropResponse.unknown_stf_ids(0) << ") before notification from TfScheduler."
+                         " Check StfSender buffer state.";
       }
     }
 
-    return pLamStfId;
-  };
+    // forget drops of StfSenders that left
+    for (auto lRetryIter = lRetryStfIds.begin(); lRetryIter != lRetryStfIds.end(); ) {
+      if (mStfSenderRpcClients.count(lRetryIter->first) == 0) {
+        lRetryIter = lRetryStfIds.erase(lRetryIter);
+      } else {
+        ++lRetryIter;
+      }
+    }
 
-  try {
-    auto lFeature = std::async(std::launch::async, lDropLambda, pStfId);
+    if (pThreadIdx == 0 && !lStfIds.empty()) {
+      static std::uint64_t sNumDroppedStfs = 0;
+      static std::uint64_t sNumDropBatches = 0;
+      sNumDroppedStfs += lStfIds.size();
+      if (++sNumDropBatches % 256 == 0) {
+        DDLOG(fair::Severity::INFO) << "Dropped SubTimeFrames (cannot schedule). Last: " << lStfIds.back()
+                                    << ", batch size: " << lStfIds.size() << ", total: " << sNumDroppedStfs;
+      }
+    }
+  }
 
-    std::scoped_lock lLock(mStfDropFuturesLock);
-    mStfDropFutures.emplace_back(std::move(lFeature));
+  DDLOG(fair::Severity::DEBUG) << "Exiting STF drop thread " << pThreadIdx << "...";
+}
 
-  } catch (std::exception &) {
-    DDLOG(fair::Severity::WARNING) << "dropAllStfsAsync: async method failed. Calling synchronously.";
-    lDropLambda(pStfId);
+void TfSchedulerConnManager::publishTfBuilderSlotTable(const TfBuilderSlotTable &pSlotTable)
+{
+  // the RPCs are blocking: do not hold the client lock while publishing
+  std::vector<std::pair<std::string, std::shared_ptr<StfSenderRpcClient>>> lStfSenderClients;
+  {
+    std::scoped_lock lLock(mStfSenderClientsLock);
+    lStfSenderClients.assign(mStfSenderRpcClients.begin(), mStfSenderRpcClients.end());
   }
 
+  for (const auto &[lStfSenderId, lStfSenderRpcCli] : lStfSenderClients) {
+    StatusResponse lResponse;
+    auto lStatus = lStfSenderRpcCli->TfBuilderSlotTableUpdate(pSlotTable, lResponse);
+    if (!lStatus.ok()) {
+      DDLOG(fair::Severity::WARNING) << "StfSender (" << lStfSenderId << ") gRPC connection problem. Code: "
+                    << lStatus.error_code() << ", message: " << lStatus.error_message();
+    }
+  }
+}
+
+void TfSchedulerConnManager::TfBuilderRemoveThread()
+{
+  DDLOG(fair::Severity::DEBUG) << "Starting TfBuilder removal thread...";
+
+  std::string lTfBuilderId;
+  while (mTfBuilderRemoveQueue->pop(lTfBuilderId)) {
+    removeTfBuilder(lTfBuilderId);
+  }
+
+  DDLOG(fair::Severity::DEBUG) << "Exiting TfBuilder removal thread...";
 }
 
 void TfSchedulerConnManager::StfSenderMonitoringThread()
@@ -236,8 +351,6 @@ void TfSchedulerConnManager::StfSenderMonitoringThread()
   DDLOG(fair::Severity::DEBUG) << "Starting StfSender RPC Monitoring thread...";
   // wait for the device to go into RUNNING state
   //
-  std::vector<std::uint64_t> lDroppedStfs;
-
   while (mRunning) {
     // make sure all StfSenders are alive
     const std::uint32_t lNumStfSenders = checkStfSenders();
@@ -247,28 +360,6 @@ void TfSchedulerConnManager::StfSenderMonitoringThread()
       continue;
     }
 
-    // wait for drop futures
-    {
-      {
-        std::scoped_lock lLock(mStfDropFuturesLock);
-        for (auto lFutureIt = mStfDropFutures.begin(); lFutureIt != mStfDropFutures.end(); lFutureIt++) {
-          if (std::future_status::ready == lFutureIt->wait_for(std::chrono::seconds(0))) {
-            assert (lFutureIt->valid());
-            lDroppedStfs.push_back(lFutureIt->get());
-            lFutureIt = mStfDropFutures.erase(lFutureIt);
-          }
-        }
-      }
-      sort(lDroppedStfs.begin(), lDroppedStfs.end());
-      for (auto &lDroppedId : lDroppedStfs) {
-        static std::uint64_t lsDropLogRate = 0;
-        if (++lsDropLogRate % 256 == 0) {
-          DDLOG(fair::Severity::INFO) << "Dropped SubTimeFrame (cannot schedule): " << lDroppedId << ", total: " << lsDropLogRate;
-        }
-      }
-      lDroppedStfs.clear();
-    }
-
     std::this_thread::sleep_for(1000ms);
   }
 
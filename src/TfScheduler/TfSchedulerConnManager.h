@@ -24,14 +24,16 @@
 #include <discovery.grpc.pb.h>
 #include <grpcpp/grpcpp.h>
 
+#include <ConcurrentQueue.h>
 #include <Utilities.h>
 
 #include <vector>
 #include <map>
 #include <set>
 #include <thread>
-#include <list>
-#include <future>
+#include <array>
+#include <mutex>
+#include <condition_variable>
 
 namespace o2
 {
@@ -63,16 +65,44 @@ class TfSchedulerConnManager
 
     // start gRPC client monitoring thread
     mStfSenderMonitoringThread = std::thread(&TfSchedulerConnManager::StfSenderMonitoringThread, this);
+
+    // start TfBuilder removal thread
+    mTfBuilderRemoveQueue = std::make_unique<ConcurrentFifo<std::string>>();
+    mTfBuilderRemoveThread = std::thread(&TfSchedulerConnManager::TfBuilderRemoveThread, this);
+
+    // start STF drop threads
+    for (unsigned i = 0; i < sNumStfDropThreads; i++) {
+      mStfDropPending[i].clear();
+      mStfDropThreads.emplace_back(std::thread(&TfSchedulerConnManager::StfDropThread, this, i));
+    }
     return true;
   }
 
   void stop() {
-    mRunning = false;
+    {
+      std::scoped_lock lLock(mStfDropLock);
+      mRunning = false;
+    }
+    mStfDropCondition.notify_all();
 
     if (mStfSenderMonitoringThread.joinable()) {
       mStfSenderMonitoringThread.join();
     }
 
+    if (mTfBuilderRemoveQueue) {
+      mTfBuilderRemoveQueue->stop();
+    }
+    if (mTfBuilderRemoveThread.joinable()) {
+      mTfBuilderRemoveThread.join();
+    }
+
+    for (auto &lThread : mStfDropThreads) {
+      if (lThread.joinable()) {
+        lThread.join();
+      }
+    }
+    mStfDropThreads.clear();
+
     // delete all rpc clients
     mStfSenderRpcClients.stop();
   }
@@ -90,16 +120,29 @@ class TfSchedulerConnManager
   }
 
   void StfSenderMonitoringThread();
+  void StfDropThread(const unsigned pThreadIdx);
+  void TfBuilderRemoveThread();
 
   /// External requests by TfBuilders
   void connectTfBuilder(const TfBuilderConfigStatus &pTfBuilderStatus, TfBuilderConnectionResponse &pResponse /*out*/);
   void disconnectTfBuilder(const TfBuilderConfigStatus &pTfBuilderStatus, StatusResponse &pResponse /*out*/);
   /// Internal request, disconnect on error
   void removeTfBuilder(const std::string &pTfBuilderId);
+  /// Disconnect on error, without blocking the caller
+  void removeTfBuilderAsync(const std::string &pTfBuilderId)
+  {
+    if (mTfBuilderRemoveQueue) {
+      mTfBuilderRemoveQueue->push(pTfBuilderId);
+    }
+  }
 
   /// Drop all SubTimeFrames (in case they can't be scheduled)
+  /// Drops are coalesced and sent to StfSenders in batches by the drop threads
   void dropAllStfsAsync(const std::uint64_t pStfId);
 
+  /// Static TF assignment: send the slot table to all StfSenders
+  void publishTfBuilderSlotTable(const TfBuilderSlotTable &pSlotTable);
+
   bool newTfBuilderRpcClient(const std::string &pId)
   {
     return mTfBuilderRpcClients.add(pId);
@@ -128,7 +171,7 @@ private:
   std::shared_ptr<ConsulTfSchedulerInstance> mDiscoveryConfig;
 
   /// Scheduler threads
-  bool mRunning = false;
+  std::atomic_bool mRunning = false;
   std::thread mStfSenderMonitoringThread;
 
   /// StfSender RPC-client channels
@@ -137,9 +180,20 @@ private:
   /// TfBuilder RPC-client channels
   TfBuilderRpcClientCollection<ConsulTfSchedulerInstance> mTfBuilderRpcClients;
 
-  /// futures for async operation
-  std::recursive_mutex mStfDropFuturesLock;
-  std::list<std::future<std::uint64_t>> mStfDropFutures;
+  /// TfBuilder removal thread: disconnecting calls all StfSenders
+  std::unique_ptr<ConcurrentFifo<std::string>> mTfBuilderRemoveQueue;
+  std::thread mTfBuilderRemoveThread;
+
+  /// STF drop threads: each one sends batched drop requests to a subset of StfSenders
+  /// Drops not delivered to a StfSender (e.g. on the request deadline) are sent with its next batch
+  static constexpr unsigned sNumStfDropThreads = 4;
+  static constexpr auto sStfDropRequestTimeout = std::chrono::milliseconds(500);
+  static constexpr auto sStfDropRetryInterval = std::chrono::milliseconds(100);
+  static constexpr std::size_t sMaxStfDropRetryIds = 1 << 16;
+  std::mutex mStfDropLock;
+  std::condition_variable mStfDropCondition;
+  std::array<std::vector<std::uint64_t>, sNumStfDropThreads> mStfDropPending;
+  std::vector<std::thread> mStfDropThreads;
 };
 }
 } /* namespace o2::DataDistribution */
@@ -43,6 +43,21 @@ void TfSchedulerDevice::InitTask()
 {
   DataDistLogger::SetThreadName("tfs-main");
 
+  {
+    const auto lPolicyName = GetConfig()->GetValue<std::string>(OptionKeyTfBuilderSelection);
+    if (!parseTfBuilderSelectionPolicy(lPolicyName, mSchedulingConfig.mSelectionPolicy)) {
+      DDLOGF(fair::Severity::ERROR, "Unknown TfBuilder selection policy. {:s}={:s}",
+        OptionKeyTfBuilderSelection, lPolicyName);
+      throw "TfBuilder selection policy";
+    }
+    DDLOGF(fair::Severity::INFO, "TfBuilder selection policy: {:s}", TfBuilderSelectionPolicyName(mSchedulingConfig.mSelectionPolicy));
+
+    mSchedulingConfig.mStaticAssignment = GetConfig()->GetValue<bool>(OptionKeyStaticTfAssignment);
+    if (mSchedulingConfig.mStaticAssignment) {
+      DDLOGF(fair::Severity::INFO, "Static TF assignment is enabled. TFs are assigned to TfBuilders with a slot table.");
+    }
+  }
+
   // Discovery
   mDiscoveryConfig = std::make_shared<ConsulTfSchedulerService>(ProcessType::TfSchedulerService, Config::getEndpointOption(*GetConfig()));
 
@@ -113,7 +128,8 @@ void TfSchedulerDevice::TfSchedulerServiceThread()
           lNewPartitionRequest.mPartitionId,
           std::make_unique<TfSchedulerInstanceHandler>(*this,
             mDiscoveryConfig->status().info().process_id() + "-" + lNewPartitionRequest.mPartitionId,
-            lNewPartitionRequest
+            lNewPartitionRequest,
+            mSchedulingConfig
           ) // value
         );
 
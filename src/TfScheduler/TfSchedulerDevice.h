@@ -40,6 +40,9 @@ class TfSchedulerDevice : public DataDistDevice
   /// Default destructor
   ~TfSchedulerDevice() override;
 
+  static constexpr const char* OptionKeyTfBuilderSelection = "tf-builder-selection";
+  static constexpr const char* OptionKeyStaticTfAssignment = "static-tf-assignment";
+
   void InitTask() final;
   void ResetTask() final;
 
@@ -51,6 +54,9 @@ class TfSchedulerDevice : public DataDistDevice
   /// Discovery configuration
   std::shared_ptr<ConsulTfSchedulerService> mDiscoveryConfig;
 
+  /// Scheduling parameters of scheduler instances
+  TfSchedulingConfig mSchedulingConfig;
+
   /// Scheduler service thread
   void TfSchedulerServiceThread();
   std::thread mServiceThread;
@@ -29,11 +29,12 @@ using namespace std::chrono_literals;
 
 TfSchedulerInstanceHandler::TfSchedulerInstanceHandler(DataDistDevice& pDev,
   const std::string &pProcessId,
-  const PartitionRequest &pPartitionRequest)
+  const PartitionRequest &pPartitionRequest,
+  const TfSchedulingConfig &pSchedulingConfig)
 : mDevice(pDev),
   mPartitionInfo(pPartitionRequest),
   mDiscoveryConfig(std::make_shared<ConsulTfSchedulerInstance>(ProcessType::TfSchedulerInstance, Config::getEndpointOption(*pDev.GetConfig()))),
-  mRpcServer(mDiscoveryConfig, pPartitionRequest)
+  mRpcServer(mDiscoveryConfig, pPartitionRequest, pSchedulingConfig)
 {
   auto &lStatus = mDiscoveryConfig->status();
 
@@ -38,7 +38,8 @@ class TfSchedulerInstanceHandler
   TfSchedulerInstanceHandler() = delete;
   TfSchedulerInstanceHandler(DataDistDevice& pDev,
     const std::string &pProcessId,
-    const PartitionRequest &pPartitionRequest);
+    const PartitionRequest &pPartitionRequest,
+    const TfSchedulingConfig &pSchedulingConfig);
 
   void start();
   void stop();
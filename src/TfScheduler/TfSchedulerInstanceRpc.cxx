@@ -17,6 +17,10 @@
 
 #include <condition_variable>
 #include <stdexcept>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
 
 namespace o2
 {
@@ -25,6 +29,153 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
+namespace {
+
+/// State of one asynchronous call. The pointer is used as the completion queue tag
+class AsyncRpcCall
+{
+ public:
+  virtual ~AsyncRpcCall() = default;
+  virtual void proceed(const bool pOk) = 0;
+};
+
+// rpc StfSenderStfUpdate(StfSenderStfInfo) returns (SchedulerStfInfoResponse) { }
+class StfSenderStfUpdateCall final : public AsyncRpcCall
+{
+ public:
+  StfSenderStfUpdateCall(TfSchedulerInstanceRpcService &pService, grpc::ServerCompletionQueue &pCq, TfSchedulerStfInfo &pStfInfo)
+  : mService(pService),
+    mCq(pCq),
+    mStfInfo(pStfInfo),
+    mResponder(&mContext)
+  {
+    mService.RequestStfSenderStfUpdate(&mContext, &mRequest, &mResponder, &mCq, &mCq, this);
+  }
+
+  void proceed(const bool pOk) override
+  {
+    if (!pOk || mFinished) {
+      delete this;
+      return;
+    }
+
+    // accept the next call
+    new StfSenderStfUpdateCall(mService, mCq, mStfInfo);
+
+    static std::atomic_uint64_t sStfUpdates = 0;
+    if (++sStfUpdates % 1000 == 0) {
+      DDLOG(fair::Severity::DEBUG) << "gRPC server: StfSenderStfUpdate from: " << mRequest.info().process_id() << ", total : " << sStfUpdates;
+    }
+
+    mStfInfo.addStfInfo(mRequest, mResponse /*out*/);
+    mResponse.set_stf_id(mRequest.stf_id());
+
+    mFinished = true;
+    mResponder.Finish(mResponse, Status::OK, this);
+  }
+
+ private:
+  TfSchedulerInstanceRpcService &mService;
+  grpc::ServerCompletionQueue &mCq;
+  TfSchedulerStfInfo &mStfInfo;
+
+  ServerContext mContext;
+  StfSenderStfInfo mRequest;
+  SchedulerStfInfoResponse mResponse;
+  grpc::ServerAsyncResponseWriter<SchedulerStfInfoResponse> mResponder;
+  bool mFinished = false;
+};
+
+// rpc StfSenderStfUpdateStream(stream StfSenderStfInfoBatch) returns (stream SchedulerStfInfoResponseBatch) { }
+class StfSenderStfUpdateStreamCall final : public AsyncRpcCall
+{
+ public:
+  StfSenderStfUpdateStreamCall(TfSchedulerInstanceRpcService &pService, grpc::ServerCompletionQueue &pCq, TfSchedulerStfInfo &pStfInfo)
+  : mService(pService),
+    mCq(pCq),
+    mStfInfo(pStfInfo),
+    mStream(&mContext)
+  {
+    mService.RequestStfSenderStfUpdateStream(&mContext, &mStream, &mCq, &mCq, this);
+  }
+
+  void proceed(const bool pOk) override
+  {
+    switch (mState) {
+      case eConnect:
+        if (!pOk) {
+          delete this;
+          return;
+        }
+        // accept the next stream
+        new StfSenderStfUpdateStreamCall(mService, mCq, mStfInfo);
+        read();
+        break;
+
+      case eRead:
+        if (!pOk) {
+          // StfSender closed the stream
+          finish();
+          break;
+        }
+        mResponseBatch.Clear();
+        for (const auto &lStfInfo : mStfInfoBatch.stf_info()) {
+          static std::atomic_uint64_t sStfUpdates = 0;
+          if (++sStfUpdates % 1000 == 0) {
+            DDLOG(fair::Severity::DEBUG) << "gRPC server: StfSenderStfUpdateStream from: " << lStfInfo.info().process_id()
+                                         << ", total : " << sStfUpdates;
+          }
+
+          auto &lResponse = *mResponseBatch.add_responses();
+          mStfInfo.addStfInfo(lStfInfo, lResponse /*out*/);
+          lResponse.set_stf_id(lStfInfo.stf_id());
+        }
+        mState = eWrite;
+        mStream.Write(mResponseBatch, this);
+        break;
+
+      case eWrite:
+        if (!pOk) {
+          finish();
+          break;
+        }
+        read();
+        break;
+
+      case eFinish:
+        delete this;
+        break;
+    }
+  }
+
+ private:
+  void read()
+  {
+    mState = eRead;
+    mStream.Read(&mStfInfoBatch, this);
+  }
+
+  void finish()
+  {
+    mState = eFinish;
+    mStream.Finish(Status::OK, this);
+  }
+
+  enum State { eConnect, eRead, eWrite, eFinish };
+  State mState = eConnect;
+
+  TfSchedulerInstanceRpcService &mService;
+  grpc::ServerCompletionQueue &mCq;
+  TfSchedulerStfInfo &mStfInfo;
+
+  ServerContext mContext;
+  StfSenderStfInfoBatch mStfInfoBatch;
+  SchedulerStfInfoResponseBatch mResponseBatch;
+  grpc::ServerAsyncReaderWriter<SchedulerStfInfoResponseBatch, StfSenderStfInfoBatch> mStream;
+};
+
+} /* anonymous namespace */
+
 void TfSchedulerInstanceRpcImpl::initDiscovery(const std::string pRpcSrvBindIp, int &lRealPort)
 {
   ServerBuilder lSrvBuilder;
@@ -33,10 +184,72 @@ void TfSchedulerInstanceRpcImpl::initDiscovery(const std::string pRpcSrvBindIp,
                                 &lRealPort  /*auto assigned port */);
   lSrvBuilder.RegisterService(this);
 
+  // infrequent control requests: keep the number of synchronous threads low
+  lSrvBuilder.SetSyncServerOption(ServerBuilder::SyncServerOption::MAX_POLLERS, sMaxSyncPollers);
+
+  // CPUs the process may run on (taskset, cgroup cpuset)
+  mCqThreadCpus.clear();
+  cpu_set_t lCpuSet;
+  CPU_ZERO(&lCpuSet);
+  if (0 == sched_getaffinity(0, sizeof(cpu_set_t), &lCpuSet)) {
+    for (int lCpu = 0; lCpu < CPU_SETSIZE; lCpu++) {
+      if (CPU_ISSET(lCpu, &lCpuSet)) {
+        mCqThreadCpus.push_back(lCpu);
+      }
+    }
+  } else {
+    DDLOGF(fair::Severity::WARNING, "Cannot get the CPU affinity of the process. "
+      "gRPC completion queue threads are not pinned.");
+  }
+
+  // STF updates: a fixed number of completion queues, each with one polling thread
+  const unsigned lNumCpus = mCqThreadCpus.empty() ? std::thread::hardware_concurrency() : mCqThreadCpus.size();
+  const unsigned lNumCqThreads = std::clamp(lNumCpus / 4, 1U, sMaxCqThreads);
+  assert(mCompletionQueues.empty());
+  for (unsigned i = 0; i < lNumCqThreads; i++) {
+    mCompletionQueues.emplace_back(lSrvBuilder.AddCompletionQueue());
+  }
+
   assert(!mServer);
   mServer = lSrvBuilder.BuildAndStart();
 
-  DDLOG(fair::Severity::INFO) << "gRPC server listening on : " << pRpcSrvBindIp << ":" << lRealPort;
+  for (unsigned i = 0; i < lNumCqThreads; i++) {
+    mCqThreads.emplace_back(std::thread(&TfSchedulerInstanceRpcImpl::CqThread, this, i));
+  }
+
+  DDLOG(fair::Severity::INFO) << "gRPC server listening on : " << pRpcSrvBindIp << ":" << lRealPort
+                              << ". Completion queue threads: " << lNumCqThreads << ", allowed CPUs: " << lNumCpus;
+}
+
+void TfSchedulerInstanceRpcImpl::CqThread(const unsigned pCqIdx)
+{
+  DataDistLogger::SetThreadName("RpcCqThread[" + std::to_string(pCqIdx) + "]");
+
+  // pin the thread to one of the CPUs allowed for the process
+  if (!mCqThreadCpus.empty()) {
+    const int lCpu = mCqThreadCpus[pCqIdx % mCqThreadCpus.size()];
+    cpu_set_t lCpuSet;
+    CPU_ZERO(&lCpuSet);
+    CPU_SET(lCpu, &lCpuSet);
+    if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &lCpuSet)) {
+      DDLOGF(fair::Severity::WARNING, "Cannot set the affinity of the gRPC completion queue thread. cq_idx={} cpu={}",
+        pCqIdx, lCpu);
+    }
+  }
+
+  auto &lCq = *mCompletionQueues[pCqIdx];
+
+  // post the initial calls
+  new StfSenderStfUpdateCall(*this, lCq, mStfInfo);
+  new StfSenderStfUpdateStreamCall(*this, lCq, mStfInfo);
+
+  void *lTag = nullptr;
+  bool lOk = false;
+  while (lCq.Next(&lTag, &lOk)) {
+    static_cast<AsyncRpcCall*>(lTag)->proceed(lOk);
+  }
+
+  DDLOGF(fair::Severity::TRACE, "Exiting gRPC completion queue thread. cq_idx={}", pCqIdx);
 }
 
 void TfSchedulerInstanceRpcImpl::start()
@@ -59,7 +272,20 @@ void TfSchedulerInstanceRpcImpl::stop()
   mTfBuilderInfo.stop();
 
   if (mServer) {
-    mServer->Shutdown();
+    // cancel the open STF update streams after the timeout
+    mServer->Shutdown(std::chrono::system_clock::now() + sShutdownTimeout);
+
+    for (auto &lCq : mCompletionQueues) {
+      lCq->Shutdown();
+    }
+    for (auto &lThread : mCqThreads) {
+      if (lThread.joinable()) {
+        lThread.join();
+      }
+    }
+    mCqThreads.clear();
+    mCompletionQueues.clear();
+
     mServer.reset(nullptr);
   }
 }
@@ -108,28 +334,15 @@ void TfSchedulerInstanceRpcImpl::stop()
   return Status::OK;
 }
 
-::grpc::Status TfSchedulerInstanceRpcImpl::StfSenderStfUpdate(::grpc::ServerContext* /*context*/, const ::o2::DataDistribution::StfSenderStfInfo* request, ::o2::DataDistribution::SchedulerStfInfoResponse* response)
+::grpc::Status TfSchedulerInstanceRpcImpl::StfSenderStfDropped(::grpc::ServerContext* /*context*/, const ::o2::DataDistribution::StfSenderStfDropInfo* request, ::google::protobuf::Empty* /*response*/)
 {
-  static std::atomic_uint64_t sStfUpdates = 0;
-  if (++sStfUpdates % 1000 == 0) {
-    DDLOG(fair::Severity::DEBUG) << "gRPC server: StfSenderStfUpdate from: " <<  request->info().process_id() << ", total : " << sStfUpdates;
-  }
+  DDLOG(fair::Severity::DEBUG) << "gRPC server: StfSenderStfDropped from: " << request->info().process_id()
+                               << ", number of STFs: " << request->stf_ids_size();
 
-  //
-  response->Clear();
-  mStfInfo.addStfInfo(*request, *response /*out*/);
-
-  // if (sStfUpdates % 1000 == 0) {
-  //   DDLOG(fair::Severity::DEBUG) << "gRPC server: StfSenderStfUpdate::Done";
-  // }
+  mStfInfo.addStfDropInfo(*request);
 
   return Status::OK;
 }
 
-
-
-
-
-
 }
 } /* o2::DataDistribution */
@@ -25,6 +25,7 @@
 #include <vector>
 #include <map>
 #include <thread>
+#include <chrono>
 
 namespace o2
 {
@@ -37,17 +38,24 @@ using grpc::ServerContext;
 using grpc::ClientContext;
 using grpc::Status;
 
-class TfSchedulerInstanceRpcImpl final : public TfSchedulerInstanceRpc::Service
+/// STF updates are served asynchronously, all other methods use the synchronous service
+using TfSchedulerInstanceRpcService =
+  TfSchedulerInstanceRpc::WithAsyncMethod_StfSenderStfUpdate<
+  TfSchedulerInstanceRpc::WithAsyncMethod_StfSenderStfUpdateStream<
+  TfSchedulerInstanceRpc::Service>>;
+
+class TfSchedulerInstanceRpcImpl final : public TfSchedulerInstanceRpcService
 {
  public:
   TfSchedulerInstanceRpcImpl() = delete;
-  TfSchedulerInstanceRpcImpl(std::shared_ptr<ConsulTfSchedulerInstance> pDiscoveryConfig, const PartitionRequest &pPartitionRequest)
+  TfSchedulerInstanceRpcImpl(std::shared_ptr<ConsulTfSchedulerInstance> pDiscoveryConfig, const PartitionRequest &pPartitionRequest,
+                             const TfSchedulingConfig &pSchedulingConfig)
   :
   mDiscoveryConfig(pDiscoveryConfig),
   mPartitionInfo(pPartitionRequest),
   mConnManager(pDiscoveryConfig, pPartitionRequest),
-  mTfBuilderInfo(pDiscoveryConfig),
-  mStfInfo(pDiscoveryConfig, mConnManager, mTfBuilderInfo)
+  mTfBuilderInfo(pDiscoveryConfig, pSchedulingConfig.mSelectionPolicy),
+  mStfInfo(pDiscoveryConfig, mConnManager, mTfBuilderInfo, pSchedulingConfig)
   { }
 
   virtual ~TfSchedulerInstanceRpcImpl() { }
@@ -57,7 +65,9 @@ class TfSchedulerInstanceRpcImpl final : public TfSchedulerInstanceRpc::Service
   ::grpc::Status TfBuilderDisconnectionRequest(::grpc::ServerContext* context, const ::o2::DataDistribution::TfBuilderConfigStatus* request, ::o2::DataDistribution::StatusResponse* response) override;
 
   ::grpc::Status TfBuilderUpdate(::grpc::ServerContext* context, const ::o2::DataDistribution::TfBuilderUpdateMessage* request, ::google::protobuf::Empty* response) override;
-  ::grpc::Status StfSenderStfUpdate(::grpc::ServerContext* context, const ::o2::DataDistribution::StfSenderStfInfo* request, ::o2::DataDistribution::SchedulerStfInfoResponse* response) override;
+
+  // StfSenderStfUpdate and StfSenderStfUpdateStream: served by the completion queue threads
+  ::grpc::Status StfSenderStfDropped(::grpc::ServerContext* context, const ::o2::DataDistribution::StfSenderStfDropInfo* request, ::google::protobuf::Empty* response) override;
 
 
   void initDiscovery(const std::string pRpcSrvBindIp, int &lRealPort /*[out]*/);
@@ -74,6 +84,16 @@ class TfSchedulerInstanceRpcImpl final : public TfSchedulerInstanceRpc::Service
   /// gRPC server object
   std::unique_ptr<Server> mServer;
 
+  /// Completion queues and polling threads for asynchronous methods
+  static constexpr unsigned sMaxCqThreads = 4;
+  static constexpr int sMaxSyncPollers = 2;
+  static constexpr auto sShutdownTimeout = std::chrono::seconds(2);
+  void CqThread(const unsigned pCqIdx);
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> mCompletionQueues;
+  std::vector<std::thread> mCqThreads;
+  /// CPUs allowed for the process: completion queue threads are pinned to them in turn
+  std::vector<int> mCqThreadCpus;
+
   /// Connection manager between StfSenders and TfBuilders + RPC clients
   TfSchedulerConnManager mConnManager;
 
@@ -35,248 +35,392 @@ void TfSchedulerStfInfo::SchedulingThread()
   DDLOGF(fair::Severity::TRACE, "Starting StfInfo Scheduling thread...");
 
   const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
-  const std::set<std::string> lStfSenderIdSet = mConnManager.getStfSenderSet();
-  std::vector<std::uint64_t> lStfsToErase;
-  lStfsToErase.reserve(1000);
-  auto lLastDiscardTime = std::chrono::system_clock::now();
+
+  // StfSender indices used in the STF info table
+  {
+    const std::set<std::string> lStfSenderIdSet = mConnManager.getStfSenderSet();
+    mStfSenderIds.assign(lStfSenderIdSet.begin(), lStfSenderIdSet.end());
+    mStfSenderIdxMap.clear();
+    for (std::uint32_t lIdx = 0; lIdx < mStfSenderIds.size(); lIdx++) {
+      mStfSenderIdxMap[mStfSenderIds[lIdx]] = lIdx;
+    }
+  }
+
+  // allocate the STF info table
+  mStfInfoRing.assign(sStfInfoRingSize, TfStfInfo());
+  for (auto &lSlot : mStfInfoRing) {
+    lSlot.mStfs.resize(mStfSenderIds.size());
+  }
+  mStfInfoExpiry.clear();
+
+  auto lLastUpdateTime = std::chrono::system_clock::now();
 
   while (mRunning) {
 
-    {
-      std::vector<StfInfo> lStfInfos;
+    // aggregate all queued STF updates
+    if (mStfInfoQueue.consume_all([this](StfSenderStfInfo &&pStfInfo) { processStfInfo(pStfInfo); }) > 0) {
+      lLastUpdateTime = std::chrono::system_clock::now();
+    }
+
+    // discard TFs with STFs evicted by StfSenders
+    mStfDropInfoQueue.consume_all([this](StfSenderStfDropInfo &&pStfDropInfo) { processStfDropInfo(pStfDropInfo); });
+
+    while (!mCompleteStfsInfo.empty()) {
+      TfStfInfo lStfInfos = std::move(mCompleteStfsInfo.front());
+      mCompleteStfsInfo.pop_front();
 
-      {
-        std::unique_lock lLock(mCompleteStfInfoLock);
+      // check complete stf information
+      assert(lStfInfos.mNumStfs == lNumStfSenders);
 
-        if (mCompleteStfsInfo.empty()) {
-          lStfInfos.clear();
-        } else {
-          lStfInfos = std::move(mCompleteStfsInfo.front());
-          mCompleteStfsInfo.pop_front();
-        }
+      scheduleTf(lStfInfos);
+    }
+
+    // discard incomplete TFs
+    {
+      const auto lNumDiscarded = expireStfInfos(std::chrono::system_clock::now());
+      if (lNumDiscarded > 0) {
+        DDLOGF(fair::Severity::WARNING,
+          "TFs have been discarded due to incomplete number of STFs. discarded_tf_count={:d}",
+          lNumDiscarded);
       }
+    }
 
-      if (!lStfInfos.empty()) {
-        // check complete stf information
-        assert(lStfInfos.size() == lNumStfSenders);
-
-        // calculate combined STF size
-        const std::uint64_t lTfSize = std::accumulate(lStfInfos.begin(), lStfInfos.end(),
-          0, [&](std::uint64_t pSum, const StfInfo &pElem) {
-            return pSum + pElem.stf_size();
-          }
-        );
-
-        const auto lTfId = lStfInfos[0].stf_id();
-
-        // 1: Get the best TfBuilder candidate
-        std::string lTfBuilderId;
-        if ( mTfBuilderInfo.findTfBuilderForTf(lTfSize, lTfBuilderId /*out*/) ) {
-
-          {
-            static std::uint64_t sNumTfScheds = 0;
-            if (++sNumTfScheds % 50 == 0) {
-              DDLOGF(fair::Severity::TRACE, "Scheduling TF. tf_id={:d} tfb_id={:s} total={:d}",
-                lTfId, lTfBuilderId, sNumTfScheds);
-            }
-          }
-
-          assert (!lTfBuilderId.empty());
-          // Notify TfBuilder to build the TF
-          TfBuilderRpcClient lRpcCli = mConnManager.getTfBuilderRpcClient(lTfBuilderId);
-
-          // finding and getting the client is racy
-          if (lRpcCli) {
-            TfBuildingInformation lRequest;
-            BuildTfResponse lResponse;
-
-            lRequest.set_tf_id(lTfId);
-            lRequest.set_tf_size(lTfSize);
-            for (const auto &lStfI : lStfInfos) {
-              (*lRequest.mutable_stf_size_map())[lStfI.process_id()] = lStfI.stf_size();
-            }
-
-            if (lRpcCli.get().BuildTfRequest(lRequest, lResponse)) {
-              switch (lResponse.status()) {
-                case BuildTfResponse::OK:
-                  // marked TfBuilder as scheduled
-                  mTfBuilderInfo.markTfBuilderWithTfId(lTfBuilderId, lRequest.tf_id());
-                  break;
-                case BuildTfResponse::ERROR_NOMEM:
-                  DDLOGF(fair::Severity::ERROR,
-                    "Scheduling error: selected TfBuilder returned ERROR_NOMEM. tf_id={:s}", lTfBuilderId);
-                  break;
-                case BuildTfResponse::ERROR_NOT_RUNNING:
-                  DDLOGF(fair::Severity::ERROR,
-                    "Scheduling error: selected TfBuilder returned ERROR_NOT_RUNNING. tf_id={:s}", lTfBuilderId);
-                  break;
-                default:
-                  break;
-              }
-            } else {
-              DDLOGF(fair::Severity::ERROR, "Scheduling of TF failed. to_tfb_id={:s} reason=grpc_error", lTfBuilderId);
-              DDLOGF(fair::Severity::WARNING, "Removing TfBuilder from scheduling. tfb_id={:s}", lTfBuilderId);
-
-              lRpcCli.put();
-              mConnManager.dropAllStfsAsync(lTfId);
-              mConnManager.removeTfBuilder(lTfBuilderId);
-              mTfBuilderInfo.removeReadyTfBuilder(lTfBuilderId);
-            }
-          } else {
-            // TfBuilder was removed in the meantime, e.g. by housekeeping thread because of stale info
-            // We drop the current TF as this is not a likely situation
-            DDLOGF(fair::Severity::WARNING,
-              "Selected TfBuilder is not currently reachable. TF will be dropped. tfb_id={:s} tf_id={:d}",
-              lTfBuilderId, lTfId);
-
-            mConnManager.dropAllStfsAsync(lTfId);
-            // mConnManager.removeTfBuilder(lTfBuilderId);
-            // mTfBuilderInfo.removeReadyTfBuilder(lTfBuilderId);
-          }
-        } else {
-          // No candidate for scheduling
-          mConnManager.dropAllStfsAsync(lTfId);
-        }
+    // wait for new STF updates or the next expiry check
+    if (!mCompleteStfsInfo.empty()) {
+      continue;
+    }
+
+    if (!mStfInfoQueue.wait_for(sStfExpiryCheckInterval) && mRunning) {
+      const auto lNow = std::chrono::system_clock::now();
+      if (lNow - lLastUpdateTime > sStfDiscardTimeout) {
+        DDLOGF(fair::Severity::WARNING, "No new SubTimeFrame updates in {:d} seconds.", sStfDiscardTimeout.count());
+        lLastUpdateTime = lNow;
       }
     }
+  }
 
-    const auto lNow = std::chrono::system_clock::now();
+  DDLOGF(fair::Severity::TRACE, "Exiting StfInfo Scheduling thread.");
+}
 
-    if (lNow - lLastDiscardTime  > sStfDiscardTimeout) {
-      lLastDiscardTime = lNow;
+void TfSchedulerStfInfo::scheduleTf(const TfStfInfo &pStfInfos)
+{
+  // calculate combined STF size
+  const std::uint64_t lTfSize = std::accumulate(pStfInfos.mStfs.begin(), pStfInfos.mStfs.end(),
+    std::uint64_t(0), [&](std::uint64_t pSum, const StfInfo &pElem) {
+      return pSum + pElem.mStfSize;
+    }
+  );
 
-      lStfsToErase.clear();
-      {
-        std::unique_lock lLock(mGlobalStfInfoLock);
+  const auto lTfId = pStfInfos.mTfId;
 
-        // check all available stf information
-        for (const auto &lStfIdInfo : mStfInfoMap) {
-          auto lStfId = lStfIdInfo.first;
-          auto &lStfInfoVec = lStfIdInfo.second;
+  // 1: Get the best TfBuilder candidate
+  std::string lTfBuilderId;
+  if (!mTfBuilderInfo.findTfBuilderForTf(lTfId, lTfSize, lTfBuilderId /*out*/)) {
+    // No candidate for scheduling
+    mConnManager.dropAllStfsAsync(lTfId);
+    return;
+  }
 
-          assert(!lStfInfoVec.empty());
+  {
+    static std::uint64_t sNumTfScheds = 0;
+    if (++sNumTfScheds % 50 == 0) {
+      DDLOGF(fair::Severity::TRACE, "Scheduling TF. tf_id={:d} tfb_id={:s} total={:d}",
+        lTfId, lTfBuilderId, sNumTfScheds);
+    }
+  }
 
-          // check reap
-          const auto &lLastStfInfo = lStfInfoVec.back();
-          const auto lTimeDiff = std::chrono::abs(lLastStfInfo.mUpdateLocalTime - lNow);
-          if (lTimeDiff > sStfDiscardTimeout) {
-            DDLOGF(fair::Severity::WARNING,
-              "Discarding incomplete SubTimeFrame. stf_id={:d} received={:d} expected={:d}",
-              lStfId, lStfInfoVec.size(), lNumStfSenders);
+  assert (!lTfBuilderId.empty());
+  // 2: Notify TfBuilder to build the TF. The response is handled by the completion thread
+  TfBuilderRpcClient lRpcCli = mConnManager.getTfBuilderRpcClient(lTfBuilderId);
 
-            // find missing StfSenders
-            std::set<std::string> lMissingStfSenders = lStfSenderIdSet;
+  // finding and getting the client is racy
+  if (!lRpcCli) {
+    // TfBuilder was removed in the meantime, e.g. by housekeeping thread because of stale info
+    // We drop the current TF as this is not a likely situation
+    DDLOGF(fair::Severity::WARNING,
+      "Selected TfBuilder is not currently reachable. TF will be dropped. tfb_id={:s} tf_id={:d}",
+      lTfBuilderId, lTfId);
 
-            for (const auto &lUpdate : lStfInfoVec) {
-              lMissingStfSenders.erase(lUpdate.process_id());
-            }
+    mTfBuilderInfo.buildTfRequestDone(lTfBuilderId, lTfId, false);
+    mConnManager.dropAllStfsAsync(lTfId);
+    return;
+  }
 
-            std::string lMissingIds = boost::algorithm::join(lMissingStfSenders, ", ");
-            DDLOGF(fair::Severity::DEBUG, "Missing STFs from StfSender IDs: {:s}", lMissingIds);
+  TfBuildingInformation lRequest;
+  lRequest.set_tf_id(lTfId);
+  lRequest.set_tf_size(lTfSize);
+  for (std::uint32_t lIdx = 0; lIdx < pStfInfos.mStfs.size(); lIdx++) {
+    (*lRequest.mutable_stf_size_map())[mStfSenderIds[lIdx]] = pStfInfos.mStfs[lIdx].mStfSize;
+  }
 
-            // TODO: more robust reporting needed!
-            //       which stfSenders did not send?
+  auto lCall = std::make_unique<BuildTfCall>();
+  lCall->mTfBuilderId = lTfBuilderId;
+  lCall->mTfId = lTfId;
+  lCall->mStart = std::chrono::steady_clock::now();
+  lCall->mContext.set_deadline(std::chrono::system_clock::now() + sBuildTfRequestTimeout);
 
-            lStfsToErase.push_back(lStfId);
-          }
-        }
+  lCall->mReader = lRpcCli.get().AsyncBuildTfRequest(lCall->mContext, lRequest, *mBuildTfCq);
+  lCall->mReader->Finish(&lCall->mResponse, &lCall->mStatus, lCall.get());
+  lCall.release(); // owned by the completion queue
+}
 
-        for (const auto &lStfId : lStfsToErase) {
-          mConnManager.dropAllStfsAsync(lStfId);
-          mStfInfoMap.erase(lStfId);
-        }
+void TfSchedulerStfInfo::BuildTfCompletionThread()
+{
+  DataDistLogger::SetThreadName("BuildTfCompletionThread");
+  DDLOGF(fair::Severity::TRACE, "Starting BuildTfRequest completion thread...");
+
+  void *lTag = nullptr;
+  bool lOk = false;
+  while (mBuildTfCq->Next(&lTag, &lOk)) {
+    std::unique_ptr<BuildTfCall> lCall(static_cast<BuildTfCall*>(lTag));
+    const auto &lTfBuilderId = lCall->mTfBuilderId;
+    const auto lTfId = lCall->mTfId;
+
+    mBuildTfLatencySamples.Fill(
+      std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - lCall->mStart).count());
+
+    if (!lOk || !lCall->mStatus.ok()) {
+      DDLOGF(fair::Severity::ERROR, "Scheduling of TF failed. to_tfb_id={:s} reason=grpc_error code={:d} message={:s}",
+        lTfBuilderId, lCall->mStatus.error_code(), lCall->mStatus.error_message());
+
+      mTfBuilderInfo.buildTfRequestDone(lTfBuilderId, lTfId, false);
+      mConnManager.dropAllStfsAsync(lTfId);
+
+      // other outstanding requests to the same TfBuilder will fail as well
+      if (mTfBuilderInfo.removeReadyTfBuilder(lTfBuilderId)) {
+        DDLOGF(fair::Severity::WARNING, "Removing TfBuilder from scheduling. tfb_id={:s}", lTfBuilderId);
+        mConnManager.removeTfBuilderAsync(lTfBuilderId);
       }
+      continue;
+    }
 
-      if (lStfsToErase.size() > 0) {
-        DDLOGF(fair::Severity::WARNING,
-          "TFs have been discarded due to incomplete number of STFs. discarded_tf_count={:d}",
-          lStfsToErase.size());
-      }
+    switch (lCall->mResponse.status()) {
+      case BuildTfResponse::OK:
+        // marked TfBuilder as scheduled
+        mTfBuilderInfo.buildTfRequestDone(lTfBuilderId, lTfId, true);
+        break;
+      case BuildTfResponse::ERROR_NOMEM:
+        DDLOGF(fair::Severity::ERROR,
+          "Scheduling error: selected TfBuilder returned ERROR_NOMEM. tfb_id={:s} tf_id={:d}", lTfBuilderId, lTfId);
+        mTfBuilderInfo.buildTfRequestDone(lTfBuilderId, lTfId, false);
+        mConnManager.dropAllStfsAsync(lTfId);
+        break;
+      case BuildTfResponse::ERROR_NOT_RUNNING:
+        DDLOGF(fair::Severity::ERROR,
+          "Scheduling error: selected TfBuilder returned ERROR_NOT_RUNNING. tfb_id={:s} tf_id={:d}", lTfBuilderId, lTfId);
+        mTfBuilderInfo.buildTfRequestDone(lTfBuilderId, lTfId, false);
+        mConnManager.dropAllStfsAsync(lTfId);
+        break;
+      default:
+        break;
     }
 
-    // wait for notification or discard on timeout
-    {
-      std::unique_lock lLock(mCompleteStfInfoLock);
-      if (! mCompleteStfsInfo.empty()) {
-        continue;
-      }
+    static std::uint64_t sNumBuildTfResponses = 0;
+    if (++sNumBuildTfResponses % 1000 == 0) {
+      DDLOGF(fair::Severity::DEBUG, "BuildTfRequest latency. mean_ms={:.3f} total={:d}",
+        mBuildTfLatencySamples.Mean(), sNumBuildTfResponses);
+    }
+  }
 
-      if (std::cv_status::timeout == mStfScheduleCondition.wait_for(lLock, sStfDiscardTimeout)) {
-        DDLOGF(fair::Severity::WARNING,
-          "No new complete SubTimeFrames in {:d} seconds. Starting stale SubTimeFrame discard procedure.",
-          sStfDiscardTimeout.count());
+  DDLOGF(fair::Severity::TRACE, "Exiting BuildTfRequest completion thread.");
+}
+
+void TfSchedulerStfInfo::StaticAssignmentThread()
+{
+  DataDistLogger::SetThreadName("StaticAssignmentThread");
+  DDLOGF(fair::Severity::TRACE, "Starting static TF assignment thread...");
+
+  TfBuilderSlotTable lSlotTable;
+  std::vector<std::string> lTfBuilderIds;
+  auto lLastPublishTime = std::chrono::steady_clock::time_point();
+
+  while (mRunning) {
+    mTfBuilderInfo.getStaticAssignmentTfBuilders(lTfBuilderIds /*out*/);
+
+    const bool lChanged = (lSlotTable.version() == 0) ||
+      !std::equal(lTfBuilderIds.begin(), lTfBuilderIds.end(),
+        lSlotTable.tf_builder_ids().begin(), lSlotTable.tf_builder_ids().end());
+
+    if (lChanged) {
+      // the first table is used immediately
+      lSlotTable.set_effective_tf_id((lSlotTable.version() == 0) ? 0 :
+        (mTfBuilderInfo.getLastBuiltTfId() + sSlotTableSwitchMargin));
+      lSlotTable.set_version(lSlotTable.version() + 1);
+      lSlotTable.mutable_tf_builder_ids()->Clear();
+      for (const auto &lTfBuilderId : lTfBuilderIds) {
+        lSlotTable.add_tf_builder_ids(lTfBuilderId);
       }
+
+      DDLOGF(fair::Severity::INFO, "TfBuilder slot table changed. version={:d} num_tfbuilders={:d} effective_tf_id={:d}",
+        lSlotTable.version(), lSlotTable.tf_builder_ids_size(), lSlotTable.effective_tf_id());
     }
+
+    const auto lNow = std::chrono::steady_clock::now();
+    if (lChanged || (lNow - lLastPublishTime) >= sSlotTableRepublishInterval) {
+      mConnManager.publishTfBuilderSlotTable(lSlotTable);
+      lLastPublishTime = lNow;
+    }
+
+    std::this_thread::sleep_for(sSlotTableUpdateInterval);
   }
 
-  DDLOGF(fair::Severity::TRACE, "Exiting StfInfo Scheduling thread.");
+  DDLOGF(fair::Severity::TRACE, "Exiting static TF assignment thread.");
 }
 
 void TfSchedulerStfInfo::addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerStfInfoResponse &pResponse)
 {
-  const auto lNumStfSenders = mDiscoveryConfig->status().stf_sender_count();
-  const auto lStfId = pStfInfo.stf_id();
-
   if (!mRunning) {
     pResponse.set_status(SchedulerStfInfoResponse::DROP_NOT_RUNNING);
     return;
   }
 
-  {
-    std::unique_lock lLock(mGlobalStfInfoLock);
+  // StfSender did not receive the slot table yet
+  if (mStaticAssignment) {
+    pResponse.set_status(SchedulerStfInfoResponse::DROP_RESOURCES);
+    return;
+  }
 
-    if (lStfId > mLastStfId + 200) {
-      DDLOGF(fair::Severity::TRACE,
-        "Received STFid is much larger than the currently processed TF id. new_stf_id={} current_stf_id={} from_stf_sender={}",
-        lStfId, mLastStfId, pStfInfo.info().process_id()
-      );
+  mStfInfoQueue.push(pStfInfo);
+  pResponse.set_status(SchedulerStfInfoResponse::OK);
+}
+
+void TfSchedulerStfInfo::addStfDropInfo(const StfSenderStfDropInfo &pStfDropInfo)
+{
+  if (!mRunning || mStaticAssignment) {
+    return;
+  }
+
+  mStfDropInfoQueue.push(pStfDropInfo);
+  // wake up the scheduling thread
+  mStfInfoQueue.notify();
+}
+
+void TfSchedulerStfInfo::processStfDropInfo(const StfSenderStfDropInfo &pStfDropInfo)
+{
+  std::uint64_t lNumDiscarded = 0;
+
+  for (const auto lStfId : pStfDropInfo.stf_ids()) {
+    auto &lSlot = mStfInfoRing[lStfId % sStfInfoRingSize];
+
+    // complete TFs are already scheduled: the TfBuilder will receive DATA_DROPPED_TIMEOUT
+    if (lSlot.mValid && lSlot.mTfId == lStfId) {
+      discardStfInfo(lSlot);
+      lNumDiscarded++;
     }
+  }
 
-    // Sanity check for delayed Stf info
-    // TODO: define tolerable delay here
-    const std::uint64_t lMaxDelayTf = sStfDiscardTimeout.count() * 44;
-    const auto lMinAccept = mLastStfId < lMaxDelayTf ? 0 : mLastStfId - lMaxDelayTf;
+  DDLOGF(fair::Severity::WARNING, "StfSender evicted SubTimeFrames. stf_sender={:s} evicted_count={:d} discarded_tf_count={:d}",
+    pStfDropInfo.info().process_id(), pStfDropInfo.stf_ids_size(), lNumDiscarded);
+}
 
-    if ((lStfId < lMinAccept) && (mStfInfoMap.count(lStfId) == 0)) {
+void TfSchedulerStfInfo::processStfInfo(const StfSenderStfInfo &pStfInfo)
+{
+  const auto lNumStfSenders = mStfSenderIds.size();
+  const auto lStfId = pStfInfo.stf_id();
+
+  const auto lStfSenderIdxIter = mStfSenderIdxMap.find(pStfInfo.info().process_id());
+  if (lStfSenderIdxIter == mStfSenderIdxMap.end()) {
+    DDLOGF(fair::Severity::ERROR, "STF info from an unknown StfSender. stf_id={:d} from_stf_sender={:s}",
+      lStfId, pStfInfo.info().process_id());
+    return;
+  }
+  const auto lStfSenderIdx = lStfSenderIdxIter->second;
+
+  if (lStfId > mLastStfId + 200) {
+    DDLOGF(fair::Severity::TRACE,
+      "Received STFid is much larger than the currently processed TF id. new_stf_id={} current_stf_id={} from_stf_sender={}",
+      lStfId, mLastStfId, pStfInfo.info().process_id()
+    );
+  }
+
+  auto &lSlot = mStfInfoRing[lStfId % sStfInfoRingSize];
+
+  if (lSlot.mValid && lSlot.mTfId != lStfId) {
+    if (lSlot.mTfId > lStfId) {
+      // the slot was already reused by a newer TF
       DDLOGF(fair::Severity::WARNING, "Delayed or duplicate STF info. "
         "stf_id={:d} current_stf_id={:d} from_stf_sender={:s}",
         lStfId, mLastStfId, pStfInfo.info().process_id());
-
-      // TODO: discarded or scheduled?
-      // pResponse.set_status(SchedulerStfInfoResponse::DROP_SCHED_DISCARDED);
-      // return;
+      return;
     }
 
-    mLastStfId = std::max(mLastStfId, lStfId);
+    // the slot holds an incomplete TF older than the whole ring
+    discardStfInfo(lSlot);
+  }
 
-    // get or create a new vector of Stf updates
-    auto &lStfIdVector = mStfInfoMap[lStfId];
+  if (!lSlot.mValid) {
+    lSlot.mTfId = lStfId;
+    lSlot.mValid = true;
+    lSlot.mNumStfs = 0;
+    lSlot.mFirstUpdate = std::chrono::system_clock::now();
+    std::fill(lSlot.mStfs.begin(), lSlot.mStfs.end(), StfInfo());
 
-    if (lStfIdVector.size() == 0) {
-      lStfIdVector.reserve(lNumStfSenders);
-    }
+    mStfInfoExpiry.emplace_back(lStfId, lSlot.mFirstUpdate);
+  }
 
-    lStfIdVector.emplace_back(
-      std::chrono::system_clock::now(),
-      pStfInfo
-    );
+  mLastStfId = std::max(mLastStfId, lStfId);
 
-    pResponse.set_status(SchedulerStfInfoResponse::OK);
+  auto &lStf = lSlot.mStfs[lStfSenderIdx];
+  if (lStf.mReceived) {
+    DDLOGF(fair::Severity::WARNING, "Duplicate STF info. stf_id={:d} from_stf_sender={:s}",
+      lStfId, pStfInfo.info().process_id());
+    return;
+  }
 
-    // check if complete
-    if (lStfIdVector.size() == lNumStfSenders) {
+  lStf.mUpdateLocalTime = std::chrono::system_clock::now();
+  lStf.mStfSize = pStfInfo.stf_size();
+  lStf.mReceived = true;
 
-      auto lInfo = mStfInfoMap.extract(lStfId);
-      lLock.unlock();
+  // check if complete
+  if (++lSlot.mNumStfs == lNumStfSenders) {
+    mCompleteStfsInfo.push_back(lSlot);
+    lSlot.mValid = false;
+  }
+}
 
-      {
-        std::unique_lock lLockComplete(mCompleteStfInfoLock);
-        mCompleteStfsInfo.emplace_back(std::move(lInfo.mapped()));
-      }
+void TfSchedulerStfInfo::discardStfInfo(TfStfInfo &pSlot)
+{
+  assert(pSlot.mValid);
+
+  DDLOGF(fair::Severity::WARNING,
+    "Discarding incomplete SubTimeFrame. stf_id={:d} received={:d} expected={:d}",
+    pSlot.mTfId, pSlot.mNumStfs, mStfSenderIds.size());
 
-      mStfScheduleCondition.notify_one();
+  // find missing StfSenders
+  std::vector<std::string> lMissingStfSenders;
+  for (std::uint32_t lIdx = 0; lIdx < pSlot.mStfs.size(); lIdx++) {
+    if (!pSlot.mStfs[lIdx].mReceived) {
+      lMissingStfSenders.push_back(mStfSenderIds[lIdx]);
     }
   }
+
+  std::string lMissingIds = boost::algorithm::join(lMissingStfSenders, ", ");
+  DDLOGF(fair::Severity::DEBUG, "Missing STFs from StfSender IDs: {:s}", lMissingIds);
+
+  mConnManager.dropAllStfsAsync(pSlot.mTfId);
+  pSlot.mValid = false;
+}
+
+std::size_t TfSchedulerStfInfo::expireStfInfos(const std::chrono::system_clock::time_point pNow)
+{
+  std::size_t lNumDiscarded = 0;
+
+  // TFs are (mostly) announced in order: only the oldest entries have to be checked
+  while (!mStfInfoExpiry.empty()) {
+    const auto [lTfId, lFirstUpdate] = mStfInfoExpiry.front();
+    if (pNow - lFirstUpdate <= sStfDiscardTimeout) {
+      break;
+    }
+    mStfInfoExpiry.pop_front();
+
+    auto &lSlot = mStfInfoRing[lTfId % sStfInfoRingSize];
+    if (lSlot.mValid && lSlot.mTfId == lTfId) {
+      discardStfInfo(lSlot);
+      lNumDiscarded++;
+    }
+  }
+
+  return lNumDiscarded;
 }
 
 
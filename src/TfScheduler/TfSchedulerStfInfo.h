@@ -26,10 +26,13 @@
 #include <discovery.grpc.pb.h>
 #include <grpcpp/grpcpp.h>
 
+#include <ConcurrentQueue.h>
 #include <Utilities.h>
 
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <thread>
 #include <chrono>
 
@@ -40,21 +43,27 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
+/// Scheduling parameters of a scheduler instance
+struct TfSchedulingConfig {
+  TfBuilderSelectionPolicy mSelectionPolicy = TfBuilderSelectionPolicy::eRoundRobin;
+  /// Publish a static TF-to-TfBuilder slot table to StfSenders instead of scheduling each TF
+  bool mStaticAssignment = false;
+};
+
+/// STF update of one StfSender
 struct StfInfo {
   std::chrono::system_clock::time_point mUpdateLocalTime;
-  StfSenderStfInfo mStfInfo;
-  bool mIsScheduled = false;
-
-  StfInfo() = delete;
-  StfInfo(std::chrono::system_clock::time_point pUpdateLocalTime, const StfSenderStfInfo &pStfInfo)
-  : mUpdateLocalTime(pUpdateLocalTime),
-    mStfInfo(pStfInfo)
-  {
-  }
+  std::uint64_t mStfSize = 0;
+  bool mReceived = false;
+};
 
-  const std::string& process_id() const { return mStfInfo.info().process_id(); }
-  std::uint64_t stf_id() const { return mStfInfo.stf_id(); }
-  std::uint64_t stf_size() const { return mStfInfo.stf_size(); }
+/// STF updates of one TF, indexed by StfSender index
+struct TfStfInfo {
+  std::uint64_t mTfId = 0;
+  bool mValid = false;
+  std::uint32_t mNumStfs = 0;
+  std::chrono::system_clock::time_point mFirstUpdate;
+  std::vector<StfInfo> mStfs;
 };
 
 class TfSchedulerStfInfo
@@ -63,10 +72,12 @@ public:
   TfSchedulerStfInfo() = delete;
   TfSchedulerStfInfo(std::shared_ptr<ConsulTfSchedulerInstance> pDiscoveryConfig,
                      TfSchedulerConnManager &pConnManager,
-                     TfSchedulerTfBuilderInfo &pTfBuilderInfo)
+                     TfSchedulerTfBuilderInfo &pTfBuilderInfo,
+                     const TfSchedulingConfig &pSchedulingConfig)
   : mDiscoveryConfig(pDiscoveryConfig),
     mConnManager(pConnManager),
-    mTfBuilderInfo(pTfBuilderInfo)
+    mTfBuilderInfo(pTfBuilderInfo),
+    mStaticAssignment(pSchedulingConfig.mStaticAssignment)
   {
 
   }
@@ -74,31 +85,63 @@ public:
   ~TfSchedulerStfInfo() { }
 
   void start() {
-    mStfInfoMap.clear();
+    mCompleteStfsInfo.clear();
+    mStfInfoQueue.clear();
+    mStfDropInfoQueue.clear();
 
     mRunning = true;
+    // Start the BuildTfRequest completion thread
+    mBuildTfCq = std::make_unique<grpc::CompletionQueue>();
+    mBuildTfCompletionThread = std::thread(&TfSchedulerStfInfo::BuildTfCompletionThread, this);
     // Start the scheduling thread
-    mSchedulingThread = std::thread(&TfSchedulerStfInfo::SchedulingThread, this);
+    if (mStaticAssignment) {
+      mSchedulingThread = std::thread(&TfSchedulerStfInfo::StaticAssignmentThread, this);
+    } else {
+      mSchedulingThread = std::thread(&TfSchedulerStfInfo::SchedulingThread, this);
+    }
   }
 
   void stop() {
     mRunning = false;
+    mStfInfoQueue.notify();
 
     if (mSchedulingThread.joinable()) {
       mSchedulingThread.join();
     }
 
+    // wait for the outstanding BuildTfRequests
+    if (mBuildTfCq) {
+      mBuildTfCq->Shutdown();
+    }
+    if (mBuildTfCompletionThread.joinable()) {
+      mBuildTfCompletionThread.join();
+    }
+    mBuildTfCq.reset();
+
     // delete all stf information
-    mStfInfoMap.clear();
+    mStfInfoRing.clear();
+    mStfInfoExpiry.clear();
+    mCompleteStfsInfo.clear();
+    mStfInfoQueue.clear();
+    mStfDropInfoQueue.clear();
   }
 
   void SchedulingThread();
+  void BuildTfCompletionThread();
+  void StaticAssignmentThread();
+
+  /// Queue the STF update for the scheduling thread. Safe to call from any thread
   void addStfInfo(const StfSenderStfInfo &pStfInfo, SchedulerStfInfoResponse &pResponse);
+  /// Queue STFs evicted by a StfSender. Their TFs cannot be built and are discarded
+  void addStfDropInfo(const StfSenderStfDropInfo &pStfDropInfo);
 
 
 private:
   /// Discard timeout for incomplete TFs
   static constexpr auto sStfDiscardTimeout = 10s;
+  static constexpr auto sStfExpiryCheckInterval = 500ms;
+  /// Number of TFs tracked by the STF info table. Must be larger than (discard timeout x TF rate)
+  static constexpr std::size_t sStfInfoRingSize = 4096;
 
   /// Discovery configuration
   std::shared_ptr<ConsulTfSchedulerInstance> mDiscoveryConfig;
@@ -109,19 +152,56 @@ private:
   /// Collect information on TfBuilders
   TfSchedulerTfBuilderInfo &mTfBuilderInfo;
 
+  /// Static TF assignment: the slot table is published on change, and periodically for late StfSenders
+  const bool mStaticAssignment;
+  static constexpr auto sSlotTableUpdateInterval = 100ms;
+  static constexpr auto sSlotTableRepublishInterval = 5s;
+  /// A new slot table takes effect this many TFs after the last built TF, so that it reaches all
+  /// StfSenders before any of them switches
+  static constexpr std::uint64_t sSlotTableSwitchMargin = 256;
+
   /// Housekeeping thread
   std::atomic_bool mRunning = false;
   std::thread mSchedulingThread;
 
-  /// Stfs global info
-  mutable std::mutex mGlobalStfInfoLock;
-  std::map<std::uint64_t, std::vector<StfInfo>> mStfInfoMap;
-  std::uint64_t mLastStfId = 0;
+  /// Incoming STF updates, consumed by the scheduling thread
+  ConcurrentMpscQueue<StfSenderStfInfo> mStfInfoQueue;
+  void processStfInfo(const StfSenderStfInfo &pStfInfo);
+
+  /// Evicted STFs, consumed by the scheduling thread
+  ConcurrentMpscQueue<StfSenderStfDropInfo> mStfDropInfoQueue;
+  void processStfDropInfo(const StfSenderStfDropInfo &pStfDropInfo);
 
-  /// Stfs for scheduling
-  mutable std::mutex mCompleteStfInfoLock;
-  std::condition_variable mStfScheduleCondition;
-  std::deque<std::vector<StfInfo>> mCompleteStfsInfo;
+  /// StfSender id <-> index mapping
+  std::vector<std::string> mStfSenderIds;
+  std::unordered_map<std::string, std::uint32_t> mStfSenderIdxMap;
+
+  /// Stfs global info (scheduling thread only): ring indexed by stf_id % sStfInfoRingSize
+  std::vector<TfStfInfo> mStfInfoRing;
+  std::deque<std::pair<std::uint64_t, std::chrono::system_clock::time_point>> mStfInfoExpiry;
+  std::uint64_t mLastStfId = 0;
+  void discardStfInfo(TfStfInfo &pSlot);
+  std::size_t expireStfInfos(const std::chrono::system_clock::time_point pNow);
+
+  /// Stfs for scheduling (scheduling thread only)
+  std::deque<TfStfInfo> mCompleteStfsInfo;
+  void scheduleTf(const TfStfInfo &pStfInfos);
+
+  /// Outstanding BuildTfRequest. The pointer is used as the completion queue tag
+  struct BuildTfCall {
+    std::string mTfBuilderId;
+    std::uint64_t mTfId = 0;
+    std::chrono::steady_clock::time_point mStart;
+
+    grpc::ClientContext mContext;
+    BuildTfResponse mResponse;
+    grpc::Status mStatus;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<BuildTfResponse>> mReader;
+  };
+  static constexpr auto sBuildTfRequestTimeout = 2s;
+  std::unique_ptr<grpc::CompletionQueue> mBuildTfCq;
+  std::thread mBuildTfCompletionThread;
+  RunningSamples<float> mBuildTfLatencySamples;
 
 };
 }
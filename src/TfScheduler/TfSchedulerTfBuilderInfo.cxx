@@ -19,6 +19,7 @@
 #include <set>
 #include <tuple>
 #include <algorithm>
+#include <limits>
 
 namespace o2
 {
@@ -27,6 +28,217 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
+bool parseTfBuilderSelectionPolicy(const std::string &pName, TfBuilderSelectionPolicy &pPolicy /*out*/)
+{
+  if (pName == "round-robin") {
+    pPolicy = TfBuilderSelectionPolicy::eRoundRobin;
+  } else if (pName == "least-loaded") {
+    pPolicy = TfBuilderSelectionPolicy::eLeastLoaded;
+  } else if (pName == "most-free-memory") {
+    pPolicy = TfBuilderSelectionPolicy::eMostFreeMemory;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* TfBuilderSelectionPolicyName(const TfBuilderSelectionPolicy pPolicy)
+{
+  switch (pPolicy) {
+    case TfBuilderSelectionPolicy::eRoundRobin:
+      return "round-robin";
+    case TfBuilderSelectionPolicy::eLeastLoaded:
+      return "least-loaded";
+    case TfBuilderSelectionPolicy::eMostFreeMemory:
+      return "most-free-memory";
+  }
+  return "unknown";
+}
+
+void TfBuilderInfo::reserveTf(const std::uint64_t pTfId, const std::uint64_t pTfSize)
+{
+  const auto lReserved = std::min(reservationSize(pTfSize), mEstimatedFreeMemory.load());
+
+  mReservations[pTfId] = TfReservation{ pTfSize, lReserved, std::chrono::steady_clock::now() };
+  mReservedMemory += lReserved;
+  mEstimatedFreeMemory -= lReserved;
+  mEstimatedNumTfs += 1;
+  mBuildTfRequestsInFlight++;
+}
+
+void TfBuilderInfo::releaseTf(const std::uint64_t pTfId)
+{
+  auto lIt = mReservations.find(pTfId);
+  if (lIt == mReservations.end()) {
+    return;
+  }
+
+  mReservedMemory -= lIt->second.mReserved;
+  mEstimatedFreeMemory += lIt->second.mReserved;
+  mEstimatedNumTfs -= std::min(mEstimatedNumTfs.load(), std::uint64_t(1));
+  mReservations.erase(lIt);
+}
+
+void TfBuilderInfo::reconcileReservations(const TfBuilderUpdateMessage &pTfBuilderUpdate)
+{
+  const auto lLastBuiltTfId = pTfBuilderUpdate.last_built_tf_id();
+
+  // learn the overhead from the last built TF
+  if (pTfBuilderUpdate.last_built_tf_size() > 0) {
+    const auto lIt = mReservations.find(lLastBuiltTfId);
+    if (lIt != mReservations.end() && lIt->second.mTfSize > 0) {
+      mSizeEstimator.addSample(double(pTfBuilderUpdate.last_built_tf_size()) / double(lIt->second.mTfSize));
+    }
+  }
+
+  // built (or dropped) TFs are accounted in the reported free memory
+  for (const auto lTfId : pTfBuilderUpdate.built_tf_ids()) {
+    const auto lIt = mReservations.find(lTfId);
+    if (lIt != mReservations.end()) {
+      mReservedMemory -= lIt->second.mReserved;
+      mReservations.erase(lIt);
+    }
+  }
+
+  // TFs that never reached the TfBuilder are not reported: release them after the timeout
+  const auto lNow = std::chrono::steady_clock::now();
+  for (auto lIt = mReservations.begin(); lIt != mReservations.end(); ) {
+    if (lNow - lIt->second.mReserveTime > sReservationTimeout) {
+      mReservedMemory -= lIt->second.mReserved;
+      lIt = mReservations.erase(lIt);
+    } else {
+      ++lIt;
+    }
+  }
+
+  const auto lFreeMemory = pTfBuilderUpdate.free_memory();
+  mEstimatedFreeMemory = (lFreeMemory > mReservedMemory) ? (lFreeMemory - mReservedMemory) : 0;
+  mEstimatedNumTfs = pTfBuilderUpdate.num_buffered_tfs() + mReservations.size();
+}
+
+void TfBuilderInfo::updateMemoryPressure(const std::uint64_t pFreeMemory)
+{
+  // hysteresis: leave the static assignment below 10% free memory, rejoin above 30%
+  constexpr double cPressureOn = 0.1;
+  constexpr double cPressureOff = 0.3;
+
+  mMaxFreeMemory = std::max(mMaxFreeMemory, pFreeMemory);
+
+  if (mMemoryPressure) {
+    mMemoryPressure = (double(pFreeMemory) < cPressureOff * double(mMaxFreeMemory));
+  } else {
+    mMemoryPressure = (double(pFreeMemory) < cPressureOn * double(mMaxFreeMemory));
+  }
+}
+
+std::uint64_t TfBuilderSelector::key(const TfBuilderInfo &pInfo) const
+{
+  switch (mPolicy) {
+    case TfBuilderSelectionPolicy::eRoundRobin:
+      return pInfo.mSelectionSeq;
+    case TfBuilderSelectionPolicy::eLeastLoaded:
+      return pInfo.mEstimatedNumTfs;
+    case TfBuilderSelectionPolicy::eMostFreeMemory:
+      return std::numeric_limits<std::uint64_t>::max() - pInfo.mEstimatedFreeMemory;
+  }
+  return 0;
+}
+
+void TfBuilderSelector::add(std::shared_ptr<TfBuilderInfo> pInfo)
+{
+  const std::string lId = pInfo->id();
+  remove(lId);
+
+  // new TfBuilders are selected first with the round-robin policy
+  pInfo->mSelectionSeq = 0;
+
+  auto lIndexIt = mIndex.emplace(key(*pInfo), lId).first;
+  mEntries.emplace(lId, Entry{ std::move(pInfo), lIndexIt, mParkedBySize.end() });
+}
+
+bool TfBuilderSelector::remove(const std::string &pId)
+{
+  auto lEntryIt = mEntries.find(pId);
+  if (lEntryIt == mEntries.end()) {
+    return false;
+  }
+
+  auto &lEntry = lEntryIt->second;
+  if (lEntry.mIndexIt != mIndex.end()) {
+    mIndex.erase(lEntry.mIndexIt);
+  }
+  if (lEntry.mParkedIt != mParkedBySize.end()) {
+    mParkedBySize.erase(lEntry.mParkedIt);
+  }
+  mEntries.erase(lEntryIt);
+  return true;
+}
+
+void TfBuilderSelector::update(const std::string &pId)
+{
+  auto lEntryIt = mEntries.find(pId);
+  if (lEntryIt == mEntries.end()) {
+    return;
+  }
+
+  auto &lEntry = lEntryIt->second;
+  const auto lKey = key(*lEntry.mInfo);
+  if (lEntry.mIndexIt == mIndex.end()) {
+    // parked by select(): selectable again with the new estimates
+    if (lEntry.mParkedIt != mParkedBySize.end()) {
+      mParkedBySize.erase(lEntry.mParkedIt);
+      lEntry.mParkedIt = mParkedBySize.end();
+    }
+    lEntry.mIndexIt = mIndex.emplace(lKey, pId).first;
+  } else if (lEntry.mIndexIt->first != lKey) {
+    mIndex.erase(lEntry.mIndexIt);
+    lEntry.mIndexIt = mIndex.emplace(lKey, pId).first;
+  }
+}
+
+std::shared_ptr<TfBuilderInfo> TfBuilderSelector::select(const std::uint64_t pTfId, const std::uint64_t pTfSize)
+{
+  const auto lStart = std::chrono::steady_clock::now();
+
+  // TfBuilders parked on a larger TF might have enough memory for this one
+  for (auto lParkedIt = mParkedBySize.lower_bound({ pTfSize + 1, std::string() }); lParkedIt != mParkedBySize.end(); ) {
+    auto &lEntry = mEntries.at(lParkedIt->second);
+    lEntry.mParkedIt = mParkedBySize.end();
+    lEntry.mIndexIt = mIndex.emplace(key(*lEntry.mInfo), lParkedIt->second).first;
+    lParkedIt = mParkedBySize.erase(lParkedIt);
+  }
+
+  std::shared_ptr<TfBuilderInfo> lSelected;
+
+  for (auto lIndexIt = mIndex.begin(); lIndexIt != mIndex.end(); ) {
+    auto &lEntry = mEntries.at(lIndexIt->second);
+    if (lEntry.mInfo->canAcceptTf(pTfSize)) {
+      lSelected = lEntry.mInfo;
+      break;
+    }
+
+    // park the TfBuilder until its estimates change (update()), so it is not walked for every TF.
+    // Without enough free memory, it is re-admitted for a smaller TF.
+    if (lEntry.mInfo->canAcceptBuildTfRequest()) {
+      lEntry.mParkedIt = mParkedBySize.emplace(pTfSize, lIndexIt->second).first;
+    }
+    lEntry.mIndexIt = mIndex.end();
+    lIndexIt = mIndex.erase(lIndexIt);
+  }
+
+  if (lSelected) {
+    // reserve the resources until the TfBuilder reports back
+    lSelected->reserveTf(pTfId, pTfSize);
+    lSelected->mSelectionSeq = ++mSelectionSeq;
+
+    update(lSelected->id());
+  }
+
+  mDecisionLatencySamples.Fill(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - lStart).count());
+
+  return lSelected;
+}
+
 void TfSchedulerTfBuilderInfo::updateTfBuilderInfo(const TfBuilderUpdateMessage &pTfBuilderUpdate)
 {
   using namespace std::chrono_literals;
@@ -79,43 +291,15 @@ void TfSchedulerTfBuilderInfo::updateTfBuilderInfo(const TfBuilderUpdateMessage
       std::scoped_lock lLockReady(mReadyInfoLock);
       lInfo->mUpdateLocalTime = lLocalTime;
 
-      // update only when the last scheduled tf is built!
-      if (pTfBuilderUpdate.last_built_tf_id() == lInfo->last_scheduled_tf_id()) {
-        // store the new information
-        lInfo->mTfBuilderUpdate = pTfBuilderUpdate;
+      lInfo->mTfBuilderUpdate = pTfBuilderUpdate;
 
-        // verify the memory estimation is correct
-        if (lInfo->mEstimatedFreeMemory > pTfBuilderUpdate.free_memory() ) {
-          DDLOGF(fair::Severity::DEBUG,
-            "TfBuilder memory estimate is too high. tfb_id={:s} mem_estimate={f}", lTfBuilderId,
-            (double(lInfo->mEstimatedFreeMemory) / double(pTfBuilderUpdate.free_memory())));
-        }
+      // NOTE: TFs are scheduled before last_scheduled_tf_id is updated. Reservations are kept
+      //       per TF id, and released only when the TfBuilder reports them as built.
+      lInfo->reconcileReservations(pTfBuilderUpdate);
+      lInfo->updateMemoryPressure(pTfBuilderUpdate.free_memory());
 
-        lInfo->mEstimatedFreeMemory = pTfBuilderUpdate.free_memory();
-
-      } else if (pTfBuilderUpdate.last_built_tf_id() < lInfo->last_scheduled_tf_id()) {
-
-        // update scheduler's estimate to be on the safe side
-        if (lInfo->mEstimatedFreeMemory > pTfBuilderUpdate.free_memory() ) {
-
-          DDLOGF(fair::Severity::DEBUG,
-            "Ignoring TfBuilder info (last_build < last_scheduled). Fixing the estimate ratio. "
-            "tfb_id={:s} new_mem_stimate={f}", lTfBuilderId,
-            (double(lInfo->mEstimatedFreeMemory) / double(pTfBuilderUpdate.free_memory())));
-
-          lInfo->mEstimatedFreeMemory = pTfBuilderUpdate.free_memory();
-
-        } else {
-          // if (last_build > last_scheduled)
-          // NOTE: there is a "race" between notifying the EPN to build and updating last_scheduled_tf_id
-          // in our record. Thus, this codepath is possible, and we should update the est memory since we
-          // hold the lock
-          lInfo->mEstimatedFreeMemory = std::min(
-            lInfo->mEstimatedFreeMemory.load(),
-            pTfBuilderUpdate.free_memory()
-          );
-        }
-      }
+      // reposition in the selection index
+      mReadyTfBuilders.update(lTfBuilderId);
     }
   } // mGlobalInfoLock unlock
 }
@@ -145,14 +329,27 @@ void TfSchedulerTfBuilderInfo::HousekeepingThread()
           lIdsToErase.emplace_back(lInfo->mTfBuilderUpdate.info().process_id());
         }
 
+        std::scoped_lock lLockReady(mReadyInfoLock);
         DDLOGF(fair::Severity::DEBUG,
-          "TfBuilder information: tfb_id={:s} free_memory={:d} num_buffered_tfs={:d}",
+          "TfBuilder information: tfb_id={:s} free_memory={:d} num_buffered_tfs={:d} reserved_memory={:d} "
+          "tf_size_factor={:.3f} tf_size_samples={:d}",
           lInfo->mTfBuilderUpdate.info().process_id(), lInfo->mTfBuilderUpdate.free_memory(),
-          lInfo->mTfBuilderUpdate.num_buffered_tfs());
+          lInfo->mTfBuilderUpdate.num_buffered_tfs(), lInfo->mReservedMemory,
+          lInfo->mSizeEstimator.factor(), lInfo->mSizeEstimator.numSamples());
       }
 
     } // mGlobalInfoLock unlock (to be able to sleep)
 
+    {
+      std::scoped_lock lLock(mReadyInfoLock);
+      const auto &lLatency = mReadyTfBuilders.DecisionLatencySamples();
+      DDLOGF(fair::Severity::DEBUG,
+        "TfBuilder selection: policy={:s} num_ready={:d} num_selectable={:d} decision_latency_us_mean={:.2f} "
+        "decision_latency_us_max={:.2f}",
+        TfBuilderSelectionPolicyName(mReadyTfBuilders.policy()), mReadyTfBuilders.size(), mReadyTfBuilders.numSelectable(),
+        lLatency.Mean(), lLatency.MinMax().second);
+    }
+
     if (!lIdsToErase.empty()) {
       for (const auto &lId : lIdsToErase) {
         std::scoped_lock lLock(mGlobalInfoLock); // CHECK if we need this lock?
@@ -26,8 +26,11 @@
 #include <Utilities.h>
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <map>
-#include <deque>
+#include <set>
+#include <unordered_map>
 #include <thread>
 #include <chrono>
 
@@ -38,12 +41,85 @@ namespace DataDistribution
 
 using namespace std::chrono_literals;
 
+/// Estimate of the TF memory requirement on a TfBuilder
+/// Learns the ratio of built TF size to the announced STF sizes (EWMA of mean and variance),
+/// and reserves the mean plus a confidence bound.
+class TfSizeEstimator
+{
+ public:
+  std::uint64_t reservation(const std::uint64_t pTfSize) const
+  {
+    return std::uint64_t(double(pTfSize) * factor());
+  }
+
+  double factor() const
+  {
+    if (mNumSamples < sMinSamples) {
+      return sDefaultFactor;
+    }
+    return std::clamp(mMean + sConfidence * std::sqrt(mVariance), sMinFactor, sMaxFactor);
+  }
+
+  void addSample(const double pRatio)
+  {
+    if (mNumSamples == 0) {
+      mMean = pRatio;
+      mVariance = 0.0;
+    } else {
+      const double lDiff = pRatio - mMean;
+      const double lIncr = sAlpha * lDiff;
+      mMean += lIncr;
+      mVariance = (1.0 - sAlpha) * (mVariance + lDiff * lIncr);
+    }
+    mNumSamples++;
+  }
+
+  std::uint64_t numSamples() const { return mNumSamples; }
+
+ private:
+  /// Used until enough TFs are built (the previous fixed 20% overestimate)
+  static constexpr double sDefaultFactor = 1.2;
+  static constexpr std::uint64_t sMinSamples = 8;
+  static constexpr double sAlpha = 0.1;
+  static constexpr double sConfidence = 3.0;
+  static constexpr double sMinFactor = 1.0;
+  static constexpr double sMaxFactor = 2.0;
+
+  double mMean = 0.0;
+  double mVariance = 0.0;
+  std::uint64_t mNumSamples = 0;
+};
+
 struct TfBuilderInfo {
   std::chrono::system_clock::time_point mUpdateLocalTime;
   TfBuilderUpdateMessage mTfBuilderUpdate;
   std::atomic_uint64_t mLastScheduledTf = 0;
 
   std::atomic_uint64_t mEstimatedFreeMemory;
+  std::atomic_uint64_t mEstimatedNumTfs;
+
+  /// Memory pressure (static TF assignment): largest reported free memory is used as the buffer size
+  std::uint64_t mMaxFreeMemory = 0;
+  bool mMemoryPressure = false;
+
+  /// Memory reserved for scheduled TFs which are not yet built
+  struct TfReservation {
+    std::uint64_t mTfSize;
+    std::uint64_t mReserved;
+    std::chrono::steady_clock::time_point mReserveTime;
+  };
+  /// longer than the TF assembly timeout of the TfBuilder
+  static constexpr auto sReservationTimeout = std::chrono::seconds(10);
+  std::map<std::uint64_t, TfReservation> mReservations;
+  std::uint64_t mReservedMemory = 0;
+  TfSizeEstimator mSizeEstimator;
+
+  /// last selection (round-robin policy)
+  std::uint64_t mSelectionSeq = 0;
+
+  /// BuildTfRequests without a response
+  static constexpr std::uint32_t sMaxBuildTfRequestsInFlight = 4;
+  std::uint32_t mBuildTfRequestsInFlight = 0;
 
   TfBuilderInfo() = delete;
 
@@ -52,19 +128,107 @@ struct TfBuilderInfo {
     mTfBuilderUpdate(pTfBuilderUpdate)
   {
     mEstimatedFreeMemory = mTfBuilderUpdate.free_memory();
+    mEstimatedNumTfs = mTfBuilderUpdate.num_buffered_tfs();
+    mMaxFreeMemory = mTfBuilderUpdate.free_memory();
   }
 
   const std::string& id() const { return mTfBuilderUpdate.info().process_id(); }
   std::uint64_t last_scheduled_tf_id() const { return mLastScheduledTf; }
   std::uint64_t last_built_tf_id() const { return mTfBuilderUpdate.last_built_tf_id(); }
+
+  std::uint64_t reservationSize(const std::uint64_t pTfSize) const { return mSizeEstimator.reservation(pTfSize); }
+  bool canAcceptBuildTfRequest() const { return mBuildTfRequestsInFlight < sMaxBuildTfRequestsInFlight; }
+  bool canAcceptTf(const std::uint64_t pTfSize) const
+  {
+    return canAcceptBuildTfRequest() && (mEstimatedFreeMemory >= reservationSize(pTfSize));
+  }
+  void reserveTf(const std::uint64_t pTfId, const std::uint64_t pTfSize);
+  void releaseTf(const std::uint64_t pTfId);
+  /// Release reservations of built TFs and learn the size overhead
+  void reconcileReservations(const TfBuilderUpdateMessage &pTfBuilderUpdate);
+  void updateMemoryPressure(const std::uint64_t pFreeMemory);
+};
+
+/// TfBuilder selection policies
+enum class TfBuilderSelectionPolicy {
+  eRoundRobin,      // least recently selected TfBuilder
+  eLeastLoaded,     // fewest buffered TimeFrames
+  eMostFreeMemory   // largest free memory
+};
+
+bool parseTfBuilderSelectionPolicy(const std::string &pName, TfBuilderSelectionPolicy &pPolicy /*out*/);
+const char* TfBuilderSelectionPolicyName(const TfBuilderSelectionPolicy pPolicy);
+
+/// Index of ready TfBuilders, ordered by the selection policy
+/// Insert, update and removal are O(log n). Selection takes the first TfBuilder in the policy
+/// order that can accept the TF (enough free memory, BuildTfRequest slots available).
+/// TfBuilders that cannot accept a TF are parked until their next update, so they are not walked
+/// for every TF. A TfBuilder parked for lack of memory is selectable again for a smaller TF.
+class TfBuilderSelector
+{
+ public:
+  TfBuilderSelector(const TfBuilderSelectionPolicy pPolicy)
+  : mPolicy(pPolicy)
+  {
+  }
+
+  TfBuilderSelectionPolicy policy() const { return mPolicy; }
+
+  void add(std::shared_ptr<TfBuilderInfo> pInfo);
+  bool remove(const std::string &pId);
+  /// Reposition the TfBuilder after its estimates have changed
+  void update(const std::string &pId);
+  /// Select a TfBuilder and reserve the memory for the TF
+  std::shared_ptr<TfBuilderInfo> select(const std::uint64_t pTfId, const std::uint64_t pTfSize);
+
+  void clear() { mIndex.clear(); mParkedBySize.clear(); mEntries.clear(); }
+
+  template <typename Func>
+  void forEach(Func&& pFunc) const
+  {
+    for (const auto &lEntry : mEntries) {
+      pFunc(*lEntry.second.mInfo);
+    }
+  }
+  bool empty() const { return mEntries.empty(); }
+  std::size_t size() const { return mEntries.size(); }
+  /// TfBuilders not parked after failing canAcceptTf()
+  std::size_t numSelectable() const { return mIndex.size(); }
+
+  /// Selection latency (in microseconds)
+  const RunningSamples<float>& DecisionLatencySamples() const { return mDecisionLatencySamples; }
+
+ private:
+  using IndexKey = std::pair<std::uint64_t, std::string>;
+
+  struct Entry {
+    std::shared_ptr<TfBuilderInfo> mInfo;
+    std::set<IndexKey>::iterator mIndexIt;  // mIndex.end() when parked
+    std::set<IndexKey>::iterator mParkedIt; // mParkedBySize.end() when not parked for lack of memory
+  };
+
+  std::uint64_t key(const TfBuilderInfo &pInfo) const;
+
+  const TfBuilderSelectionPolicy mPolicy;
+  std::uint64_t mSelectionSeq = 0;
+
+  /// TfBuilders that cannot accept a TF are removed from the index until their next update
+  std::set<IndexKey> mIndex;
+  /// TfBuilders parked for lack of memory, keyed by the size of the rejected TF
+  std::set<IndexKey> mParkedBySize;
+  std::unordered_map<std::string, Entry> mEntries;
+
+  RunningSamples<float> mDecisionLatencySamples;
 };
 
 class TfSchedulerTfBuilderInfo
 {
  public:
   TfSchedulerTfBuilderInfo() = delete;
-  TfSchedulerTfBuilderInfo(std::shared_ptr<ConsulTfSchedulerInstance> pDiscoveryConfig)
-  : mDiscoveryConfig(pDiscoveryConfig)
+  TfSchedulerTfBuilderInfo(std::shared_ptr<ConsulTfSchedulerInstance> pDiscoveryConfig,
+                           const TfBuilderSelectionPolicy pSelectionPolicy)
+  : mDiscoveryConfig(pDiscoveryConfig),
+    mReadyTfBuilders(pSelectionPolicy)
   {
     mGlobalInfo.reserve(1000); // number of EPNs
   }
@@ -88,7 +252,10 @@ class TfSchedulerTfBuilderInfo
 
     // delete all info
     mGlobalInfo.clear();
-    mReadyTfBuilders.clear();
+    {
+      std::scoped_lock lLock(mReadyInfoLock);
+      mReadyTfBuilders.clear();
+    }
   }
 
   void HousekeepingThread();
@@ -98,42 +265,33 @@ class TfSchedulerTfBuilderInfo
   void addReadyTfBuilder(std::shared_ptr<TfBuilderInfo> pInfo)
   {
     std::scoped_lock lLock(mReadyInfoLock);
-    mReadyTfBuilders.emplace_back(std::move(pInfo));
+    mReadyTfBuilders.add(std::move(pInfo));
   }
 
-  void removeReadyTfBuilder(const std::string &pId)
+  bool removeReadyTfBuilder(const std::string &pId)
   {
     std::scoped_lock lLock(mReadyInfoLock);
-    for (auto it = mReadyTfBuilders.begin(); it != mReadyTfBuilders.end(); it++) {
-      if ((*it)->id() == pId) {
-        DDLOG(fair::Severity::DEBUG) << "Removed TfBuilder from the ready list :" << pId;
-        mReadyTfBuilders.erase(it);
-        break;
-      }
+    if (mReadyTfBuilders.remove(pId)) {
+      DDLOG(fair::Severity::DEBUG) << "Removed TfBuilder from the ready list :" << pId;
+      return true;
     }
+    return false;
   }
 
-  bool findTfBuilderForTf(const std::uint64_t pSize, std::string& pTfBuilderId /*out*/)
+  bool findTfBuilderForTf(const std::uint64_t pTfId, const std::uint64_t pSize, std::string& pTfBuilderId /*out*/)
   {
 
     static std::atomic_uint64_t sNoTfBuilderAvailable = 0;
     static std::atomic_uint64_t sNoMemoryAvailable = 0;
 
-    // NOTE: we will overestimate memory requirement by a factor, until TfBuilder updates
-    //       us with the actual size.
-    const auto lTfEstSize = pSize * (sTfSizeOverestimatePercent + 100) / 100;
-
     std::scoped_lock lLock(mReadyInfoLock);
 
-    auto lIt = mReadyTfBuilders.begin();
-    for (; lIt != mReadyTfBuilders.end(); ++lIt) {
-      if ((*lIt)->mEstimatedFreeMemory >= lTfEstSize) {
-        break;
-      }
-    }
+    // NOTE: the memory is reserved with the estimated TF overhead, until TfBuilder updates
+    //       us with the built TF.
+    auto lTfBuilder = mReadyTfBuilders.select(pTfId, pSize);
 
     // TfBuilder not found?
-    if ( lIt == mReadyTfBuilders.end() ) {
+    if (!lTfBuilder) {
       if (mReadyTfBuilders.empty()) {
         if (++sNoTfBuilderAvailable % 10 == 0) {
           DDLOGF(fair::Severity::INFO,
@@ -149,39 +307,62 @@ class TfSchedulerTfBuilderInfo
       return false;
     }
 
-
-    // reposition the selected StfBuilder to the end of the list
-    auto lTfBuilder = std::move(*lIt);
-
-    assert (lTfBuilder->mEstimatedFreeMemory >= lTfEstSize);
-
     // copy the string out
     assert (!lTfBuilder->id().empty());
     pTfBuilderId = lTfBuilder->id();
 
-    // deque erase reverse_iterator
-    mReadyTfBuilders.erase(lIt);
+    return true;
+  }
 
-    lTfBuilder->mEstimatedFreeMemory -= lTfEstSize;
-    mReadyTfBuilders.emplace_back(std::move(lTfBuilder));
+  /// TfBuilders for the static TF assignment: ready and not under memory pressure (sorted)
+  void getStaticAssignmentTfBuilders(std::vector<std::string> &pTfBuilderIds /*out*/) const
+  {
+    pTfBuilderIds.clear();
+    {
+      std::scoped_lock lLock(mReadyInfoLock);
+      mReadyTfBuilders.forEach([&](const TfBuilderInfo &pInfo) {
+        if (!pInfo.mMemoryPressure) {
+          pTfBuilderIds.push_back(pInfo.id());
+        }
+      });
+    }
+    std::sort(pTfBuilderIds.begin(), pTfBuilderIds.end());
+  }
 
-    return true;
+  /// Newest TF built by any ready TfBuilder
+  std::uint64_t getLastBuiltTfId() const
+  {
+    std::uint64_t lLastBuiltTfId = 0;
+    std::scoped_lock lLock(mReadyInfoLock);
+    mReadyTfBuilders.forEach([&](const TfBuilderInfo &pInfo) {
+      lLastBuiltTfId = std::max(lLastBuiltTfId, pInfo.last_built_tf_id());
+    });
+    return lLastBuiltTfId;
   }
 
-  bool markTfBuilderWithTfId(const std::string& pTfBuilderId, const std::uint64_t pTfIf)
+  /// BuildTfRequest completed. If the TF will not be built, the reservation is released
+  void buildTfRequestDone(const std::string& pTfBuilderId, const std::uint64_t pTfId, const bool pAccepted)
   {
-    std::scoped_lock lLock(mGlobalInfoLock);
-    if (mGlobalInfo.count(pTfBuilderId) > 0) {
-      mGlobalInfo[pTfBuilderId]->mLastScheduledTf = pTfIf;
-      return true;
+    std::scoped_lock lLock(mGlobalInfoLock, mReadyInfoLock);
+    auto lIt = mGlobalInfo.find(pTfBuilderId);
+    if (lIt == mGlobalInfo.end()) {
+      return;
     }
-    return false;
+
+    auto &lInfo = lIt->second;
+    if (lInfo->mBuildTfRequestsInFlight > 0) {
+      lInfo->mBuildTfRequestsInFlight--;
+    }
+
+    if (pAccepted) {
+      lInfo->mLastScheduledTf = std::max(lInfo->mLastScheduledTf.load(), pTfId);
+    } else {
+      lInfo->releaseTf(pTfId);
+    }
+    mReadyTfBuilders.update(pTfBuilderId);
   }
 
 private:
-  /// Overestimation of actual size for TF building
-  static constexpr std::uint64_t sTfSizeOverestimatePercent = 20;
-
   /// Discard timeout for non-complete TFs
   static constexpr auto sTfBuilderDiscardTimeout = 5s;
 
@@ -196,9 +377,9 @@ private:
   mutable std::recursive_mutex mGlobalInfoLock;
   std::unordered_map<std::string, std::shared_ptr<TfBuilderInfo>> mGlobalInfo;
 
-  /// List of TfBuilders with available resources
+  /// TfBuilders with available resources
   mutable std::recursive_mutex mReadyInfoLock;
-  std::deque<std::shared_ptr<TfBuilderInfo>> mReadyTfBuilders;
+  TfBuilderSelector mReadyTfBuilders;
 };
 
 }
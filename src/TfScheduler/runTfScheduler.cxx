@@ -19,6 +19,19 @@ namespace bpo = boost::program_options;
 
 void addCustomOptions(bpo::options_description& options)
 {
+  bpo::options_description lTfSchedulerOptions("TfScheduler options", 120);
+
+  lTfSchedulerOptions.add_options()(
+    o2::DataDistribution::TfSchedulerDevice::OptionKeyTfBuilderSelection,
+    bpo::value<std::string>()->default_value("round-robin"),
+    "TfBuilder selection policy: round-robin, least-loaded, or most-free-memory.")(
+    o2::DataDistribution::TfSchedulerDevice::OptionKeyStaticTfAssignment,
+    bpo::bool_switch()->default_value(false),
+    "Assign TFs to TfBuilders with a static slot table published to StfSenders. "
+    "TfBuilders under memory pressure are removed from the table.");
+
+  options.add(lTfSchedulerOptions);
+
   // Add options for Data Distribution discovery
   options.add(o2::DataDistribution::Config::getProgramOptions(o2::DataDistribution::ProcessType::TfSchedulerService));
 }
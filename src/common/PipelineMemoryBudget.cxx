@@ -0,0 +1,92 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "PipelineMemoryBudget.h"
+#include "DataDistLogger.h"
+
+#include <options/FairMQProgOptions.h>
+
+#include <boost/program_options/options_description.hpp>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+namespace bpo = boost::program_options;
+
+////////////////////////////////////////////////////////////////////////////////
+/// PipelineMemoryBudgetConfig
+////////////////////////////////////////////////////////////////////////////////
+
+bpo::options_description PipelineMemoryBudgetConfig::getProgramOptions()
+{
+  bpo::options_description lBudgetDesc("Pipeline memory budget options", 120);
+
+  lBudgetDesc.add_options()(
+    OptionKeyHighWatermark,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Maximum size of (Sub)TimeFrames buffered in the processing pipeline in MiB. "
+    "Above this size (Sub)TimeFrames are dropped. Default: 0 (unlimited)")(
+    OptionKeyLowWatermark,
+    bpo::value<std::uint64_t>()->default_value(0),
+    "Size of buffered (Sub)TimeFrames in MiB below which dropping stops. "
+    "Default: 0 (90% of the high watermark)")(
+    OptionKeyDropPolicy,
+    bpo::value<std::string>()->default_value("drop-oldest"),
+    "Which (Sub)TimeFrames are dropped when over the budget: drop-oldest or drop-newest.");
+
+  return lBudgetDesc;
+}
+
+bool PipelineMemoryBudgetConfig::loadVerifyConfig(const FairMQProgOptions& pFMQProgOpt, PipelineMemoryBudget &pBudget)
+{
+  pBudget = PipelineMemoryBudget();
+
+  const auto lHighMiB = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyHighWatermark);
+  const auto lLowMiB = pFMQProgOpt.GetValue<std::uint64_t>(OptionKeyLowWatermark);
+  const auto lPolicy = pFMQProgOpt.GetValue<std::string>(OptionKeyDropPolicy);
+
+  if (lPolicy == "drop-oldest") {
+    pBudget.mDropPolicy = PipelineMemoryBudget::eDropOldest;
+  } else if (lPolicy == "drop-newest") {
+    pBudget.mDropPolicy = PipelineMemoryBudget::eDropNewest;
+  } else {
+    DDLOG(fair::Severity::ERROR) << "Invalid pipeline memory drop policy: " << lPolicy
+                                 << ". Supported: drop-oldest, drop-newest.";
+    return false;
+  }
+
+  if (lHighMiB == 0) {
+    DDLOG(fair::Severity::INFO) << "Pipeline memory budget is disabled.";
+    return true;
+  }
+
+  if (lLowMiB > lHighMiB) {
+    DDLOG(fair::Severity::ERROR) << "Pipeline memory low watermark (" << lLowMiB
+                                 << " MiB) is larger than the high watermark (" << lHighMiB << " MiB).";
+    return false;
+  }
+
+  pBudget.mHighWatermark = lHighMiB << 20;
+  pBudget.mLowWatermark = (lLowMiB > 0) ? (lLowMiB << 20) : (pBudget.mHighWatermark / 10 * 9);
+
+  DDLOG(fair::Severity::INFO) << "Pipeline memory budget :: high watermark = " << (pBudget.mHighWatermark >> 20) << " MiB";
+  DDLOG(fair::Severity::INFO) << "Pipeline memory budget :: low watermark  = " << (pBudget.mLowWatermark >> 20) << " MiB";
+  DDLOG(fair::Severity::INFO) << "Pipeline memory budget :: drop policy    = " << lPolicy;
+
+  return true;
+}
+
+}
+} /* namespace o2::DataDistribution */
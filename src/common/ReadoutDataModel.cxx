@@ -29,56 +29,45 @@ namespace DataDistribution
 ReadoutDataUtils::SanityCheckMode ReadoutDataUtils::sRdhSanityCheckMode = eNoSanityCheck;
 
 /// static
-std::uint64_t ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
+thread_local std::uint64_t ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
 
 std::tuple<std::uint32_t,std::uint32_t,std::uint32_t>
 ReadoutDataUtils::getSubSpecificationComponents(const char* pRdhData, const std::size_t len)
 {
   std::uint32_t lCruId = 0, lEndPoint = 0, lLinkId = 0;
-  if (len < 64) { // size of one RDH
+  if (len < sRdhSize) {
     return std::tuple{~lCruId, ~lEndPoint, ~lLinkId};
   }
 
   // get the RDH version
-  const auto lVer = pRdhData[0];
-  switch (lVer) {
-    case 3:
-    {
-      // no CRUIDin v3! -> get feeId
-      std::memcpy(&lCruId, pRdhData + (1 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lCruId &= 0x0000FFFF;
-
-      // no endpoint in V3! -> 0
-      lEndPoint = 0;
-
-      std::memcpy(&lLinkId, pRdhData + (3 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lLinkId &= 0x000000FF;
-      break;
-    }
-    case 4:
-    case 5:
-    {
-      std::memcpy(&lCruId, pRdhData + (3 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lCruId >>= 16;
-      lCruId &= 0x00000FFF; /* 12 bit */
-
-      std::memcpy(&lEndPoint, pRdhData + (3 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lEndPoint >>= 28;
-      lEndPoint &= 0x0000000F; /* 4 bit */
-
-      std::memcpy(&lLinkId, pRdhData + (3 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lLinkId &= 0x000000FF; /* 8 bit */
-      break;
-    }
-    default:
-    {
-      static auto lErrorRate = 0;
-      if (lErrorRate++ % 2048 == 0) {
-        DDLOG(fair::Severity::ERROR) << "Unknown RDH version: " << lVer << ". Please report the issue.";
-      }
-      return std::tuple{~lCruId, ~lEndPoint, ~lLinkId};
-      break;
+  const std::uint8_t lVer = pRdhData[0];
+
+  if (lVer == 3) {
+    // no CRUIDin v3! -> get feeId
+    std::memcpy(&lCruId, pRdhData + (1 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
+    lCruId &= 0x0000FFFF;
+
+    // no endpoint in V3! -> 0
+    lEndPoint = 0;
+
+    std::memcpy(&lLinkId, pRdhData + (3 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
+    lLinkId &= 0x000000FF;
+    return { lCruId, lEndPoint, lLinkId };
+  }
+
+  const bool lKnown = withRdhLayout(lVer, [&](auto pLayout) {
+    using Layout = decltype(pLayout);
+    lCruId = Layout::sCruId.get(pRdhData);
+    lEndPoint = Layout::sEndPoint.get(pRdhData);
+    lLinkId = Layout::sLinkId.get(pRdhData);
+  });
+
+  if (!lKnown) {
+    static auto lErrorRate = 0;
+    if (lErrorRate++ % 2048 == 0) {
+      DDLOG(fair::Severity::ERROR) << "Unknown RDH version: " << unsigned(lVer) << ". Please report the issue.";
     }
+    return std::tuple{~std::uint32_t(0), ~std::uint32_t(0), ~std::uint32_t(0)};
   }
 
   return { lCruId, lEndPoint, lLinkId };
@@ -90,7 +79,7 @@ ReadoutDataUtils::getSubSpecification(const char* pRdhData, const std::size_t le
   static_assert( sizeof(o2::header::DataHeader::SubSpecificationType) == 4);
 
   o2::header::DataHeader::SubSpecificationType lSubSpec = 0;
-  if (len < 64) { // size of one RDH
+  if (len < sRdhSize) {
     return ~lSubSpec;
   }
 
@@ -105,57 +94,49 @@ ReadoutDataUtils::getSubSpecification(const char* pRdhData, const std::size_t le
 std::tuple<std::size_t, int>
 ReadoutDataUtils::getRdhMemorySize(const char* data, const std::size_t len)
 {
-  std::size_t lMemRet = 0;
-  int lStopRet = 0;
-
-  if (data[0] != 4) {
-    return {-1, -1};
-  }
-
-  const char *p = data;
+  static thread_local RdhBlockScan sScan;
 
-  while (p < data + len) {
-    const auto [lMemSize, lOffsetNext, lStopBit] = getRdhNavigationVals(p);
-    lMemRet += lMemSize;
-    lStopRet = lStopBit;
+  scanRdhBlock(data, len, sScan);
 
-    if( lStopBit ) {
-      break;
-    }
-
-    p += lOffsetNext;
+  if (sScan.mStatus == RdhBlockScan::eScanShortBlock || sScan.mStatus == RdhBlockScan::eScanUnknownVersion) {
+    return {-1, -1};
   }
 
-  if (p > data + len) {
+  if (sScan.mStatus == RdhBlockScan::eScanShortRdh) {
     DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: StopBit lookup failed: advanced beyond end of the buffer.";
-    lStopRet = -1;
+    return {sScan.memorySize(), -1};
   }
 
-  return {lMemRet, lStopRet};
+  const int lStopRet = sScan.mPackets.empty() ? 0 : sScan.mPackets.back().mStopBit;
+  return {sScan.memorySize(), lStopRet};
 }
 
 std::uint16_t ReadoutDataUtils::getFeeId(const char* data, const std::size_t len)
 {
-  std::uint16_t lFeeId = 0;
+  std::uint16_t lFeeId = std::uint16_t(-1);
 
-  if (len < 64 || data[0] != 4) {
-    return std::uint16_t(-1);
+  if (len < sRdhSize) {
+    return lFeeId;
   }
 
-  std::memcpy(&lFeeId, data + (1 * sizeof(std::uint32_t)), sizeof(std::uint16_t));
+  withRdhLayout(data[0], [&](auto pLayout) {
+    lFeeId = decltype(pLayout)::sFeeId.get(data);
+  });
 
   return lFeeId;
 }
 
 std::uint32_t ReadoutDataUtils::getHBOrbit(const char* data, const std::size_t len)
 {
-  std::uint32_t lHBOrbit = 0;
+  std::uint32_t lHBOrbit = std::uint32_t(-1);
 
-  if (len < 64 || data[0] != 4) {
-    return std::uint32_t(-1);
+  if (len < sRdhSize) {
+    return lHBOrbit;
   }
 
-  std::memcpy(&lHBOrbit, data + (5 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
+  withRdhLayout(data[0], [&](auto pLayout) {
+    lHBOrbit = decltype(pLayout)::sOrbit.get(data);
+  });
 
   return lHBOrbit;
 }
@@ -165,44 +146,135 @@ std::tuple<uint32_t,uint32_t,uint32_t>
 ReadoutDataUtils::getRdhNavigationVals(const char* pRdhData)
 {
   std::uint32_t lMemSize, lOffsetNext, lStopBit;
+  lMemSize = lOffsetNext = lStopBit = ~std::uint32_t(0);
+
+  withRdhLayout(pRdhData[0], [&](auto pLayout) {
+    using Layout = decltype(pLayout);
+    lMemSize = Layout::sMemorySize.get(pRdhData);
+    lOffsetNext = Layout::sOffsetNext.get(pRdhData);
+    lStopBit = Layout::sStopBit.get(pRdhData);
+  });
 
-  const auto lVer = pRdhData[0];
-  switch (lVer) {
-    case 4:
-    {
-      std::memcpy(&lOffsetNext, pRdhData + (2 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lOffsetNext &= 0x0000FFFF;
+  return {lMemSize, lOffsetNext, lStopBit};
+}
 
-      std::memcpy(&lMemSize, pRdhData + (2 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lMemSize >>= 16;
-      lMemSize &= 0x0000FFFF;
+std::size_t RdhBlockScan::memorySize() const
+{
+  std::size_t lMemSize = 0;
+  for (const auto &lPacket : mPackets) {
+    lMemSize += lPacket.mMemorySize;
+  }
+  return lMemSize;
+}
 
-      std::memcpy(&lStopBit, pRdhData + (13 * sizeof(std::uint32_t)), sizeof(std::uint32_t));
-      lStopBit &= 0x000000FF;
-      break;
+namespace
+{
+/// Scan with the field layout of the version: no per-packet dispatch
+template <class Layout>
+bool scanRdhBlockLayout(const char* pData, const std::size_t pLen, RdhBlockScan &pScan)
+{
+  constexpr std::size_t cRdhSize = ReadoutDataUtils::sRdhSize;
+
+  std::size_t lOffset = 0;
+  while (lOffset < pLen) {
+    if (pLen - lOffset < cRdhSize) {
+      pScan.mStatus = RdhBlockScan::eScanShortRdh;
+      pScan.mErrorOffset = lOffset;
+      return false;
     }
-    default:
-    {
-      lMemSize = lOffsetNext = lStopBit = ~std::uint32_t(0);
-      break;
+
+    const char *lRdh = pData + lOffset;
+    if (std::uint8_t(lRdh[0]) != Layout::sVersion) {
+      pScan.mStatus = RdhBlockScan::eScanVersionMismatch;
+      pScan.mErrorOffset = lOffset;
+      return false;
     }
+
+    RdhPacketDescriptor &lPacket = pScan.mPackets.emplace_back();
+    lPacket.mOffset = lOffset;
+    lPacket.mOffsetNext = Layout::sOffsetNext.get(lRdh);
+    lPacket.mMemorySize = Layout::sMemorySize.get(lRdh);
+    lPacket.mOrbit = Layout::sOrbit.get(lRdh);
+    lPacket.mSubSpec = ReadoutDataUtils::getSubSpecification<Layout>(lRdh);
+    lPacket.mFeeId = Layout::sFeeId.get(lRdh);
+    lPacket.mLinkId = Layout::sLinkId.get(lRdh);
+    lPacket.mStopBit = Layout::sStopBit.get(lRdh);
+
+    if (lPacket.mStopBit) {
+      return true;
+    }
+
+    if (lPacket.mOffsetNext == 0) {
+      pScan.mStatus = RdhBlockScan::eScanZeroOffset;
+      pScan.mErrorOffset = lOffset;
+      return false;
+    }
+
+    lOffset += lPacket.mOffsetNext;
   }
 
-  return {lMemSize, lOffsetNext, lStopBit};
+  pScan.mStatus = RdhBlockScan::eScanNoStopBit;
+  pScan.mErrorOffset = pScan.mPackets.back().mOffset;
+  return false;
+}
+}
+
+bool ReadoutDataUtils::scanRdhBlock(const char* pData, const std::size_t pLen, RdhBlockScan &pScan)
+{
+  pScan.clear();
+  pScan.mBlockSize = pLen;
+
+  if (pLen < sRdhSize) {
+    pScan.mStatus = RdhBlockScan::eScanShortBlock;
+    return false;
+  }
+
+  // version is checked once for the block
+  pScan.mVersion = pData[0];
+
+  bool lRet = false;
+  const bool lKnown = withRdhLayout(pScan.mVersion, [&](auto pLayout) {
+    lRet = scanRdhBlockLayout<decltype(pLayout)>(pData, pLen, pScan);
+  });
+
+  if (!lKnown) {
+    pScan.mStatus = RdhBlockScan::eScanUnknownVersion;
+    return false;
+  }
+
+  return lRet;
 }
 
 bool ReadoutDataUtils::rdhSanityCheck(const char* pData, const std::size_t pLen)
 {
-  if (pLen < 64) { // size of one RDH
+  static thread_local RdhBlockScan sScan;
+
+  scanRdhBlock(pData, pLen, sScan);
+  return rdhSanityCheck(pData, sScan);
+}
+
+bool ReadoutDataUtils::rdhSanityCheck(const char* pData, const RdhBlockScan &pScan)
+{
+  const std::size_t pLen = pScan.mBlockSize;
+
+  if (pScan.mStatus == RdhBlockScan::eScanShortBlock) {
     DDLOG(fair::Severity::ERROR) << "Data block is shorter than RDH: " << pLen;
     o2::header::hexDump("Short readout block", pData, pLen);
     return false;
   }
 
+  if (pScan.mStatus == RdhBlockScan::eScanUnknownVersion) {
+    DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Unsupported RDH version: " << unsigned(pScan.mVersion);
+    return false;
+  }
+
+  if (pScan.mPackets.empty()) {
+    return false;
+  }
+
   // set first hbframe orbit if not set for this stf
   {
-    std::uint32_t lOrbit = 0;
-    std::memcpy(&lOrbit, pData + (5 * sizeof (std::uint32_t)), sizeof (std::uint32_t));
+    const std::uint32_t lOrbit = pScan.mPackets.front().mOrbit;
     if (sFirstSeenHBOrbitCnt == 0) {
       sFirstSeenHBOrbitCnt = lOrbit;
     } else {
@@ -219,126 +291,130 @@ bool ReadoutDataUtils::rdhSanityCheck(const char* pData, const std::size_t pLen)
   }
 
   // sub spec of first RDH
-  const auto lSubSpec = getSubSpecification(pData, pLen);
-
-  std::int64_t lDataLen = pLen;
-  const char* lCurrData = pData;
+  const auto lSubSpec = pScan.mPackets.front().mSubSpec;
   std::uint32_t lPacketCnt = 1;
 
-  while(lDataLen > 0) {
-
-    if (lDataLen > 0 && lDataLen < 64/*RDH*/ ) {
-      DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Data is shorter than RDH. Block offset: " << lCurrData - pData;
-      o2::header::hexDump("Data at the end of the block", lCurrData, lDataLen);
-      return false;
-    }
+  for (const auto &lPacket : pScan.mPackets) {
+    const std::int64_t lDataLen = pLen - lPacket.mOffset;
 
     // check if sub spec matches
-    if (lSubSpec != getSubSpecification(lCurrData, lDataLen)) {
+    if (lSubSpec != lPacket.mSubSpec) {
       DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Data sub-specification of trailing RDHs does not match."
                     " Subspecification of the first RDH: 0x" << std::hex << lSubSpec
-                 << " Subspecification of " << lPacketCnt << ". RDH: 0x" << std::hex << getSubSpecification(lCurrData, lDataLen);
+                 << " Subspecification of " << std::dec << lPacketCnt << ". RDH: 0x" << std::hex << lPacket.mSubSpec;
       return false;
     }
 
-    const auto [lMemSize, lOffsetNext, lStopBit] = getRdhNavigationVals(lCurrData);
-
     // check if last package
-    if (lStopBit) {
-      if (lMemSize <= lDataLen) {
+    if (lPacket.mStopBit) {
+      if (lPacket.mMemorySize <= lDataLen) {
         return true; // all memory is accounted for
       } else {
         DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: RDH has bit stop set, but memory size is different from remaining block size."
-                      " memory size: " << lMemSize <<
+                      " memory size: " << lPacket.mMemorySize <<
                       " remaining buffer size: " << lDataLen;
         return false;
       }
     }
 
-    if (lOffsetNext == 0) {
+    if (lPacket.mOffsetNext == 0) {
       DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Next block offset is 0.";
       return false;
     }
 
-    if (lOffsetNext >= lDataLen) {
+    if (lPacket.mOffsetNext >= lDataLen) {
       DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Next offset points beyond end of data block (stop bit is not set).";
       return false;
     }
 
-    if (lMemSize >= lDataLen) {
+    if (lPacket.mMemorySize >= lDataLen) {
       DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Memory size is larger than remaining data block size for packet " << lPacketCnt;
       return false;
     }
 
-    lDataLen -= lOffsetNext;
-    lCurrData += lOffsetNext;
     lPacketCnt += 1;
   }
 
-  return true;
+  // scan stopped before the stop bit
+  switch (pScan.mStatus) {
+    case RdhBlockScan::eScanShortRdh:
+      DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Data is shorter than RDH. Block offset: " << pScan.mErrorOffset;
+      o2::header::hexDump("Data at the end of the block", pData + pScan.mErrorOffset, pLen - pScan.mErrorOffset);
+      break;
+    case RdhBlockScan::eScanVersionMismatch:
+      DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: RDH version of packet at offset " << pScan.mErrorOffset
+                                   << " does not match the first RDH version " << unsigned(pScan.mVersion);
+      break;
+    default:
+      break;
+  }
+
+  return false;
 }
 
 bool ReadoutDataUtils::filterTriggerEmpyBlocksV4(const char* pData, const std::size_t pLen)
 {
-  std::uint32_t lMemSize1, lOffsetNext1, lStopBit1;
-  std::uint32_t lMemSize2, lOffsetNext2, lStopBit2;
+  static thread_local RdhBlockScan sScan;
 
-  if (pLen == 128 || pLen == 16384) { /* usual case */
-    static thread_local std::size_t sNumFiltered128Blocks = 0;
-    static thread_local std::size_t sNumFiltered16kBlocks = 0;
+  if (pLen != 128 && pLen != 16384) {
+    return false; // size does not match
+  }
 
-    if (pData[0] != 4) {
-      return false; // not RDH4
-    }
+  if (pData[0] != 4) {
+    return false; // not RDH4
+  }
 
-    std::tie(lMemSize1, lOffsetNext1, lStopBit1) = getRdhNavigationVals(pData);
+  scanRdhBlock(pData, pLen, sScan);
+  return filterTriggerEmpyBlocksV4(sScan);
+}
 
-    if (lStopBit1) {
-      return false;
-    }
+bool ReadoutDataUtils::filterTriggerEmpyBlocksV4(const RdhBlockScan &pScan)
+{
+  static thread_local std::size_t sNumFiltered128Blocks = 0;
+  static thread_local std::size_t sNumFiltered16kBlocks = 0;
 
-    if (lOffsetNext1 > pLen) {
-      DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Invalid offset " << lOffsetNext1 << " (beyond end of the buffer)";
-    } if (lOffsetNext1 < 64) {
-      DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Invalid offset " << lOffsetNext1 << " (less than RDH size)";
-    }
+  if (pScan.mBlockSize != 128 && pScan.mBlockSize != 16384) {
+    return false; // size does not match
+  }
 
-    const char *lRDH1 = pData;
-    const std::size_t lRDH1Size = std::min(std::size_t(lOffsetNext1), std::size_t(8192));
+  if (pScan.mVersion != 4) {
+    return false; // not RDH4
+  }
 
-    const char *lRDH2 = lRDH1 + lOffsetNext1;
+  // empty trigger block: two RDHs without payload, the second one with the stop bit
+  if (!pScan.ok() || pScan.mPackets.size() != 2) {
+    return false;
+  }
 
-    std::tie(lMemSize2, lOffsetNext2, lStopBit2) = getRdhNavigationVals(lRDH2);
-    const std::size_t lRDH2Size = std::min(std::size_t(lMemSize2), std::size_t(8192));
+  const auto &lRdh1 = pScan.mPackets[0];
+  const auto &lRdh2 = pScan.mPackets[1];
 
-    if (getSubSpecification(lRDH1, lRDH1Size) != getSubSpecification(lRDH2, lRDH2Size)) {
-      return false;
-    }
+  if (lRdh1.mOffsetNext < sRdhSize) {
+    DDLOG(fair::Severity::ERROR) << "BLOCK CHECK: Invalid offset " << lRdh1.mOffsetNext << " (less than RDH size)";
+  }
 
+  if (lRdh1.mSubSpec != lRdh2.mSubSpec) {
+    return false;
+  }
 
-    if (lMemSize1 != lMemSize2 || lMemSize1 != 64) {
-      return false;
-    }
+  if (lRdh1.mMemorySize != lRdh2.mMemorySize || lRdh1.mMemorySize != 64) {
+    return false;
+  }
 
-    if ((lStopBit1 != 0) || (lStopBit2 != 1)) {
-      return false;
-    }
+  if ((lRdh1.mStopBit != 0) || (lRdh2.mStopBit != 1)) {
+    return false;
+  }
 
-    if (pLen == 128) {
-      sNumFiltered128Blocks++;
-      if (sNumFiltered128Blocks % 250000 == 0) {
-        DDLOG(fair::Severity::INFO) << "Filtered " << sNumFiltered128Blocks << " of 128 B blocks in trigger mode.";
-      }
-    } else if (pLen == 16384) {
-      sNumFiltered16kBlocks++;
-      if (sNumFiltered16kBlocks % 250000 == 0) {
-        DDLOG(fair::Severity::INFO) << "Filtered " << sNumFiltered16kBlocks << " of 16 kiB blocks in trigger mode.";
-      }
+  if (pScan.mBlockSize == 128) {
+    sNumFiltered128Blocks++;
+    if (sNumFiltered128Blocks % 250000 == 0) {
+      DDLOG(fair::Severity::INFO) << "Filtered " << sNumFiltered128Blocks << " of 128 B blocks in trigger mode.";
     }
-
-
   } else {
-    return false; // size does not match
+    sNumFiltered16kBlocks++;
+    if (sNumFiltered16kBlocks % 250000 == 0) {
+      DDLOG(fair::Severity::INFO) << "Filtered " << sNumFiltered16kBlocks << " of 16 kiB blocks in trigger mode.";
+    }
   }
 
   // looks like it should be empty trigger message
@@ -23,6 +23,8 @@
 #include <fairmq/FairMQDevice.h>
 #include <fairmq/FairMQUnmanagedRegion.h>
 
+#include <cstring>
+
 namespace o2
 {
 namespace DataDistribution
@@ -34,15 +36,19 @@ using namespace o2::header;
 /// SubTimeFrameReadoutBuilder
 ////////////////////////////////////////////////////////////////////////////////
 
-SubTimeFrameReadoutBuilder::SubTimeFrameReadoutBuilder(FairMQChannel& pChan, bool pDplEnabled)
+SubTimeFrameReadoutBuilder::SubTimeFrameReadoutBuilder(FairMQChannel& pChan, bool pDplEnabled,
+  const HeaderRegionConfig& pHdrRegionCfg)
   : mStf(nullptr),
+    mChan(pChan),
     mDplEnabled(pDplEnabled)
 {
   mHeaderMemRes = std::make_unique<FMQUnsynchronizedPoolMemoryResource>(
-    pChan, 64ULL << 20 /* make configurable */,
+    pChan, pHdrRegionCfg.mSize,
     mDplEnabled ?
       sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader) :
-      sizeof(DataHeader)
+      sizeof(DataHeader),
+    pHdrRegionCfg.mAdaptive,
+    pHdrRegionCfg.mMaxSize
   );
 }
 
@@ -58,6 +64,18 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
 
   std::vector<bool> lKeepBlocks(pHBFrameLen, true);
 
+  // scan RDHs of all blocks once: used by filtering and sanity checks
+  if (mRdh4FilterTrigger || RdhSanityCheck() != ReadoutDataUtils::eNoSanityCheck) {
+    if (mRdhBlockScans.size() < pHBFrameLen) {
+      mRdhBlockScans.resize(pHBFrameLen);
+    }
+
+    for (std::size_t i = 0; i < pHBFrameLen; i++) {
+      ReadoutDataUtils::scanRdhBlock(reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()),
+        pHbFramesBegin[i]->GetSize(), mRdhBlockScans[i]);
+    }
+  }
+
   // filter empty trigger RDHv4
   {
     if (mRdh4FilterTrigger) {
@@ -65,28 +83,14 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
       if (pHBFrameLen == 2 && lKeepBlocks[0] == true && lKeepBlocks[1] == true) {
         if (pHbFramesBegin[0]->GetSize() == 8192 && pHbFramesBegin[1]->GetSize() == 8192) {
 
-          bool lRem1 = false, lRem2 = false;
-          {
-            const auto [lMemSize, lOffsetNext, lStopBit] = ReadoutDataUtils::getRdhNavigationVals(
-              reinterpret_cast<const char*>(pHbFramesBegin[0]->GetData()));
-
-            (void) lOffsetNext; /*unused*/
-
-            if (lStopBit && lMemSize == 64) {
-              lRem1 = true;
-            }
-          }
-
-          {
-            const auto [lMemSize, lOffsetNext, lStopBit] = ReadoutDataUtils::getRdhNavigationVals(
-              reinterpret_cast<const char*>(pHbFramesBegin[1]->GetData()));
+          const auto lEmptyPage = [](const RdhBlockScan &pScan) {
+            return pScan.mVersion == 4 && !pScan.mPackets.empty() &&
+              pScan.mPackets[0].mStopBit && pScan.mPackets[0].mMemorySize == 64;
+          };
 
-            (void) lOffsetNext; /*unused*/
+          const bool lRem1 = lEmptyPage(mRdhBlockScans[0]);
+          const bool lRem2 = lEmptyPage(mRdhBlockScans[1]);
 
-            if (lStopBit && lMemSize == 64) {
-              lRem2 = true;
-            }
-          }
           if (lRem1 && lRem2) {
             lKeepBlocks[0] = false;
             lKeepBlocks[1] = false;
@@ -100,9 +104,7 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
           continue; // already discarded
         }
 
-        if (!ReadoutDataUtils::filterTriggerEmpyBlocksV4(
-                                  reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()),
-                                  pHbFramesBegin[i]->GetSize()) ) {
+        if (!ReadoutDataUtils::filterTriggerEmpyBlocksV4(mRdhBlockScans[i])) {
           lKeepBlocks[i] = true;
         } else {
           lKeepBlocks[i] = false;
@@ -127,7 +129,7 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
 
         const auto lOk = ReadoutDataUtils::rdhSanityCheck(
           reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData()),
-          pHbFramesBegin[i]->GetSize());
+          mRdhBlockScans[i]);
 
         if (!lOk && RdhSanityCheck() == ReadoutDataUtils::eSanityCheckDrop) {
           DDLOG(fair::Severity::WARNING) << "RDH SANITY CHECK: Removing data block";
@@ -179,6 +181,11 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
     pDataOrig,
     pSubSpecification);
 
+  if (mSuperpagePacking) {
+    addPackedHbFrames(lEqId, lKeepBlocks, pHbFramesBegin, pHBFrameLen);
+    return;
+  }
+
   for (size_t i = 0; i < pHBFrameLen; i++) {
 
     if (lKeepBlocks[i] == false) {
@@ -219,6 +226,92 @@ void SubTimeFrameReadoutBuilder::addHbFrames(
 
 }
 
+void SubTimeFrameReadoutBuilder::addPackedHbFrames(const EquipmentIdentifier &pEqId,
+  const std::vector<bool> &pKeepBlocks,
+  std::vector<FairMQMessagePtr>::iterator pHbFramesBegin, const std::size_t pHBFrameLen)
+{
+  std::uint32_t lNumHbFrames = 0;
+  std::size_t lDataSize = 0;
+
+  for (std::size_t i = 0; i < pHBFrameLen; i++) {
+    if (pKeepBlocks[i]) {
+      lNumHbFrames++;
+      lDataSize += pHbFramesBegin[i]->GetSize();
+    }
+  }
+
+  if (lNumHbFrames == 0) {
+    return;
+  }
+
+  // header stack: DataHeader, [DataProcessingHeader], HBFrameIndexHeader + entries
+  const std::size_t lDplHdrSize = mDplEnabled ? sizeof(o2::framework::DataProcessingHeader) : 0;
+  const std::size_t lHdrSize = sizeof(DataHeader) + lDplHdrSize + HBFrameIndexHeader::getSize(lNumHbFrames);
+
+  auto lHdrMsg = mChan.NewMessage(lHdrSize);
+  if (!lHdrMsg) {
+    DDLOG(fair::Severity::ERROR) << "Allocation error: packed HbFrames. header_size: " << lHdrSize;
+    throw std::bad_alloc();
+  }
+
+  char *lHdrData = static_cast<char*>(lHdrMsg->GetData());
+
+  DataHeader lDataHdr(
+    pEqId.mDataDescription,
+    pEqId.mDataOrigin,
+    pEqId.mSubSpecification,
+    lDataSize
+  );
+  lDataHdr.payloadSerializationMethod = gSerializationMethodNone;
+  lDataHdr.flagsNextHeader = 1;
+  std::memcpy(lHdrData, &lDataHdr, sizeof(DataHeader));
+
+  if (mDplEnabled) {
+    o2::framework::DataProcessingHeader lDplHdr{mStf->header().mId};
+    lDplHdr.flagsNextHeader = 1;
+    std::memcpy(lHdrData + sizeof(DataHeader), &lDplHdr, sizeof(o2::framework::DataProcessingHeader));
+  }
+
+  auto lIndex = new (lHdrData + sizeof(DataHeader) + lDplHdrSize) HBFrameIndexHeader(lNumHbFrames);
+  auto lEntries = lIndex->entries();
+
+  // HBFrame messages are not copied: they follow the header as data parts
+  SubTimeFrame::StfData lStfData{ std::move(lHdrMsg), nullptr };
+  lStfData.mDataParts.reserve(lNumHbFrames - 1);
+
+  std::size_t lOffset = 0;
+  std::uint32_t lEntryIdx = 0;
+
+  for (std::size_t i = 0; i < pHBFrameLen; i++) {
+    if (!pKeepBlocks[i]) {
+      continue;
+    }
+
+    const auto lHbfData = reinterpret_cast<const char*>(pHbFramesBegin[i]->GetData());
+    const auto lHbfSize = pHbFramesBegin[i]->GetSize();
+
+    auto &lEntry = lEntries[lEntryIdx++];
+    lEntry.mOffset = lOffset;
+    lEntry.mSize = lHbfSize;
+    lEntry.mOrbit = std::uint32_t(-1);
+    if (lHbfSize >= ReadoutDataUtils::sRdhSize) {
+      ReadoutDataUtils::withRdhLayout(lHbfData[0], [&](auto pLayout) {
+        lEntry.mOrbit = decltype(pLayout)::sOrbit.get(lHbfData);
+      });
+    }
+    lEntry.mReserved = 0;
+
+    lOffset += lHbfSize;
+    if (!lStfData.mData) {
+      lStfData.mData = std::move(pHbFramesBegin[i]);
+    } else {
+      lStfData.mDataParts.emplace_back(std::move(pHbFramesBegin[i]));
+    }
+  }
+
+  mStf->addStfData(lDataHdr, std::move(lStfData));
+}
+
 std::unique_ptr<SubTimeFrame> SubTimeFrameReadoutBuilder::getStf()
 {
   std::unique_ptr<SubTimeFrame> lStf = std::move(mStf);
@@ -231,62 +324,95 @@ std::unique_ptr<SubTimeFrame> SubTimeFrameReadoutBuilder::getStf()
 /// SubTimeFrameFileBuilder
 ////////////////////////////////////////////////////////////////////////////////
 
-SubTimeFrameFileBuilder::SubTimeFrameFileBuilder(FairMQChannel& pChan, bool pDplEnabled)
-  : mDplEnabled(pDplEnabled)
+SubTimeFrameFileBuilder::SubTimeFrameFileBuilder(FairMQChannel& pChan, bool pDplEnabled,
+  const HeaderRegionConfig& pHdrRegionCfg)
+  : mChan(pChan),
+    mDplEnabled(pDplEnabled)
 {
   mHeaderMemRes = std::make_unique<FMQUnsynchronizedPoolMemoryResource>(
-    pChan, 32ULL << 20 /* make configurable */,
+    pChan, pHdrRegionCfg.mSize,
     mDplEnabled ?
       sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader) :
-      sizeof(DataHeader)
+      sizeof(DataHeader),
+    pHdrRegionCfg.mAdaptive,
+    pHdrRegionCfg.mMaxSize
   );
 }
 
+namespace {
+/// Insert the DataProcessingHeader after the DataHeader, preserving the rest of the stack
+FairMQMessagePtr insertDplHeader(FairMQChannel& pChan, const FairMQMessagePtr &pHeader, const std::uint64_t pStfId)
+{
+  using o2::framework::DataProcessingHeader;
+
+  const auto lHdrData = static_cast<const char*>(pHeader->GetData());
+  const auto lRestSize = pHeader->GetSize() - sizeof(DataHeader);
+
+  auto lNewHeader = pChan.NewMessage(pHeader->GetSize() + sizeof(DataProcessingHeader));
+  auto lNewData = static_cast<char*>(lNewHeader->GetData());
+
+  DataHeader lDataHdr;
+  std::memcpy(&lDataHdr, lHdrData, sizeof(DataHeader));
+  lDataHdr.flagsNextHeader = 1;
+  std::memcpy(lNewData, &lDataHdr, sizeof(DataHeader));
+
+  DataProcessingHeader lDplHdr{pStfId};
+  lDplHdr.flagsNextHeader = 1;
+  std::memcpy(lNewData + sizeof(DataHeader), &lDplHdr, sizeof(DataProcessingHeader));
+
+  std::memcpy(lNewData + sizeof(DataHeader) + sizeof(DataProcessingHeader), lHdrData + sizeof(DataHeader), lRestSize);
+
+  return lNewHeader;
+}
+}
+
 void SubTimeFrameFileBuilder::adaptHeaders(SubTimeFrame *pStf)
 {
   if (!pStf) {
     return;
   }
 
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
+  for (auto& lStfDataIter : pStf->mData) {
 
-        // make sure there is a DataProcessing header in the stack
-        const auto &lHeader = lStfDataIter.mHeader;
+    // make sure there is a DataProcessing header in the stack
+    const auto &lHeader = lStfDataIter.mHeader;
 
-        if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
-          DDLOG(fair::Severity::ERROR) << "File data invalid. Missing DataHeader.";
-          return;
-        }
+    if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
+      DDLOG(fair::Severity::ERROR) << "File data invalid. Missing DataHeader.";
+      return;
+    }
 
-        auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(lHeader->GetData(), lHeader->GetSize());
+    auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(lHeader->GetData(), lHeader->GetSize());
 
-        if (lDplHdrConst != nullptr) {
-          if (lDplHdrConst->startTime != pStf->header().mId) {
+    if (lDplHdrConst != nullptr) {
+      if (lDplHdrConst->startTime != pStf->header().mId) {
 
-            auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
-            lDplHdr->startTime = pStf->header().mId;
-          }
-        } else {
-          // make the stack with an DPL header
-          // get the DataHeader
-          auto lDHdr = o2::header::get<o2::header::DataHeader*>(lHeader->GetData(), lHeader->GetSize());
-          if (lDHdr == nullptr) {
-            DDLOG(fair::Severity::ERROR) << "File data invalid. DataHeader not found in the header stack.";
-            return;
-          }
+        auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
+        lDplHdr->startTime = pStf->header().mId;
+      }
+    } else {
+      // make the stack with an DPL header
+      // get the DataHeader
+      auto lDHdr = o2::header::get<o2::header::DataHeader*>(lHeader->GetData(), lHeader->GetSize());
+      if (lDHdr == nullptr) {
+        DDLOG(fair::Severity::ERROR) << "File data invalid. DataHeader not found in the header stack.";
+        return;
+      }
 
-          if (mDplEnabled) {
-            auto lStack = Stack(mHeaderMemRes->allocator(),
-              *lDHdr, /* TODO: add complete existing header lStfDataIter.mHeader */
-              o2::framework::DataProcessingHeader{pStf->header().mId}
-            );
+      if (mDplEnabled && lHeader->GetSize() > sizeof(DataHeader)) {
+        // keep trailing headers (e.g. HBFrame index of packed superpages)
+        lStfDataIter.mHeader = insertDplHeader(mChan, lStfDataIter.mHeader, pStf->header().mId);
+        continue;
+      }
 
-            lStfDataIter.mHeader = mHeaderMemRes->NewFairMQMessageFromPtr(lStack.data());
-            assert(lStfDataIter.mHeader->GetSize() > sizeof (DataHeader));
-          }
-        }
+      if (mDplEnabled) {
+        auto lStack = Stack(mHeaderMemRes->allocator(),
+          *lDHdr,
+          o2::framework::DataProcessingHeader{pStf->header().mId}
+        );
+
+        lStfDataIter.mHeader = mHeaderMemRes->NewFairMQMessageFromPtr(lStack.data());
+        assert(lStfDataIter.mHeader->GetSize() > sizeof (DataHeader));
       }
     }
   }
@@ -296,14 +422,18 @@ void SubTimeFrameFileBuilder::adaptHeaders(SubTimeFrame *pStf)
 /// TimeFrameBuilder
 ////////////////////////////////////////////////////////////////////////////////
 
-TimeFrameBuilder::TimeFrameBuilder(FairMQChannel& pChan, bool pDplEnabled)
-  : mDplEnabled(pDplEnabled)
+TimeFrameBuilder::TimeFrameBuilder(FairMQChannel& pChan, bool pDplEnabled,
+  const HeaderRegionConfig& pHdrRegionCfg)
+  : mChan(pChan),
+    mDplEnabled(pDplEnabled)
 {
   mHeaderMemRes = std::make_unique<FMQUnsynchronizedPoolMemoryResource>(
-    pChan, 64ULL << 20 /* make configurable */,
+    pChan, pHdrRegionCfg.mSize,
     mDplEnabled ?
       sizeof(DataHeader) + sizeof(o2::framework::DataProcessingHeader) :
-      sizeof(DataHeader)
+      sizeof(DataHeader),
+    pHdrRegionCfg.mAdaptive,
+    pHdrRegionCfg.mMaxSize
   );
 }
 
@@ -313,52 +443,54 @@ void TimeFrameBuilder::adaptHeaders(SubTimeFrame *pStf)
     return;
   }
 
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
+  for (auto& lStfDataIter : pStf->mData) {
 
-        // make sure there is a DataProcessing header in the stack
-        const auto &lHeader = lStfDataIter.mHeader;
+    // make sure there is a DataProcessing header in the stack
+    const auto &lHeader = lStfDataIter.mHeader;
 
-        if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
-          DDLOG(fair::Severity::ERROR) << "Adapting TF headers: Missing DataHeader.";
-          continue;
-        }
+    if (!lHeader || lHeader->GetSize() < sizeof(DataHeader)) {
+      DDLOG(fair::Severity::ERROR) << "Adapting TF headers: Missing DataHeader.";
+      continue;
+    }
 
-        auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(
-          lHeader->GetData(),
-          lHeader->GetSize()
-        );
+    auto lDplHdrConst = o2::header::get<o2::framework::DataProcessingHeader*>(
+      lHeader->GetData(),
+      lHeader->GetSize()
+    );
 
-        if (lDplHdrConst != nullptr) {
-          if (lDplHdrConst->startTime != pStf->header().mId) {
+    if (lDplHdrConst != nullptr) {
+      if (lDplHdrConst->startTime != pStf->header().mId) {
 
-            auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
-            lDplHdr->startTime = pStf->header().mId;
-          }
-        } else {
-          // make the stack with an DPL header
-          // get the DataHeader
-          auto lDHdr = o2::header::get<o2::header::DataHeader*>(
-            lHeader->GetData(),
-            lHeader->GetSize()
-          );
-
-          if (lDHdr == nullptr) {
-            DDLOG(fair::Severity::ERROR) << "TimeFrame invalid. DataHeader not found in the header stack.";
-            continue;
-          }
+        auto lDplHdr = const_cast<o2::framework::DataProcessingHeader*>(lDplHdrConst);
+        lDplHdr->startTime = pStf->header().mId;
+      }
+    } else {
+      // make the stack with an DPL header
+      // get the DataHeader
+      auto lDHdr = o2::header::get<o2::header::DataHeader*>(
+        lHeader->GetData(),
+        lHeader->GetSize()
+      );
 
-          if (mDplEnabled) {
-            auto lStack = Stack(mHeaderMemRes->allocator(),
-              *lDHdr, /* TODO: add complete existing header lStfDataIter.mHeader */
-              o2::framework::DataProcessingHeader{pStf->header().mId}
-            );
+      if (lDHdr == nullptr) {
+        DDLOG(fair::Severity::ERROR) << "TimeFrame invalid. DataHeader not found in the header stack.";
+        continue;
+      }
 
-            lStfDataIter.mHeader = mHeaderMemRes->NewFairMQMessageFromPtr(lStack.data());
-            assert(lStfDataIter.mHeader->GetSize() > sizeof (DataHeader));
-          }
-        }
+      if (mDplEnabled && lHeader->GetSize() > sizeof(DataHeader)) {
+        // keep trailing headers (e.g. HBFrame index of packed superpages)
+        lStfDataIter.mHeader = insertDplHeader(mChan, lStfDataIter.mHeader, pStf->header().mId);
+        continue;
+      }
+
+      if (mDplEnabled) {
+        auto lStack = Stack(mHeaderMemRes->allocator(),
+          *lDHdr,
+          o2::framework::DataProcessingHeader{pStf->header().mId}
+        );
+
+        lStfDataIter.mHeader = mHeaderMemRes->NewFairMQMessageFromPtr(lStack.data());
+        assert(lStfDataIter.mHeader->GetSize() > sizeof (DataHeader));
       }
     }
   }
@@ -64,30 +64,64 @@ void StfDplAdapter::visit(SubTimeFrame& pStf)
     mMessages.emplace_back(std::move(lDataMsg));
   }
 
-  for (auto& lDataIdentMapIter : pStf.mData) {
+  mMessages.reserve(mMessages.size() + 2 * pStf.mData.size());
 
-    auto &lSubSpecDataMap = lDataIdentMapIter.second;
+  for (const auto& lEquipRange : pStf.mIndex) {
 
-    for (auto& lSubSpecMapIter : lSubSpecDataMap) {
+    // packed HBFrames are sent as one header-payload pair per HBFrame
+    std::uint64_t lNumParts = 0;
+    for (uint64_t i = 0; i < lEquipRange.mCount; i++) {
+      lNumParts += pStf.mData[lEquipRange.mBegin + i].getNumDataParts();
+    }
+
+    std::uint64_t lPartIdx = 0;
+
+    for (uint64_t i = 0; i < lEquipRange.mCount; i++) {
 
-      auto & lHBFrameVector = lSubSpecMapIter.second;
+      auto& lHBFrame = pStf.mData[lEquipRange.mBegin + i];
 
-      for (uint64_t i = 0; i < lHBFrameVector.size(); i++) {
+      // O2 messages belonging to a single STF:
+      //  - DataProcessingHeader::startTime == STF ID
+      //  - DataHeader(origin, description, subspecification) can repeat
+      //  - DataHeader(origin, description, subspecification, splitPayloadIndex) is unique
 
-        // O2 messages belonging to a single STF:
-        //  - DataProcessingHeader::startTime == STF ID
-        //  - DataHeader(origin, description, subspecification) can repeat
-        //  - DataHeader(origin, description, subspecification, splitPayloadIndex) is unique
+      if (!lHBFrame.getHbFrameIndex()) {
+        if (lNumParts != lEquipRange.mCount) {
+          lHBFrame.setPayloadIndex(lPartIdx, lNumParts);
+        }
 
-        assert(lHBFrameVector[i].getDataHeader().splitPayloadIndex == i);
-        assert(lHBFrameVector[i].getDataHeader().splitPayloadParts == lHBFrameVector.size());
+        assert(lHBFrame.getDataHeader().splitPayloadIndex == lPartIdx);
+        assert(lHBFrame.getDataHeader().splitPayloadParts == lNumParts);
 
-        mMessages.emplace_back(std::move(lHBFrameVector[i].mHeader));
-        mMessages.emplace_back(std::move(lHBFrameVector[i].mData));
+        mMessages.emplace_back(std::move(lHBFrame.mHeader));
+        mMessages.emplace_back(std::move(lHBFrame.mData));
+        lPartIdx++;
+        continue;
+      }
+
+      DataHeader lDataHdr = lHBFrame.getDataHeader();
+      lDataHdr.splitPayloadParts = lNumParts;
+
+      for (std::size_t p = 0; p < lHBFrame.getNumDataParts(); p++) {
+        lDataHdr.payloadSize = lHBFrame.getDataPart(p).GetSize();
+        lDataHdr.splitPayloadIndex = lPartIdx++;
+
+        auto lHdrStack = Stack(lDataHdr, o2::framework::DataProcessingHeader(pStf.header().mId));
+        auto lHdrMsg = mChan.NewMessage(lHdrStack.size());
+        if (!lHdrMsg) {
+          DDLOG(fair::Severity::ERROR) << "Allocation error: HbFrame::DataHeader: " << lHdrStack.size();
+          throw std::bad_alloc();
+        }
+        std::memcpy(lHdrMsg->GetData(), lHdrStack.data(), lHdrStack.size());
+
+        mMessages.emplace_back(std::move(lHdrMsg));
+        mMessages.emplace_back(p == 0 ? std::move(lHBFrame.mData) : std::move(lHBFrame.mDataParts[p - 1]));
       }
-      lHBFrameVector.clear();
     }
   }
+
+  pStf.mData.clear();
+  pStf.mIndex.clear();
 }
 
 void StfDplAdapter::sendToDpl(std::unique_ptr<SubTimeFrame>&& pStf)
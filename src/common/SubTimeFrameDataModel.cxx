@@ -27,6 +27,8 @@ namespace DataDistribution
 
 using namespace o2::header;
 
+const o2::header::HeaderType HBFrameIndexHeader::sHeaderType = "HBFIndex";
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrame
 ////////////////////////////////////////////////////////////////////////////////
@@ -39,12 +41,8 @@ std::uint64_t SubTimeFrame::getDataSize() const
 {
   std::uint64_t lDataSize = std::uint64_t(0);
 
-  for (const auto& lDataIdentMapIter : mData) {
-    for (const auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (const auto& lStfDataIter : lSubSpecMapIter.second) {
-        lDataSize += lStfDataIter.mData->GetSize();
-      }
-    }
+  for (const auto& lStfData : mData) {
+    lDataSize += lStfData.getDataSize();
   }
 
   return lDataSize;
@@ -52,12 +50,14 @@ std::uint64_t SubTimeFrame::getDataSize() const
 
 std::vector<EquipmentIdentifier> SubTimeFrame::getEquipmentIdentifiers() const
 {
+  // make sure the equipment index has no repetitions
+  updateStf();
+
   std::vector<EquipmentIdentifier> lKeys;
+  lKeys.reserve(mIndex.size());
 
-  for (const auto& lDataIdentMapIter : mData) {
-    for (const auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      lKeys.emplace_back(EquipmentIdentifier(lDataIdentMapIter.first, lSubSpecMapIter.first));
-    }
+  for (const auto& lRange : mIndex) {
+    lKeys.emplace_back(lRange.mEquipment);
   }
 
   return lKeys;
@@ -65,37 +65,115 @@ std::vector<EquipmentIdentifier> SubTimeFrame::getEquipmentIdentifiers() const
 
 void SubTimeFrame::mergeStf(std::unique_ptr<SubTimeFrame> pStf)
 {
-  // make sure data equipment does not repeat
-  std::set<EquipmentIdentifier> lUnionSet;
-  for (const auto& lId : getEquipmentIdentifiers())
-    lUnionSet.emplace(lId);
-
-  for (const auto& lId : pStf->getEquipmentIdentifiers()) {
-    if (lUnionSet.emplace(lId).second == false /* not inserted */) {
-      DDLOG(fair::Severity::ERROR) << "Equipment already present" << lId.info();
+  // make sure data equipment does not repeat. Neither index is regrouped here: TFs are built by
+  // merging STFs one at a time, the data is grouped only once by updateStf().
+  std::vector<EquipmentIdentifier> lNewEquipIds;
+  lNewEquipIds.reserve(pStf->mIndex.size());
+  for (const auto& lRange : pStf->mIndex) {
+    lNewEquipIds.push_back(lRange.mEquipment);
+  }
+  std::sort(lNewEquipIds.begin(), lNewEquipIds.end());
+  lNewEquipIds.erase(std::unique(lNewEquipIds.begin(), lNewEquipIds.end()), lNewEquipIds.end());
+
+  std::vector<EquipmentIdentifier> lRepeated;
+  for (const auto& lRange : mIndex) {
+    if (std::binary_search(lNewEquipIds.cbegin(), lNewEquipIds.cend(), lRange.mEquipment)) {
+      lRepeated.push_back(lRange.mEquipment);
     }
   }
+  std::sort(lRepeated.begin(), lRepeated.end());
+  lRepeated.erase(std::unique(lRepeated.begin(), lRepeated.end()), lRepeated.end());
 
-  // merge the Stfs
-  for (auto& lDataIdentMapIter : pStf->mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      // source
-      const DataIdentifier& lDataId = lDataIdentMapIter.first;
-      const DataHeader::SubSpecificationType& lSubSpec = lSubSpecMapIter.first;
-      StfDataVector& lStfDataVec = lSubSpecMapIter.second;
+  for (const auto& lId : lRepeated) {
+    DDLOG(fair::Severity::ERROR) << "Equipment already present" << lId.info();
+  }
 
-      // destination
-      StfDataVector& lDstStfDataVec = mData[lDataId][lSubSpec];
+  // merge the Stfs: append data blocks and ranges, ordering is restored in updateStf()
+  const auto lOffset = mData.size();
 
-      std::move(
-        lStfDataVec.begin(),
-        lStfDataVec.end(),
-        std::back_inserter(lDstStfDataVec));
-    }
+  mData.reserve(mData.size() + pStf->mData.size());
+  std::move(
+    pStf->mData.begin(),
+    pStf->mData.end(),
+    std::back_inserter(mData));
+
+  mIndex.reserve(mIndex.size() + pStf->mIndex.size());
+  for (const auto& lRange : pStf->mIndex) {
+    mIndex.push_back(StfEquipmentRange{ lRange.mEquipment, lRange.mBegin + lOffset, lRange.mCount });
   }
 
+  mUpdated = false;
+
   // delete pStf
   pStf.reset();
 }
+
+void SubTimeFrame::updateStf() const
+{
+  if (mUpdated) {
+    return;
+  }
+
+  const auto lEquipLess = [](const StfEquipmentRange& a, const StfEquipmentRange& b) {
+    return a.mEquipment < b.mEquipment;
+  };
+
+  // Group the data blocks by equipment, if the ranges are not already strictly ordered.
+  // This happens only when blocks of different equipments were interleaved, or after merging.
+  const auto lUnordered = std::adjacent_find(mIndex.cbegin(), mIndex.cend(),
+    [&lEquipLess](const StfEquipmentRange& a, const StfEquipmentRange& b) {
+      return !lEquipLess(a, b);
+    });
+
+  if (lUnordered != mIndex.cend()) {
+    // keep the order of blocks within the same equipment
+    std::stable_sort(mIndex.begin(), mIndex.end(), lEquipLess);
+
+    StfDataVector lData;
+    lData.reserve(mData.size());
+    StfEquipmentIndex lIndex;
+    lIndex.reserve(mIndex.size());
+
+    for (const auto& lRange : mIndex) {
+      if (lIndex.empty() || lIndex.back().mEquipment != lRange.mEquipment) {
+        lIndex.push_back(StfEquipmentRange{ lRange.mEquipment, lData.size(), 0 });
+      }
+
+      std::move(
+        mData.begin() + lRange.mBegin,
+        mData.begin() + lRange.end(),
+        std::back_inserter(lData));
+
+      lIndex.back().mCount += lRange.mCount;
+    }
+
+    mData = std::move(lData);
+    mIndex = std::move(lIndex);
+  }
+
+  // Update data block indexes
+  for (const auto& lRange : mIndex) {
+    const auto lTotalCount = lRange.mCount;
+    for (StfDataVector::size_type i = 0; i < lTotalCount; i++) {
+      mData[lRange.mBegin + i].setPayloadIndex(i, lTotalCount);
+    }
+
+    assert(lTotalCount == 0 ? true :
+      mData[lRange.mBegin].getDataHeader().splitPayloadIndex == 0
+    );
+    assert(lTotalCount == 0 ? true :
+      mData[lRange.end() - 1].getDataHeader().splitPayloadIndex == (lTotalCount - 1)
+    );
+    assert(lTotalCount == 0 ? true :
+      mData[lRange.mBegin].getDataHeader().splitPayloadParts == lTotalCount
+    );
+    assert(lTotalCount == 0 ? true :
+      mData[lRange.mBegin].getDataHeader().splitPayloadParts ==
+      mData[lRange.end() - 1].getDataHeader().splitPayloadParts
+    );
+  }
+
+  mUpdated = true;
+}
 }
 } /* o2::DataDistribution */
@@ -40,16 +40,20 @@ using namespace std::chrono_literals;
 /// SubTimeFrameFileSource
 ////////////////////////////////////////////////////////////////////////////////
 
-void SubTimeFrameFileSource::start(FairMQChannel& pDstChan, const bool pDplEnabled)
+void SubTimeFrameFileSource::start(FairMQChannel& pDstChan, const bool pDplEnabled,
+  const HeaderRegionConfig& pHdrRegionCfg)
 {
   if (enabled()) {
     mDstChan = &pDstChan;
     mDplEnabled = pDplEnabled;
 
     if (!mFileBuilder) {
-      mFileBuilder = std::make_unique<SubTimeFrameFileBuilder>(pDstChan, mDplEnabled);
+      mFileBuilder = std::make_unique<SubTimeFrameFileBuilder>(pDstChan, mDplEnabled, pHdrRegionCfg);
     }
 
+    // bounded read-ahead: the reading thread blocks while the queue is full
+    mReadStfQueue.set_capacity(sReadAheadStfs);
+
     mRunning = true;
     mInjectThread = std::thread(&SubTimeFrameFileSource::DataInjectThread, this);
     mSourceThread = std::thread(&SubTimeFrameFileSource::DataHandlerThread, this);
@@ -187,8 +191,6 @@ void SubTimeFrameFileSource::DataInjectThread()
 /// File reading thread
 void SubTimeFrameFileSource::DataHandlerThread()
 {
-  // inject rate
-  const std::chrono::microseconds lIntervalUs(mLoadRate > 0 ? 1000000 / mLoadRate : 0);
   // Load the sorted list of StfFiles
   auto lFilesVector = getDataFileList();
   if (lFilesVector.empty()) {
@@ -209,18 +211,13 @@ void SubTimeFrameFileSource::DataHandlerThread()
       DDLOG(fair::Severity::DEBUG) << "FileSource: opened new file " << lFileNameAbs.string();
 
       while (mRunning) {
-        // prevent large read-ahead
-        while (mRunning && mReadStfQueue.size() > 3) {
-          std::this_thread::sleep_for(lIntervalUs);
-        }
-
         // read STF from file
         auto lStfPtr = lStfReader.read(*mDstChan);
 
         if (mRunning && lStfPtr) {
           // adapt Stf headers for different output channels, native or DPL
           mFileBuilder->adaptHeaders(lStfPtr.get());
-          mReadStfQueue.push(std::move(lStfPtr));
+          mReadStfQueue.push(std::move(lStfPtr)); // blocks while the read-ahead queue is full
         } else {
           break; // EOF or !running
         }
@@ -98,42 +98,30 @@ void SubTimeFrameFileWriter::visit(const SubTimeFrame& pStf)
   assert(mStfDataIndex.empty());
 
   // Write data in lexicographical order of DataIdentifier + subSpecification
-  // for easier binary comparison
-  std::vector<EquipmentIdentifier> lEquipIds = pStf.getEquipmentIdentifiers();
-  std::sort(std::begin(lEquipIds), std::end(lEquipIds));
+  // for easier binary comparison. The Stf equipment index is already sorted.
+  mStfData.reserve(pStf.mData.size());
 
-  //  sizes for different equipment identifiers
-  std::unordered_map<EquipmentIdentifier, std::tuple<std::uint64_t, std::uint32_t>> lDataIdSizeCnt;
+  // build the index
+  std::uint64_t lCurrOff = 0;
 
-  for (const auto& lEquip : lEquipIds) {
+  for (const auto& lEquipRange : pStf.mIndex) {
 
-    const auto& lEquipDataVec = pStf.mData.at(lEquip).at(lEquip.mSubSpecification);
+    std::uint64_t lIdSize = 0;
 
-    for (const auto& lData : lEquipDataVec) {
+    for (auto i = lEquipRange.mBegin; i < lEquipRange.end(); i++) {
+      const auto& lData = pStf.mData[i];
       // NOTE: get only pointers to <hdr, data> struct
       mStfData.emplace_back(&lData);
-      // account the size
-      const auto lHdrDataSize = lData.mHeader->GetSize() + lData.mData->GetSize();
-
-      // total size
-      mStfSize += lHdrDataSize;
-
-      // calculate the size for the index
-      auto & [ lSize, lCnt ] = lDataIdSizeCnt[lEquip];
-      lSize += lHdrDataSize;
-      lCnt++;
+      // account the size (only the DataHeader of the stack is written)
+      lIdSize += sizeof(DataHeader) + lData.getDataSize();
     }
-  }
 
-  // build the index
-  {
-    std::uint64_t lCurrOff = 0;
-    for (const auto& lId : lEquipIds) {
-      const auto[lIdSize, IdCnt] = lDataIdSizeCnt[lId];
-      assert(lIdSize > sizeof(DataHeader));
-      mStfDataIndex.AddStfElement(lId, IdCnt, lCurrOff, lIdSize);
-      lCurrOff += lIdSize;
-    }
+    // total size
+    mStfSize += lIdSize;
+
+    assert(lIdSize > sizeof(DataHeader));
+    mStfDataIndex.AddStfElement(lEquipRange.mEquipment, lEquipRange.mCount, lCurrOff, lIdSize);
+    lCurrOff += lIdSize;
   }
 }
 
@@ -185,7 +173,11 @@ std::uint64_t SubTimeFrameFileWriter::_write(const SubTimeFrame& pStf)
       // only write DataHeader (make a local DataHeader copy to clear flagsNextHeader bit)
       const DataHeader lDh = lStfData->getDataHeader();
       buffered_write(reinterpret_cast<const char*>(&lDh), sizeof (DataHeader));
-      buffered_write(lStfData->mData->GetData(), lStfData->mData->GetSize());
+      // packed HBFrames are written as one contiguous payload (DataHeader::payloadSize covers all parts)
+      for (std::size_t i = 0; i < lStfData->getNumDataParts(); i++) {
+        const auto &lDataPart = lStfData->getDataPart(i);
+        buffered_write(lDataPart.GetData(), lDataPart.GetSize());
+      }
     }
 
     // flush the buffer and check the state
@@ -204,6 +196,7 @@ std::uint64_t SubTimeFrameFileWriter::_write(const SubTimeFrame& pStf)
       const auto l1StfId = pStf.header().mId;
       const auto l2StfFileOff = lPrevSize;
       const auto l3StfFileSize = lStfSizeInFile;
+      RdhBlockScan lRdhScan;
 
       for (const auto& lStfData : mStfData) {
         DataHeader lDH;
@@ -215,22 +208,42 @@ std::uint64_t SubTimeFrameFileWriter::_write(const SubTimeFrame& pStf)
         const auto l7DataIndex = lDH.splitPayloadIndex;
 
         const auto l8HdrOff = lDataOffset;
-        lDataOffset += lStfData->mHeader->GetSize();
-        const auto l9HdrSize = lStfData->mHeader->GetSize();
+        lDataOffset += sizeof(DataHeader);
+        const auto l9HdrSize = sizeof(DataHeader);
         const auto l10DataOff = lDataOffset;
-        lDataOffset += lStfData->mData->GetSize();
-        const auto l11DataSize = lStfData->mData->GetSize();
-        const auto [l12MemSize, l13StopBit] = ReadoutDataUtils::getRdhMemorySize(
-          reinterpret_cast<const char*>(lStfData->mData->GetData()),
-          lStfData->mData->GetSize());
-
-        const auto l14FeeId = ReadoutDataUtils::getFeeId(
-          reinterpret_cast<const char*>(lStfData->mData->GetData()),
-          lStfData->mData->GetSize());
-
-        const auto l15Orbit = ReadoutDataUtils::getHBOrbit(
-          reinterpret_cast<const char*>(lStfData->mData->GetData()),
-          lStfData->mData->GetSize());
+        lDataOffset += lStfData->getDataSize();
+        const auto l11DataSize = lStfData->getDataSize();
+        // all RDH fields from one pass over each HBFrame (packed superpages hold several)
+        bool lRdhValid = true;
+        bool lFirstHbf = true;
+        std::size_t l12MemSize = 0;
+        int l13StopBit = -1;
+        auto l14FeeId = std::uint16_t(-1);
+        auto l15Orbit = std::uint32_t(-1);
+
+        lStfData->forEachHbFrame([&](const char* pHbfData, const std::size_t pHbfSize) {
+          ReadoutDataUtils::scanRdhBlock(pHbfData, pHbfSize, lRdhScan);
+
+          lRdhValid = lRdhValid && !lRdhScan.mPackets.empty();
+          if (!lRdhValid) {
+            return;
+          }
+
+          if (lFirstHbf) {
+            l14FeeId = lRdhScan.mPackets.front().mFeeId;
+            l15Orbit = lRdhScan.mPackets.front().mOrbit;
+            lFirstHbf = false;
+          }
+
+          l12MemSize += lRdhScan.memorySize();
+          l13StopBit = lRdhScan.ok() ? lRdhScan.mPackets.back().mStopBit :
+            (lRdhScan.mStatus == RdhBlockScan::eScanNoStopBit ? 0 : -1);
+        });
+
+        if (!lRdhValid) {
+          l12MemSize = std::size_t(-1);
+          l13StopBit = -1;
+        }
 
         mInfoFile << l1StfId << sSidecarFieldSep;
         mInfoFile << l2StfFileOff << sSidecarFieldSep;
@@ -20,6 +20,7 @@
 
 #include <vector>
 #include <deque>
+#include <iterator>
 
 namespace o2
 {
@@ -32,38 +33,45 @@ namespace DataDistribution
 
 void DataIdentifierSplitter::visit(SubTimeFrame& pStf)
 {
-  std::vector<DataIdentifier> lToErase;
-
   if (mDataIdentifier.dataOrigin == gDataOriginAny) {
     mSubTimeFrame = std::make_unique<SubTimeFrame>(std::move(pStf));
-  } else if (mDataIdentifier.dataDescription == gDataDescriptionAny) {
-    // filter any source with requested origin
-    mSubTimeFrame = std::make_unique<SubTimeFrame>(pStf.header().mId);
-    for (auto& lKeyData : pStf.mData) {
-      const DataIdentifier& lIden = lKeyData.first;
-      if (lIden.dataOrigin == mDataIdentifier.dataOrigin) {
-        // use the equipment identifier of the object
-        mSubTimeFrame->mData[lIden] = std::move(lKeyData.second);
-        lToErase.emplace_back(lIden);
-      }
+    return;
+  }
+
+  mSubTimeFrame = std::make_unique<SubTimeFrame>(pStf.header().mId);
+
+  const auto lMatches = [this](const DataIdentifier& pIden) -> bool {
+    if (mDataIdentifier.dataDescription == gDataDescriptionAny) {
+      // filter any source with requested origin
+      return pIden.dataOrigin == mDataIdentifier.dataOrigin;
     }
-  } else {
     /* find the exact match */
-    mSubTimeFrame = std::make_unique<SubTimeFrame>(pStf.header().mId);
-
-    for (auto& lKeyData : pStf.mData) {
-      const DataIdentifier& lIden = lKeyData.first;
-      if (lIden == mDataIdentifier) {
-        // use the equipment identifier of the object
-        mSubTimeFrame->mData[lIden] = std::move(lKeyData.second);
-        lToErase.emplace_back(lIden);
+    return pIden == mDataIdentifier;
+  };
+
+  // move matching equipment ranges to the new Stf, compact the rest
+  SubTimeFrame::StfDataVector lRemainingData;
+  SubTimeFrame::StfEquipmentIndex lRemainingIndex;
+
+  for (const auto& lRange : pStf.mIndex) {
+    const DataIdentifier lIden = lRange.mEquipment;
+
+    if (lMatches(lIden)) {
+      for (auto i = lRange.mBegin; i < lRange.end(); i++) {
+        mSubTimeFrame->addStfData(lRange.mEquipment, std::move(pStf.mData[i]));
       }
+    } else {
+      lRemainingIndex.push_back(SubTimeFrame::StfEquipmentRange{ lRange.mEquipment, lRemainingData.size(), lRange.mCount });
+
+      std::move(
+        pStf.mData.begin() + lRange.mBegin,
+        pStf.mData.begin() + lRange.end(),
+        std::back_inserter(lRemainingData));
     }
   }
 
-  // erase forked elements
-  for (auto& lIden : lToErase)
-    pStf.mData.erase(lIden);
+  pStf.mData = std::move(lRemainingData);
+  pStf.mIndex = std::move(lRemainingIndex);
 }
 
 std::unique_ptr<SubTimeFrame> DataIdentifierSplitter::split(SubTimeFrame& pStf, const DataIdentifier& pDataIdent)
@@ -22,6 +22,7 @@
 #include <deque>
 #include <new>
 #include <memory>
+#include <iterator>
 
 namespace o2
 {
@@ -60,21 +61,25 @@ void InterleavedHdrDataSerializer::visit(SubTimeFrame& pStf)
   mMessages.emplace_back(std::move(lDataHeaderMsg));
   mMessages.emplace_back(std::move(lDataMsg));
 
-  for (auto& lDataIdentMapIter : pStf.mData) {
-    for (auto& lSubSpecMapIter : lDataIdentMapIter.second) {
-      for (auto& lStfDataIter : lSubSpecMapIter.second) {
-        mMessages.emplace_back(std::move(lStfDataIter.mHeader));
+  mMessages.reserve(mMessages.size() + 2 * pStf.mData.size());
 
-        if (lStfDataIter.mData->GetSize() == 0) {
-          DDLOG(fair::Severity::ERROR) << "Sending STF data payload with zero size";
-        }
+  for (auto& lStfDataIter : pStf.mData) {
+    mMessages.emplace_back(std::move(lStfDataIter.mHeader));
 
-        mMessages.emplace_back(std::move(lStfDataIter.mData));
-      }
+    if (lStfDataIter.mData->GetSize() == 0) {
+      DDLOG(fair::Severity::ERROR) << "Sending STF data payload with zero size";
+    }
+
+    mMessages.emplace_back(std::move(lStfDataIter.mData));
+
+    // packed HBFrames: remaining data parts follow the first one
+    for (auto& lDataPart : lStfDataIter.mDataParts) {
+      mMessages.emplace_back(std::move(lDataPart));
     }
   }
 
   pStf.mData.clear();
+  pStf.mIndex.clear();
   pStf.mHeader = SubTimeFrame::Header();
 }
 
@@ -95,7 +100,6 @@ void InterleavedHdrDataSerializer::serialize(std::unique_ptr<SubTimeFrame>&& pSt
 void InterleavedHdrDataDeserializer::visit(SubTimeFrame& pStf)
 {
   assert(mMessages.size() >= 2); // stf meta messages must be present
-  assert(mMessages.size() % 2 == 0);
 
   // header
   DataHeader lStfDataHdr;
@@ -109,15 +113,34 @@ void InterleavedHdrDataDeserializer::visit(SubTimeFrame& pStf)
   std::memcpy(&pStf.mHeader, mMessages[1]->GetData(), sizeof(SubTimeFrame::Header));
 
   // iterate over all incoming HBFrame data sources
-  for (size_t i = 2; i < mMessages.size(); i += 2) {
+  size_t i = 2;
+  while (i < mMessages.size()) {
+
+    if (i + 1 >= mMessages.size()) {
+      throw std::runtime_error("SubTimeFrame::StfData: missing data message");
+    }
 
-    auto &lDataMsg = mMessages[i + 1];
+    SubTimeFrame::StfData lStfData{ std::move(mMessages[i]), std::move(mMessages[i + 1]) };
+    i += 2;
 
-    if (lDataMsg->GetSize() == 0) {
+    if (lStfData.mData->GetSize() == 0) {
       DDLOG(fair::Severity::ERROR) << "Received STF data payload with zero size";
     }
 
-    pStf.addStfData({ std::move(mMessages[i]), std::move(lDataMsg) });
+    // packed HBFrames: one data message per HBFrame index entry
+    const auto lIndex = lStfData.getHbFrameIndex();
+    if (lIndex && lIndex->mNumHbFrames > 1) {
+      const std::size_t lNumParts = lIndex->mNumHbFrames - 1;
+      if (i + lNumParts > mMessages.size()) {
+        throw std::runtime_error("SubTimeFrame::StfData: missing packed HBFrame data messages");
+      }
+
+      lStfData.mDataParts.reserve(lNumParts);
+      std::move(mMessages.begin() + i, mMessages.begin() + i + lNumParts, std::back_inserter(lStfData.mDataParts));
+      i += lNumParts;
+    }
+
+    pStf.addStfData(std::move(lStfData));
   }
 }
 
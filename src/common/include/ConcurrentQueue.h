@@ -16,12 +16,16 @@
 
 #include <cassert>
 #include <atomic>
+#include <memory>
 #include <vector>
 #include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <iterator>
 #include <chrono>
+#include <functional>
+#include <utility>
+#include <algorithm>
 
 #include <Utilities.h>
 
@@ -34,6 +38,8 @@ namespace impl
 {
 
 /// Concurrent (thread-safe) container adapter for FIFO/LIFO data structures
+/// The container is unbounded unless a capacity is set. Producers of a bounded container block
+/// in push(), or can use try_push() and push_wait_for() to handle the back-pressure themselves.
 enum QueueType {
   eFIFO,
   eLIFO
@@ -58,29 +64,80 @@ class ConcurrentContainerImpl
     mImpl->mRunning = false;
     lLock.unlock();
     mImpl->mCond.notify_all();
+    mImpl->mSpaceCond.notify_all();
   }
 
   void flush()
   {
     std::unique_lock<std::mutex> lLock(mImpl->mLock);
     mImpl->mContainer.clear();
+    mImpl->mAboveHighWatermark = false;
     lLock.unlock();
     mImpl->mCond.notify_all();
+    mImpl->mSpaceCond.notify_all();
   }
 
+  /// Maximum number of elements in the container (0: unbounded)
+  void set_capacity(const std::size_t pCapacity)
+  {
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    mImpl->mCapacity = pCapacity;
+    lLock.unlock();
+    mImpl->mSpaceCond.notify_all();
+  }
+
+  std::size_t capacity() const { return mImpl->mCapacity; }
+
+  /// Callback invoked by the producer when the size reaches the high watermark. The callback is
+  /// re-armed when the size drops below the watermark. Called without holding the container lock.
+  void set_high_watermark(const std::size_t pHighWatermark, std::function<void(const std::size_t)> pCallback)
+  {
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    mImpl->mHighWatermark = pHighWatermark;
+    mImpl->mHighWatermarkCallback = std::move(pCallback);
+    mImpl->mAboveHighWatermark = false;
+  }
+
+  /// Blocks while the container is full. Elements are always added after stop().
   template <typename... Args>
   void push(Args&&... args)
   {
     std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    while (full() && mImpl->mRunning) {
+      mImpl->mSpaceCond.wait(lLock);
+    }
 
-    if (type == eFIFO) {
-      mImpl->mContainer.emplace_back(std::forward<Args>(args)...);
-    } else if (type == eLIFO) {
-      mImpl->mContainer.emplace_front(std::forward<Args>(args)...);
+    emplace(lLock, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  bool try_push(Args&&... args)
+  {
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    if (full()) {
+      return false;
     }
 
-    lLock.unlock(); // reduce contention
-    mImpl->mCond.notify_one();
+    emplace(lLock, std::forward<Args>(args)...);
+    return true;
+  }
+
+  template <typename... Args>
+  bool push_wait_for(const std::chrono::microseconds &us, Args&&... args)
+  {
+    std::unique_lock<std::mutex> lLock(mImpl->mLock);
+    if (full() && mImpl->mRunning) {
+      if (!mImpl->mSpaceCond.wait_for(lLock, us, [this]() { return !full() || !mImpl->mRunning; })) {
+        return false;
+      }
+    }
+
+    if (full()) {
+      return false; // stopped
+    }
+
+    emplace(lLock, std::forward<Args>(args)...);
+    return true;
   }
 
   bool pop(T& d)
@@ -96,6 +153,7 @@ class ConcurrentContainerImpl
     assert(!mImpl->mContainer.empty());
     d = std::move(mImpl->mContainer.front());
     mImpl->mContainer.pop_front();
+    removed(lLock);
     return true;
   }
 
@@ -132,6 +190,7 @@ class ConcurrentContainerImpl
     unsigned long ret = std::min(mImpl->mContainer.size(), pCnt);
     std::move(std::begin(mImpl->mContainer), std::begin(mImpl->mContainer) + ret, pDstIter);
     mImpl->mContainer.erase(std::begin(mImpl->mContainer), std::begin(mImpl->mContainer) + ret);
+    removed(lLock);
     return ret;
   }
 
@@ -144,6 +203,7 @@ class ConcurrentContainerImpl
 
     d = std::move(mImpl->mContainer.front());
     mImpl->mContainer.pop_front();
+    removed(lLock);
     return true;
   }
 
@@ -158,6 +218,7 @@ class ConcurrentContainerImpl
     unsigned long ret = std::min(mImpl->mContainer.size(), pCnt);
     std::move(std::begin(mImpl->mContainer), std::begin(mImpl->mContainer) + ret, pDstIter);
     mImpl->mContainer.erase(std::begin(mImpl->mContainer), std::begin(mImpl->mContainer) + ret);
+    removed(lLock);
     return ret;
   }
 
@@ -170,11 +231,58 @@ class ConcurrentContainerImpl
   bool is_running() const { return mImpl->mRunning; }
 
   private:
+  bool full() const { return mImpl->mCapacity > 0 && mImpl->mContainer.size() >= mImpl->mCapacity; }
+
+  template <typename... Args>
+  void emplace(std::unique_lock<std::mutex> &pLock, Args&&... args)
+  {
+    if (type == eFIFO) {
+      mImpl->mContainer.emplace_back(std::forward<Args>(args)...);
+    } else if (type == eLIFO) {
+      mImpl->mContainer.emplace_front(std::forward<Args>(args)...);
+    }
+
+    const auto lSize = mImpl->mContainer.size();
+    const bool lHighWatermark = mImpl->mHighWatermark > 0 && !mImpl->mAboveHighWatermark &&
+                                lSize >= mImpl->mHighWatermark;
+    if (lHighWatermark) {
+      mImpl->mAboveHighWatermark = true;
+    }
+
+    pLock.unlock(); // reduce contention
+    mImpl->mCond.notify_one();
+
+    if (lHighWatermark && mImpl->mHighWatermarkCallback) {
+      mImpl->mHighWatermarkCallback(lSize);
+    }
+  }
+
+  // called with the lock held, after elements are removed
+  void removed(std::unique_lock<std::mutex> &pLock)
+  {
+    if (mImpl->mAboveHighWatermark && mImpl->mContainer.size() < mImpl->mHighWatermark) {
+      mImpl->mAboveHighWatermark = false;
+    }
+
+    if (mImpl->mCapacity > 0) {
+      pLock.unlock();
+      mImpl->mSpaceCond.notify_all();
+    }
+  }
+
   struct QueueInternals {
     std::deque<T> mContainer;
     mutable std::mutex mLock;
     std::condition_variable mCond;
     bool mRunning = true;
+
+    /// bounded container
+    std::condition_variable mSpaceCond;
+    std::size_t mCapacity = 0;
+
+    std::size_t mHighWatermark = 0;
+    bool mAboveHighWatermark = false;
+    std::function<void(const std::size_t)> mHighWatermarkCallback;
   };
 
   std::unique_ptr<QueueInternals> mImpl;
@@ -194,6 +302,284 @@ using ConcurrentFifo = impl::ConcurrentContainerImpl<T, impl::eFIFO>;
 template <class T>
 using ConcurrentLifo = impl::ConcurrentContainerImpl<T, impl::eLIFO>;
 
+///
+///  Lock-free single-producer single-consumer ring
+///
+///  Fixed capacity (power of 2) ring of slots. Producer and consumer synchronize only on the
+///  head and tail indices. Threads block (with timeout) on a condition variable only when the ring
+///  is full or empty, and are woken only if they announced waiting.
+///
+template <typename T>
+class ConcurrentSpscRing
+{
+ public:
+  typedef T value_type;
+
+  ConcurrentSpscRing(const std::size_t pCapacity = 1024)
+  : mImpl(std::make_unique<RingInternals>(pCapacity)) { }
+
+  ConcurrentSpscRing(ConcurrentSpscRing &&) = default;
+
+  ~ConcurrentSpscRing() { if (mImpl) { stop(); } }
+
+  void stop()
+  {
+    mImpl->mRunning = false;
+    std::scoped_lock lLock(mImpl->mWaitLock);
+    mImpl->mWaitCond.notify_all();
+  }
+
+  std::size_t capacity() const { return mImpl->mSlots.size(); }
+
+  std::size_t size() const
+  {
+    const auto lTail = mImpl->mTail.load(std::memory_order_acquire);
+    return lTail - mImpl->mHead.load(std::memory_order_acquire);
+  }
+
+  bool is_running() const { return mImpl->mRunning; }
+
+  /// Producer: returns false when the ring is full. The argument is not consumed in that case.
+  template <typename... Args>
+  bool try_push(Args&&... args)
+  {
+    auto &lI = *mImpl;
+    const auto lTail = lI.mTail.load(std::memory_order_relaxed);
+
+    if (lTail - lI.mCachedHead == lI.mSlots.size()) {
+      lI.mCachedHead = lI.mHead.load(std::memory_order_acquire);
+      if (lTail - lI.mCachedHead == lI.mSlots.size()) {
+        return false;
+      }
+    }
+
+    lI.mSlots[lTail & lI.mMask] = T(std::forward<Args>(args)...);
+    lI.mTail.store(lTail + 1, std::memory_order_release);
+
+    wake(lI.mConsumerWaiting);
+    return true;
+  }
+
+  /// Producer: waits up to the timeout for a free slot
+  template <typename... Args>
+  bool push_wait_for(const std::chrono::microseconds &us, Args&&... args)
+  {
+    if (try_push(std::forward<Args>(args)...)) {
+      return true;
+    }
+
+    wait_for(mImpl->mProducerWaiting, us, [this]() { return size() < capacity(); });
+    return try_push(std::forward<Args>(args)...);
+  }
+
+  /// Consumer: move out up to pCnt elements. Returns the number of elements.
+  template <class OutputIt>
+  unsigned long try_pop_n(const unsigned long pCnt, OutputIt pDstIter)
+  {
+    auto &lI = *mImpl;
+    const auto lHead = lI.mHead.load(std::memory_order_relaxed);
+
+    if (lI.mCachedTail - lHead < pCnt) {
+      lI.mCachedTail = lI.mTail.load(std::memory_order_acquire);
+    }
+
+    const unsigned long lCnt = std::min(lI.mCachedTail - lHead, pCnt);
+    if (lCnt == 0) {
+      return 0;
+    }
+
+    for (unsigned long i = 0; i < lCnt; i++) {
+      *pDstIter++ = std::move(lI.mSlots[(lHead + i) & lI.mMask]);
+    }
+    lI.mHead.store(lHead + lCnt, std::memory_order_release);
+
+    wake(lI.mProducerWaiting);
+    return lCnt;
+  }
+
+  bool try_pop(T& d)
+  {
+    return try_pop_n(1, &d) == 1;
+  }
+
+  /// Consumer: waits up to the timeout for at least one element
+  template <class OutputIt>
+  unsigned long pop_n_wait_for(const unsigned long pCnt, OutputIt pDstIter, const std::chrono::microseconds &us)
+  {
+    const auto lCnt = try_pop_n(pCnt, pDstIter);
+    if (lCnt > 0) {
+      return lCnt;
+    }
+
+    wait_for(mImpl->mConsumerWaiting, us, [this]() { return size() > 0; });
+    return try_pop_n(pCnt, pDstIter);
+  }
+
+ private:
+  template <class Pred>
+  void wait_for(std::atomic_bool &pWaiting, const std::chrono::microseconds &us, Pred pPred)
+  {
+    auto &lI = *mImpl;
+    std::unique_lock<std::mutex> lLock(lI.mWaitLock);
+    pWaiting.store(true);
+    // pairs with the fence in wake(): the other side either sees pWaiting, or we see its update
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    lI.mWaitCond.wait_for(lLock, us, [&]() { return pPred() || !lI.mRunning; });
+    pWaiting.store(false, std::memory_order_relaxed);
+  }
+
+  void wake(std::atomic_bool &pWaiting)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pWaiting.load(std::memory_order_relaxed)) {
+      std::scoped_lock lLock(mImpl->mWaitLock);
+      mImpl->mWaitCond.notify_all();
+    }
+  }
+
+  static std::size_t roundUpPow2(const std::size_t pVal)
+  {
+    std::size_t lRet = 2;
+    while (lRet < pVal) {
+      lRet <<= 1;
+    }
+    return lRet;
+  }
+
+  struct RingInternals {
+    RingInternals(const std::size_t pCapacity)
+    : mSlots(roundUpPow2(pCapacity)),
+      mMask(mSlots.size() - 1) { }
+
+    std::vector<T> mSlots;
+    const std::size_t mMask;
+
+    /// consumer side
+    alignas(64) std::atomic_size_t mHead = 0;
+    std::size_t mCachedTail = 0;
+
+    /// producer side
+    alignas(64) std::atomic_size_t mTail = 0;
+    std::size_t mCachedHead = 0;
+
+    /// blocking when empty or full
+    alignas(64) std::atomic_bool mRunning = true;
+    std::atomic_bool mConsumerWaiting = false;
+    std::atomic_bool mProducerWaiting = false;
+    std::mutex mWaitLock;
+    std::condition_variable mWaitCond;
+  };
+
+  std::unique_ptr<RingInternals> mImpl;
+};
+
+///
+///  Lock-free multiple-producer single-consumer queue
+///  Producers push with a single CAS. The consumer takes all queued elements at once.
+///
+template <typename T>
+class ConcurrentMpscQueue
+{
+ public:
+  typedef T value_type;
+
+  ConcurrentMpscQueue() = default;
+  ConcurrentMpscQueue(const ConcurrentMpscQueue&) = delete;
+  ConcurrentMpscQueue& operator=(const ConcurrentMpscQueue&) = delete;
+
+  ~ConcurrentMpscQueue() { clear(); }
+
+  template <typename... Args>
+  void push(Args&&... args)
+  {
+    Node *lNode = new Node{ T(std::forward<Args>(args)...), mHead.load(std::memory_order_relaxed) };
+    while (!mHead.compare_exchange_weak(lNode->mNext, lNode)) { }
+
+    // wake up the consumer only if it is waiting
+    if (mConsumerWaiting) {
+      std::lock_guard<std::mutex> lLock(mWaitLock);
+      mWaitCond.notify_one();
+    }
+  }
+
+  /// Consume all queued elements in FIFO order (consumer only)
+  template <typename Func>
+  std::size_t consume_all(Func&& pFunc)
+  {
+    Node *lList = mHead.exchange(nullptr);
+
+    // reverse to get the insertion order
+    Node *lFifo = nullptr;
+    while (lList) {
+      Node *lNext = lList->mNext;
+      lList->mNext = lFifo;
+      lFifo = lList;
+      lList = lNext;
+    }
+
+    std::size_t lCnt = 0;
+    while (lFifo) {
+      std::unique_ptr<Node> lNode(lFifo);
+      lFifo = lFifo->mNext;
+      pFunc(std::move(lNode->mValue));
+      lCnt++;
+    }
+    return lCnt;
+  }
+
+  void clear() { consume_all([](T&&) {}); }
+
+  bool empty() const { return mHead.load() == nullptr; }
+
+  /// Wait until the queue is not empty, the timeout expires, or notify() is called (consumer only)
+  template <class Rep, class Period>
+  bool wait_for(const std::chrono::duration<Rep, Period>& pTimeout)
+  {
+    std::unique_lock<std::mutex> lLock(mWaitLock);
+    mConsumerWaiting = true;
+    if (empty()) {
+      mWaitCond.wait_for(lLock, pTimeout);
+    }
+    mConsumerWaiting = false;
+    return !empty();
+  }
+
+  void notify()
+  {
+    std::lock_guard<std::mutex> lLock(mWaitLock);
+    mWaitCond.notify_all();
+  }
+
+ private:
+  struct Node {
+    T mValue;
+    Node *mNext;
+  };
+
+  std::atomic<Node*> mHead = nullptr;
+
+  std::atomic_bool mConsumerWaiting = false;
+  std::mutex mWaitLock;
+  std::condition_variable mWaitCond;
+};
+
+///
+///  Memory budget of a pipeline: bytes buffered in the stage queues
+///
+struct PipelineMemoryBudget {
+  enum DropPolicy {
+    eDropNewest,  // reject elements queued while over the budget
+    eDropOldest   // evict queued elements, starting from the last stage
+  };
+
+  /// Dropping starts above the high watermark and stops below the low watermark (0: no budget)
+  std::uint64_t mHighWatermark = 0;
+  std::uint64_t mLowWatermark = 0;
+  DropPolicy mDropPolicy = eDropOldest;
+
+  bool enabled() const { return mHighWatermark > 0; }
+};
+
 ///
 ///  Pipeline handler with input and output ConcurrentContainer queue/stack
 ///
@@ -220,17 +606,29 @@ class IFifoPipeline
     }
   }
 
-  template <typename... Args>
-  bool queue(unsigned pStage, Args&&... args)
+  void setPipelineMemoryBudget(const PipelineMemoryBudget &pBudget) { mMemoryBudget = pBudget; }
+
+  bool queue(unsigned pStage, T&& pElem)
   {
     assert(pStage < mPipelineQueues.size());
+
+    // admission control: size of the element is only needed with the memory budget
+    std::uint64_t lBytes = 0;
+    if (mMemoryBudget.enabled()) {
+      lBytes = getPipelineElementSize(pElem);
+      if (!admitPipelineElement(lBytes)) {
+        return false;
+      }
+    }
+
     auto lNextStage = getNextPipelineStage(pStage);
     assert((lNextStage <= mPipelineQueues.size()) && "next stage larger than expected");
 
     // NOTE: (lNextStage == mPipelineQueues.size()) is the drop queue
     if (lNextStage < mPipelineQueues.size()) {
       const auto lSize = ++mPipelinedSize;
-      mPipelineQueues[lNextStage].push(std::forward<Args>(args)...);
+      mPipelinedBytes += lBytes;
+      mPipelineQueues[lNextStage].push(std::move(pElem), lBytes);
       mPipelinedSizeSamples.Fill(lSize);
       return true;
     }
@@ -239,29 +637,82 @@ class IFifoPipeline
 
   T dequeue(unsigned pStage)
   {
-    T t;
-    mPipelineQueues[pStage].pop(t);
+    std::pair<T, std::uint64_t> lElem;
+    if (mPipelineQueues[pStage].pop(lElem)) {
+      mPipelinedBytes -= lElem.second;
+    }
     mPipelinedSize--;
-    return std::move(t);
+    return std::move(lElem.first);
   }
 
   bool try_pop(unsigned pStage)
   {
-    T t;
-    return mPipelineQueues[pStage].try_pop(t);
+    std::pair<T, std::uint64_t> lElem;
+    if (!mPipelineQueues[pStage].try_pop(lElem)) {
+      return false;
+    }
+    mPipelinedBytes -= lElem.second;
+    return true;
   }
 
   long getPipelineSize() const noexcept { return mPipelinedSize; }
+  std::uint64_t getPipelineBytes() const noexcept { return mPipelinedBytes; }
+  std::uint64_t getPipelineBudgetDrops() const noexcept { return mPipelineBudgetDrops; }
 
   const auto& getPipelinedSizeSamples() const noexcept { return mPipelinedSizeSamples; }
 
  protected:
   virtual unsigned getNextPipelineStage(unsigned pStage) = 0;
 
+  /// Size of an element for the memory budget
+  virtual std::uint64_t getPipelineElementSize(const T& /*pElem*/) const { return 0; }
+  /// Notification of an element evicted by the memory budget (eDropOldest)
+  virtual void onPipelineElementEvicted(unsigned /*pStage*/, const T& /*pElem*/) { }
+
   std::atomic_long mPipelinedSize = 0;
-  std::vector<o2::DataDistribution::ConcurrentFifo<T>> mPipelineQueues;
+  std::vector<o2::DataDistribution::ConcurrentFifo<std::pair<T, std::uint64_t>>> mPipelineQueues;
 
   RunningSamples<long> mPipelinedSizeSamples;
+
+ private:
+  bool admitPipelineElement(const std::uint64_t pBytes)
+  {
+    if (!mOverBudget) {
+      if (mPipelinedBytes + pBytes <= mMemoryBudget.mHighWatermark) {
+        return true;
+      }
+      mOverBudget = true;
+    } else if (mPipelinedBytes + pBytes <= mMemoryBudget.mLowWatermark) {
+      mOverBudget = false;
+      return true;
+    }
+
+    if (mMemoryBudget.mDropPolicy == PipelineMemoryBudget::eDropNewest) {
+      mPipelineBudgetDrops++;
+      return false;
+    }
+
+    // make room down to the low watermark. Back-end stages hold the oldest elements.
+    for (auto lStage = mPipelineQueues.size(); lStage-- > 0; ) {
+      while (mPipelinedBytes + pBytes > mMemoryBudget.mLowWatermark) {
+        std::pair<T, std::uint64_t> lElem;
+        if (!mPipelineQueues[lStage].try_pop(lElem)) {
+          break;
+        }
+        mPipelinedBytes -= lElem.second;
+        mPipelinedSize--;
+        mPipelineBudgetDrops++;
+        onPipelineElementEvicted(lStage, lElem.first);
+      }
+    }
+    mOverBudget = false;
+    return true;
+  }
+
+  PipelineMemoryBudget mMemoryBudget;
+  std::atomic_uint64_t mPipelinedBytes = 0;
+  std::atomic_uint64_t mPipelineBudgetDrops = 0;
+  std::atomic_bool mOverBudget = false;
 };
 }
 } /* namespace o2::DataDistribution */
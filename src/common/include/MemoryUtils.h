@@ -24,9 +24,12 @@
 
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 class DataHeader;
 class FairMQUnmanagedRegion;
@@ -42,28 +45,34 @@ class FMQUnsynchronizedPoolMemoryResource : public boost::container::pmr::memory
 public:
   FMQUnsynchronizedPoolMemoryResource() = delete;
 
+  /// Adaptive mode: new regions of the initial size are added when the pool occupancy stays high
+  /// over sHighOccupancyReclaims reclaims and at least sHighOccupancyTime, up to sMaxRegions
+  /// regions and pMaxSize bytes (0: sDefaultMaxSizeFactor times the initial size). Reclaims after a
+  /// timed out wait do not count: a stalled downstream (back-pressure) does not grow the pool.
+  static constexpr std::size_t sMaxRegions = 16;
+  static constexpr std::size_t sDefaultMaxSizeFactor = 4;
+  static constexpr std::size_t sHighOccupancyReclaims = 4;
+  static constexpr auto sHighOccupancyTime = std::chrono::seconds(1);
+
   FMQUnsynchronizedPoolMemoryResource(FairMQChannel &pChan,
-                                      const std::size_t pSize, const std::size_t pObjSize)
+                                      const std::size_t pSize, const std::size_t pObjSize,
+                                      const bool pAdaptive = false, const std::size_t pMaxSize = 0)
   : mChan(pChan),
+    mRegionSize(pSize),
+    mMaxSize(pMaxSize > 0 ? std::max(pMaxSize, pSize) : (pSize * sDefaultMaxSizeFactor)),
+    mAdaptive(pAdaptive),
     mObjectSize(pObjSize),
     mAlignedSize((pObjSize + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t))
   {
+    addRegion();
+  }
 
-    mRegion = pChan.NewUnmanagedRegion(pSize,
-      [this](void* pRelData, size_t pRelSize, void* /* hint */) {
-      // callback to be called when message buffers no longer needed by transport
-      reclaimSHMMessage(pRelData, pRelSize);
-    });
-
-    // prepare header pointers
-    unsigned char* lObj = static_cast<unsigned char*>(mRegion->GetData());
-    memset(lObj, 0xAA, mRegion->GetSize());
-
-    const std::size_t lObjectCnt = mRegion->GetSize() / mAlignedSize;
-
-    for (std::size_t i = 0; i < lObjectCnt; i++) {
-      mAvailableObjects.push_back(lObj + i * mAlignedSize);
-    }
+  ~FMQUnsynchronizedPoolMemoryResource()
+  {
+    DDLOGF(fair::Severity::INFO, "Header pool statistics: object_size={} regions={} region_size={} "
+      "total_objects={} used_objects={} used_objects_high_water={} allocation_waits={}",
+      mObjectSize, mRegions.size(), mRegionSize, totalObjects(), usedObjects(),
+      usedObjectsHighWater(), allocationWaits());
   }
 
   std::unique_ptr<FairMQMessage> NewFairMQMessage() {
@@ -71,7 +80,7 @@ public:
     const auto lMem = allocate(0); // boost -> do_allocate(0) .. always return fixed object size (mObjectSize)
 
     if (lMem != nullptr) {
-      return mChan.NewMessage(mRegion, lMem, mObjectSize);
+      return mChan.NewMessage(getRegion(lMem), lMem, mObjectSize);
     } else {
       // Log warning to increase the pool size
       static thread_local unsigned throttle = 0;
@@ -85,37 +94,52 @@ public:
   }
 
   std::unique_ptr<FairMQMessage> NewFairMQMessageFromPtr(void *pPtr) {
-    assert(pPtr >= static_cast<byte*>(mRegion->GetData()) && pPtr < static_cast<byte*>(mRegion->GetData()) + mRegion->GetSize());
-
-    return mChan.NewMessage(mRegion, pPtr, mObjectSize);
+    return mChan.NewMessage(getRegion(pPtr), pPtr, mObjectSize);
   }
 
   std::size_t objectSize() const { return mObjectSize; }
 
+  /// Pool occupancy counters
+  std::size_t totalObjects() const { return mObjectsTotal.load(std::memory_order_relaxed); }
+  std::size_t usedObjects() const { return mObjectsUsed.load(std::memory_order_relaxed); }
+  std::size_t usedObjectsHighWater() const { return mObjectsUsedHighWater.load(std::memory_order_relaxed); }
+  std::uint64_t allocationWaits() const { return mAllocationWaits.load(std::memory_order_relaxed); }
+
   inline auto allocator() { return boost::container::pmr::polymorphic_allocator<o2::byte>(this); }
 
 protected:
   virtual void* do_allocate(std::size_t , std::size_t) override
   {
-    unsigned long lAllocAttempt= 0;
     auto lRet = try_alloc();
     // we cannot fail! report problem if failing to allocate block often
     while (!lRet) {
       using namespace std::chrono_literals;
 
-      if (++lAllocAttempt % 1000 == 0) {
-        DDLOG(fair::Severity::ERROR) << "FMQUnsynchronizedPoolMemoryResource: failing to get free block of "
-                     << mObjectSize << " B, total region size: " << mRegion->GetSize() << " B";
-        DDLOG(fair::Severity::ERROR) << "Downstream components are creating back-pressure!";
+      // try to reclaim if possible. The pool grows only on sustained high occupancy (try_reclaim)
+      if (!try_reclaim()) {
+        // wait for the transport to release some of the objects
+        mAllocationWaits.fetch_add(1, std::memory_order_relaxed);
+
+        if (!wait_reclaim(1s)) {
+          // nothing released: downstream back-pressure, not a too small pool
+          mHighOccupancyCnt = 0;
+
+          DDLOG(fair::Severity::ERROR) << "FMQUnsynchronizedPoolMemoryResource: failing to get free block of "
+                       << mObjectSize << " B, total region size: " << (mRegions.size() * mRegionSize) << " B";
+          DDLOG(fair::Severity::ERROR) << "Downstream components are creating back-pressure!";
+        }
       }
 
-      std::this_thread::sleep_for(1ms);
-      // try to reclaim if possible
-      try_reclaim();
       // try again
       lRet = try_alloc();
     }
 
+    // update occupancy counters. NOTE: only the allocating thread updates the high-water mark
+    const auto lUsed = mObjectsUsed.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (lUsed > mObjectsUsedHighWater.load(std::memory_order_relaxed)) {
+      mObjectsUsedHighWater.store(lUsed, std::memory_order_relaxed);
+    }
+
     return lRet;
   }
 
@@ -130,6 +154,57 @@ protected:
 
 private:
 
+  void addRegion() {
+
+    auto lRegion = mChan.NewUnmanagedRegion(mRegionSize,
+      [this](void* pRelData, size_t pRelSize, void* /* hint */) {
+      // callback to be called when message buffers no longer needed by transport
+      reclaimSHMMessage(pRelData, pRelSize);
+    });
+
+    // prepare header pointers
+    unsigned char* lObj = static_cast<unsigned char*>(lRegion->GetData());
+    memset(lObj, 0xAA, lRegion->GetSize());
+
+    const std::size_t lObjectCnt = lRegion->GetSize() / mAlignedSize;
+
+    mAvailableObjects.reserve(mAvailableObjects.size() + lObjectCnt);
+    for (std::size_t i = 0; i < lObjectCnt; i++) {
+      mAvailableObjects.push_back(lObj + i * mAlignedSize);
+    }
+
+    mRegions.emplace_back(std::move(lRegion));
+    mObjectsTotal.fetch_add(lObjectCnt, std::memory_order_relaxed);
+  }
+
+  bool try_grow() {
+
+    if (!mAdaptive || mRegions.size() >= sMaxRegions || (mRegions.size() + 1) * mRegionSize > mMaxSize) {
+      return false;
+    }
+
+    addRegion();
+    mHighOccupancyCnt = 0;
+
+    DDLOGF(fair::Severity::INFO, "Header pool: added a new memory region. regions={} total_size={} max_size={} "
+      "total_objects={}", mRegions.size(), mRegions.size() * mRegionSize, mMaxSize, totalObjects());
+
+    return !mAvailableObjects.empty();
+  }
+
+  std::unique_ptr<FairMQUnmanagedRegion>& getRegion(const void *pPtr) {
+
+    for (auto &lRegion : mRegions) {
+      const auto lBegin = static_cast<const unsigned char*>(lRegion->GetData());
+      if (pPtr >= lBegin && pPtr < lBegin + lRegion->GetSize()) {
+        return lRegion;
+      }
+    }
+
+    assert(false && "Object not allocated from the header pool");
+    return mRegions.front();
+  }
+
   void* try_alloc() {
 
     if (!mAvailableObjects.empty()) {
@@ -144,36 +219,100 @@ private:
 
   bool try_reclaim() {
 
-    std::scoped_lock lock(mReclaimLock);
-
     assert(mAvailableObjects.empty());
 
-    mAvailableObjects = std::move(mReclaimedObjects);
-    mReclaimedObjects.clear();
+    // take the whole list of reclaimed objects at once (single consumer: no ABA problem)
+    ReclaimedObject* lObject = mReclaimedObjects.exchange(nullptr, std::memory_order_acquire);
+
+    while (lObject != nullptr) {
+      mAvailableObjects.push_back(lObject);
+      lObject = lObject->mNext;
+    }
+
+    // adaptive mode: grow the pool when most of the objects are still in use on consecutive reclaims
+    if (mAdaptive) {
+      if (mAvailableObjects.size() < (totalObjects() / 8)) {
+        const auto lNow = std::chrono::steady_clock::now();
+        if (mHighOccupancyCnt++ == 0) {
+          mHighOccupancySince = lNow;
+        }
+        if (mHighOccupancyCnt >= sHighOccupancyReclaims && (lNow - mHighOccupancySince) >= sHighOccupancyTime) {
+          try_grow();
+        }
+      } else {
+        mHighOccupancyCnt = 0;
+      }
+    }
 
     return !mAvailableObjects.empty();
   }
 
+  bool wait_reclaim(const std::chrono::milliseconds pTimeout) {
+
+    std::unique_lock lLock(mReclaimWaitLock);
+
+    mAllocatorWaiting.store(true, std::memory_order_seq_cst);
+    const bool lReclaimed = mReclaimWaitCond.wait_for(lLock, pTimeout, [this]() {
+      return mReclaimedObjects.load(std::memory_order_seq_cst) != nullptr;
+    });
+    mAllocatorWaiting.store(false, std::memory_order_relaxed);
+
+    return lReclaimed;
+  }
+
   void reclaimSHMMessage(void* pData, size_t pSize)
   {
     (void) pSize;
     assert (pSize == mObjectSize);
 
-    std::scoped_lock lock(mReclaimLock);
-    mReclaimedObjects.push_back(pData);
+    // account before the object becomes available again
+    mObjectsUsed.fetch_sub(1, std::memory_order_relaxed);
+
+    // free objects are linked through their own memory
+    ReclaimedObject* lObject = static_cast<ReclaimedObject*>(pData);
+    lObject->mNext = mReclaimedObjects.load(std::memory_order_relaxed);
+    while (!mReclaimedObjects.compare_exchange_weak(lObject->mNext, lObject,
+      std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    }
+
+    // wake up the allocating thread only if it's blocked on an empty pool
+    if (mAllocatorWaiting.load(std::memory_order_seq_cst)) {
+      { std::scoped_lock lLock(mReclaimWaitLock); }
+      mReclaimWaitCond.notify_one();
+    }
   }
 
   FairMQChannel& mChan;
 
-  std::unique_ptr<FairMQUnmanagedRegion> mRegion;
+  std::vector<std::unique_ptr<FairMQUnmanagedRegion>> mRegions;
+  std::size_t mRegionSize;
+  std::size_t mMaxSize;
+  bool mAdaptive;
+  std::size_t mHighOccupancyCnt = 0;
+  std::chrono::steady_clock::time_point mHighOccupancySince;
+
   std::size_t mObjectSize;
   std::size_t mAlignedSize;
 
   std::vector<void*> mAvailableObjects;
-  std::mutex mReclaimLock;
 
-  // two step reclaim to avoid lock contention in the allocation path
-  std::vector<void*> mReclaimedObjects;
+  // two step reclaim to avoid contention in the allocation path:
+  // lock-free list of objects released by the transport (multiple producers, single consumer)
+  struct ReclaimedObject {
+    ReclaimedObject* mNext;
+  };
+  std::atomic<ReclaimedObject*> mReclaimedObjects = nullptr;
+
+  // blocking of the allocating thread when the pool is exhausted
+  std::atomic_bool mAllocatorWaiting = false;
+  std::mutex mReclaimWaitLock;
+  std::condition_variable mReclaimWaitCond;
+
+  // occupancy counters
+  std::atomic<std::size_t> mObjectsTotal = 0;
+  std::atomic<std::size_t> mObjectsUsed = 0;
+  std::atomic<std::size_t> mObjectsUsedHighWater = 0;
+  std::atomic<std::uint64_t> mAllocationWaits = 0;
 };
 
 }
@@ -0,0 +1,50 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ALICEO2_PIPELINE_MEMORY_BUDGET_H_
+#define ALICEO2_PIPELINE_MEMORY_BUDGET_H_
+
+#include "ConcurrentQueue.h"
+
+#include <boost/program_options/options_description.hpp>
+
+#include <options/FairMQProgOptions.h>
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+namespace bpo = boost::program_options;
+
+////////////////////////////////////////////////////////////////////////////////
+/// PipelineMemoryBudgetConfig: options of the IFifoPipeline memory budget
+////////////////////////////////////////////////////////////////////////////////
+
+class PipelineMemoryBudgetConfig
+{
+ public:
+  static constexpr const char* OptionKeyHighWatermark = "pipeline-memory-high-watermark";
+  static constexpr const char* OptionKeyLowWatermark = "pipeline-memory-low-watermark";
+  static constexpr const char* OptionKeyDropPolicy = "pipeline-memory-drop-policy";
+
+  static bpo::options_description getProgramOptions();
+
+  /// Fills the budget from the options. Returns false on invalid configuration.
+  static bool loadVerifyConfig(const FairMQProgOptions& pFMQProgOpt, PipelineMemoryBudget &pBudget /*out*/);
+};
+
+}
+} /* namespace o2::DataDistribution */
+
+#endif /* ALICEO2_PIPELINE_MEMORY_BUDGET_H_ */
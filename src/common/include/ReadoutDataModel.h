@@ -18,7 +18,9 @@
 
 #include <istream>
 #include <cstdint>
+#include <cstring>
 #include <tuple>
+#include <vector>
 
 namespace o2
 {
@@ -40,10 +42,142 @@ struct ReadoutSubTimeframeHeader {
   std::uint8_t mLinkId;       // common link id of all data in this HBframe
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// RDH field layouts
+////////////////////////////////////////////////////////////////////////////////
+
+/// Location of an RDH field: 32 bit word at a byte offset, shifted and masked
+struct RdhFieldDesc {
+  std::size_t mOffset;
+  std::uint32_t mShift;
+  std::uint32_t mMask;
+
+  std::uint32_t get(const char* pRdh) const
+  {
+    std::uint32_t lWord;
+    std::memcpy(&lWord, pRdh + mOffset, sizeof(std::uint32_t));
+    return (lWord >> mShift) & mMask;
+  }
+};
+
+/// Field layout per RDH version. Supporting a new version requires a new layout and a case in
+/// ReadoutDataUtils::withRdhLayout().
+struct RdhLayoutV4 {
+  static constexpr std::uint8_t sVersion = 4;
+  static constexpr RdhFieldDesc sFeeId      { 4,  0, 0x0000FFFF };
+  static constexpr RdhFieldDesc sOffsetNext { 8,  0, 0x0000FFFF };
+  static constexpr RdhFieldDesc sMemorySize { 8, 16, 0x0000FFFF };
+  static constexpr RdhFieldDesc sLinkId     { 12, 0, 0x000000FF };
+  static constexpr RdhFieldDesc sCruId      { 12, 16, 0x00000FFF };
+  static constexpr RdhFieldDesc sEndPoint   { 12, 28, 0x0000000F };
+  static constexpr RdhFieldDesc sOrbit      { 20, 0, 0xFFFFFFFF }; // heartbeat orbit
+  static constexpr RdhFieldDesc sStopBit    { 52, 0, 0x000000FF };
+};
+
+struct RdhLayoutV5 {
+  static constexpr std::uint8_t sVersion = 5;
+  static constexpr RdhFieldDesc sFeeId      { 0, 16, 0x0000FFFF };
+  static constexpr RdhFieldDesc sOffsetNext { 8,  0, 0x0000FFFF };
+  static constexpr RdhFieldDesc sMemorySize { 8, 16, 0x0000FFFF };
+  static constexpr RdhFieldDesc sLinkId     { 12, 0, 0x000000FF };
+  static constexpr RdhFieldDesc sCruId      { 12, 16, 0x00000FFF };
+  static constexpr RdhFieldDesc sEndPoint   { 12, 28, 0x0000000F };
+  static constexpr RdhFieldDesc sOrbit      { 20, 0, 0xFFFFFFFF };
+  static constexpr RdhFieldDesc sStopBit    { 36, 16, 0x000000FF };
+};
+
+/// v6 keeps the v5 positions of all fields used here
+struct RdhLayoutV6 : RdhLayoutV5 {
+  static constexpr std::uint8_t sVersion = 6;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// RDH block scanning
+////////////////////////////////////////////////////////////////////////////////
+
+/// Fields of one RDH packet, extracted in a single pass over a readout block (HBF)
+struct RdhPacketDescriptor {
+  std::uint32_t mOffset;      // offset of the RDH in the block
+  std::uint32_t mOffsetNext;
+  std::uint32_t mMemorySize;
+  std::uint32_t mOrbit;
+  o2::header::DataHeader::SubSpecificationType mSubSpec;
+  std::uint16_t mFeeId;
+  std::uint8_t mLinkId;
+  std::uint8_t mStopBit;
+};
+
+struct RdhBlockScan {
+  enum ScanStatus {
+    eScanOk,
+    eScanShortBlock,      // block shorter than one RDH
+    eScanShortRdh,        // RDH truncated at the end of the block
+    eScanUnknownVersion,
+    eScanVersionMismatch, // RDHs of different versions in one block
+    eScanZeroOffset,
+    eScanNoStopBit        // end of the block reached without the stop bit
+  };
+
+  std::size_t mBlockSize = 0;
+  std::uint8_t mVersion = 0;
+  ScanStatus mStatus = eScanOk;
+  std::uint32_t mErrorOffset = 0;
+
+  /// Packets up to the stop bit, or up to the first error
+  std::vector<RdhPacketDescriptor> mPackets;
+
+  void clear()
+  {
+    mBlockSize = 0;
+    mVersion = 0;
+    mStatus = eScanOk;
+    mErrorOffset = 0;
+    mPackets.clear();
+  }
+
+  bool ok() const { return mStatus == eScanOk; }
+
+  /// Sum of packet memory sizes
+  std::size_t memorySize() const;
+};
+
 class ReadoutDataUtils {
 public:
 
-  static std::uint64_t sFirstSeenHBOrbitCnt;
+  static constexpr std::size_t sRdhSize = 64;
+
+  /// Calls pFunc with the field layout of the RDH version (e.g. RdhLayoutV4{}).
+  /// Returns false if the version is not supported.
+  template <class F>
+  static bool withRdhLayout(const std::uint8_t pVersion, F&& pFunc)
+  {
+    switch (pVersion) {
+      case RdhLayoutV4::sVersion:
+        pFunc(RdhLayoutV4{});
+        return true;
+      case RdhLayoutV5::sVersion:
+        pFunc(RdhLayoutV5{});
+        return true;
+      case RdhLayoutV6::sVersion:
+        pFunc(RdhLayoutV6{});
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  template <class Layout>
+  static o2::header::DataHeader::SubSpecificationType getSubSpecification(const char* pRdh)
+  {
+    const std::uint32_t lCruId = Layout::sCruId.get(pRdh);
+    const std::uint32_t lEndPoint = Layout::sEndPoint.get(pRdh);
+    const std::uint32_t lLinkId = Layout::sLinkId.get(pRdh);
+
+    /* add 1 to linkID because they start with 0 */
+    return (lCruId << 16) | ((lLinkId + 1) << (lEndPoint == 0 ? 0 : 8));
+  }
+
+  static thread_local std::uint64_t sFirstSeenHBOrbitCnt;
 
   static std::tuple<std::uint32_t,std::uint32_t,std::uint32_t>
   getSubSpecificationComponents(const char* pRdhData, const std::size_t len);
@@ -62,8 +196,13 @@ public:
     eSanityCheckPrint
   };
 
+  /// Extract fields of all RDHs in the block. The RDH version is checked once per block.
+  static bool scanRdhBlock(const char* pData, const std::size_t pLen, RdhBlockScan &pScan /*out*/);
+
   static bool rdhSanityCheck(const char* data, const std::size_t len);
+  static bool rdhSanityCheck(const char* pData, const RdhBlockScan &pScan);
   static bool filterTriggerEmpyBlocksV4(const char* pData, const std::size_t pLen);
+  static bool filterTriggerEmpyBlocksV4(const RdhBlockScan &pScan);
 
 public:
   static SanityCheckMode sRdhSanityCheckMode;
@@ -28,6 +28,16 @@ namespace o2
 namespace DataDistribution
 {
 
+////////////////////////////////////////////////////////////////////////////////
+/// Header memory region configuration
+////////////////////////////////////////////////////////////////////////////////
+
+struct HeaderRegionConfig {
+  std::size_t mSize;        // size of the (initial) header memory region
+  bool mAdaptive = false;   // add regions when the occupancy of the header pool stays high
+  std::size_t mMaxSize = 0; // adaptive: total size limit (0: a multiple of mSize)
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrameReadoutBuilder
 ////////////////////////////////////////////////////////////////////////////////
@@ -35,8 +45,11 @@ namespace DataDistribution
 class SubTimeFrameReadoutBuilder
 {
  public:
+  static constexpr std::size_t sDefaultHeaderRegionSize = 64ULL << 20;
+
   SubTimeFrameReadoutBuilder() = delete;
-  SubTimeFrameReadoutBuilder(FairMQChannel& pChan, bool pDplEnabled);
+  SubTimeFrameReadoutBuilder(FairMQChannel& pChan, bool pDplEnabled,
+    const HeaderRegionConfig& pHdrRegionCfg = { sDefaultHeaderRegionSize });
 
   void addHbFrames(const o2::header::DataOrigin &pDataOrig,
     const o2::header::DataHeader::SubSpecificationType pSubSpecification,
@@ -45,12 +58,20 @@ class SubTimeFrameReadoutBuilder
   std::unique_ptr<SubTimeFrame> getStf();
 
   void setRdh4FilterTrigger(bool pVal) { mRdh4FilterTrigger = pVal; }
+  void setSuperpagePacking(bool pVal) { mSuperpagePacking = pVal; }
 
  private:
 
+  /// Send all HBFrames of an update under one header with an HBFrame index (no data copy)
+  void addPackedHbFrames(const EquipmentIdentifier &pEqId,
+    const std::vector<bool> &pKeepBlocks,
+    std::vector<FairMQMessagePtr>::iterator pHbFramesBegin, const std::size_t pHBFrameLen);
+
   std::unique_ptr<SubTimeFrame> mStf;
 
+  FairMQChannel& mChan;
   bool mDplEnabled;
+  bool mSuperpagePacking = false;
 
   std::unique_ptr<FMQUnsynchronizedPoolMemoryResource> mHeaderMemRes;
 
@@ -58,6 +79,9 @@ class SubTimeFrameReadoutBuilder
 
   // bool mRdhSanityCheck = false;
   bool mRdh4FilterTrigger = false;
+
+  /// RDH scans of blocks in the current update (reused to avoid allocations)
+  std::vector<RdhBlockScan> mRdhBlockScans;
 };
 
 
@@ -68,13 +92,17 @@ class SubTimeFrameReadoutBuilder
 class SubTimeFrameFileBuilder
 {
  public:
+  static constexpr std::size_t sDefaultHeaderRegionSize = 32ULL << 20;
+
   SubTimeFrameFileBuilder() = delete;
-  SubTimeFrameFileBuilder(FairMQChannel& pChan, bool pDplEnabled);
+  SubTimeFrameFileBuilder(FairMQChannel& pChan, bool pDplEnabled,
+    const HeaderRegionConfig& pHdrRegionCfg = { sDefaultHeaderRegionSize });
 
   void adaptHeaders(SubTimeFrame *pStf);
 
  private:
 
+  FairMQChannel& mChan;
   bool mDplEnabled;
 
   std::unique_ptr<FMQUnsynchronizedPoolMemoryResource> mHeaderMemRes;
@@ -87,13 +115,17 @@ class SubTimeFrameFileBuilder
 class TimeFrameBuilder
 {
  public:
+  static constexpr std::size_t sDefaultHeaderRegionSize = 64ULL << 20;
+
   TimeFrameBuilder() = delete;
-  TimeFrameBuilder(FairMQChannel& pChan, bool pDplEnabled);
+  TimeFrameBuilder(FairMQChannel& pChan, bool pDplEnabled,
+    const HeaderRegionConfig& pHdrRegionCfg = { sDefaultHeaderRegionSize });
 
   void adaptHeaders(SubTimeFrame *pStf);
 
  private:
 
+  FairMQChannel& mChan;
   bool mDplEnabled;
 
   std::unique_ptr<FMQUnsynchronizedPoolMemoryResource> mHeaderMemRes;
@@ -199,6 +199,41 @@ struct HBFrameHeader : public o2hdr::BaseHeader {
   }
 };
 
+/// Index of HBFrames packed under one header (readout update granularity)
+/// The header is followed by mNumHbFrames HBFrameIndexEntry records (variable size header).
+/// Each HBFrame stays in its own (readout) data message; entry i describes data part i.
+struct HBFrameIndexEntry {
+  uint32_t mOffset; // in the concatenated payload (DataHeader::payloadSize covers all parts)
+  uint32_t mSize;
+  uint32_t mOrbit;
+  uint32_t mReserved;
+};
+
+struct HBFrameIndexHeader : public o2hdr::BaseHeader {
+
+  // Required to do the lookup
+  static const o2hdr::HeaderType sHeaderType;
+  static const uint32_t sVersion = 1;
+
+  uint32_t mNumHbFrames;
+  uint32_t mReserved;
+
+  HBFrameIndexHeader(uint32_t pNumHbFrames)
+    : BaseHeader(getSize(pNumHbFrames), sHeaderType, o2hdr::gSerializationMethodNone, sVersion),
+      mNumHbFrames(pNumHbFrames),
+      mReserved(0)
+  {
+  }
+
+  static std::size_t getSize(const std::size_t pNumHbFrames)
+  {
+    return sizeof(HBFrameIndexHeader) + pNumHbFrames * sizeof(HBFrameIndexEntry);
+  }
+
+  HBFrameIndexEntry* entries() { return reinterpret_cast<HBFrameIndexEntry*>(this + 1); }
+  const HBFrameIndexEntry* entries() const { return reinterpret_cast<const HBFrameIndexEntry*>(this + 1); }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Visitor friends
 ////////////////////////////////////////////////////////////////////////////////
@@ -211,7 +246,8 @@ struct HBFrameHeader : public o2hdr::BaseHeader {
   friend class DataIdentifierSplitter;         \
   friend class SubTimeFrameFileWriter;         \
   friend class SubTimeFrameFileReader;         \
-  friend class StfDplAdapter;
+  friend class StfDplAdapter;                  \
+  friend class SubTimeFrameTestVisitor; /* unit tests */
 
 ////////////////////////////////////////////////////////////////////////////////
 /// SubTimeFrame
@@ -228,6 +264,29 @@ class SubTimeFrame : public IDataModelObject
 
     std::unique_ptr<FairMQMessage> mHeader;
     std::unique_ptr<FairMQMessage> mData;
+    /// Packed HBFrames: data messages following mData (one per HBFrame index entry after the first)
+    std::vector<std::unique_ptr<FairMQMessage>> mDataParts;
+
+    StfData() = default;
+    StfData(std::unique_ptr<FairMQMessage> pHeader, std::unique_ptr<FairMQMessage> pData)
+      : mHeader(std::move(pHeader)), mData(std::move(pData)) { }
+
+    inline std::size_t getNumDataParts() const { return 1 + mDataParts.size(); }
+
+    inline FairMQMessage& getDataPart(const std::size_t pIdx) const
+    {
+      return pIdx == 0 ? *mData : *mDataParts[pIdx - 1];
+    }
+
+    /// Payload size of all data parts
+    inline std::uint64_t getDataSize() const
+    {
+      std::uint64_t lSize = mData->GetSize();
+      for (const auto &lPart : mDataParts) {
+        lSize += lPart->GetSize();
+      }
+      return lSize;
+    }
 
     inline o2hdr::DataHeader getDataHeader() const
     {
@@ -257,6 +316,25 @@ class SubTimeFrame : public IDataModelObject
       lDataHdr.splitPayloadParts = pTotal;
       std::memcpy(mHeader->GetData(), &lDataHdr, sizeof(o2hdr::DataHeader));
     }
+
+    /// HBFrame index of packed data, or nullptr if the data message holds a single HBFrame (block)
+    inline const HBFrameIndexHeader* getHbFrameIndex() const
+    {
+      if (mHeader->GetSize() <= sizeof(o2hdr::DataHeader)) {
+        return nullptr; // fast path: only the DataHeader
+      }
+      return o2hdr::get<HBFrameIndexHeader*>(mHeader->GetData(), mHeader->GetSize());
+    }
+
+    /// Visit HBFrames of the data message(s): pFunc(const char* pData, std::size_t pSize)
+    template <class F>
+    inline void forEachHbFrame(F&& pFunc) const
+    {
+      for (std::size_t i = 0; i < getNumDataParts(); i++) {
+        const auto &lPart = getDataPart(i);
+        pFunc(static_cast<const char*>(lPart.GetData()), std::size_t(lPart.GetSize()));
+      }
+    }
   };
 
  public:
@@ -283,22 +361,34 @@ class SubTimeFrame : public IDataModelObject
 
   const Header& header() const { return mHeader; }
 
-  void updateStf() { updateStf(mData); }
+  // NOTE: method declared const to work with const visitors, manipulated fields are mutable
+  void updateStf() const;
 
  protected:
-  void accept(ISubTimeFrameVisitor& v) override { updateStf(mData); v.visit(*this); }
-  void accept(ISubTimeFrameConstVisitor& v) const override { updateStf(mData); v.visit(*this); }
+  void accept(ISubTimeFrameVisitor& v) override { updateStf(); v.visit(*this); }
+  void accept(ISubTimeFrameConstVisitor& v) const override { updateStf(); v.visit(*this); }
 
  private:
   using StfDataVector = std::vector<StfData>;
-  using StfSubSpecMap = std::unordered_map<o2hdr::DataHeader::SubSpecificationType, StfDataVector>;
-  using StfDataIdentMap = std::unordered_map<o2hdr::DataIdentifier, StfSubSpecMap>;
+
+  // Contiguous range of data blocks belonging to a single equipment
+  struct StfEquipmentRange {
+    EquipmentIdentifier mEquipment;
+    StfDataVector::size_type mBegin;
+    StfDataVector::size_type mCount;
+
+    inline StfDataVector::size_type end() const { return mBegin + mCount; }
+  };
+  using StfEquipmentIndex = std::vector<StfEquipmentRange>;
 
   ///
   /// Fields
   ///
   Header mHeader;
-  mutable StfDataIdentMap mData;
+  // All data blocks of the Stf. Grouped by equipment after updateStf()
+  mutable StfDataVector mData;
+  // Equipment ranges in mData. Sorted by EquipmentIdentifier, without repetition, after updateStf()
+  mutable StfEquipmentIndex mIndex;
 
   ///
   /// internal
@@ -308,60 +398,27 @@ class SubTimeFrame : public IDataModelObject
   ///
   /// helper methods
   ///
-  inline void addStfData(const o2hdr::DataHeader& pDataHeader, StfData&& pStfData)
+  inline void addStfData(const EquipmentIdentifier& pEquipment, StfData&& pStfData)
   {
-    const o2hdr::DataIdentifier lDataId = impl::getDataIdentifier(pDataHeader);
-
-    auto& lDataVector = mData[lDataId][pDataHeader.subSpecification];
+    // extend the last range if blocks of the same equipment are added back-to-back (common case)
+    if (mIndex.empty() || mIndex.back().mEquipment != pEquipment) {
+      mIndex.push_back(StfEquipmentRange{ pEquipment, mData.size(), 0 });
+    }
 
-    lDataVector.emplace_back(std::move(pStfData));
+    mData.emplace_back(std::move(pStfData));
+    mIndex.back().mCount++;
     mUpdated = false;
   }
 
-  inline void addStfData(StfData&& pStfData)
+  inline void addStfData(const o2hdr::DataHeader& pDataHeader, StfData&& pStfData)
   {
-    const o2hdr::DataHeader lDataHeader = pStfData.getDataHeader();
-    addStfData(lDataHeader, std::move(pStfData));
+    addStfData(EquipmentIdentifier(pDataHeader), std::move(pStfData));
   }
 
-  // NOTE: method declared const to work with const visitors, manipulated fields are mutable
-  inline void updateStf(StfDataIdentMap &pData) const
+  inline void addStfData(StfData&& pStfData)
   {
-    if (mUpdated) {
-      return;
-    }
-
-    // Update data block indexes
-    for (auto &lIdentSubSpecVect : pData) {
-      StfSubSpecMap &lSubSpecMap = lIdentSubSpecVect.second;
-
-      for (auto &lSubSpecDataVector : lSubSpecMap) {
-        StfDataVector &lDataVector = lSubSpecDataVector.second;
-
-        const auto lTotalCount = lDataVector.size();
-        for (StfDataVector::size_type i = 0; i < lTotalCount; i++) {
-          lDataVector[i].setPayloadIndex(i, lTotalCount);
-        }
-
-        assert(lDataVector.empty() ? true :
-          lDataVector.front().getDataHeader().splitPayloadIndex == 0
-        );
-        assert(lDataVector.empty() ? true :
-          lDataVector.back().getDataHeader().splitPayloadIndex == (lTotalCount - 1)
-        );
-        assert(lDataVector.empty() ? true :
-          lDataVector.front().getDataHeader().splitPayloadParts == lTotalCount
-        );
-        assert(lDataVector.empty() ? true :
-          lDataVector.front().getDataHeader().splitPayloadParts ==
-          lDataVector.back().getDataHeader().splitPayloadParts
-        );
-
-      }
-
-    }
-
-    mUpdated = true;
+    const o2hdr::DataHeader lDataHeader = pStfData.getDataHeader();
+    addStfData(lDataHeader, std::move(pStfData));
   }
 
 };
@@ -71,7 +71,8 @@ class SubTimeFrameFileSource
 
   bool enabled() const { return mEnabled; }
 
-  void start(FairMQChannel& pDstChan, const bool pDplEnabled);
+  void start(FairMQChannel& pDstChan, const bool pDplEnabled,
+    const HeaderRegionConfig& pHdrRegionCfg = { SubTimeFrameFileBuilder::sDefaultHeaderRegionSize });
   void stop();
 
   void DataHandlerThread();
@@ -94,6 +95,7 @@ class SubTimeFrameFileSource
 
   /// Thread for file writing
   std::atomic_bool mRunning = false;
+  static constexpr std::size_t sReadAheadStfs = 4;
   ConcurrentFifo<std::unique_ptr<SubTimeFrame>> mReadStfQueue;
   std::thread mSourceThread;
   std::thread mInjectThread;
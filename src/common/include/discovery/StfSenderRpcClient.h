@@ -64,6 +64,32 @@ public:
     return mStub->StfDataRequest(&lContext, pParam, &pRet);
   }
 
+  // rpc StfDataDropRequest(StfDataDropMessage) returns (StfDataDropResponse) { }
+  grpc::Status StfDataDropRequest(const StfDataDropMessage &pParam, StfDataDropResponse &pRet /*out*/,
+                                  const std::chrono::milliseconds pTimeout) {
+    ClientContext lContext;
+    lContext.set_deadline(std::chrono::system_clock::now() + pTimeout);
+    return mStub->StfDataDropRequest(&lContext, pParam, &pRet);
+  }
+
+  // rpc TfBuilderSlotTableUpdate(TfBuilderSlotTable) returns (StatusResponse) { }
+  grpc::Status TfBuilderSlotTableUpdate(const TfBuilderSlotTable &pParam, StatusResponse &pRet /*out*/) {
+    ClientContext lContext;
+    return mStub->TfBuilderSlotTableUpdate(&lContext, pParam, &pRet);
+  }
+
+  // rpc StfDataCreditUpdate(StfDataCredit) returns (StatusResponse) { }
+  grpc::Status StfDataCreditUpdate(const StfDataCredit &pParam, StatusResponse &pRet /*out*/) {
+    ClientContext lContext;
+    return mStub->StfDataCreditUpdate(&lContext, pParam, &pRet);
+  }
+
+  // Asynchronous StfDataRequest: completion is delivered to pCq after calling Finish() on the reader
+  std::unique_ptr<grpc::ClientAsyncResponseReader<StfDataResponse>>
+  AsyncStfDataRequest(ClientContext &pContext, const StfDataRequestMessage &pParam, grpc::CompletionQueue &pCq) {
+    return mStub->AsyncStfDataRequest(&pContext, pParam, &pCq);
+  }
+
 private:
   std::unique_ptr<StfSenderRpc::Stub> mStub;
 };
@@ -126,7 +152,7 @@ public:
       // create the RPC client
       mClients.try_emplace(
         lStfSenderId,
-        std::make_unique<StfSenderRpcClient>(lStfSenderStatus.rpc_endpoint())
+        std::make_shared<StfSenderRpcClient>(lStfSenderStatus.rpc_endpoint())
       );
     }
 
@@ -174,7 +200,8 @@ private:
 
   std::shared_ptr<T> mDiscoveryConfig;
 
-  std::map<std::string, std::unique_ptr<StfSenderRpcClient>> mClients;
+  /// shared: clients can be used outside of the owner's lock
+  std::map<std::string, std::shared_ptr<StfSenderRpcClient>> mClients;
 };
 
 }
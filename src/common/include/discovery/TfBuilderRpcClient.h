@@ -98,6 +98,12 @@ public:
     return false;
   }
 
+  // Asynchronous BuildTfRequest: completion is delivered to pCq after calling Finish() on the reader
+  std::unique_ptr<grpc::ClientAsyncResponseReader<BuildTfResponse>>
+  AsyncBuildTfRequest(ClientContext &pContext, const TfBuildingInformation &pTfInfo, grpc::CompletionQueue &pCq) {
+    return mStub->AsyncBuildTfRequest(&pContext, pTfInfo, &pCq);
+  }
+
 
   std::string getEndpoint() { return mTfBuilderConf.rpc_endpoint(); }
 
@@ -217,6 +217,40 @@ public:
     return false;
   }
 
+  // rpc StfSenderStfDropped(StfSenderStfDropInfo) returns (google.protobuf.Empty) { }
+  bool StfSenderStfDropped(StfSenderStfDropInfo &pMsg) {
+    if (!mStub) {
+      DDLOG(fair::Severity::ERROR) << "StfSenderStfDropped: no gRPC connection to scheduler";
+      return false;
+    }
+
+    ClientContext lContext;
+    ::google::protobuf::Empty lRet;
+
+    // update timestamp
+    updateTimeInformation(*pMsg.mutable_info());
+
+    auto lStatus = mStub->StfSenderStfDropped(&lContext, pMsg, &lRet);
+    if (lStatus.ok()) {
+      return true;
+    }
+
+    DDLOG(fair::Severity::ERROR) << "gRPC: StfSenderStfDropped: error code: " << lStatus.error_code() << " message: " << lStatus.error_message();
+    return false;
+  }
+
+  // rpc StfSenderStfUpdateStream(stream StfSenderStfInfoBatch) returns (stream SchedulerStfInfoResponseBatch) { }
+  using StfUpdateStream = grpc::ClientReaderWriter<StfSenderStfInfoBatch, SchedulerStfInfoResponseBatch>;
+
+  std::unique_ptr<StfUpdateStream> StfSenderStfUpdateStream(ClientContext &pContext) {
+    if (!mStub) {
+      DDLOG(fair::Severity::ERROR) << "StfSenderStfUpdateStream: no gRPC connection to scheduler";
+      return nullptr;
+    }
+
+    return mStub->StfSenderStfUpdateStream(&pContext);
+  }
+
 
   std::string getEndpoint() { return mTfSchedulerConf.rpc_endpoint(); }
 
@@ -0,0 +1,157 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Benchmark of the StfBuilder input queues
+///
+/// One producer thread sends readout updates (vectors of messages) to one consumer thread,
+/// as the StfBuilder input thread does for each builder thread. Compares the mutex-based
+/// ConcurrentFifo to the lock-free ConcurrentSpscRing with batched pop.
+
+#include <ConcurrentQueue.h>
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+namespace
+{
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+// stand-in for std::vector<FairMQMessagePtr>
+using ReadoutUpdate = std::vector<std::unique_ptr<std::uint64_t>>;
+
+struct BenchmarkConfig {
+  std::uint64_t mNumUpdates = 2000000;
+  unsigned mMsgsPerUpdate = 8;
+  std::size_t mCapacity = 2048;
+  unsigned long mBatch = 64;
+};
+
+ReadoutUpdate makeUpdate(const BenchmarkConfig &pCfg, const std::uint64_t pId)
+{
+  ReadoutUpdate lUpdate;
+  lUpdate.reserve(pCfg.mMsgsPerUpdate);
+  for (unsigned i = 0; i < pCfg.mMsgsPerUpdate; i++) {
+    lUpdate.emplace_back(std::make_unique<std::uint64_t>(pId));
+  }
+  return lUpdate;
+}
+
+template <class Producer, class Consumer>
+void runBenchmark(const BenchmarkConfig &pCfg, const std::string &pName, Producer &&pProducer, Consumer &&pConsumer)
+{
+  const auto lStart = std::chrono::steady_clock::now();
+
+  std::uint64_t lChecksum = 0;
+  std::thread lConsumerThread([&]() { lChecksum = pConsumer(); });
+
+  for (std::uint64_t i = 0; i < pCfg.mNumUpdates; i++) {
+    pProducer(makeUpdate(pCfg, i));
+  }
+
+  lConsumerThread.join();
+
+  const auto lDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+  const bool lValid = (lChecksum == pCfg.mNumUpdates * (pCfg.mNumUpdates - 1) / 2);
+
+  std::cout << std::setw(36) << pName
+            << std::setw(14) << std::fixed << std::setprecision(3) << (pCfg.mNumUpdates / lDuration / 1e6)
+            << std::setw(14) << std::setprecision(1) << (lDuration / pCfg.mNumUpdates * 1e9)
+            << std::setw(8) << (lValid ? "ok" : "ERROR") << std::endl;
+}
+
+} /* anonymous namespace */
+
+int main(int argc, char* argv[])
+{
+  BenchmarkConfig lCfg;
+  if (argc > 1) {
+    lCfg.mNumUpdates = std::max(1L, std::atol(argv[1]));
+  }
+  if (argc > 2) {
+    lCfg.mMsgsPerUpdate = std::max(1, std::atoi(argv[2]));
+  }
+
+  std::cout << "Readout updates: " << lCfg.mNumUpdates << ", messages per update: " << lCfg.mMsgsPerUpdate
+            << ", queue capacity: " << lCfg.mCapacity << ", batch: " << lCfg.mBatch << std::endl;
+  std::cout << std::setw(36) << "queue" << std::setw(14) << "Mupdates/s" << std::setw(14) << "ns/update"
+            << std::setw(8) << "check" << std::endl;
+
+  // sum of ids of received updates
+  const auto lConsume = [&lCfg](ReadoutUpdate &pUpdate, std::uint64_t &pReceived) {
+    pReceived++;
+    return *pUpdate.front();
+  };
+
+  {
+    ConcurrentFifo<ReadoutUpdate> lFifo;
+    runBenchmark(lCfg, "ConcurrentFifo pop_wait_for",
+      [&](ReadoutUpdate &&pUpdate) { lFifo.push(std::move(pUpdate)); },
+      [&]() {
+        std::uint64_t lReceived = 0, lSum = 0;
+        ReadoutUpdate lUpdate;
+        while (lReceived < lCfg.mNumUpdates) {
+          if (lFifo.pop_wait_for(lUpdate, 2s)) {
+            lSum += lConsume(lUpdate, lReceived);
+          }
+        }
+        return lSum;
+      });
+  }
+
+  {
+    ConcurrentFifo<ReadoutUpdate> lFifo;
+    lFifo.set_capacity(lCfg.mCapacity);
+    runBenchmark(lCfg, "ConcurrentFifo (bounded) pop_n",
+      [&](ReadoutUpdate &&pUpdate) { lFifo.push(std::move(pUpdate)); },
+      [&]() {
+        std::uint64_t lReceived = 0, lSum = 0;
+        std::vector<ReadoutUpdate> lUpdates;
+        while (lReceived < lCfg.mNumUpdates) {
+          lUpdates.clear();
+          lFifo.pop_n(lCfg.mBatch, std::back_inserter(lUpdates));
+          for (auto &lUpdate : lUpdates) {
+            lSum += lConsume(lUpdate, lReceived);
+          }
+        }
+        return lSum;
+      });
+  }
+
+  {
+    ConcurrentSpscRing<ReadoutUpdate> lRing(lCfg.mCapacity);
+    runBenchmark(lCfg, "ConcurrentSpscRing pop_n_wait_for",
+      [&](ReadoutUpdate &&pUpdate) { while (!lRing.push_wait_for(100ms, std::move(pUpdate))) { } },
+      [&]() {
+        std::uint64_t lReceived = 0, lSum = 0;
+        std::vector<ReadoutUpdate> lUpdates;
+        while (lReceived < lCfg.mNumUpdates) {
+          lUpdates.clear();
+          lRing.pop_n_wait_for(lCfg.mBatch, std::back_inserter(lUpdates), 2s);
+          for (auto &lUpdate : lUpdates) {
+            lSum += lConsume(lUpdate, lReceived);
+          }
+        }
+        return lSum;
+      });
+  }
+
+  return 0;
+}
@@ -0,0 +1,196 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Benchmark of STF transfer pacing (TfBuilder max-concurrent-stf-senders)
+///
+/// Fluid model of a single EPN switch port: StfSenders send into a shallow port buffer drained
+/// at the EPN link rate. Sender rates follow AIMD: on buffer overflow the senders lose data and
+/// halve their rate, or stall for a retransmission timeout. Reports the TF transfer time
+/// distribution for different numbers of concurrently sending StfSenders.
+/// NOTE: this is a model only. benchmark_StfTransferSlots drives the real slot acquire/release code.
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+namespace
+{
+
+struct BenchmarkConfig {
+  unsigned mNumStfSenders = 64;
+  unsigned mNumTfs = 1000;
+  double mStfSize = 2.0e6;          // bytes
+  double mStfSizeJitter = 0.3;      // relative
+  double mSenderRate = 12.5e9;      // bytes/s (100 Gb/s)
+  double mEpnRate = 12.5e9;         // bytes/s (100 Gb/s)
+  double mPortBuffer = 4.0e6;       // bytes
+  double mRto = 2.0e-3;             // s
+  double mRtoProbability = 0.2;     // loss causes a timeout instead of a fast retransmit
+  double mInitialRate = 9.0e9;      // bytes/s (10 x 9 kB per 10 us RTT)
+  double mRateIncrease = 9.0e13;    // bytes/s^2 (one 9 kB segment per 10 us RTT)
+  double mTimeStep = 1.0e-6;        // s
+};
+
+struct Sender {
+  double mRemaining = 0.0;
+  double mRate = 0.0;
+  double mStalledUntil = 0.0;
+  bool mStarted = false;
+};
+
+/// Time to transfer one TF with at most pWindow StfSenders sending concurrently (0: unlimited)
+double transferTf(const BenchmarkConfig &pCfg, const unsigned pWindow, std::vector<Sender> &pSenders,
+                  std::mt19937_64 &pRnd)
+{
+  std::bernoulli_distribution lRto(pCfg.mRtoProbability);
+
+  const unsigned lWindow = (pWindow == 0) ? pCfg.mNumStfSenders : pWindow;
+
+  double lTime = 0.0;
+  double lQueue = 0.0;
+  unsigned lNextSender = 0;
+  unsigned lActive = 0;
+  unsigned lDone = 0;
+
+  std::vector<unsigned> lSending;
+  std::vector<double> lSent;
+
+  while (lDone < pCfg.mNumStfSenders) {
+    // start new senders when slots are free
+    while (lActive < lWindow && lNextSender < pCfg.mNumStfSenders) {
+      auto &lSender = pSenders[lNextSender++];
+      lSender.mStarted = true;
+      lSender.mRate = pCfg.mInitialRate;
+      lActive++;
+    }
+
+    // senders transmitting in this step
+    lSending.clear();
+    for (unsigned i = 0; i < lNextSender; i++) {
+      const auto &lSender = pSenders[i];
+      if (lSender.mStarted && lSender.mRemaining > 0.0 && lSender.mStalledUntil <= lTime) {
+        lSending.push_back(i);
+      }
+    }
+
+    double lArrived = 0.0;
+    lSent.resize(pSenders.size());
+    for (const auto lIdx : lSending) {
+      lSent[lIdx] = std::min(pSenders[lIdx].mRemaining, pSenders[lIdx].mRate * pCfg.mTimeStep);
+      pSenders[lIdx].mRemaining -= lSent[lIdx];
+      lArrived += lSent[lIdx];
+    }
+
+    lQueue += lArrived;
+
+    if (lQueue > pCfg.mPortBuffer && lArrived > 0.0) {
+      // overflow: the lost data is retransmitted
+      const double lLost = lQueue - pCfg.mPortBuffer;
+      lQueue = pCfg.mPortBuffer;
+      for (const auto lIdx : lSending) {
+        auto &lSender = pSenders[lIdx];
+        lSender.mRemaining += lLost * lSent[lIdx] / lArrived;
+        if (lRto(pRnd)) {
+          lSender.mStalledUntil = lTime + pCfg.mRto;
+          lSender.mRate = pCfg.mInitialRate;
+        } else {
+          lSender.mRate /= 2.0;
+        }
+      }
+    } else {
+      for (const auto lIdx : lSending) {
+        auto &lSender = pSenders[lIdx];
+        lSender.mRate = std::min(pCfg.mSenderRate, lSender.mRate + pCfg.mRateIncrease * pCfg.mTimeStep);
+      }
+    }
+
+    lQueue = std::max(0.0, lQueue - pCfg.mEpnRate * pCfg.mTimeStep);
+    lTime += pCfg.mTimeStep;
+
+    // senders free their slot when all data is sent
+    for (const auto lIdx : lSending) {
+      auto &lSender = pSenders[lIdx];
+      if (lSender.mRemaining <= 0.0) {
+        lSender.mStarted = false;
+        lActive--;
+        lDone++;
+      }
+    }
+  }
+
+  // the TF is complete when the port buffer is drained
+  return lTime + lQueue / pCfg.mEpnRate;
+}
+
+void runBenchmark(const BenchmarkConfig &pCfg, const unsigned pWindow)
+{
+  std::mt19937_64 lRnd(42);
+  std::uniform_real_distribution<double> lJitter(1.0 - pCfg.mStfSizeJitter, 1.0 + pCfg.mStfSizeJitter);
+
+  std::vector<Sender> lSenders(pCfg.mNumStfSenders);
+  std::vector<double> lTfTimes;
+  lTfTimes.reserve(pCfg.mNumTfs);
+
+  for (unsigned lTf = 0; lTf < pCfg.mNumTfs; lTf++) {
+    for (auto &lSender : lSenders) {
+      lSender = Sender();
+      lSender.mRemaining = pCfg.mStfSize * lJitter(lRnd);
+    }
+    lTfTimes.push_back(transferTf(pCfg, pWindow, lSenders, lRnd));
+  }
+
+  std::sort(lTfTimes.begin(), lTfTimes.end());
+  const auto lPercentile = [&](const double p) {
+    return lTfTimes[std::min(lTfTimes.size() - 1, std::size_t(p * lTfTimes.size()))] * 1e3;
+  };
+  const double lMean = std::accumulate(lTfTimes.begin(), lTfTimes.end(), 0.0) / lTfTimes.size() * 1e3;
+
+  std::cout << std::setw(12) << (pWindow == 0 ? std::string("unlimited") : std::to_string(pWindow))
+            << std::fixed << std::setprecision(3)
+            << std::setw(12) << lMean
+            << std::setw(12) << lPercentile(0.50)
+            << std::setw(12) << lPercentile(0.99)
+            << std::setw(12) << lTfTimes.back() * 1e3 << std::endl;
+}
+
+} /* anonymous namespace */
+
+int main(int argc, char* argv[])
+{
+  BenchmarkConfig lCfg;
+  if (argc > 1) {
+    lCfg.mNumStfSenders = std::max(1, std::atoi(argv[1]));
+  }
+  if (argc > 2) {
+    lCfg.mNumTfs = std::max(1, std::atoi(argv[2]));
+  }
+
+  const double lIdealMs = lCfg.mNumStfSenders * lCfg.mStfSize / lCfg.mEpnRate * 1e3;
+
+  std::cout << "StfSenders: " << lCfg.mNumStfSenders << ", TFs: " << lCfg.mNumTfs
+            << ", STF size: " << lCfg.mStfSize / 1e6 << " MB, port buffer: " << lCfg.mPortBuffer / 1e6
+            << " MB, RTO: " << lCfg.mRto * 1e3 << " ms, ideal TF transfer: " << lIdealMs << " ms" << std::endl;
+  std::cout << std::setw(12) << "senders" << std::setw(12) << "mean[ms]" << std::setw(12) << "p50[ms]"
+            << std::setw(12) << "p99[ms]" << std::setw(12) << "max[ms]" << std::endl;
+
+  for (const unsigned lWindow : { 0U, 16U, 8U, 4U, 2U, 1U }) {
+    runBenchmark(lCfg, lWindow);
+  }
+
+  return 0;
+}
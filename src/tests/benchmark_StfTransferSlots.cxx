@@ -0,0 +1,291 @@
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/// Benchmark of the TfBuilder STF transfer slots (max-concurrent-stf-senders)
+///
+/// Drives the StfTransferSlots acquire/release path used by TfBuilderRpcImpl over local FairMQ
+/// channels: a requester thread takes a slot for each STF before requesting it, StfSender threads
+/// send the requested STFs, and one receiving thread per StfSender frees the slot on arrival, as
+/// TfBuilderInput does. Some STFs are acknowledged but never sent (their slot is freed on the
+/// deadline), and some are pushed without a request (they must not free any slot).
+
+#include "StfTransferSlots.h"
+
+#include <ConcurrentQueue.h>
+
+#include <fairmq/FairMQDevice.h>
+
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+namespace
+{
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+struct BenchmarkConfig {
+  unsigned mNumStfSenders = 16;
+  std::uint64_t mNumTfs = 1000;
+  std::size_t mStfSize = 1 << 20;          // bytes
+  double mLostProbability = 0.002;         // STF acknowledged, but never sent
+  double mUnrequestedProbability = 0.01;   // STF pushed without a request (static TF assignment)
+  std::chrono::milliseconds mSlotTimeout = 20ms;
+};
+
+// TF ids of STFs pushed without a request
+constexpr std::uint64_t cUnrequestedTfIdBit = 1ULL << 62;
+constexpr std::uint64_t cStopTfId = ~0ULL;
+
+struct BenchmarkResult {
+  std::vector<double> mTfTimes; // ms
+  double mDuration = 0.0;       // s
+  std::size_t mMaxInTransfer = 0;
+  std::uint64_t mNumLost = 0;
+  std::uint64_t mNumUnrequested = 0;
+  std::uint64_t mNumUnmatchedReleases = 0;
+  std::uint64_t mNumExpired = 0;
+};
+
+class StfTransferBenchmark
+{
+ public:
+  StfTransferBenchmark(const BenchmarkConfig &pCfg)
+  : mCfg(pCfg),
+    mTransport(FairMQTransportFactory::CreateTransportFactory("zeromq")),
+    mRequests(pCfg.mNumStfSenders)
+  {
+    for (unsigned i = 0; i < mCfg.mNumStfSenders; i++) {
+      const auto lAddress = "inproc://benchmark_stf_transfer_" + std::to_string(i);
+      mStfSenderIds.push_back("stfs-" + std::to_string(i));
+
+      mOutChans.emplace_back(std::make_unique<FairMQChannel>("stf-out-" + std::to_string(i), "pair", mTransport));
+      mInChans.emplace_back(std::make_unique<FairMQChannel>("stf-in-" + std::to_string(i), "pair", mTransport));
+      mOutChans.back()->Bind(lAddress);
+      mInChans.back()->Connect(lAddress);
+    }
+  }
+
+  BenchmarkResult run(const unsigned pWindow)
+  {
+    BenchmarkResult lResult;
+    mSlots.start(pWindow, mCfg.mSlotTimeout);
+    mTfStarts.clear();
+    mTfReceived.clear();
+    mTfTimes.clear();
+    mNumLost = 0;
+    mNumUnrequested = 0;
+    mNumUnmatchedReleases = 0;
+
+    std::vector<std::thread> lThreads;
+    for (unsigned i = 0; i < mCfg.mNumStfSenders; i++) {
+      lThreads.emplace_back(&StfTransferBenchmark::StfSenderThread, this, i);
+      lThreads.emplace_back(&StfTransferBenchmark::ReceiverThread, this, i);
+    }
+
+    const auto lStart = std::chrono::steady_clock::now();
+
+    // StfRequestThread: a slot is taken for each STF before it is requested
+    std::vector<unsigned> lOrder(mCfg.mNumStfSenders);
+    for (std::uint64_t lTfId = 0; lTfId < mCfg.mNumTfs; lTfId++) {
+      {
+        std::scoped_lock lLock(mTfLock);
+        mTfStarts[lTfId] = std::chrono::steady_clock::now();
+      }
+
+      std::iota(lOrder.begin(), lOrder.end(), 0);
+      std::rotate(lOrder.begin(), lOrder.begin() + (lTfId % lOrder.size()), lOrder.end());
+
+      for (const auto lIdx : lOrder) {
+        while (!mSlots.acquire(lTfId, mStfSenderIds[lIdx], 10ms)) { }
+        lResult.mMaxInTransfer = std::max(lResult.mMaxInTransfer, mSlots.inTransfer());
+        mRequests[lIdx].push(lTfId);
+      }
+    }
+
+    for (auto &lRequests : mRequests) {
+      lRequests.push(cStopTfId);
+    }
+    for (auto &lThread : lThreads) {
+      lThread.join();
+    }
+
+    lResult.mDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - lStart).count();
+    lResult.mTfTimes = std::move(mTfTimes);
+    lResult.mNumLost = mNumLost;
+    lResult.mNumUnrequested = mNumUnrequested;
+    lResult.mNumUnmatchedReleases = mNumUnmatchedReleases;
+    lResult.mNumExpired = mSlots.numExpired();
+
+    mSlots.stop();
+    return lResult;
+  }
+
+ private:
+  void sendStf(FairMQChannel &pChan, const std::uint64_t pTfId)
+  {
+    auto lMsg = pChan.NewMessage(std::max(sizeof(std::uint64_t), mCfg.mStfSize));
+    std::memcpy(lMsg->GetData(), &pTfId, sizeof(std::uint64_t));
+    pChan.Send(lMsg);
+  }
+
+  void StfSenderThread(const unsigned pIdx)
+  {
+    auto &lChan = *mOutChans[pIdx];
+    std::mt19937_64 lRnd(pIdx);
+    std::bernoulli_distribution lLost(mCfg.mLostProbability);
+    std::bernoulli_distribution lUnrequested(mCfg.mUnrequestedProbability);
+
+    std::uint64_t lTfId;
+    while (mRequests[pIdx].pop(lTfId)) {
+      if (lTfId == cStopTfId) {
+        sendStf(lChan, cStopTfId);
+        break;
+      }
+
+      if (lUnrequested(lRnd)) {
+        sendStf(lChan, lTfId | cUnrequestedTfIdBit);
+        mNumUnrequested++;
+      }
+
+      if (lLost(lRnd)) {
+        mNumLost++;
+        continue;
+      }
+
+      sendStf(lChan, lTfId);
+    }
+  }
+
+  // TfBuilderInput::DataHandlerThread
+  void ReceiverThread(const unsigned pIdx)
+  {
+    auto &lChan = *mInChans[pIdx];
+    FairMQMessagePtr lMsg = lChan.NewMessage();
+
+    while (true) {
+      if (lChan.Receive(lMsg, 100) < 0) {
+        continue;
+      }
+
+      std::uint64_t lTfId;
+      std::memcpy(&lTfId, lMsg->GetData(), sizeof(std::uint64_t));
+      if (lTfId == cStopTfId) {
+        break;
+      }
+
+      // TfBuilderRpcImpl::recordStfReceived()
+      const bool lHadSlot = mSlots.release(lTfId, mStfSenderIds[pIdx]);
+      if (lTfId & cUnrequestedTfIdBit) {
+        mNumUnmatchedReleases += lHadSlot ? 1 : 0;
+        continue;
+      }
+
+      // TfBuilderRpcImpl::recordTfBuilt()
+      std::scoped_lock lLock(mTfLock);
+      if (++mTfReceived[lTfId] == mCfg.mNumStfSenders) {
+        mSlots.releaseTf(lTfId);
+        mTfTimes.push_back(std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - mTfStarts[lTfId]).count());
+      }
+    }
+  }
+
+  const BenchmarkConfig mCfg;
+  std::shared_ptr<FairMQTransportFactory> mTransport;
+  std::vector<std::string> mStfSenderIds;
+  std::vector<std::unique_ptr<FairMQChannel>> mOutChans;
+  std::vector<std::unique_ptr<FairMQChannel>> mInChans;
+  std::vector<ConcurrentFifo<std::uint64_t>> mRequests;
+
+  StfTransferSlots mSlots;
+
+  std::mutex mTfLock;
+  std::map<std::uint64_t, std::chrono::steady_clock::time_point> mTfStarts;
+  std::map<std::uint64_t, unsigned> mTfReceived;
+  std::vector<double> mTfTimes;
+
+  std::atomic_uint64_t mNumLost = 0;
+  std::atomic_uint64_t mNumUnrequested = 0;
+  std::atomic_uint64_t mNumUnmatchedReleases = 0;
+};
+
+void printResult(const unsigned pWindow, BenchmarkResult &pResult)
+{
+  auto &lTfTimes = pResult.mTfTimes;
+  std::sort(lTfTimes.begin(), lTfTimes.end());
+  const auto lPercentile = [&](const double p) {
+    return lTfTimes.empty() ? 0.0 : lTfTimes[std::min(lTfTimes.size() - 1, std::size_t(p * lTfTimes.size()))];
+  };
+  const double lMean = lTfTimes.empty() ? 0.0 :
+    std::accumulate(lTfTimes.begin(), lTfTimes.end(), 0.0) / lTfTimes.size();
+
+  // the limit must hold, and STFs without a slot must not free one
+  const bool lValid = (pWindow == 0 || pResult.mMaxInTransfer <= pWindow) && pResult.mNumUnmatchedReleases == 0;
+
+  std::cout << std::setw(10) << (pWindow == 0 ? std::string("unlimited") : std::to_string(pWindow))
+            << std::fixed << std::setprecision(1)
+            << std::setw(10) << (lTfTimes.size() / pResult.mDuration)
+            << std::setprecision(3)
+            << std::setw(10) << lMean
+            << std::setw(10) << lPercentile(0.50)
+            << std::setw(10) << lPercentile(0.99)
+            << std::setw(10) << pResult.mMaxInTransfer
+            << std::setw(8) << pResult.mNumLost
+            << std::setw(9) << pResult.mNumExpired
+            << std::setw(8) << pResult.mNumUnrequested
+            << std::setw(8) << (lValid ? "ok" : "ERROR") << std::endl;
+}
+
+} /* anonymous namespace */
+
+int main(int argc, char* argv[])
+{
+  BenchmarkConfig lCfg;
+  if (argc > 1) {
+    lCfg.mNumStfSenders = std::max(1, std::atoi(argv[1]));
+  }
+  if (argc > 2) {
+    lCfg.mNumTfs = std::max(1L, std::atol(argv[2]));
+  }
+
+  std::cout << "StfSenders: " << lCfg.mNumStfSenders << ", TFs: " << lCfg.mNumTfs
+            << ", STF size: " << (lCfg.mStfSize >> 10) << " kiB, slot timeout: " << lCfg.mSlotTimeout.count()
+            << " ms, lost STFs: " << lCfg.mLostProbability << ", unrequested STFs: "
+            << lCfg.mUnrequestedProbability << std::endl;
+  std::cout << std::setw(10) << "senders" << std::setw(10) << "TF/s" << std::setw(10) << "mean[ms]"
+            << std::setw(10) << "p50[ms]" << std::setw(10) << "p99[ms]" << std::setw(10) << "max-slots"
+            << std::setw(8) << "lost" << std::setw(9) << "expired" << std::setw(8) << "pushed"
+            << std::setw(8) << "check" << std::endl;
+
+  StfTransferBenchmark lBenchmark(lCfg);
+
+  for (const unsigned lWindow : { 0U, 16U, 8U, 4U, 2U, 1U }) {
+    auto lResult = lBenchmark.run(lWindow);
+    printResult(lWindow, lResult);
+  }
+
+  return 0;
+}
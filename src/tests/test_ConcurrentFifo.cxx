@@ -0,0 +1,180 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "ConcurrentFifo"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ConcurrentQueue.h>
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(UnboundedTest)
+{
+  ConcurrentFifo<int> lQueue;
+  BOOST_CHECK(lQueue.capacity() == 0);
+
+  for (int i = 0; i < 1000; i++) {
+    BOOST_CHECK(lQueue.try_push(i));
+  }
+  BOOST_CHECK(lQueue.push_wait_for(1ms, 1000));
+  BOOST_CHECK(lQueue.size() == 1001);
+
+  int lVal = -1;
+  BOOST_CHECK(lQueue.try_pop(lVal) && lVal == 0);
+}
+
+BOOST_AUTO_TEST_CASE(TryPushTest)
+{
+  ConcurrentFifo<std::unique_ptr<int>> lQueue;
+  lQueue.set_capacity(2);
+
+  BOOST_CHECK(lQueue.try_push(std::make_unique<int>(0)));
+  BOOST_CHECK(lQueue.try_push(std::make_unique<int>(1)));
+
+  // the element is not consumed when the queue is full
+  auto lElem = std::make_unique<int>(2);
+  BOOST_CHECK(!lQueue.try_push(std::move(lElem)));
+  BOOST_CHECK(lElem && *lElem == 2);
+  BOOST_CHECK(lQueue.size() == 2);
+
+  std::unique_ptr<int> lPopped;
+  BOOST_CHECK(lQueue.try_pop(lPopped) && *lPopped == 0);
+  BOOST_CHECK(lQueue.try_push(std::move(lElem)));
+  BOOST_CHECK(!lElem);
+
+  BOOST_CHECK(lQueue.try_pop(lPopped) && *lPopped == 1);
+  BOOST_CHECK(lQueue.try_pop(lPopped) && *lPopped == 2);
+}
+
+BOOST_AUTO_TEST_CASE(PushWaitForTest)
+{
+  ConcurrentFifo<std::unique_ptr<int>> lQueue;
+  lQueue.set_capacity(1);
+  BOOST_CHECK(lQueue.push_wait_for(1ms, std::make_unique<int>(0)));
+
+  // timeout when full, the element is not consumed
+  auto lElem = std::make_unique<int>(1);
+  const auto lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK(!lQueue.push_wait_for(20ms, std::move(lElem)));
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) >= 20ms);
+  BOOST_CHECK(lElem);
+
+  // a pop wakes up the waiting producer
+  std::thread lConsumer([&lQueue]() {
+    std::this_thread::sleep_for(50ms);
+    std::unique_ptr<int> lPopped;
+    lQueue.try_pop(lPopped);
+  });
+
+  BOOST_CHECK(lQueue.push_wait_for(10s, std::move(lElem)));
+  BOOST_CHECK(!lElem);
+  lConsumer.join();
+
+  std::unique_ptr<int> lPopped;
+  BOOST_CHECK(lQueue.try_pop(lPopped) && *lPopped == 1);
+}
+
+BOOST_AUTO_TEST_CASE(PushWaitForStopTest)
+{
+  ConcurrentFifo<int> lQueue;
+  lQueue.set_capacity(1);
+  lQueue.push(0);
+
+  // stop wakes up the waiting producer, the element is not added
+  std::thread lStopper([&lQueue]() {
+    std::this_thread::sleep_for(50ms);
+    lQueue.stop();
+  });
+
+  const auto lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK(!lQueue.push_wait_for(10s, 1));
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) < 5s);
+  BOOST_CHECK(lQueue.size() == 1);
+
+  lStopper.join();
+}
+
+BOOST_AUTO_TEST_CASE(BlockingPushTest)
+{
+  constexpr int cNumElements = 100000;
+
+  ConcurrentFifo<int> lQueue;
+  lQueue.set_capacity(8);
+
+  std::size_t lMaxSize = 0;
+  std::thread lProducer([&lQueue]() {
+    for (int i = 0; i < cNumElements; i++) {
+      lQueue.push(i);
+    }
+  });
+
+  // the producer never exceeds the capacity, elements are received in order
+  bool lInOrder = true;
+  for (int i = 0; i < cNumElements; i++) {
+    lMaxSize = std::max(lMaxSize, lQueue.size());
+    int lVal = -1;
+    lInOrder &= lQueue.pop(lVal) && (lVal == i);
+  }
+  lProducer.join();
+
+  BOOST_CHECK(lInOrder);
+  BOOST_CHECK(lMaxSize <= 8);
+  BOOST_CHECK(lQueue.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(HighWatermarkTest)
+{
+  ConcurrentFifo<int> lQueue;
+
+  std::vector<std::size_t> lCalls;
+  lQueue.set_high_watermark(4, [&lCalls](const std::size_t pSize) { lCalls.push_back(pSize); });
+
+  for (int i = 0; i < 3; i++) {
+    lQueue.push(i);
+  }
+  BOOST_CHECK(lCalls.empty());
+
+  // invoked once when the watermark is reached
+  lQueue.push(3);
+  lQueue.push(4);
+  BOOST_CHECK(lCalls.size() == 1);
+  BOOST_CHECK(lCalls[0] == 4);
+
+  // not re-armed while the size stays at or above the watermark
+  int lVal;
+  BOOST_CHECK(lQueue.try_pop(lVal));
+  lQueue.push(5);
+  BOOST_CHECK(lCalls.size() == 1);
+
+  // re-armed when the size drops below the watermark
+  BOOST_CHECK(lQueue.try_pop(lVal));
+  BOOST_CHECK(lQueue.try_pop(lVal));
+  BOOST_CHECK(lQueue.size() == 3);
+  BOOST_CHECK(lQueue.try_push(6));
+  BOOST_CHECK(lCalls.size() == 2);
+  BOOST_CHECK(lCalls[1] == 4);
+
+  // re-armed by flush()
+  lQueue.flush();
+  for (int i = 0; i < 4; i++) {
+    BOOST_CHECK(lQueue.push_wait_for(1ms, i));
+  }
+  BOOST_CHECK(lCalls.size() == 3);
+}
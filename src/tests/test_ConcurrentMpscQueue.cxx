@@ -0,0 +1,139 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "ConcurrentMpscQueue"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ConcurrentQueue.h>
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(FifoOrderTest)
+{
+  ConcurrentMpscQueue<int> lQueue;
+  BOOST_CHECK(lQueue.empty());
+
+  for (int i = 0; i < 100; i++) {
+    lQueue.push(i);
+  }
+  BOOST_CHECK(!lQueue.empty());
+
+  std::vector<int> lValues;
+  BOOST_CHECK(lQueue.consume_all([&](int &&pVal) { lValues.push_back(pVal); }) == 100);
+  BOOST_CHECK(lQueue.empty());
+
+  for (int i = 0; i < 100; i++) {
+    BOOST_CHECK(lValues[i] == i);
+  }
+
+  // nothing left to consume
+  BOOST_CHECK(lQueue.consume_all([](int &&) {}) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(MultipleProducersTest)
+{
+  constexpr int cNumProducers = 4;
+  constexpr int cNumElements = 20000;
+
+  ConcurrentMpscQueue<std::pair<int, int>> lQueue;
+
+  std::vector<std::thread> lProducers;
+  for (int p = 0; p < cNumProducers; p++) {
+    lProducers.emplace_back([&lQueue, p]() {
+      for (int i = 0; i < cNumElements; i++) {
+        lQueue.push(p, i);
+      }
+    });
+  }
+
+  // each producer's elements are consumed in the order they were pushed
+  std::vector<int> lNextSeq(cNumProducers, 0);
+  int lNumConsumed = 0;
+  bool lInOrder = true;
+
+  while (lNumConsumed < cNumProducers * cNumElements) {
+    lQueue.wait_for(10ms);
+    lNumConsumed += lQueue.consume_all([&](std::pair<int, int> &&pElem) {
+      lInOrder &= (pElem.second == lNextSeq[pElem.first]);
+      lNextSeq[pElem.first] = pElem.second + 1;
+    });
+  }
+
+  for (auto &lThread : lProducers) {
+    lThread.join();
+  }
+
+  BOOST_CHECK(lInOrder);
+  BOOST_CHECK(lNumConsumed == cNumProducers * cNumElements);
+  BOOST_CHECK(lQueue.empty());
+  for (int p = 0; p < cNumProducers; p++) {
+    BOOST_CHECK(lNextSeq[p] == cNumElements);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(WaitForTest)
+{
+  ConcurrentMpscQueue<int> lQueue;
+
+  // timeout on an empty queue
+  BOOST_CHECK(!lQueue.wait_for(10ms));
+
+  // no waiting when not empty
+  lQueue.push(1);
+  BOOST_CHECK(lQueue.wait_for(10s));
+  lQueue.clear();
+
+  // a push wakes up the waiting consumer
+  std::thread lProducer([&lQueue]() {
+    std::this_thread::sleep_for(50ms);
+    lQueue.push(2);
+  });
+
+  const auto lStart = std::chrono::steady_clock::now();
+  bool lNotEmpty = false;
+  while (!lNotEmpty && (std::chrono::steady_clock::now() - lStart) < 10s) {
+    lNotEmpty = lQueue.wait_for(10s);
+  }
+  BOOST_CHECK(lNotEmpty);
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) < 5s);
+
+  lProducer.join();
+}
+
+BOOST_AUTO_TEST_CASE(ClearTest)
+{
+  auto lElem = std::make_shared<int>(1);
+
+  {
+    ConcurrentMpscQueue<std::shared_ptr<int>> lQueue;
+    lQueue.push(lElem);
+    lQueue.push(lElem);
+    BOOST_CHECK(lElem.use_count() == 3);
+
+    lQueue.clear();
+    BOOST_CHECK(lQueue.empty());
+    BOOST_CHECK(lElem.use_count() == 1);
+
+    // elements are destroyed with the queue
+    lQueue.push(lElem);
+    BOOST_CHECK(lElem.use_count() == 2);
+  }
+  BOOST_CHECK(lElem.use_count() == 1);
+}
@@ -0,0 +1,124 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "ConcurrentSpscRing"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ConcurrentQueue.h>
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(CapacityTest)
+{
+  // rounded up to a power of 2
+  BOOST_CHECK(ConcurrentSpscRing<int>(1).capacity() == 2);
+  BOOST_CHECK(ConcurrentSpscRing<int>(2).capacity() == 2);
+  BOOST_CHECK(ConcurrentSpscRing<int>(3).capacity() == 4);
+  BOOST_CHECK(ConcurrentSpscRing<int>(1000).capacity() == 1024);
+  BOOST_CHECK(ConcurrentSpscRing<int>(1024).capacity() == 1024);
+}
+
+BOOST_AUTO_TEST_CASE(FullEmptyTest)
+{
+  ConcurrentSpscRing<std::unique_ptr<int>> lRing(4);
+
+  for (int i = 0; i < 4; i++) {
+    BOOST_CHECK(lRing.try_push(std::make_unique<int>(i)));
+  }
+  BOOST_CHECK(lRing.size() == 4);
+
+  // the element is not consumed when the ring is full
+  auto lElem = std::make_unique<int>(4);
+  BOOST_CHECK(!lRing.try_push(std::move(lElem)));
+  BOOST_CHECK(lElem && *lElem == 4);
+
+  // timeout when full
+  BOOST_CHECK(!lRing.push_wait_for(10ms, std::move(lElem)));
+  BOOST_CHECK(lElem);
+
+  std::vector<std::unique_ptr<int>> lOut;
+  BOOST_CHECK(lRing.try_pop_n(3, std::back_inserter(lOut)) == 3);
+  BOOST_CHECK(lRing.size() == 1);
+
+  // wrap around
+  BOOST_CHECK(lRing.try_push(std::move(lElem)));
+  BOOST_CHECK(lRing.try_pop_n(10, std::back_inserter(lOut)) == 2);
+  BOOST_CHECK(lRing.size() == 0);
+
+  for (int i = 0; i < 5; i++) {
+    BOOST_CHECK(*lOut[i] == i);
+  }
+
+  // empty
+  std::unique_ptr<int> lPopped;
+  BOOST_CHECK(!lRing.try_pop(lPopped));
+  BOOST_CHECK(lRing.pop_n_wait_for(1, &lPopped, 10ms) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ProducerConsumerTest)
+{
+  constexpr std::uint64_t cNumElements = 1000000;
+
+  ConcurrentSpscRing<std::uint64_t> lRing(64);
+
+  std::thread lProducer([&lRing]() {
+    for (std::uint64_t i = 0; i < cNumElements; i++) {
+      while (!lRing.push_wait_for(100ms, i)) { }
+    }
+  });
+
+  // elements are received in order, without loss or duplication
+  std::vector<std::uint64_t> lBatch(16);
+  std::uint64_t lNext = 0;
+  bool lInOrder = true;
+
+  while (lNext < cNumElements) {
+    const auto lCnt = lRing.pop_n_wait_for(lBatch.size(), lBatch.begin(), 100ms);
+    for (unsigned long i = 0; i < lCnt; i++) {
+      lInOrder &= (lBatch[i] == lNext++);
+    }
+  }
+
+  lProducer.join();
+
+  BOOST_CHECK(lInOrder);
+  BOOST_CHECK(lNext == cNumElements);
+  BOOST_CHECK(lRing.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(StopTest)
+{
+  ConcurrentSpscRing<int> lRing(4);
+  BOOST_CHECK(lRing.is_running());
+
+  // stop wakes up the waiting consumer
+  std::thread lStopper([&lRing]() {
+    std::this_thread::sleep_for(50ms);
+    lRing.stop();
+  });
+
+  int lVal = 0;
+  const auto lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK(lRing.pop_n_wait_for(1, &lVal, 10s) == 0);
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) < 5s);
+  BOOST_CHECK(!lRing.is_running());
+
+  lStopper.join();
+}
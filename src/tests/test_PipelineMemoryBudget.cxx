@@ -0,0 +1,141 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "PipelineMemoryBudget"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ConcurrentQueue.h>
+
+#include <vector>
+
+using namespace o2::DataDistribution;
+
+//____________________________________________________________________________//
+
+struct TestElem {
+  int mId = -1;
+  std::uint64_t mSize = 0;
+};
+
+/// Two stage pipeline: elements are queued into the given stage
+class TestPipeline : public IFifoPipeline<TestElem>
+{
+ public:
+  TestPipeline()
+  : IFifoPipeline(2) { }
+
+  std::vector<int> mEvictedIds;
+
+ protected:
+  unsigned getNextPipelineStage(unsigned pStage) final { return pStage; }
+
+  std::uint64_t getPipelineElementSize(const TestElem& pElem) const final { return pElem.mSize; }
+
+  void onPipelineElementEvicted(unsigned /*pStage*/, const TestElem& pElem) final { mEvictedIds.push_back(pElem.mId); }
+};
+
+static PipelineMemoryBudget makeBudget(const PipelineMemoryBudget::DropPolicy pPolicy)
+{
+  PipelineMemoryBudget lBudget;
+  lBudget.mHighWatermark = 1000;
+  lBudget.mLowWatermark = 500;
+  lBudget.mDropPolicy = pPolicy;
+  return lBudget;
+}
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(NoBudgetTest)
+{
+  TestPipeline lPipeline;
+
+  for (int i = 0; i < 100; i++) {
+    BOOST_CHECK(lPipeline.queue(0, TestElem{ i, 1000 }));
+  }
+
+  BOOST_CHECK(lPipeline.getPipelineSize() == 100);
+  BOOST_CHECK(lPipeline.getPipelineBudgetDrops() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(DropNewestHysteresisTest)
+{
+  TestPipeline lPipeline;
+  lPipeline.setPipelineMemoryBudget(makeBudget(PipelineMemoryBudget::eDropNewest));
+
+  // admitted up to the high watermark
+  for (int i = 0; i < 10; i++) {
+    BOOST_CHECK(lPipeline.queue(0, TestElem{ i, 100 }));
+  }
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 1000);
+
+  // over the high watermark: the new element is rejected
+  BOOST_CHECK(!lPipeline.queue(0, TestElem{ 10, 100 }));
+  BOOST_CHECK(lPipeline.getPipelineBudgetDrops() == 1);
+
+  // below the high watermark, but not below the low watermark: still rejected
+  for (int i = 0; i < 5; i++) {
+    BOOST_CHECK(lPipeline.dequeue(0).mId == i);
+  }
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 500);
+  BOOST_CHECK(!lPipeline.queue(0, TestElem{ 11, 100 }));
+  BOOST_CHECK(lPipeline.getPipelineBudgetDrops() == 2);
+
+  // fits under the low watermark: admitted again, up to the high watermark
+  BOOST_CHECK(lPipeline.dequeue(0).mId == 5);
+  BOOST_CHECK(lPipeline.queue(0, TestElem{ 12, 100 }));
+  for (int i = 0; i < 5; i++) {
+    BOOST_CHECK(lPipeline.queue(0, TestElem{ 13 + i, 100 }));
+  }
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 1000);
+  BOOST_CHECK(!lPipeline.queue(0, TestElem{ 18, 100 }));
+
+  BOOST_CHECK(lPipeline.getPipelineBudgetDrops() == 3);
+  BOOST_CHECK(lPipeline.mEvictedIds.empty());
+  BOOST_CHECK(lPipeline.getPipelineSize() == 10);
+}
+
+BOOST_AUTO_TEST_CASE(DropOldestHysteresisTest)
+{
+  TestPipeline lPipeline;
+  lPipeline.setPipelineMemoryBudget(makeBudget(PipelineMemoryBudget::eDropOldest));
+
+  // ids 0-4 in the back-end stage, 5-9 in the front-end stage
+  for (int i = 0; i < 5; i++) {
+    BOOST_CHECK(lPipeline.queue(1, TestElem{ i, 100 }));
+  }
+  for (int i = 5; i < 10; i++) {
+    BOOST_CHECK(lPipeline.queue(0, TestElem{ i, 100 }));
+  }
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 1000);
+
+  // over the high watermark: the oldest elements are evicted until the new one fits under
+  // the low watermark, starting from the last stage
+  BOOST_CHECK(lPipeline.queue(0, TestElem{ 10, 100 }));
+
+  const std::vector<int> lExpectedEvicted = { 0, 1, 2, 3, 4, 5 };
+  BOOST_CHECK(lPipeline.mEvictedIds == lExpectedEvicted);
+  BOOST_CHECK(lPipeline.getPipelineBudgetDrops() == 6);
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 500);
+  BOOST_CHECK(lPipeline.getPipelineSize() == 5);
+
+  // no eviction until the high watermark is reached again
+  lPipeline.mEvictedIds.clear();
+  for (int i = 11; i < 16; i++) {
+    BOOST_CHECK(lPipeline.queue(0, TestElem{ i, 100 }));
+  }
+  BOOST_CHECK(lPipeline.mEvictedIds.empty());
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 1000);
+
+  // remaining elements are in the queued order
+  BOOST_CHECK(lPipeline.dequeue(0).mId == 6);
+  BOOST_CHECK(lPipeline.getPipelineBytes() == 900);
+}
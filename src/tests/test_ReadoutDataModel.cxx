@@ -0,0 +1,379 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "ReadoutDataModel"
+
+#include <boost/test/unit_test.hpp>
+
+#include "ReadoutDataModel.h"
+
+#include <vector>
+#include <random>
+#include <cstring>
+
+using namespace o2::DataDistribution;
+
+//____________________________________________________________________________//
+
+namespace
+{
+
+constexpr std::size_t cRdhSize = ReadoutDataUtils::sRdhSize;
+
+void put32(char* pRdh, const std::size_t pOffset, const std::uint32_t pVal)
+{
+  std::memcpy(pRdh + pOffset, &pVal, sizeof(std::uint32_t));
+}
+
+std::uint32_t get32(const char* pRdh, const std::size_t pOffset)
+{
+  std::uint32_t lVal;
+  std::memcpy(&lVal, pRdh + pOffset, sizeof(std::uint32_t));
+  return lVal;
+}
+
+struct RdhV4Fields {
+  std::uint32_t mOffsetNext = cRdhSize;
+  std::uint32_t mMemorySize = cRdhSize;
+  std::uint32_t mStopBit = 0;
+  std::uint32_t mOrbit = 1000;
+  std::uint32_t mCruId = 3;
+  std::uint32_t mLinkId = 5;
+  std::uint32_t mEndPoint = 0;
+};
+
+/// RDH v4 written from the word positions of the format description
+void writeRdhV4(char* pRdh, const RdhV4Fields &pF)
+{
+  std::memset(pRdh, 0, cRdhSize);
+  pRdh[0] = 4;
+  put32(pRdh, 2 * 4, (pF.mMemorySize << 16) | (pF.mOffsetNext & 0xFFFF));
+  put32(pRdh, 3 * 4, (pF.mEndPoint << 28) | ((pF.mCruId & 0xFFF) << 16) | (pF.mLinkId & 0xFF));
+  put32(pRdh, 5 * 4, pF.mOrbit);
+  put32(pRdh, 13 * 4, pF.mStopBit);
+}
+
+/// Block of RDH v4 packets: each packet is placed at the offset of the previous one
+std::vector<char> makeBlockV4(const std::vector<RdhV4Fields> &pPackets, const std::size_t pLen)
+{
+  std::vector<char> lBlock(pLen, 0);
+  std::size_t lOffset = 0;
+  for (const auto &lPacket : pPackets) {
+    if (lOffset + cRdhSize > pLen) {
+      break;
+    }
+    writeRdhV4(lBlock.data() + lOffset, lPacket);
+    lOffset += lPacket.mOffsetNext;
+  }
+  return lBlock;
+}
+
+/// RDH v4 sanity check as implemented before the block scanner (reference)
+std::uint32_t sRefFirstOrbit = 0;
+
+bool referenceRdhSanityCheck(const char* pData, const std::size_t pLen)
+{
+  const auto lSubSpecOf = [](const char* pRdh) {
+    const std::uint32_t lWord3 = get32(pRdh, 3 * 4);
+    const std::uint32_t lCruId = (lWord3 >> 16) & 0x0FFF;
+    const std::uint32_t lEndPoint = (lWord3 >> 28) & 0x0F;
+    const std::uint32_t lLinkId = lWord3 & 0xFF;
+    return (lCruId << 16) | ((lLinkId + 1) << (lEndPoint == 0 ? 0 : 8));
+  };
+
+  if (pLen < cRdhSize) {
+    return false;
+  }
+
+  const std::uint32_t lOrbit = get32(pData, 5 * 4);
+  if (sRefFirstOrbit == 0) {
+    sRefFirstOrbit = lOrbit;
+  } else if (lOrbit < sRefFirstOrbit || lOrbit > (sRefFirstOrbit + 255)) {
+    return false;
+  }
+
+  const auto lSubSpec = lSubSpecOf(pData);
+
+  std::int64_t lDataLen = pLen;
+  const char* lCurrData = pData;
+
+  while (lDataLen > 0) {
+    if (lDataLen < std::int64_t(cRdhSize)) {
+      return false;
+    }
+
+    if (lSubSpec != lSubSpecOf(lCurrData)) {
+      return false;
+    }
+
+    const std::uint32_t lOffsetNext = get32(lCurrData, 2 * 4) & 0xFFFF;
+    const std::uint32_t lMemSize = (get32(lCurrData, 2 * 4) >> 16) & 0xFFFF;
+    const std::uint32_t lStopBit = get32(lCurrData, 13 * 4) & 0xFF;
+
+    if (lStopBit) {
+      return (lMemSize <= lDataLen);
+    }
+
+    if (lOffsetNext == 0 || lOffsetNext >= lDataLen || lMemSize >= lDataLen) {
+      return false;
+    }
+
+    lDataLen -= lOffsetNext;
+    lCurrData += lOffsetNext;
+  }
+
+  return true;
+}
+
+/// Both checks start a new STF (first orbit not seen)
+bool compareChecks(const std::vector<char> &pBlock)
+{
+  ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
+  sRefFirstOrbit = 0;
+
+  const bool lRet = ReadoutDataUtils::rdhSanityCheck(pBlock.data(), pBlock.size());
+  const bool lRefRet = referenceRdhSanityCheck(pBlock.data(), pBlock.size());
+  BOOST_CHECK(lRet == lRefRet);
+  return lRet;
+}
+
+}
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(ScanBlockTest)
+{
+  RdhV4Fields lFirst;
+  lFirst.mOffsetNext = 8192;
+  lFirst.mMemorySize = 1000;
+  RdhV4Fields lLast = lFirst;
+  lLast.mMemorySize = 500;
+  lLast.mStopBit = 1;
+
+  const auto lBlock = makeBlockV4({ lFirst, lLast }, 16384);
+
+  RdhBlockScan lScan;
+  BOOST_CHECK(ReadoutDataUtils::scanRdhBlock(lBlock.data(), lBlock.size(), lScan));
+  BOOST_CHECK(lScan.ok());
+  BOOST_CHECK(lScan.mVersion == 4);
+  BOOST_CHECK(lScan.mPackets.size() == 2);
+  BOOST_CHECK(lScan.memorySize() == 1500);
+  BOOST_CHECK(lScan.mPackets[1].mOffset == 8192);
+  BOOST_CHECK(lScan.mPackets[0].mOrbit == lFirst.mOrbit);
+  BOOST_CHECK(lScan.mPackets[0].mSubSpec == ((3u << 16) | (5u + 1)));
+  BOOST_CHECK(lScan.mPackets[1].mStopBit == 1);
+
+  // memory size and stop bit of the last packet
+  const auto [lMemSize, lStopBit] = ReadoutDataUtils::getRdhMemorySize(lBlock.data(), lBlock.size());
+  BOOST_CHECK(lMemSize == 1500);
+  BOOST_CHECK(lStopBit == 1);
+
+  // errors
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lBlock.data(), 32, lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanShortBlock);
+
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lBlock.data(), 8192 + 32, lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanShortRdh);
+  BOOST_CHECK(lScan.mErrorOffset == 8192);
+
+  auto lUnknown = lBlock;
+  lUnknown[0] = 42;
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lUnknown.data(), lUnknown.size(), lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanUnknownVersion);
+
+  auto lMismatch = lBlock;
+  lMismatch[8192] = 5;
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lMismatch.data(), lMismatch.size(), lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanVersionMismatch);
+
+  RdhV4Fields lZero = lFirst;
+  lZero.mOffsetNext = 0;
+  const auto lZeroBlock = makeBlockV4({ lZero }, 16384);
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lZeroBlock.data(), lZeroBlock.size(), lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanZeroOffset);
+
+  const auto lNoStopBlock = makeBlockV4({ lFirst, lFirst }, 16384);
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lNoStopBlock.data(), lNoStopBlock.size(), lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanNoStopBit);
+  BOOST_CHECK(lScan.mPackets.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(SanityCheckCasesTest)
+{
+  RdhV4Fields lPacket;
+  lPacket.mOffsetNext = 8192;
+  lPacket.mMemorySize = 1000;
+  RdhV4Fields lLast = lPacket;
+  lLast.mStopBit = 1;
+
+  // valid blocks
+  BOOST_CHECK(compareChecks(makeBlockV4({ lLast }, 8192)));
+  BOOST_CHECK(compareChecks(makeBlockV4({ lPacket, lLast }, 16384)));
+
+  // short block
+  BOOST_CHECK(!compareChecks(std::vector<char>(32, 4)));
+
+  // zero offset
+  RdhV4Fields lZero = lPacket;
+  lZero.mOffsetNext = 0;
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lZero }, 16384)));
+
+  // next offset beyond the end of the block
+  RdhV4Fields lBeyond = lPacket;
+  lBeyond.mOffsetNext = 16384;
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lBeyond }, 16384)));
+
+  // memory size larger than the rest of the block
+  RdhV4Fields lLargeMem = lPacket;
+  lLargeMem.mMemorySize = 20000;
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lLargeMem, lLast }, 16384)));
+
+  // stop bit with memory size larger than the rest of the block
+  RdhV4Fields lLargeLast = lLast;
+  lLargeLast.mMemorySize = 9000;
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lPacket, lLargeLast }, 16384)));
+
+  // sub-specification of a trailing RDH does not match
+  RdhV4Fields lOtherLink = lLast;
+  lOtherLink.mLinkId = 6;
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lPacket, lOtherLink }, 16384)));
+
+  // trailing data shorter than an RDH
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lPacket, lLast }, 8192 + 32)));
+
+  // no stop bit
+  BOOST_CHECK(!compareChecks(makeBlockV4({ lPacket, lPacket }, 16384)));
+}
+
+BOOST_AUTO_TEST_CASE(SanityCheckOrbitTest)
+{
+  RdhV4Fields lLast;
+  lLast.mStopBit = 1;
+
+  ReadoutDataUtils::sFirstSeenHBOrbitCnt = 0;
+  sRefFirstOrbit = 0;
+
+  for (const std::uint32_t lOrbit : { 1000u, 1100u, 1255u, 1256u, 999u, 1000u }) {
+    lLast.mOrbit = lOrbit;
+    const auto lBlock = makeBlockV4({ lLast }, cRdhSize);
+    const bool lRet = ReadoutDataUtils::rdhSanityCheck(lBlock.data(), lBlock.size());
+    BOOST_CHECK(lRet == referenceRdhSanityCheck(lBlock.data(), lBlock.size()));
+    BOOST_CHECK(lRet == (lOrbit >= 1000 && lOrbit <= 1255));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SanityCheckRandomTest)
+{
+  // random blocks of mostly well formed packets: both checks must agree on every block
+  std::mt19937 lGen(42);
+  const auto lRnd = [&](const std::uint32_t pMax) { return std::uniform_int_distribution<std::uint32_t>(0, pMax)(lGen); };
+
+  std::size_t lNumValid = 0;
+  for (int i = 0; i < 20000; i++) {
+    const std::size_t lLen = cRdhSize + lRnd(4) * 512 + (lRnd(3) == 0 ? lRnd(127) : 0);
+
+    std::vector<RdhV4Fields> lPackets(1 + lRnd(8));
+    for (auto &lPacket : lPackets) {
+      lPacket.mOffsetNext = (lRnd(15) == 0) ? lRnd(0xFFFF) : (1 + lRnd(3)) * 256;
+      lPacket.mMemorySize = (lRnd(15) == 0) ? lRnd(0xFFFF) : cRdhSize + lRnd(192);
+      lPacket.mStopBit = (lRnd(3) == 0) ? 1 : 0;
+      lPacket.mLinkId = (lRnd(31) == 0) ? 6 : 5;
+      lPacket.mEndPoint = (lRnd(31) == 0) ? 1 : 0;
+    }
+
+    lNumValid += compareChecks(makeBlockV4(lPackets, lLen)) ? 1 : 0;
+  }
+
+  // both outcomes are covered
+  BOOST_CHECK(lNumValid > 0);
+  BOOST_CHECK(lNumValid < 20000);
+}
+
+//____________________________________________________________________________//
+
+namespace
+{
+
+/// RDH written byte by byte from the format description of the version
+void writeRdhBytes(char* pRdh, const std::uint8_t pVersion)
+{
+  const auto lPut16 = [&](const std::size_t pByte, const std::uint16_t pVal) { std::memcpy(pRdh + pByte, &pVal, 2); };
+
+  std::memset(pRdh, 0, cRdhSize);
+  pRdh[0] = pVersion;
+  pRdh[1] = cRdhSize;                             // header size
+  lPut16((pVersion == 4) ? 4 : 2, 0x1234);        // FEE id
+  lPut16(8, 0x2000);                              // offset to the next packet
+  lPut16(10, 0x0400);                             // memory size
+  pRdh[12] = 0x0B;                                // link id
+  lPut16(14, (0x2u << 12) | 0x0ABC);              // CRU id, end point
+  const std::uint32_t lOrbit = 0x01020304;
+  std::memcpy(pRdh + 20, &lOrbit, 4);             // heartbeat orbit
+  pRdh[(pVersion == 4) ? 52 : 38] = 1;            // stop bit
+}
+
+template <class Layout>
+void checkLayout()
+{
+  char lRdh[cRdhSize];
+  writeRdhBytes(lRdh, Layout::sVersion);
+
+  BOOST_CHECK(Layout::sFeeId.get(lRdh) == 0x1234);
+  BOOST_CHECK(Layout::sOffsetNext.get(lRdh) == 0x2000);
+  BOOST_CHECK(Layout::sMemorySize.get(lRdh) == 0x0400);
+  BOOST_CHECK(Layout::sLinkId.get(lRdh) == 0x0B);
+  BOOST_CHECK(Layout::sCruId.get(lRdh) == 0x0ABC);
+  BOOST_CHECK(Layout::sEndPoint.get(lRdh) == 0x2);
+  BOOST_CHECK(Layout::sOrbit.get(lRdh) == 0x01020304);
+  BOOST_CHECK(Layout::sStopBit.get(lRdh) == 1);
+
+  // end point != 0: link id in the second byte
+  BOOST_CHECK(ReadoutDataUtils::getSubSpecification<Layout>(lRdh) == ((0x0ABCu << 16) | ((0x0Bu + 1) << 8)));
+
+  // version dispatch of the generic accessors
+  BOOST_CHECK(ReadoutDataUtils::getFeeId(lRdh, cRdhSize) == 0x1234);
+  BOOST_CHECK(ReadoutDataUtils::getHBOrbit(lRdh, cRdhSize) == 0x01020304);
+  BOOST_CHECK(ReadoutDataUtils::getSubSpecification(lRdh, cRdhSize) == ReadoutDataUtils::getSubSpecification<Layout>(lRdh));
+
+  const auto [lMemSize, lOffsetNext, lStopBit] = ReadoutDataUtils::getRdhNavigationVals(lRdh);
+  BOOST_CHECK(lMemSize == 0x0400);
+  BOOST_CHECK(lOffsetNext == 0x2000);
+  BOOST_CHECK(lStopBit == 1);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(RdhLayoutTest)
+{
+  checkLayout<RdhLayoutV4>();
+  checkLayout<RdhLayoutV5>();
+  checkLayout<RdhLayoutV6>();
+}
+
+BOOST_AUTO_TEST_CASE(RdhLayoutDispatchTest)
+{
+  for (const std::uint8_t lVersion : { 4, 5, 6 }) {
+    std::uint8_t lLayoutVersion = 0;
+    BOOST_CHECK(ReadoutDataUtils::withRdhLayout(lVersion, [&](auto pLayout) { lLayoutVersion = decltype(pLayout)::sVersion; }));
+    BOOST_CHECK(lLayoutVersion == lVersion);
+  }
+
+  for (const std::uint8_t lVersion : { 0, 3, 7 }) {
+    BOOST_CHECK(!ReadoutDataUtils::withRdhLayout(lVersion, [](auto) {}));
+  }
+
+  // unknown versions are rejected by the scanner
+  char lRdh[cRdhSize];
+  writeRdhBytes(lRdh, 7);
+  RdhBlockScan lScan;
+  BOOST_CHECK(!ReadoutDataUtils::scanRdhBlock(lRdh, cRdhSize, lScan));
+  BOOST_CHECK(lScan.mStatus == RdhBlockScan::eScanUnknownVersion);
+}
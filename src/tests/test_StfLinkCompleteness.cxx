@@ -0,0 +1,114 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "StfLinkCompleteness"
+
+#include <boost/test/unit_test.hpp>
+
+#include "StfLinkCompleteness.h"
+
+using namespace o2::DataDistribution;
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(LearnExpectedHbfsTest)
+{
+  StfLinkCompleteness lLinks;
+
+  // first STF: nothing learned yet, the STF is never complete
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 128));
+  BOOST_CHECK(!lLinks.addUpdate(2, 128));
+  BOOST_CHECK(lLinks.numLinks() == 2);
+  BOOST_CHECK(lLinks.numCompleteLinks() == 0);
+
+  // second STF: complete when both links delivered the learned number of HBFrames
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 64));
+  BOOST_CHECK(!lLinks.addUpdate(1, 64));
+  BOOST_CHECK(lLinks.numCompleteLinks() == 1);
+  BOOST_CHECK(lLinks.addUpdate(2, 128));
+  BOOST_CHECK(lLinks.numCompleteLinks() == 2);
+
+  // a shorter STF does not lower the expected number of HBFrames
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 100));
+  BOOST_CHECK(!lLinks.addUpdate(2, 100));
+
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 128));
+  BOOST_CHECK(lLinks.addUpdate(2, 128));
+}
+
+BOOST_AUTO_TEST_CASE(NoLearningTest)
+{
+  StfLinkCompleteness lLinks;
+
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 10));
+
+  // expected counts are not updated
+  lLinks.startStf(false);
+  BOOST_CHECK(!lLinks.addUpdate(1, 10));
+
+  lLinks.startStf(true);
+  BOOST_CHECK(lLinks.addUpdate(1, 10));
+}
+
+BOOST_AUTO_TEST_CASE(ConfiguredOrbitsTest)
+{
+  StfLinkCompleteness lLinks;
+  lLinks.setOrbitsPerTf(32);
+
+  // complete from the first STF, for all links seen so far
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 16));
+  BOOST_CHECK(lLinks.addUpdate(1, 16));
+
+  // a new link makes the STF incomplete again
+  BOOST_CHECK(!lLinks.addUpdate(2, 16));
+  BOOST_CHECK(lLinks.addUpdate(2, 16));
+
+  // a link is counted as complete only once
+  BOOST_CHECK(lLinks.addUpdate(2, 16));
+  BOOST_CHECK(lLinks.numCompleteLinks() == 2);
+
+  // the configured value is used over the learned one
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 32));
+  BOOST_CHECK(lLinks.addUpdate(2, 32));
+}
+
+BOOST_AUTO_TEST_CASE(DropMissingLinksTest)
+{
+  StfLinkCompleteness lLinks;
+  lLinks.setOrbitsPerTf(8);
+
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 4));
+  BOOST_CHECK(!lLinks.addUpdate(2, 8));
+  BOOST_CHECK(lLinks.addUpdate(1, 4));
+
+  // link 2 stops sending: the STF is not complete
+  lLinks.startStf(true);
+  BOOST_CHECK(!lLinks.addUpdate(1, 8));
+  BOOST_CHECK(lLinks.numCompleteLinks() == 1);
+
+  BOOST_CHECK(lLinks.dropMissingLinks() == 1);
+  BOOST_CHECK(lLinks.numLinks() == 1);
+
+  // STFs complete again without the missing link
+  lLinks.startStf(true);
+  BOOST_CHECK(lLinks.addUpdate(1, 8));
+
+  // nothing to drop when all links sent data
+  BOOST_CHECK(lLinks.dropMissingLinks() == 0);
+}
@@ -0,0 +1,141 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "StfTransferSlots"
+
+#include <boost/test/unit_test.hpp>
+
+#include "StfTransferSlots.h"
+
+#include <thread>
+
+using namespace o2::DataDistribution;
+using namespace std::chrono_literals;
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(UnlimitedTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(0, 1s);
+
+  for (int i = 0; i < 100; i++) {
+    BOOST_CHECK(lSlots.acquire(1, "stfs-" + std::to_string(i), 0ms));
+  }
+  BOOST_CHECK(lSlots.inTransfer() == 0);
+  BOOST_CHECK(!lSlots.release(1, "stfs-0"));
+}
+
+BOOST_AUTO_TEST_CASE(LimitTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(2, 10s);
+
+  BOOST_CHECK(lSlots.acquire(1, "stfs-0", 0ms));
+  BOOST_CHECK(lSlots.acquire(1, "stfs-1", 0ms));
+
+  // never forced past the limit
+  BOOST_CHECK(!lSlots.acquire(1, "stfs-2", 10ms));
+  BOOST_CHECK(lSlots.inTransfer() == 2);
+
+  // requesting the same STF again keeps its slot
+  BOOST_CHECK(lSlots.acquire(1, "stfs-1", 0ms));
+  BOOST_CHECK(lSlots.inTransfer() == 2);
+
+  BOOST_CHECK(lSlots.release(1, "stfs-0"));
+  BOOST_CHECK(lSlots.acquire(1, "stfs-2", 0ms));
+  BOOST_CHECK(lSlots.inTransfer() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(UnrequestedReleaseTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(1, 10s);
+
+  BOOST_CHECK(lSlots.acquire(1, "stfs-0", 0ms));
+
+  // STFs that did not take a slot (static TF assignment) do not free the slot of another STF
+  BOOST_CHECK(!lSlots.release(2, "stfs-0"));
+  BOOST_CHECK(!lSlots.release(1, "stfs-1"));
+  BOOST_CHECK(lSlots.inTransfer() == 1);
+  BOOST_CHECK(!lSlots.acquire(1, "stfs-1", 0ms));
+
+  // released only once
+  BOOST_CHECK(lSlots.release(1, "stfs-0"));
+  BOOST_CHECK(!lSlots.release(1, "stfs-0"));
+  BOOST_CHECK(lSlots.inTransfer() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ReleaseTfTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(4, 10s);
+
+  BOOST_CHECK(lSlots.acquire(1, "stfs-0", 0ms));
+  BOOST_CHECK(lSlots.acquire(2, "stfs-0", 0ms));
+  BOOST_CHECK(lSlots.acquire(2, "stfs-1", 0ms));
+  BOOST_CHECK(lSlots.acquire(3, "stfs-0", 0ms));
+
+  // only the slots of the TF are freed
+  BOOST_CHECK(lSlots.releaseTf(2) == 2);
+  BOOST_CHECK(lSlots.releaseTf(2) == 0);
+  BOOST_CHECK(lSlots.inTransfer() == 2);
+
+  BOOST_CHECK(lSlots.release(1, "stfs-0"));
+  BOOST_CHECK(lSlots.release(3, "stfs-0"));
+}
+
+BOOST_AUTO_TEST_CASE(DeadlineTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(1, 50ms);
+
+  // the STF never arrives: the slot is freed on its deadline
+  BOOST_CHECK(lSlots.acquire(1, "stfs-0", 0ms));
+  BOOST_CHECK(!lSlots.acquire(2, "stfs-0", 0ms));
+
+  const auto lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK(lSlots.acquire(2, "stfs-0", 1s));
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) < 500ms);
+  BOOST_CHECK(lSlots.numExpired() == 1);
+  BOOST_CHECK(lSlots.inTransfer() == 1);
+
+  // late arrival of the expired STF does not free the new slot
+  BOOST_CHECK(!lSlots.release(1, "stfs-0"));
+  BOOST_CHECK(lSlots.inTransfer() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(WakeUpTest)
+{
+  StfTransferSlots lSlots;
+  lSlots.start(1, 10s);
+  BOOST_CHECK(lSlots.acquire(1, "stfs-0", 0ms));
+
+  // a release wakes up the waiting request
+  std::thread lReceiver([&lSlots]() {
+    std::this_thread::sleep_for(50ms);
+    lSlots.release(1, "stfs-0");
+  });
+
+  const auto lStart = std::chrono::steady_clock::now();
+  BOOST_CHECK(lSlots.acquire(1, "stfs-1", 5s));
+  BOOST_CHECK((std::chrono::steady_clock::now() - lStart) < 2s);
+  lReceiver.join();
+
+  // stop fails the waiting request
+  std::thread lStopper([&lSlots]() {
+    std::this_thread::sleep_for(50ms);
+    lSlots.stop();
+  });
+
+  BOOST_CHECK(!lSlots.acquire(1, "stfs-2", 5s));
+  lStopper.join();
+}
@@ -0,0 +1,418 @@
+// Copyright CERN and copyright holders of ALICE O2. This software is
+// distributed under the terms of the GNU General Public License v3 (GPL
+// Version 3), copied verbatim in the file "COPYING".
+//
+// See http://alice-o2.web.cern.ch/license for full licensing information.
+//
+// In applying this license CERN does not waive the privileges and immunities
+// granted to it by virtue of its status as an Intergovernmental Organization
+// or submit itself to any jurisdiction.
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE "SubTimeFrameDataModel"
+
+#include <boost/test/unit_test.hpp>
+
+#include "SubTimeFrameDataModel.h"
+#include "SubTimeFrameBuilder.h"
+#include "SubTimeFrameVisitors.h"
+#include "SubTimeFrameDPL.h"
+#include "SubTimeFrameFileWriter.h"
+#include "SubTimeFrameFileReader.h"
+#include "ReadoutDataModel.h"
+
+#include <Headers/DataHeader.h>
+#include <Framework/DataProcessingHeader.h>
+
+#include <fairmq/FairMQDevice.h>
+#include <fairmq/FairMQParts.h>
+
+#include <boost/filesystem.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+
+using namespace o2::DataDistribution;
+using namespace o2::header;
+
+namespace o2
+{
+namespace DataDistribution
+{
+
+/// Access to the data blocks of a (Sub)TimeFrame
+class SubTimeFrameTestVisitor : public ISubTimeFrameConstVisitor
+{
+ public:
+  /// pFunc(const EquipmentIdentifier&, const SubTimeFrame::StfData&), in the equipment order
+  template <class F>
+  static void forEachStfData(const SubTimeFrame& pStf, F&& pFunc)
+  {
+    SubTimeFrameTestVisitor lVisitor;
+    pStf.accept(lVisitor);
+
+    for (const auto& lRange : pStf.mIndex) {
+      for (auto i = lRange.mBegin; i < lRange.end(); i++) {
+        pFunc(lRange.mEquipment, pStf.mData[i]);
+      }
+    }
+  }
+
+ protected:
+  void visit(const SubTimeFrame&) override {}
+};
+}
+}
+
+//____________________________________________________________________________//
+
+namespace
+{
+
+constexpr std::uint32_t cStfId = 7;
+constexpr std::uint32_t cPackedSubSpec = 0x10;
+constexpr std::uint32_t cUnpackedSubSpec = 0x20;
+
+const std::vector<std::size_t> cHbfSizes = { 1024, 4096, 512, 8192 };
+
+/// RDH v6 HBFrames with orbits 100, 101, ...
+std::vector<FairMQMessagePtr> makeHbFrames(FairMQChannel& pChan, const char pFill)
+{
+  std::vector<FairMQMessagePtr> lHbFrames;
+
+  for (std::size_t i = 0; i < cHbfSizes.size(); i++) {
+    auto lMsg = pChan.NewMessage(cHbfSizes[i]);
+    char* lData = static_cast<char*>(lMsg->GetData());
+
+    std::memset(lData, pFill + char(i), cHbfSizes[i]);
+    std::memset(lData, 0, ReadoutDataUtils::sRdhSize);
+    lData[0] = RdhLayoutV6::sVersion;
+    const std::uint32_t lOrbit = 100 + i;
+    std::memcpy(lData + RdhLayoutV6::sOrbit.mOffset, &lOrbit, sizeof(std::uint32_t));
+
+    lHbFrames.emplace_back(std::move(lMsg));
+  }
+  return lHbFrames;
+}
+
+std::string toString(const char* pData, const std::size_t pSize)
+{
+  return std::string(pData, pSize);
+}
+
+/// One packed (TPC) and one unpacked (ITS) equipment, with the HBFrame contents for comparison
+struct TestStf {
+  std::unique_ptr<SubTimeFrame> mStf;
+  std::vector<std::string> mPackedHbfs;
+  std::vector<const void*> mPackedHbfPtrs;
+  std::vector<std::string> mUnpackedHbfs;
+};
+
+TestStf makeStf(FairMQChannel& pChan, SubTimeFrameReadoutBuilder& pPackingBuilder,
+  SubTimeFrameReadoutBuilder& pBuilder)
+{
+  TestStf lRet;
+  ReadoutSubTimeframeHeader lHdr{ cStfId, std::uint32_t(cHbfSizes.size()), 0 };
+
+  auto lPacked = makeHbFrames(pChan, 'a');
+  for (const auto& lMsg : lPacked) {
+    lRet.mPackedHbfs.push_back(toString(static_cast<const char*>(lMsg->GetData()), lMsg->GetSize()));
+    lRet.mPackedHbfPtrs.push_back(lMsg->GetData());
+  }
+  pPackingBuilder.addHbFrames(gDataOriginTPC, cPackedSubSpec, lHdr, lPacked.begin(), lPacked.size());
+
+  auto lUnpacked = makeHbFrames(pChan, 'A');
+  for (const auto& lMsg : lUnpacked) {
+    lRet.mUnpackedHbfs.push_back(toString(static_cast<const char*>(lMsg->GetData()), lMsg->GetSize()));
+  }
+  pBuilder.addHbFrames(gDataOriginITS, cUnpackedSubSpec, lHdr, lUnpacked.begin(), lUnpacked.size());
+
+  lRet.mStf = pPackingBuilder.getStf();
+  lRet.mStf->mergeStf(pBuilder.getStf());
+  return lRet;
+}
+
+std::uint64_t totalSize()
+{
+  std::uint64_t lSize = 0;
+  for (const auto lHbfSize : cHbfSizes) {
+    lSize += lHbfSize;
+  }
+  return lSize;
+}
+
+} // namespace
+
+//____________________________________________________________________________//
+
+BOOST_AUTO_TEST_CASE(HBFrameIndexHeaderTest)
+{
+  constexpr std::uint32_t cNumHbFrames = 3;
+
+  BOOST_CHECK(HBFrameIndexHeader::getSize(cNumHbFrames) ==
+    sizeof(HBFrameIndexHeader) + cNumHbFrames * sizeof(HBFrameIndexEntry));
+  BOOST_CHECK(sizeof(HBFrameIndexEntry) == 16);
+
+  std::vector<char> lStack(sizeof(o2::header::DataHeader) + HBFrameIndexHeader::getSize(cNumHbFrames));
+
+  o2::header::DataHeader lDataHdr(gDataDescriptionRawData, gDataOriginTPC, 0, 0);
+  lDataHdr.flagsNextHeader = 1;
+  std::memcpy(lStack.data(), &lDataHdr, sizeof(o2::header::DataHeader));
+
+  auto lIndex = new (lStack.data() + sizeof(o2::header::DataHeader)) HBFrameIndexHeader(cNumHbFrames);
+  BOOST_CHECK(lIndex->headerSize == HBFrameIndexHeader::getSize(cNumHbFrames));
+  BOOST_CHECK(lIndex->mNumHbFrames == cNumHbFrames);
+
+  // entries follow the header
+  BOOST_CHECK(reinterpret_cast<char*>(lIndex->entries()) == lStack.data() + sizeof(o2::header::DataHeader) + sizeof(HBFrameIndexHeader));
+  for (std::uint32_t i = 0; i < cNumHbFrames; i++) {
+    lIndex->entries()[i] = HBFrameIndexEntry{ i * 100, 100, 1000 + i, 0 };
+  }
+
+  // found in the header stack
+  auto lFound = o2::header::get<HBFrameIndexHeader*>(lStack.data(), lStack.size());
+  BOOST_REQUIRE(lFound == lIndex);
+  BOOST_CHECK(lFound->entries()[2].mOffset == 200);
+  BOOST_CHECK(lFound->entries()[2].mOrbit == 1002);
+
+  // not found without the next header flag
+  reinterpret_cast<o2::header::DataHeader*>(lStack.data())->flagsNextHeader = 0;
+  BOOST_CHECK(o2::header::get<HBFrameIndexHeader*>(lStack.data(), lStack.size()) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(PackedHbFramesTest)
+{
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  FairMQChannel lChan("packed", "pair", lTransport);
+
+  SubTimeFrameReadoutBuilder lPackingBuilder(lChan, false, { 1ULL << 20 });
+  lPackingBuilder.setSuperpagePacking(true);
+  SubTimeFrameReadoutBuilder lBuilder(lChan, false, { 1ULL << 20 });
+
+  auto lTest = makeStf(lChan, lPackingBuilder, lBuilder);
+  BOOST_CHECK(lTest.mStf->getDataSize() == 2 * totalSize());
+
+  std::size_t lNumPacked = 0;
+  std::size_t lNumUnpacked = 0;
+
+  SubTimeFrameTestVisitor::forEachStfData(*lTest.mStf, [&](const EquipmentIdentifier& pEq, const auto& pStfData) {
+    const auto lIndex = pStfData.getHbFrameIndex();
+
+    if (pEq.mSubSpecification == cUnpackedSubSpec) {
+      // one HBFrame per message, visited once
+      BOOST_CHECK(lIndex == nullptr);
+      BOOST_CHECK(pStfData.getNumDataParts() == 1);
+
+      std::size_t lNumVisited = 0;
+      pStfData.forEachHbFrame([&](const char* pData, const std::size_t pSize) {
+        BOOST_CHECK(toString(pData, pSize) == lTest.mUnpackedHbfs[lNumUnpacked]);
+        lNumVisited++;
+      });
+      BOOST_CHECK(lNumVisited == 1);
+      lNumUnpacked++;
+      return;
+    }
+
+    lNumPacked++;
+    BOOST_REQUIRE(lIndex != nullptr);
+    BOOST_CHECK(lIndex->mNumHbFrames == cHbfSizes.size());
+    BOOST_CHECK(pStfData.getNumDataParts() == cHbfSizes.size());
+    BOOST_CHECK(pStfData.getDataHeader().payloadSize == totalSize());
+    BOOST_CHECK(pStfData.getDataSize() == totalSize());
+
+    std::uint32_t lOffset = 0;
+    for (std::uint32_t i = 0; i < lIndex->mNumHbFrames; i++) {
+      const auto& lEntry = lIndex->entries()[i];
+      BOOST_CHECK(lEntry.mOffset == lOffset);
+      BOOST_CHECK(lEntry.mSize == cHbfSizes[i]);
+      BOOST_CHECK(lEntry.mOrbit == 100 + i);
+      lOffset += lEntry.mSize;
+    }
+
+    // the readout messages are not copied
+    std::size_t lHbfIdx = 0;
+    pStfData.forEachHbFrame([&](const char* pData, const std::size_t pSize) {
+      BOOST_CHECK(pData == lTest.mPackedHbfPtrs[lHbfIdx]);
+      BOOST_CHECK(pSize == cHbfSizes[lHbfIdx]);
+      lHbfIdx++;
+    });
+    BOOST_CHECK(lHbfIdx == cHbfSizes.size());
+  });
+
+  BOOST_CHECK(lNumPacked == 1);
+  BOOST_CHECK(lNumUnpacked == cHbfSizes.size());
+}
+
+BOOST_AUTO_TEST_CASE(SerializerRoundTripTest)
+{
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  FairMQChannel lOutChan("stf-out", "pair", lTransport);
+  FairMQChannel lInChan("stf-in", "pair", lTransport);
+  BOOST_REQUIRE(lOutChan.Bind("inproc://test_stf_serializer"));
+  BOOST_REQUIRE(lInChan.Connect("inproc://test_stf_serializer"));
+
+  SubTimeFrameReadoutBuilder lPackingBuilder(lOutChan, false, { 1ULL << 20 });
+  lPackingBuilder.setSuperpagePacking(true);
+  SubTimeFrameReadoutBuilder lBuilder(lOutChan, false, { 1ULL << 20 });
+
+  auto lTest = makeStf(lOutChan, lPackingBuilder, lBuilder);
+
+  InterleavedHdrDataSerializer lSerializer(lOutChan);
+  lSerializer.serialize(std::move(lTest.mStf));
+
+  InterleavedHdrDataDeserializer lDeserializer;
+  auto lStf = lDeserializer.deserialize(lInChan);
+  BOOST_REQUIRE(lStf);
+  BOOST_CHECK(lStf->header().mId == cStfId);
+  BOOST_CHECK(lStf->getDataSize() == 2 * totalSize());
+
+  std::size_t lNumUnpacked = 0;
+
+  SubTimeFrameTestVisitor::forEachStfData(*lStf, [&](const EquipmentIdentifier& pEq, const auto& pStfData) {
+    if (pEq.mSubSpecification == cUnpackedSubSpec) {
+      BOOST_CHECK(pStfData.getHbFrameIndex() == nullptr);
+      BOOST_CHECK(toString(static_cast<const char*>(pStfData.mData->GetData()), pStfData.mData->GetSize()) ==
+        lTest.mUnpackedHbfs[lNumUnpacked++]);
+      return;
+    }
+
+    // the data parts of packed HBFrames are received with their header
+    BOOST_REQUIRE(pStfData.getHbFrameIndex() != nullptr);
+    BOOST_CHECK(pStfData.getNumDataParts() == cHbfSizes.size());
+
+    std::size_t lHbfIdx = 0;
+    pStfData.forEachHbFrame([&](const char* pData, const std::size_t pSize) {
+      BOOST_CHECK(toString(pData, pSize) == lTest.mPackedHbfs[lHbfIdx++]);
+    });
+    BOOST_CHECK(lHbfIdx == cHbfSizes.size());
+  });
+
+  BOOST_CHECK(lNumUnpacked == cHbfSizes.size());
+}
+
+BOOST_AUTO_TEST_CASE(DplAdapterTest)
+{
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  FairMQChannel lOutChan("dpl-out", "pair", lTransport);
+  FairMQChannel lInChan("dpl-in", "pair", lTransport);
+  BOOST_REQUIRE(lOutChan.Bind("inproc://test_stf_dpl"));
+  BOOST_REQUIRE(lInChan.Connect("inproc://test_stf_dpl"));
+
+  SubTimeFrameReadoutBuilder lPackingBuilder(lOutChan, true, { 1ULL << 20 });
+  lPackingBuilder.setSuperpagePacking(true);
+  SubTimeFrameReadoutBuilder lBuilder(lOutChan, true, { 1ULL << 20 });
+
+  auto lTest = makeStf(lOutChan, lPackingBuilder, lBuilder);
+
+  StfDplAdapter lAdapter(lOutChan);
+  lAdapter.sendToDpl(std::move(lTest.mStf));
+
+  FairMQParts lParts;
+  BOOST_REQUIRE(lInChan.Receive(lParts, 1000) >= 0);
+
+  // STF header + one header-payload pair per HBFrame of both equipments
+  BOOST_REQUIRE(lParts.Size() == 2 + 2 * 2 * cHbfSizes.size());
+
+  std::size_t lNumPacked = 0;
+  std::size_t lNumUnpacked = 0;
+
+  for (std::size_t i = 2; i < lParts.Size(); i += 2) {
+    const auto& lHdrMsg = lParts.AtRef(i);
+    const auto& lDataMsg = lParts.AtRef(i + 1);
+
+    const auto lDataHdr = o2::header::get<o2::header::DataHeader*>(lHdrMsg.GetData(), lHdrMsg.GetSize());
+    const auto lDplHdr = o2::header::get<o2::framework::DataProcessingHeader*>(lHdrMsg.GetData(), lHdrMsg.GetSize());
+    BOOST_REQUIRE(lDataHdr != nullptr);
+    BOOST_REQUIRE(lDplHdr != nullptr);
+    BOOST_CHECK(lDplHdr->startTime == cStfId);
+
+    // DPL does not see the HBFrame index
+    BOOST_CHECK(o2::header::get<HBFrameIndexHeader*>(lHdrMsg.GetData(), lHdrMsg.GetSize()) == nullptr);
+    BOOST_CHECK(lDataHdr->payloadSize == lDataMsg.GetSize());
+    BOOST_CHECK(lDataHdr->splitPayloadParts == cHbfSizes.size());
+
+    const auto lData = toString(static_cast<const char*>(lDataMsg.GetData()), lDataMsg.GetSize());
+
+    if (lDataHdr->subSpecification == cPackedSubSpec) {
+      BOOST_CHECK(lDataHdr->splitPayloadIndex == lNumPacked);
+      BOOST_CHECK(lData == lTest.mPackedHbfs[lNumPacked++]);
+    } else {
+      BOOST_CHECK(lDataHdr->splitPayloadIndex == lNumUnpacked);
+      BOOST_CHECK(lData == lTest.mUnpackedHbfs[lNumUnpacked++]);
+    }
+  }
+
+  BOOST_CHECK(lNumPacked == cHbfSizes.size());
+  BOOST_CHECK(lNumUnpacked == cHbfSizes.size());
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterRoundTripTest)
+{
+  auto lTransport = FairMQTransportFactory::CreateTransportFactory("zeromq");
+  FairMQChannel lChan("file", "pair", lTransport);
+
+  SubTimeFrameReadoutBuilder lPackingBuilder(lChan, false, { 1ULL << 20 });
+  lPackingBuilder.setSuperpagePacking(true);
+  SubTimeFrameReadoutBuilder lBuilder(lChan, false, { 1ULL << 20 });
+
+  auto lTest = makeStf(lChan, lPackingBuilder, lBuilder);
+
+  auto lFileName = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_stf_%%%%%%%%.tf");
+
+  std::uint64_t lWritten = 0;
+  {
+    SubTimeFrameFileWriter lWriter(lFileName, true);
+    lWritten = lWriter.write(*lTest.mStf);
+  }
+  BOOST_CHECK(lWritten > 2 * totalSize());
+  BOOST_CHECK(boost::filesystem::file_size(lFileName) == lWritten);
+
+  // sidecar: one record per data block
+  {
+    std::ifstream lInfoFile(lFileName.string() + ".info");
+    std::size_t lNumLines = 0;
+    std::string lLine;
+    while (std::getline(lInfoFile, lLine)) {
+      lNumLines++;
+    }
+    BOOST_CHECK(lNumLines == 1 + 1 + cHbfSizes.size());
+  }
+
+  // packed HBFrames are read back as one contiguous payload
+  std::unique_ptr<SubTimeFrame> lStf;
+  {
+    SubTimeFrameFileReader lReader(lFileName);
+    lStf = lReader.read(lChan);
+  }
+  BOOST_REQUIRE(lStf);
+  BOOST_CHECK(lStf->getDataSize() == 2 * totalSize());
+
+  std::string lPackedPayload;
+  for (const auto& lHbf : lTest.mPackedHbfs) {
+    lPackedPayload += lHbf;
+  }
+
+  std::size_t lNumPacked = 0;
+  std::size_t lNumUnpacked = 0;
+
+  SubTimeFrameTestVisitor::forEachStfData(*lStf, [&](const EquipmentIdentifier& pEq, const auto& pStfData) {
+    BOOST_CHECK(pStfData.getHbFrameIndex() == nullptr);
+    const auto lData = toString(static_cast<const char*>(pStfData.mData->GetData()), pStfData.mData->GetSize());
+
+    if (pEq.mSubSpecification == cPackedSubSpec) {
+      BOOST_CHECK(pStfData.getDataHeader().payloadSize == totalSize());
+      BOOST_CHECK(lData == lPackedPayload);
+      lNumPacked++;
+    } else {
+      BOOST_CHECK(lData == lTest.mUnpackedHbfs[lNumUnpacked++]);
+    }
+  });
+
+  BOOST_CHECK(lNumPacked == 1);
+  BOOST_CHECK(lNumUnpacked == cHbfSizes.size());
+
+  boost::filesystem::remove(lFileName);
+  boost::filesystem::remove(lFileName.string() + ".info");
+}